@@ -0,0 +1,706 @@
+#pragma once
+
+#include <bit>
+#include <map>
+#include <array>
+#include <deque>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <string>
+#include <limits>
+#include <cstdint>
+#include <ostream>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+// Two-level segregated fit allocator over the offset range [0, size). It only does the
+// bookkeeping, the memory itself is owned by whoever hands out the range. Allocation and
+// free are O(1), free regions are coalesced with their physical neighbours immediately.
+class TlsfAllocator {
+public:
+	static constexpr uint32_t SL_LOG2 = 4;
+	static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+	static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+	static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+	TlsfAllocator() = delete;
+
+	explicit TlsfAllocator(uint64_t size) :
+		total(size)
+	{
+		if (size == 0) {
+			throw std::invalid_argument("TlsfAllocator: size must be non-zero");
+		}
+		for (auto& heads : this->free_heads) {
+			heads.fill(NIL);
+		}
+		this->blocks.push_back({ .offset = 0, .size = size });
+		this->insertFree(0);
+	}
+
+	// alignment must be a power of two
+	std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1)
+	{
+		size = std::max<uint64_t>(size, 1);
+		alignment = std::max<uint64_t>(alignment, 1);
+		if (!std::has_single_bit(alignment)) {
+			throw std::invalid_argument("TlsfAllocator: alignment must be a power of two");
+		}
+		if (size > this->total || alignment - 1 > std::numeric_limits<uint64_t>::max() - size) {
+			return std::nullopt;
+		}
+
+		const uint64_t search = size + alignment - 1;
+		uint32_t index = this->findFree(search);
+		if (index == NIL) {
+			// the rounded up size class may be empty while a block in the class below still fits
+			index = this->findFit(size, alignment);
+		}
+		if (index == NIL) {
+			return std::nullopt;
+		}
+		this->removeFree(index);
+
+		const uint64_t offset = this->blocks[index].offset;
+		const uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+
+		if (aligned > offset) {
+			// leading padding stays behind as a free block. Its previous neighbour is in use,
+			// free neighbours are always coalesced.
+			uint32_t rest = this->split(index, aligned - offset);
+			this->insertFree(index);
+			index = rest;
+		}
+		if (this->blocks[index].size > size) {
+			uint32_t tail = this->split(index, size);
+			this->insertFree(tail);
+		}
+
+		Block& block = this->blocks[index];
+		block.free = false;
+		block.alignment = alignment;
+
+		this->allocated[aligned] = index;
+		this->used_bytes += block.size;
+		return aligned;
+	}
+
+	void free(uint64_t offset)
+	{
+		auto it = this->allocated.find(offset);
+		if (it == this->allocated.end()) {
+			throw std::invalid_argument("TlsfAllocator: no allocation at offset " + std::to_string(offset));
+		}
+		uint32_t index = it->second;
+		this->allocated.erase(it);
+
+		this->used_bytes -= this->blocks[index].size;
+		this->blocks[index].free = true;
+
+		uint32_t prev = this->blocks[index].prev_phys;
+		if (prev != NIL && this->blocks[prev].free) {
+			this->removeFree(prev);
+			this->merge(prev, index);
+			index = prev;
+		}
+		uint32_t next = this->blocks[index].next_phys;
+		if (next != NIL && this->blocks[next].free) {
+			this->removeFree(next);
+			this->merge(index, next);
+		}
+		this->insertFree(index);
+	}
+
+	uint64_t allocationSize(uint64_t offset) const
+	{
+		return this->blocks[this->allocated.at(offset)].size;
+	}
+
+	// visits live allocations in address order as f(offset, size, alignment)
+	template <typename Function>
+	void forEachAllocation(Function function) const
+	{
+		// block 0 always starts at offset 0, merges only ever absorb the higher block
+		for (uint32_t index = 0; index != NIL; index = this->blocks[index].next_phys) {
+			const Block& block = this->blocks[index];
+			if (!block.free) {
+				function(block.offset, block.size, block.alignment);
+			}
+		}
+	}
+
+	uint64_t largestFreeRegion() const
+	{
+		if (!this->fl_bitmap) {
+			return 0;
+		}
+		uint32_t fl = 63 - std::countl_zero(this->fl_bitmap);
+		uint32_t sl = 31 - std::countl_zero(this->sl_bitmap[fl]);
+		uint64_t largest = 0;
+		for (uint32_t index = this->free_heads[fl][sl]; index != NIL; index = this->blocks[index].next_free) {
+			largest = std::max(largest, this->blocks[index].size);
+		}
+		return largest;
+	}
+
+	uint64_t size() const { return this->total; }
+	uint64_t used() const { return this->used_bytes; }
+	uint64_t available() const { return this->total - this->used_bytes; }
+	size_t allocationCount() const { return this->allocated.size(); }
+	size_t freeRegionCount() const { return this->free_count; }
+	bool empty() const { return this->allocated.empty(); }
+
+	// maps a size to its first and second level list
+	static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+	{
+		if (size < SL_COUNT) {
+			fl = 0;
+			sl = static_cast<uint32_t>(size);
+		}
+		else {
+			uint32_t log2 = 63 - std::countl_zero(size);
+			fl = log2 - SL_LOG2 + 1;
+			sl = static_cast<uint32_t>(size >> (log2 - SL_LOG2)) ^ SL_COUNT;
+		}
+	}
+
+private:
+	struct Block {
+		uint64_t offset{ 0 };
+		uint64_t size{ 0 };
+		uint64_t alignment{ 1 };
+		uint32_t prev_phys{ NIL };
+		uint32_t next_phys{ NIL };
+		uint32_t prev_free{ NIL };
+		uint32_t next_free{ NIL };
+		bool free{ true };
+	};
+
+	uint32_t findFree(uint64_t size) const
+	{
+		if (size >= SL_COUNT) {
+			// round up to the next list so that any block found is large enough
+			uint32_t log2 = 63 - std::countl_zero(size);
+			uint64_t round = (uint64_t(1) << (log2 - SL_LOG2)) - 1;
+			if (size > std::numeric_limits<uint64_t>::max() - round) {
+				return NIL;
+			}
+			size += round;
+		}
+		uint32_t fl, sl;
+		mapping(size, fl, sl);
+
+		uint32_t sl_map = this->sl_bitmap[fl] & (~0u << sl);
+		if (!sl_map) {
+			uint64_t fl_map = (fl + 1 < 64) ? this->fl_bitmap & (~uint64_t(0) << (fl + 1)) : 0;
+			if (!fl_map) {
+				return NIL;
+			}
+			fl = std::countr_zero(fl_map);
+			sl_map = this->sl_bitmap[fl];
+		}
+		sl = std::countr_zero(sl_map);
+		return this->free_heads[fl][sl];
+	}
+
+	// searches the lists findFree skipped, from the class of size up to that of size + alignment
+	uint32_t findFit(uint64_t size, uint64_t alignment) const
+	{
+		uint32_t fl, sl, last_fl, last_sl;
+		mapping(size, fl, sl);
+		mapping(size + alignment - 1, last_fl, last_sl);
+
+		for (uint32_t list = fl * SL_COUNT + sl; list <= last_fl * SL_COUNT + last_sl; list++) {
+			uint32_t index = this->free_heads[list / SL_COUNT][list % SL_COUNT];
+			for (; index != NIL; index = this->blocks[index].next_free) {
+				const Block& block = this->blocks[index];
+				uint64_t aligned = (block.offset + alignment - 1) & ~(alignment - 1);
+				if (aligned + size <= block.offset + block.size) {
+					return index;
+				}
+			}
+		}
+		return NIL;
+	}
+
+	void insertFree(uint32_t index)
+	{
+		uint32_t fl, sl;
+		mapping(this->blocks[index].size, fl, sl);
+
+		Block& block = this->blocks[index];
+		block.free = true;
+		block.prev_free = NIL;
+		block.next_free = this->free_heads[fl][sl];
+		if (block.next_free != NIL) {
+			this->blocks[block.next_free].prev_free = index;
+		}
+		this->free_heads[fl][sl] = index;
+		this->fl_bitmap |= uint64_t(1) << fl;
+		this->sl_bitmap[fl] |= 1u << sl;
+		this->free_count++;
+	}
+
+	void removeFree(uint32_t index)
+	{
+		uint32_t fl, sl;
+		mapping(this->blocks[index].size, fl, sl);
+
+		Block& block = this->blocks[index];
+		if (block.prev_free != NIL) {
+			this->blocks[block.prev_free].next_free = block.next_free;
+		}
+		else {
+			this->free_heads[fl][sl] = block.next_free;
+		}
+		if (block.next_free != NIL) {
+			this->blocks[block.next_free].prev_free = block.prev_free;
+		}
+		block.prev_free = NIL;
+		block.next_free = NIL;
+
+		if (this->free_heads[fl][sl] == NIL) {
+			this->sl_bitmap[fl] &= ~(1u << sl);
+			if (!this->sl_bitmap[fl]) {
+				this->fl_bitmap &= ~(uint64_t(1) << fl);
+			}
+		}
+		this->free_count--;
+	}
+
+	// shrinks the block to size and returns the index of the new block holding the remainder
+	uint32_t split(uint32_t index, uint64_t size)
+	{
+		uint32_t rest = this->newBlock();
+		Block& block = this->blocks[index];
+		Block& remainder = this->blocks[rest];
+
+		remainder.offset = block.offset + size;
+		remainder.size = block.size - size;
+		remainder.prev_phys = index;
+		remainder.next_phys = block.next_phys;
+		if (block.next_phys != NIL) {
+			this->blocks[block.next_phys].prev_phys = rest;
+		}
+		block.next_phys = rest;
+		block.size = size;
+		return rest;
+	}
+
+	// absorbs the physically following block into the first one
+	void merge(uint32_t first, uint32_t second)
+	{
+		Block& block = this->blocks[first];
+		const Block& next = this->blocks[second];
+		block.size += next.size;
+		block.next_phys = next.next_phys;
+		if (next.next_phys != NIL) {
+			this->blocks[next.next_phys].prev_phys = first;
+		}
+		this->unused.push_back(second);
+	}
+
+	uint32_t newBlock()
+	{
+		if (!this->unused.empty()) {
+			uint32_t index = this->unused.back();
+			this->unused.pop_back();
+			this->blocks[index] = Block{};
+			return index;
+		}
+		this->blocks.push_back(Block{});
+		return static_cast<uint32_t>(this->blocks.size() - 1);
+	}
+
+	uint64_t total;
+	uint64_t used_bytes{ 0 };
+	size_t free_count{ 0 };
+	std::vector<Block> blocks;
+	std::vector<uint32_t> unused;
+	std::unordered_map<uint64_t, uint32_t> allocated;
+
+	uint64_t fl_bitmap{ 0 };
+	std::array<uint32_t, FL_COUNT> sl_bitmap{};
+	std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> free_heads;
+};
+
+
+struct AllocatorStats {
+	uint64_t blocks{ 0 };
+	uint64_t dedicated{ 0 };
+	uint64_t allocations{ 0 };
+	uint64_t reserved{ 0 };
+	uint64_t used{ 0 };
+	uint64_t largest_free{ 0 };
+	uint64_t contiguous_free{ 0 };
+	uint64_t free_regions{ 0 };
+
+	// 0 when the free memory of each block is one contiguous region, approaching 1 as it splinters
+	double fragmentation() const
+	{
+		uint64_t free = this->reserved - this->used;
+		return free ? 1.0 - static_cast<double>(this->contiguous_free) / static_cast<double>(free) : 0.0;
+	}
+
+	void print(std::ostream& stream) const
+	{
+		stream << "Memory: " << this->allocations << " allocations in "
+			<< this->blocks << " blocks + " << this->dedicated << " dedicated, "
+			<< this->used / (1024.0 * 1024.0) << " of " << this->reserved / (1024.0 * 1024.0) << " mb used, "
+			<< "fragmentation: " << this->fragmentation() * 100.0 << "%" << std::endl;
+	}
+};
+
+
+// Sub-allocates device memory from large blocks, one set of blocks per memory type, resource
+// kind and allocate flags. The device side is abstracted away by the two block callbacks, a
+// block is identified by the non-zero handle returned from create_block.
+class MemoryAllocator {
+public:
+	// linear resources (buffers, linear images) and optimal tiling images may not share a
+	// bufferImageGranularity page. They get separate blocks when the granularity is > 1.
+	enum class ResourceKind : uint32_t {
+		LINEAR = 0,
+		OPTIMAL = 1,
+	};
+
+	struct Request {
+		uint64_t size{ 0 };
+		uint64_t alignment{ 1 };
+		uint32_t memory_type{ 0 };
+		ResourceKind kind{ ResourceKind::LINEAR };
+		uint32_t flags{ 0 };
+		bool dedicated{ false };
+	};
+
+	struct Allocation {
+		uint64_t block{ 0 };
+		uint64_t offset{ 0 };
+		uint64_t size{ 0 };
+		uint32_t memory_type{ 0 };
+		uint32_t pool{ 0 };
+		bool dedicated{ false };
+	};
+
+	// the destination is already allocated, the source must be freed once the data is moved
+	struct Move {
+		Allocation src;
+		Allocation dst;
+	};
+
+	typedef std::function<uint64_t(uint32_t memory_type, uint32_t flags, uint64_t size)> CreateBlock;
+	typedef std::function<void(uint64_t block)> DestroyBlock;
+
+	MemoryAllocator() = delete;
+
+	MemoryAllocator(
+		CreateBlock create_block,
+		DestroyBlock destroy_block,
+		uint64_t block_size = 64 * 1024 * 1024,
+		uint64_t granularity = 1) :
+		create_block(std::move(create_block)),
+		destroy_block(std::move(destroy_block)),
+		block_size(block_size),
+		granularity(granularity)
+	{}
+
+	~MemoryAllocator()
+	{
+		for (auto& pool : this->pools) {
+			for (auto& block : pool.blocks) {
+				this->destroy_block(block.handle);
+			}
+		}
+		for (auto& [handle, size] : this->dedicated) {
+			this->destroy_block(handle);
+		}
+	}
+
+	Allocation allocate(const Request& request)
+	{
+		uint32_t pool_index = this->poolIndex(request);
+
+		if (request.dedicated || request.size > this->block_size / 2) {
+			uint64_t handle = this->create_block(request.memory_type, request.flags, request.size);
+			this->dedicated[handle] = request.size;
+			return {
+				.block = handle,
+				.offset = 0,
+				.size = request.size,
+				.memory_type = request.memory_type,
+				.pool = pool_index,
+				.dedicated = true,
+			};
+		}
+
+		Pool& pool = this->pools[pool_index];
+		for (auto& block : pool.blocks) {
+			auto offset = block.tlsf->allocate(request.size, request.alignment);
+			if (offset) {
+				return this->allocation(pool_index, block, *offset);
+			}
+		}
+
+		// new block, halving its size if the device refuses, as long as the request still fits
+		uint64_t size = this->block_size;
+		while (true) {
+			try {
+				uint64_t handle = this->create_block(request.memory_type, request.flags, size);
+				pool.blocks.push_back({ handle, std::make_unique<TlsfAllocator>(size) });
+				break;
+			}
+			catch (std::exception&) {
+				size /= 2;
+				if (size < request.size + request.alignment || size < this->block_size / 8) {
+					throw;
+				}
+			}
+		}
+		Block& block = pool.blocks.back();
+		auto offset = block.tlsf->allocate(request.size, request.alignment);
+		if (!offset) {
+			throw std::runtime_error("MemoryAllocator: allocation does not fit in a new block");
+		}
+		return this->allocation(pool_index, block, *offset);
+	}
+
+	void free(const Allocation& allocation)
+	{
+		if (allocation.dedicated) {
+			if (!this->dedicated.erase(allocation.block)) {
+				throw std::invalid_argument("MemoryAllocator: unknown dedicated allocation");
+			}
+			this->destroy_block(allocation.block);
+			return;
+		}
+
+		Pool& pool = this->pools.at(allocation.pool);
+		auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&](const Block& block) {
+			return block.handle == allocation.block;
+			});
+
+		if (it == pool.blocks.end()) {
+			throw std::invalid_argument("MemoryAllocator: unknown block");
+		}
+		it->tlsf->free(allocation.offset);
+
+		// keep one empty block around per pool to avoid allocation churn
+		if (it->tlsf->empty() && pool.blocks.size() > 1) {
+			this->destroy_block(it->handle);
+			pool.blocks.erase(it);
+		}
+	}
+
+	// Plans moves that empty the least used block of each pool into the free space of the
+	// others. Nothing is moved, the caller copies the data, rebinds the resource and frees
+	// the source allocation, which releases the block once it is empty.
+	std::vector<Move> defragment()
+	{
+		std::vector<Move> moves;
+		for (uint32_t pool_index = 0; pool_index < this->pools.size(); pool_index++) {
+			Pool& pool = this->pools[pool_index];
+			if (pool.blocks.size() < 2) {
+				continue;
+			}
+			auto source = std::min_element(pool.blocks.begin(), pool.blocks.end(), [](const Block& a, const Block& b) {
+				return a.tlsf->used() < b.tlsf->used();
+				});
+
+			std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> live;
+			source->tlsf->forEachAllocation([&](uint64_t offset, uint64_t size, uint64_t alignment) {
+				live.push_back({ offset, size, alignment });
+				});
+
+			// largest first packs better
+			std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+				return std::get<1>(a) > std::get<1>(b);
+				});
+
+			std::vector<Move> planned;
+			for (auto& [offset, size, alignment] : live) {
+				std::optional<Move> move;
+				for (auto& block : pool.blocks) {
+					// moving into an empty block gains nothing
+					if (block.handle == source->handle || block.tlsf->empty()) {
+						continue;
+					}
+					auto dst = block.tlsf->allocate(size, alignment);
+					if (dst) {
+						move = Move{
+							.src = this->allocation(pool_index, *source, offset),
+							.dst = this->allocation(pool_index, block, *dst),
+						};
+						break;
+					}
+				}
+				if (!move) {
+					break;
+				}
+				planned.push_back(*move);
+			}
+
+			if (planned.size() != live.size()) {
+				// the block can't be emptied, moving part of it gains nothing
+				for (auto& move : planned) {
+					this->free(move.dst);
+				}
+				continue;
+			}
+			moves.insert(moves.end(), planned.begin(), planned.end());
+		}
+		return moves;
+	}
+
+	AllocatorStats stats() const
+	{
+		AllocatorStats stats;
+		for (auto& pool : this->pools) {
+			for (auto& block : pool.blocks) {
+				stats.blocks++;
+				stats.allocations += block.tlsf->allocationCount();
+				stats.reserved += block.tlsf->size();
+				stats.used += block.tlsf->used();
+				uint64_t largest = block.tlsf->largestFreeRegion();
+				stats.free_regions += block.tlsf->freeRegionCount();
+				stats.contiguous_free += largest;
+				stats.largest_free = std::max(stats.largest_free, largest);
+			}
+		}
+		for (auto& [handle, size] : this->dedicated) {
+			stats.dedicated++;
+			stats.allocations++;
+			stats.reserved += size;
+			stats.used += size;
+		}
+		return stats;
+	}
+
+	uint64_t blockSize() const { return this->block_size; }
+	uint64_t bufferImageGranularity() const { return this->granularity; }
+
+private:
+	struct Block {
+		uint64_t handle;
+		std::unique_ptr<TlsfAllocator> tlsf;
+	};
+
+	struct Pool {
+		uint32_t memory_type;
+		uint32_t flags;
+		std::vector<Block> blocks;
+	};
+
+	uint32_t poolIndex(const Request& request)
+	{
+		ResourceKind kind = (this->granularity > 1) ? request.kind : ResourceKind::LINEAR;
+		auto key = std::make_tuple(request.memory_type, static_cast<uint32_t>(kind), request.flags);
+
+		auto it = this->pool_index.find(key);
+		if (it != this->pool_index.end()) {
+			return it->second;
+		}
+		this->pools.push_back({ request.memory_type, request.flags, {} });
+		uint32_t index = static_cast<uint32_t>(this->pools.size() - 1);
+		this->pool_index[key] = index;
+		return index;
+	}
+
+	Allocation allocation(uint32_t pool_index, const Block& block, uint64_t offset) const
+	{
+		return {
+			.block = block.handle,
+			.offset = offset,
+			.size = block.tlsf->allocationSize(offset),
+			.memory_type = this->pools[pool_index].memory_type,
+			.pool = pool_index,
+			.dedicated = false,
+		};
+	}
+
+	CreateBlock create_block;
+	DestroyBlock destroy_block;
+	uint64_t block_size;
+	uint64_t granularity;
+
+	std::vector<Pool> pools;
+	std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> pool_index;
+	std::unordered_map<uint64_t, uint64_t> dedicated;
+};
+
+
+// Bookkeeping for a staging ring buffer of fixed capacity. Ranges are handed out in order and
+// grouped into batches, a batch is tagged with a serial when it is submitted and its ranges are
+// reclaimed once that serial has completed. Positions only ever grow, the offset into the ring
+// is the position modulo the capacity.
+class StagingRing {
+public:
+	StagingRing() = delete;
+
+	explicit StagingRing(uint64_t capacity) :
+		capacity_bytes(capacity)
+	{
+		if (capacity == 0) {
+			throw std::invalid_argument("StagingRing: capacity must be non-zero");
+		}
+	}
+
+	// a range never wraps around the end of the ring, the bytes skipped are reclaimed with the batch
+	std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1)
+	{
+		alignment = std::max<uint64_t>(alignment, 1);
+		if (size > this->capacity_bytes) {
+			return std::nullopt;
+		}
+		if (this->head == this->tail && this->batches.empty()) {
+			// nothing in flight, start over at the beginning
+			this->head = this->tail = 0;
+		}
+		uint64_t offset = this->head % this->capacity_bytes;
+		uint64_t aligned = (offset + alignment - 1) / alignment * alignment;
+		uint64_t start = this->head + (aligned - offset);
+		if (aligned + size > this->capacity_bytes) {
+			start = this->head + (this->capacity_bytes - offset);
+		}
+		if (start + size - this->tail > this->capacity_bytes) {
+			return std::nullopt;
+		}
+		this->head = start + size;
+		return start % this->capacity_bytes;
+	}
+
+	// ends the current batch, everything allocated since the previous close is released by reclaim(serial)
+	void close(uint64_t serial)
+	{
+		uint64_t end = this->batches.empty() ? this->tail : this->batches.back().second;
+		if (end == this->head) {
+			return;
+		}
+		this->batches.push_back({ serial, this->head });
+	}
+
+	// releases all batches with a serial at or before the completed one, returns bytes released
+	uint64_t reclaim(uint64_t completed)
+	{
+		uint64_t released = 0;
+		while (!this->batches.empty() && this->batches.front().first <= completed) {
+			released += this->batches.front().second - this->tail;
+			this->tail = this->batches.front().second;
+			this->batches.pop_front();
+		}
+		return released;
+	}
+
+	uint64_t capacity() const { return this->capacity_bytes; }
+	uint64_t used() const { return this->head - this->tail; }
+	size_t pending() const { return this->batches.size(); }
+
+private:
+	uint64_t capacity_bytes;
+	uint64_t head{ 0 };
+	uint64_t tail{ 0 };
+	std::deque<std::pair<uint64_t, uint64_t>> batches;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <Innovator/ThreadPool.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+
+struct AssetProgress {
+	size_t total{ 0 };
+	size_t loaded{ 0 };
+	size_t failed{ 0 };
+	size_t cancelled{ 0 };
+
+	bool done() const
+	{
+		return this->loaded + this->failed + this->cancelled == this->total;
+	}
+
+	void print(std::ostream& out) const
+	{
+		out << "assets: " << this->loaded << "/" << this->total << " loaded";
+		if (this->failed) {
+			out << ", " << this->failed << " failed";
+		}
+		if (this->cancelled) {
+			out << ", " << this->cancelled << " cancelled";
+		}
+		out << std::endl;
+	}
+};
+
+// Reads and decodes assets on a thread pool, so loading a scene takes about as long as its
+// slowest asset instead of the sum of them. The reads only touch their own asset, uploads
+// to the GPU are left to the allocation traversal that follows, which visits assets in the
+// order the scene depends on them.
+class AssetLoader {
+public:
+	typedef std::function<void()> Read;
+	typedef std::function<void(const AssetProgress&)> Report;
+
+	explicit AssetLoader(size_t threads = std::thread::hardware_concurrency()) :
+		pool(threads)
+	{}
+
+	// reads in flight refer to the assets, let them finish
+	~AssetLoader()
+	{
+		this->cancel();
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->changed.wait(lock, [this] { return this->running == 0; });
+	}
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	void load(std::string name, Read read)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->current.total++;
+			this->running++;
+		}
+		this->pool.submit([this, name = std::move(name), read = std::move(read)]() {
+			this->run(name, read);
+			});
+	}
+
+	// reads that haven't started are skipped, wait() still waits for the ones that have
+	void cancel()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->cancelled = true;
+	}
+
+	AssetProgress progress() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->current;
+	}
+
+	// Blocks until every asset is read, failed or cancelled, reporting progress on the calling
+	// thread as assets complete. Throws if any read failed. The loader takes new assets after.
+	AssetProgress wait(const Report& report = nullptr)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		size_t reported = SIZE_MAX;
+		while (true) {
+			this->changed.wait(lock, [&] {
+				return this->running == 0 || this->completed() != reported;
+				});
+			if (report && this->completed() != reported) {
+				AssetProgress progress = this->current;
+				reported = this->completed();
+				lock.unlock();
+				report(progress);
+				lock.lock();
+			}
+			reported = report ? reported : this->completed();
+			if (this->running == 0 && this->completed() == reported) {
+				break;
+			}
+		}
+
+		AssetProgress progress = this->current;
+		std::vector<std::string> errors = std::move(this->errors);
+		this->current = {};
+		this->errors.clear();
+		this->cancelled = false;
+		lock.unlock();
+
+		if (!errors.empty()) {
+			std::string message = "AssetLoader: " + std::to_string(errors.size()) + " asset(s) failed to load";
+			for (auto& error : errors) {
+				message += "\n" + error;
+			}
+			throw std::runtime_error(message);
+		}
+		return progress;
+	}
+
+private:
+	void run(const std::string& name, const Read& read)
+	{
+		bool skip;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			skip = this->cancelled;
+		}
+		std::string error;
+		if (!skip) {
+			try {
+				read();
+			}
+			catch (std::exception& e) {
+				error = name + ": " + e.what();
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (skip) {
+				this->current.cancelled++;
+			}
+			else if (!error.empty()) {
+				this->current.failed++;
+				this->errors.push_back(error);
+			}
+			else {
+				this->current.loaded++;
+			}
+			this->running--;
+			// under the lock, the destructor may return as soon as running drops to zero
+			this->changed.notify_all();
+		}
+	}
+
+	size_t completed() const
+	{
+		return this->current.loaded + this->current.failed + this->current.cancelled;
+	}
+
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	AssetProgress current;
+	std::vector<std::string> errors;
+	size_t running{ 0 };
+	bool cancelled{ false };
+	// last, so the workers are joined before the bookkeeping they update goes away
+	ThreadPool pool;
+};
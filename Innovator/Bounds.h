@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Axis aligned bounds and view frustum tests for culling. Matrices are 4x4 doubles in column
+// major order, the way glm stores them, so the math here can be tested without glm or a GPU.
+
+typedef std::array<double, 16> Matrix4;
+typedef std::array<double, 3> Point3;
+
+class BoundingBox {
+public:
+	BoundingBox() = default;
+
+	BoundingBox(const Point3& min, const Point3& max) :
+		min(min), max(max)
+	{}
+
+	// for content that must never be culled
+	static BoundingBox Infinite()
+	{
+		constexpr double inf = std::numeric_limits<double>::infinity();
+		return BoundingBox({ -inf, -inf, -inf }, { inf, inf, inf });
+	}
+
+	// bounds of count float3 positions, stride bytes apart starting at offset
+	static BoundingBox FromPositions(const char* data, size_t count, size_t stride, size_t offset = 0)
+	{
+		BoundingBox box;
+		for (size_t i = 0; i < count; i++) {
+			float p[3];
+			std::memcpy(p, data + i * stride + offset, sizeof(p));
+			box.extend({ p[0], p[1], p[2] });
+		}
+		return box;
+	}
+
+	bool empty() const
+	{
+		return this->min[0] > this->max[0] || this->min[1] > this->max[1] || this->min[2] > this->max[2];
+	}
+
+	bool infinite() const
+	{
+		return std::isinf(this->min[0]) || std::isinf(this->min[1]) || std::isinf(this->min[2]) ||
+			std::isinf(this->max[0]) || std::isinf(this->max[1]) || std::isinf(this->max[2]);
+	}
+
+	void extend(const Point3& point)
+	{
+		for (int i = 0; i < 3; i++) {
+			this->min[i] = std::min(this->min[i], point[i]);
+			this->max[i] = std::max(this->max[i], point[i]);
+		}
+	}
+
+	void extend(const BoundingBox& box)
+	{
+		if (!box.empty()) {
+			this->extend(box.min);
+			this->extend(box.max);
+		}
+	}
+
+	// bounds of the box after an affine transform (Arvo)
+	BoundingBox transformed(const Matrix4& m) const
+	{
+		if (this->empty() || this->infinite()) {
+			return *this;
+		}
+		BoundingBox box;
+		for (int i = 0; i < 3; i++) {
+			double center = m[12 + i];
+			double extent = 0.0;
+			for (int j = 0; j < 3; j++) {
+				double c = (this->min[j] + this->max[j]) * 0.5;
+				double e = (this->max[j] - this->min[j]) * 0.5;
+				center += m[j * 4 + i] * c;
+				extent += std::abs(m[j * 4 + i]) * e;
+			}
+			box.min[i] = center - extent;
+			box.max[i] = center + extent;
+		}
+		return box;
+	}
+
+	Point3 min{ std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+	Point3 max{ std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+};
+
+
+class Frustum {
+public:
+	static constexpr uint32_t ALL_PLANES = 0x3f;
+
+	// a default frustum has degenerate planes and culls nothing
+	Frustum() = default;
+
+	// Planes of the clip volume of projection * view, in world space. Depth is clipped to
+	// [0, w] as in Vulkan, which is conservative for a [-w, w] projection.
+	explicit Frustum(const Matrix4& m)
+	{
+		auto row = [&m](int i) {
+			return std::array<double, 4>{ m[i], m[4 + i], m[8 + i], m[12 + i] };
+		};
+		auto combine = [](const std::array<double, 4>& a, const std::array<double, 4>& b, double s) {
+			return std::array<double, 4>{ a[0] + s * b[0], a[1] + s * b[1], a[2] + s * b[2], a[3] + s * b[3] };
+		};
+		auto r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+		this->planes = {
+			combine(r3, r0, 1.0),  // left
+			combine(r3, r0, -1.0), // right
+			combine(r3, r1, 1.0),  // bottom
+			combine(r3, r1, -1.0), // top
+			r2,                    // near
+			combine(r3, r2, -1.0), // far
+		};
+	}
+
+	// True when the box is outside the frustum. Planes the box is entirely inside of are cleared
+	// from the mask, what is contained in the box needs not be tested against them again.
+	bool cull(const BoundingBox& box, uint32_t& mask) const
+	{
+		if (box.empty() || box.infinite()) {
+			return false;
+		}
+		for (uint32_t i = 0; i < 6; i++) {
+			if (!(mask & (1u << i))) {
+				continue;
+			}
+			auto& plane = this->planes[i];
+			double outer = plane[3];
+			double inner = plane[3];
+			for (int j = 0; j < 3; j++) {
+				outer += plane[j] * (plane[j] > 0 ? box.max[j] : box.min[j]);
+				inner += plane[j] * (plane[j] > 0 ? box.min[j] : box.max[j]);
+			}
+			if (outer < 0.0) {
+				return true;
+			}
+			if (inner >= 0.0) {
+				mask &= ~(1u << i);
+			}
+		}
+		return false;
+	}
+
+	std::array<std::array<double, 4>, 6> planes{};
+};
+
+
+// World bounds of a subtree, cached by the render traversal. The cache is valid as long as
+// the revision it was made at is current, transforms that change bump the revision.
+class SubtreeBounds {
+public:
+	bool valid(uint64_t revision) const
+	{
+		return this->revision == revision;
+	}
+
+	bool cull(const Frustum& frustum, uint32_t& mask, uint64_t revision) const
+	{
+		return this->valid(revision) && frustum.cull(this->bounds, mask);
+	}
+
+	void update(const BoundingBox& bounds, uint64_t revision)
+	{
+		this->bounds = bounds;
+		this->revision = revision;
+	}
+
+	BoundingBox bounds;
+	uint64_t revision{ std::numeric_limits<uint64_t>::max() };
+};
@@ -0,0 +1,914 @@
+#pragma once
+
+#include <Innovator/Bounds.h>
+#include <Innovator/Simd.h>
+#include <Innovator/ThreadPool.h>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+
+// axis aligned box in single precision, what the hierarchy is made of
+struct BvhBox {
+	std::array<float, 3> min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	std::array<float, 3> max{ std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+	bool empty() const
+	{
+		return this->min[0] > this->max[0] || this->min[1] > this->max[1] || this->min[2] > this->max[2];
+	}
+
+	// the inner loop of the build, plain comparisons keep it fast in debug builds too
+	void extend(const float* point)
+	{
+		this->extend(point, point);
+	}
+
+	void extend(const BvhBox& box)
+	{
+		this->extend(box.min.data(), box.max.data());
+	}
+
+	void extend(const float* lower, const float* upper)
+	{
+		float* min = this->min.data();
+		float* max = this->max.data();
+		for (int k = 0; k < 3; k++) {
+			min[k] = lower[k] < min[k] ? lower[k] : min[k];
+			max[k] = upper[k] > max[k] ? upper[k] : max[k];
+		}
+	}
+
+	// half the surface area, the probability of a ray hitting it is proportional to it
+	float area() const
+	{
+		if (this->empty()) {
+			return 0.0f;
+		}
+		float x = this->max[0] - this->min[0], y = this->max[1] - this->min[1], z = this->max[2] - this->min[2];
+		return x * y + y * z + z * x;
+	}
+
+	BoundingBox bounds() const
+	{
+		if (this->empty()) {
+			return BoundingBox();
+		}
+		return BoundingBox({ this->min[0], this->min[1], this->min[2] }, { this->max[0], this->max[1], this->max[2] });
+	}
+};
+
+// Interior nodes have count 0 and their children at first and first + 1, leaves have count
+// primitives starting at first in the primitive order. Two nodes fill a cache line.
+struct BvhNode {
+	BvhBox box;
+	uint32_t first{ 0 };
+	uint32_t count{ 0 };
+};
+
+static_assert(sizeof(BvhNode) == 32);
+
+// What traversal walks: the children of a node of the binary tree, with interior children
+// opened into theirs until there are four, and their boxes as structure of arrays so a ray or
+// a frustum plane is tested against all four at once. A lane of count 0 is interior and first
+// is the wide node of its children, otherwise it is a leaf of count primitives from first.
+struct BvhNode4 {
+	std::array<std::array<float, 4>, 3> min{};
+	std::array<std::array<float, 4>, 3> max{};
+	std::array<uint32_t, 4> first{};
+	std::array<uint32_t, 4> count{};
+	uint32_t lanes{ 0 };
+};
+
+// hits between tmin and tmax count, a hit shortens tmax
+struct BvhRay {
+	std::array<float, 3> origin{ 0, 0, 0 };
+	std::array<float, 3> direction{ 0, 0, 1 };
+	float tmin{ 0.0f };
+	float tmax{ std::numeric_limits<float>::infinity() };
+};
+
+// Bounding volume hierarchy over primitive boxes, split by the surface area heuristic
+// evaluated over bins of primitive centroids (Wald, On fast Construction of SAH-based
+// Bounding Volume Hierarchies, 2007).
+class Bvh {
+public:
+	static constexpr uint32_t BINS = 16;
+	static constexpr uint32_t MAX_LEAF_SIZE = 8;
+	// of a traversal step, in primitive tests
+	static constexpr float TRAVERSAL_COST = 2.0f;
+	// larger ranges are split on the calling thread with their binning spread over the pool,
+	// smaller ones are built as one task each
+	static constexpr uint32_t TASK_PRIMITIVES = 1 << 15;
+
+	// shared by all builds, which must not run on it themselves
+	static ThreadPool& Threads()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	Bvh() = default;
+
+	explicit Bvh(std::vector<BvhBox> boxes, ThreadPool* pool = nullptr) :
+		boxes(std::move(boxes))
+	{
+		if (this->boxes.size() >= std::numeric_limits<uint32_t>::max() / 2) {
+			throw std::overflow_error("Bvh: too many primitives");
+		}
+		this->build(pool);
+	}
+
+	// The primitives moved, the tree is kept and its boxes recomputed. Cheaper than a build
+	// but the tree gets worse the further they move from where it was built.
+	void refit(std::vector<BvhBox> boxes)
+	{
+		if (boxes.size() != this->boxes.size()) {
+			throw std::invalid_argument("Bvh: refit with a different number of primitives");
+		}
+		this->boxes = std::move(boxes);
+		// children are always stored after their parent
+		for (size_t i = this->nodes.size(); i-- > 0;) {
+			BvhNode& node = this->nodes[i];
+			node.box = BvhBox();
+			if (node.count) {
+				for (uint32_t p = node.first; p < node.first + node.count; p++) {
+					node.box.extend(this->boxes[this->primitives[p]]);
+				}
+			}
+			else {
+				node.box.extend(this->nodes[node.first].box);
+				node.box.extend(this->nodes[node.first + 1].box);
+			}
+		}
+		this->widen();
+	}
+
+	// Calls leaf(slot, ray) for the primitives in the leaves the ray enters, nearest first,
+	// primitives[slot] is the primitive. Leaves shorten ray.tmax when they hit, which prunes
+	// what is further away.
+	template <typename Leaf>
+	void intersect(BvhRay& ray, Leaf&& leaf) const
+	{
+		if (this->wide.empty()) {
+			return;
+		}
+		Float4 origin[3];
+		Float4 inverse[3];
+		for (int k = 0; k < 3; k++) {
+			// a tiny component instead of 0 keeps the slabs free of 0 * inf
+			float d = ray.direction[k] != 0.0f ? ray.direction[k] : std::copysign(1e-30f, ray.direction[k]);
+			origin[k] = Float4::Set(ray.origin[k]);
+			inverse[k] = Float4::Set(1.0f / d);
+		}
+
+		// a wide node or a leaf, and where the ray enters it
+		struct Entry {
+			uint32_t first;
+			uint32_t count;
+			float t;
+		};
+		// each wide node takes one entry and adds at most four
+		const size_t size = 3 * size_t(this->depth) + 4;
+		Entry fixed[64];
+		std::vector<Entry> grown;
+		Entry* stack = fixed;
+		if (size > 64) {
+			grown.resize(size);
+			stack = grown.data();
+		}
+		size_t top = 0;
+		stack[top++] = { 0, 0, ray.tmin };
+
+		while (top > 0) {
+			Entry entry = stack[--top];
+			if (entry.t > ray.tmax) {
+				continue;
+			}
+			if (entry.count) {
+				for (uint32_t slot = entry.first; slot < entry.first + entry.count; slot++) {
+					leaf(slot, ray);
+				}
+				continue;
+			}
+			const BvhNode4& node = this->wide[entry.first];
+			float t[4];
+			uint32_t hits = Enter(node, ray, origin, inverse, t);
+
+			// the lanes entered, furthest first so the nearest is taken next
+			uint32_t order[4];
+			uint32_t entered = 0;
+			for (uint32_t lane = 0; lane < node.lanes; lane++) {
+				if (hits & (1u << lane)) {
+					uint32_t i = entered++;
+					for (; i > 0 && t[order[i - 1]] < t[lane]; i--) {
+						order[i] = order[i - 1];
+					}
+					order[i] = lane;
+				}
+			}
+			for (uint32_t i = 0; i < entered; i++) {
+				stack[top++] = { node.first[order[i]], node.count[order[i]], t[order[i]] };
+			}
+		}
+	}
+
+	// Calls visible(primitive) for the primitives whose boxes are not outside the frustum.
+	// Planes a subtree is inside of are not tested again below it.
+	template <typename Visible>
+	void cull(const Frustum& frustum, Visible&& visible) const
+	{
+		if (!this->wide.empty()) {
+			this->cull(frustum, 0, Frustum::ALL_PLANES, visible);
+		}
+	}
+
+	size_t size() const
+	{
+		return this->boxes.size();
+	}
+
+	std::vector<BvhNode> nodes;
+	// the tree traversed, made from nodes when it is built or refit
+	std::vector<BvhNode4> wide;
+	// primitives in leaf order
+	std::vector<uint32_t> primitives;
+	std::vector<BvhBox> boxes;
+	// of the deepest leaf, the root is at depth 0
+	uint32_t depth{ 0 };
+
+private:
+	// Distances at which the ray enters the boxes of the lanes, and a bit for each lane it
+	// enters. The far distances are widened a little so rounding never loses a hit on a box
+	// face (Ize, Robust BVH Ray Traversal, 2013).
+	static uint32_t Enter(const BvhNode4& node, const BvhRay& ray, const Float4* origin, const Float4* inverse, float* t)
+	{
+		Float4 near = Float4::Set(ray.tmin);
+		Float4 far = Float4::Set(ray.tmax);
+		for (int k = 0; k < 3; k++) {
+			Float4 a = (Float4::Load(node.min[k].data()) - origin[k]) * inverse[k];
+			Float4 b = (Float4::Load(node.max[k].data()) - origin[k]) * inverse[k];
+			near = Float4::Max(near, Float4::Min(a, b));
+			far = Float4::Min(far, Float4::Max(a, b) * Float4::Set(1.0000004f));
+		}
+		near.store(t);
+		return Float4::LessEqual(near, far) & ((1u << node.lanes) - 1);
+	}
+
+	// Bits of the lanes outside a plane of mask, and for each lane the planes of mask it is not
+	// entirely inside of. In float, within a margin of rounding error of a plane a box is left
+	// for the exact tests of the primitives below it. Empty boxes are not culled, as in Frustum.
+	static uint32_t Outside(const Frustum& frustum, const BvhNode4& node, uint32_t mask, std::array<uint32_t, 4>& masks)
+	{
+		uint32_t empty = 0;
+		for (int k = 0; k < 3; k++) {
+			empty |= Float4::Less(Float4::Load(node.max[k].data()), Float4::Load(node.min[k].data()));
+		}
+		uint32_t outside = 0;
+		for (uint32_t i = 0; i < 6; i++) {
+			if (!(mask & (1u << i))) {
+				continue;
+			}
+			const auto& plane = frustum.planes[i];
+			Float4 outer = Float4::Set(float(plane[3]));
+			Float4 inner = outer;
+			Float4 magnitude = Float4::Abs(outer);
+			for (int k = 0; k < 3; k++) {
+				Float4 n = Float4::Set(float(plane[k]));
+				Float4 upper = n * Float4::Load(node.max[k].data());
+				Float4 lower = n * Float4::Load(node.min[k].data());
+				outer = outer + (plane[k] > 0 ? upper : lower);
+				inner = inner + (plane[k] > 0 ? lower : upper);
+				magnitude = magnitude + Float4::Max(Float4::Abs(upper), Float4::Abs(lower));
+			}
+			Float4 margin = magnitude * Float4::Set(1e-6f);
+			outside |= Float4::Less(outer + margin, Float4::Set(0.0f));
+			uint32_t inside = Float4::LessEqual(margin, inner) & ~empty;
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				if (inside & (1u << lane)) {
+					masks[lane] &= ~(1u << i);
+				}
+			}
+		}
+		return outside & ~empty;
+	}
+
+	template <typename Visible>
+	void cull(const Frustum& frustum, uint32_t index, uint32_t mask, Visible& visible) const
+	{
+		const BvhNode4& node = this->wide[index];
+		std::array<uint32_t, 4> masks{ mask, mask, mask, mask };
+		uint32_t outside = mask ? Outside(frustum, node, mask, masks) : 0;
+		for (uint32_t lane = 0; lane < node.lanes; lane++) {
+			if (outside & (1u << lane)) {
+				continue;
+			}
+			if (!node.count[lane]) {
+				this->cull(frustum, node.first[lane], masks[lane], visible);
+				continue;
+			}
+			for (uint32_t slot = node.first[lane]; slot < node.first[lane] + node.count[lane]; slot++) {
+				uint32_t planes = masks[lane];
+				uint32_t primitive = this->primitives[slot];
+				if (!planes || !frustum.cull(this->boxes[primitive].bounds(), planes)) {
+					visible(primitive);
+				}
+			}
+		}
+	}
+
+	void widen()
+	{
+		this->wide.clear();
+		if (!this->nodes.empty()) {
+			this->widen(0);
+		}
+	}
+
+	// the wide node of the children of a node, before the wide nodes below it
+	uint32_t widen(uint32_t index)
+	{
+		// a root with few primitives is a leaf, it is then the only lane
+		std::array<uint32_t, 4> lanes{ index };
+		uint32_t count = 1;
+		if (!this->nodes[index].count) {
+			lanes = { this->nodes[index].first, this->nodes[index].first + 1 };
+			count = 2;
+		}
+		while (count < 4) {
+			// the largest box is the one a ray most likely enters
+			int open = -1;
+			float area = -1.0f;
+			for (uint32_t lane = 0; lane < count; lane++) {
+				const BvhNode& node = this->nodes[lanes[lane]];
+				if (!node.count && node.box.area() > area) {
+					open = int(lane);
+					area = node.box.area();
+				}
+			}
+			if (open < 0) {
+				break;
+			}
+			uint32_t first = this->nodes[lanes[open]].first;
+			lanes[open] = first;
+			lanes[count++] = first + 1;
+		}
+
+		BvhNode4 wide;
+		wide.lanes = count;
+		for (uint32_t lane = 0; lane < count; lane++) {
+			const BvhNode& node = this->nodes[lanes[lane]];
+			for (int k = 0; k < 3; k++) {
+				wide.min[k][lane] = node.box.min[k];
+				wide.max[k][lane] = node.box.max[k];
+			}
+			wide.first[lane] = node.first;
+			wide.count[lane] = node.count;
+		}
+		const uint32_t w = static_cast<uint32_t>(this->wide.size());
+		this->wide.push_back(wide);
+		for (uint32_t lane = 0; lane < count; lane++) {
+			if (!this->nodes[lanes[lane]].count) {
+				this->wide[w].first[lane] = this->widen(lanes[lane]);
+			}
+		}
+		return w;
+	}
+
+	// a node's primitives, with their bounds and the bounds of their centroids
+	struct Range {
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+		uint32_t depth;
+		BvhBox box;
+		BvhBox centroids;
+	};
+
+	struct Bin {
+		BvhBox box;
+		BvhBox centroids;
+		uint32_t count{ 0 };
+
+		void merge(const Bin& other)
+		{
+			this->box.extend(other.box);
+			this->centroids.extend(other.centroids);
+			this->count += other.count;
+		}
+	};
+
+	typedef std::array<std::array<Bin, BINS>, 3> Bins;
+
+	// primitives are partitioned as copies of their boxes, reading them stays sequential
+	struct Item {
+		BvhBox box;
+		std::array<float, 3> centroid;
+		uint32_t primitive;
+	};
+
+	// what the build threads share
+	struct Builder {
+		std::vector<Item> items;
+		// nodes are allocated in pairs of siblings
+		std::atomic<uint32_t> next{ 1 };
+		std::atomic<uint32_t> depth{ 0 };
+	};
+
+	void build(ThreadPool* pool)
+	{
+		const uint32_t count = static_cast<uint32_t>(this->boxes.size());
+		this->nodes.clear();
+		this->wide.clear();
+		this->primitives.resize(count);
+		std::iota(this->primitives.begin(), this->primitives.end(), 0);
+		if (count == 0) {
+			return;
+		}
+		Builder builder;
+		builder.items.resize(count);
+		Range root{ .node = 0, .begin = 0, .end = count, .depth = 0, .box = {}, .centroids = {} };
+		for (uint32_t p = 0; p < count; p++) {
+			Item& item = builder.items[p];
+			item.box = this->boxes[p];
+			item.primitive = p;
+			for (int k = 0; k < 3; k++) {
+				item.centroid[k] = (item.box.min[k] + item.box.max[k]) * 0.5f;
+			}
+			root.box.extend(item.box);
+			root.centroids.extend(item.centroid.data());
+		}
+		this->nodes.resize(size_t(count) * 2 - 1);
+
+		// the top of the tree breadth first on this thread, then the subtrees in parallel
+		std::vector<Range> large{ root };
+		std::vector<Range> small;
+		while (!large.empty()) {
+			Range range = large.back();
+			large.pop_back();
+			if (!pool || range.end - range.begin <= TASK_PRIMITIVES) {
+				small.push_back(range);
+				continue;
+			}
+			for (const Range& child : this->split(builder, range, pool)) {
+				large.push_back(child);
+			}
+		}
+
+		auto subtree = [this, &builder](Range root) {
+			std::vector<Range> ranges{ root };
+			while (!ranges.empty()) {
+				Range range = ranges.back();
+				ranges.pop_back();
+				for (const Range& child : this->split(builder, range, nullptr)) {
+					ranges.push_back(child);
+				}
+			}
+		};
+		if (pool && small.size() > 1) {
+			std::vector<std::future<void>> futures;
+			for (const Range& range : small) {
+				futures.push_back(pool->submit([&subtree, range] { subtree(range); }));
+			}
+			for (auto& future : futures) {
+				future.get();
+			}
+		}
+		else {
+			for (const Range& range : small) {
+				subtree(range);
+			}
+		}
+
+		this->nodes.resize(builder.next);
+		this->depth = builder.depth;
+		for (uint32_t i = 0; i < count; i++) {
+			this->primitives[i] = builder.items[i].primitive;
+		}
+		this->widen();
+	}
+
+	// fewer for small ranges, where evaluating the splits costs more than binning
+	static uint32_t BinCount(uint32_t primitives)
+	{
+		return std::clamp(primitives / 4, 4u, BINS);
+	}
+
+	static uint32_t BinIndex(float centroid, float min, float scale, uint32_t bins)
+	{
+		return std::min(bins - 1, static_cast<uint32_t>((centroid - min) * scale));
+	}
+
+	// the range's primitives binned along each axis, over the pool in chunks if it is large
+	Bins bin(const Builder& builder, const Range& range, ThreadPool* pool) const
+	{
+		const uint32_t count = BinCount(range.end - range.begin);
+		std::array<float, 3> scale{};
+		for (int k = 0; k < 3; k++) {
+			float extent = range.centroids.max[k] - range.centroids.min[k];
+			scale[k] = extent > 0.0f ? float(count) / extent : 0.0f;
+		}
+		auto chunk = [&](uint32_t begin, uint32_t end) {
+			Bins bins{};
+			for (uint32_t i = begin; i < end; i++) {
+				const Item& item = builder.items[i];
+				const float* centroid = item.centroid.data();
+				for (int k = 0; k < 3; k++) {
+					Bin& bin = bins[k][BinIndex(centroid[k], range.centroids.min[k], scale[k], count)];
+					bin.box.extend(item.box);
+					bin.centroids.extend(centroid);
+					bin.count++;
+				}
+			}
+			return bins;
+		};
+		if (!pool || range.end - range.begin <= TASK_PRIMITIVES) {
+			return chunk(range.begin, range.end);
+		}
+		const uint32_t chunks = static_cast<uint32_t>(std::min<size_t>(pool->size() * 2, (range.end - range.begin) / (TASK_PRIMITIVES / 4)));
+		const uint32_t size = (range.end - range.begin + chunks - 1) / chunks;
+		std::vector<std::future<Bins>> futures;
+		for (uint32_t begin = range.begin; begin < range.end; begin += size) {
+			uint32_t end = std::min(range.end, begin + size);
+			futures.push_back(pool->submit([&chunk, begin, end] { return chunk(begin, end); }));
+		}
+		Bins bins{};
+		for (auto& future : futures) {
+			Bins part = future.get();
+			for (int k = 0; k < 3; k++) {
+				for (uint32_t b = 0; b < BINS; b++) {
+					bins[k][b].merge(part[k][b]);
+				}
+			}
+		}
+		return bins;
+	}
+
+	// Makes the range's node a leaf, or an interior node and returns the ranges of its children
+	std::vector<Range> split(Builder& builder, const Range& range, ThreadPool* pool)
+	{
+		const uint32_t count = range.end - range.begin;
+		BvhNode& node = this->nodes[range.node];
+		node.box = range.box;
+
+		auto leaf = [&] {
+			node.first = range.begin;
+			node.count = count;
+			uint32_t depth = builder.depth.load();
+			while (range.depth > depth && !builder.depth.compare_exchange_weak(depth, range.depth)) {}
+			return std::vector<Range>{};
+		};
+		if (count == 1) {
+			return leaf();
+		}
+
+		Bins bins = this->bin(builder, range, pool);
+		const uint32_t bin_count = BinCount(count);
+
+		// the cheapest split between bins, in units of the node's area
+		float best_cost = std::numeric_limits<float>::max();
+		int best_axis = -1;
+		uint32_t best_bin = 0;
+		for (int k = 0; k < 3; k++) {
+			if (range.centroids.max[k] <= range.centroids.min[k]) {
+				continue;
+			}
+			std::array<float, BINS> right_cost{};
+			Bin right;
+			for (uint32_t b = bin_count - 1; b > 0; b--) {
+				right.merge(bins[k][b]);
+				right_cost[b] = right.box.area() * float(right.count);
+			}
+			Bin left;
+			for (uint32_t b = 1; b < bin_count; b++) {
+				left.merge(bins[k][b - 1]);
+				if (left.count == 0 || left.count == count) {
+					continue;
+				}
+				float cost = left.box.area() * float(left.count) + right_cost[b];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = k;
+					best_bin = b;
+				}
+			}
+		}
+
+		const float area = range.box.area();
+		Range children[2]{
+			{ .node = 0, .begin = range.begin, .end = 0, .depth = range.depth + 1, .box = {}, .centroids = {} },
+			{ .node = 0, .begin = 0, .end = range.end, .depth = range.depth + 1, .box = {}, .centroids = {} },
+		};
+		if (best_axis >= 0 && (count > MAX_LEAF_SIZE || area * TRAVERSAL_COST + best_cost < area * float(count))) {
+			const int k = best_axis;
+			const float min = range.centroids.min[k];
+			const float scale = float(bin_count) / (range.centroids.max[k] - min);
+			auto first = builder.items.begin() + range.begin;
+			auto last = builder.items.begin() + range.end;
+			children[0].end = static_cast<uint32_t>(std::partition(first, last, [&](const Item& item) {
+				return BinIndex(item.centroid[k], min, scale, bin_count) < best_bin;
+				}) - builder.items.begin());
+			for (uint32_t b = 0; b < bin_count; b++) {
+				Range& child = children[b < best_bin ? 0 : 1];
+				child.box.extend(bins[k][b].box);
+				child.centroids.extend(bins[k][b].centroids);
+			}
+		}
+		else if (count > MAX_LEAF_SIZE) {
+			// all centroids in one point, any split will do
+			children[0].end = range.begin + count / 2;
+			children[0].centroids = range.centroids;
+			children[1].centroids = range.centroids;
+			for (uint32_t i = range.begin; i < range.end; i++) {
+				children[i < children[0].end ? 0 : 1].box.extend(builder.items[i].box);
+			}
+		}
+		else {
+			return leaf();
+		}
+		children[1].begin = children[0].end;
+
+		const uint32_t first = builder.next.fetch_add(2);
+		node.first = first;
+		node.count = 0;
+		children[0].node = first;
+		children[1].node = first + 1;
+		return { children[0], children[1] };
+	}
+};
+
+
+// a ray's nearest triangle, t along the ray and the barycentrics of the second and third vertex
+struct BvhHit {
+	uint32_t triangle;
+	float t;
+	float u;
+	float v;
+};
+
+// Triangles of an indexed mesh in a Bvh. Positions are copied into leaf order, a leaf's
+// triangles are next to each other in memory.
+class TriangleBvh {
+public:
+	TriangleBvh() = delete;
+	TriangleBvh(const TriangleBvh&) = delete;
+	TriangleBvh& operator=(const TriangleBvh&) = delete;
+
+	// float xyz at the start of each vertex, stride floats apart
+	TriangleBvh(const float* vertices, size_t vertex_count, size_t stride, std::vector<uint32_t> indices, ThreadPool* pool = nullptr) :
+		indices(std::move(indices))
+	{
+		if (this->indices.size() % 3) {
+			throw std::invalid_argument("TriangleBvh: not a triangle list");
+		}
+		for (uint32_t index : this->indices) {
+			if (index >= vertex_count) {
+				throw std::out_of_range("TriangleBvh: index past the end of the vertices");
+			}
+		}
+		this->bvh = Bvh(this->triangleBoxes(vertices, stride), pool);
+		this->gather(vertices, stride);
+	}
+
+	// the vertices moved, the indices are the same
+	void refit(const float* vertices, size_t stride)
+	{
+		this->bvh.refit(this->triangleBoxes(vertices, stride));
+		this->gather(vertices, stride);
+	}
+
+	std::optional<BvhHit> intersect(BvhRay ray) const
+	{
+		std::optional<BvhHit> hit;
+		this->bvh.intersect(ray, [&](uint32_t slot, BvhRay& ray) {
+			float t, u, v;
+			if (IntersectTriangle(&this->triangles[size_t(slot) * 9], ray, t, u, v)) {
+				ray.tmax = t;
+				hit = BvhHit{ this->bvh.primitives[slot], t, u, v };
+			}
+			});
+		return hit;
+	}
+
+	template <typename Visible>
+	void cull(const Frustum& frustum, Visible&& visible) const
+	{
+		this->bvh.cull(frustum, visible);
+	}
+
+	BoundingBox bounds() const
+	{
+		return this->bvh.nodes.empty() ? BoundingBox() : this->bvh.nodes[0].box.bounds();
+	}
+
+	size_t triangleCount() const
+	{
+		return this->indices.size() / 3;
+	}
+
+	// Moller and Trumbore, Fast, Minimum Storage Ray/Triangle Intersection, 1997. Both sides
+	// of a triangle are hit, hits at tmax are not.
+	static bool IntersectTriangle(const float* p, const BvhRay& ray, float& t, float& u, float& v)
+	{
+		const float* o = ray.origin.data();
+		const float* d = ray.direction.data();
+		float e1[3]{ p[3] - p[0], p[4] - p[1], p[5] - p[2] };
+		float e2[3]{ p[6] - p[0], p[7] - p[1], p[8] - p[2] };
+		float pv[3]{ d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+		float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+		if (det == 0.0f) {
+			return false;
+		}
+		float inverse = 1.0f / det;
+		float tv[3]{ o[0] - p[0], o[1] - p[1], o[2] - p[2] };
+		u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * inverse;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		float qv[3]{ tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0] };
+		v = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) * inverse;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		t = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * inverse;
+		return t >= ray.tmin && t < ray.tmax;
+	}
+
+private:
+	std::vector<BvhBox> triangleBoxes(const float* vertices, size_t stride) const
+	{
+		std::vector<BvhBox> boxes(this->triangleCount());
+		for (size_t t = 0; t < boxes.size(); t++) {
+			for (size_t k = 0; k < 3; k++) {
+				boxes[t].extend(&vertices[this->indices[t * 3 + k] * stride]);
+			}
+		}
+		return boxes;
+	}
+
+	void gather(const float* vertices, size_t stride)
+	{
+		this->triangles.resize(this->indices.size() * 3);
+		for (size_t slot = 0; slot < this->bvh.primitives.size(); slot++) {
+			size_t t = this->bvh.primitives[slot];
+			for (size_t k = 0; k < 3; k++) {
+				const float* p = &vertices[this->indices[t * 3 + k] * stride];
+				std::copy(p, p + 3, &this->triangles[slot * 9 + k * 3]);
+			}
+		}
+	}
+
+	std::vector<uint32_t> indices;
+	std::vector<float> triangles;
+	Bvh bvh;
+};
+
+
+// the nearest hit among the instances of a BvhScene, point and t in world space
+struct BvhSceneHit {
+	size_t instance;
+	uint32_t triangle;
+	double t;
+	Point3 point;
+};
+
+// Instances of triangle meshes under their transforms, with a Bvh over their world bounds on
+// top. Instances are added anew for each query; when the same meshes come in the same order
+// as last time the top level is refit to the new transforms rather than built again.
+class BvhScene {
+public:
+	void begin()
+	{
+		this->previous.clear();
+		for (auto& instance : this->instances) {
+			this->previous.push_back(instance.mesh.get());
+		}
+		this->instances.clear();
+	}
+
+	void add(std::shared_ptr<const TriangleBvh> mesh, const Matrix4& transform)
+	{
+		// a transform that collapses the mesh can not be hit
+		auto inverse = AffineInverse(transform);
+		if (mesh && inverse) {
+			this->instances.push_back({ std::move(mesh), transform, *inverse });
+		}
+	}
+
+	void end(ThreadPool* pool = nullptr)
+	{
+		std::vector<BvhBox> boxes;
+		bool same = this->previous.size() == this->instances.size();
+		for (size_t i = 0; i < this->instances.size(); i++) {
+			BoundingBox world = this->instances[i].mesh->bounds().transformed(this->instances[i].transform);
+			BvhBox box;
+			if (!world.empty()) {
+				box.min = { float(world.min[0]), float(world.min[1]), float(world.min[2]) };
+				box.max = { float(world.max[0]), float(world.max[1]), float(world.max[2]) };
+				// widened by the rounding to float
+				for (int k = 0; k < 3; k++) {
+					box.min[k] = std::nextafter(box.min[k], -std::numeric_limits<float>::infinity());
+					box.max[k] = std::nextafter(box.max[k], std::numeric_limits<float>::infinity());
+				}
+			}
+			boxes.push_back(box);
+			same = same && this->previous[i] == this->instances[i].mesh.get();
+		}
+		if (same && this->top.size() == boxes.size()) {
+			this->top.refit(std::move(boxes));
+			this->refits++;
+		}
+		else {
+			this->top = Bvh(std::move(boxes), pool);
+			this->builds++;
+		}
+	}
+
+	// direction need not be unit length, t is in its units
+	std::optional<BvhSceneHit> intersect(const Point3& origin, const Point3& direction) const
+	{
+		std::optional<BvhSceneHit> hit;
+		BvhRay ray{
+			.origin = { float(origin[0]), float(origin[1]), float(origin[2]) },
+			.direction = { float(direction[0]), float(direction[1]), float(direction[2]) },
+		};
+		this->top.intersect(ray, [&](uint32_t slot, BvhRay& ray) {
+			size_t i = this->top.primitives[slot];
+			const Instance& instance = this->instances[i];
+			// in object space, an affine transform keeps t the same
+			const Matrix4& m = instance.inverse;
+			BvhRay local{ .tmin = ray.tmin, .tmax = ray.tmax };
+			for (int k = 0; k < 3; k++) {
+				local.origin[k] = float(m[k] * origin[0] + m[4 + k] * origin[1] + m[8 + k] * origin[2] + m[12 + k]);
+				local.direction[k] = float(m[k] * direction[0] + m[4 + k] * direction[1] + m[8 + k] * direction[2]);
+			}
+			if (auto local_hit = instance.mesh->intersect(local)) {
+				ray.tmax = local_hit->t;
+				double t = local_hit->t;
+				hit = BvhSceneHit{
+					.instance = i,
+					.triangle = local_hit->triangle,
+					.t = t,
+					.point = { origin[0] + direction[0] * t, origin[1] + direction[1] * t, origin[2] + direction[2] * t },
+				};
+			}
+			});
+		return hit;
+	}
+
+	size_t size() const
+	{
+		return this->instances.size();
+	}
+
+	uint64_t builds{ 0 };
+	uint64_t refits{ 0 };
+
+	// of a column major matrix whose last row is 0 0 0 1
+	static std::optional<Matrix4> AffineInverse(const Matrix4& m)
+	{
+		auto a = [&m](int row, int column) { return m[column * 4 + row]; };
+		double c00 = a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1);
+		double c01 = a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2);
+		double c02 = a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0);
+		double det = a(0, 0) * c00 + a(0, 1) * c01 + a(0, 2) * c02;
+		if (!std::isnormal(det)) {
+			return std::nullopt;
+		}
+		double s = 1.0 / det;
+		double r[3][3]{
+			{ c00 * s, (a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2)) * s, (a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1)) * s },
+			{ c01 * s, (a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0)) * s, (a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2)) * s },
+			{ c02 * s, (a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1)) * s, (a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0)) * s },
+		};
+		Matrix4 inverse{};
+		for (int row = 0; row < 3; row++) {
+			for (int column = 0; column < 3; column++) {
+				inverse[column * 4 + row] = r[row][column];
+			}
+			inverse[12 + row] = -(r[row][0] * a(0, 3) + r[row][1] * a(1, 3) + r[row][2] * a(2, 3));
+		}
+		inverse[15] = 1.0;
+		return inverse;
+	}
+
+private:
+	struct Instance {
+		std::shared_ptr<const TriangleBvh> mesh;
+		Matrix4 transform;
+		Matrix4 inverse;
+	};
+
+	std::vector<Instance> instances;
+	std::vector<const TriangleBvh*> previous;
+	Bvh top;
+};
@@ -22,8 +22,8 @@ public:
 #define REGISTER_VISITOR(__visitor__, __nodetype__, __method__)									\
 {																								\
 	static bool once = []() {																	\
-		__visitor__.register_callback<__nodetype__>([](__nodetype__* self)	 {					\
-			self->__method__(&__visitor__);														\
+		visitors::__visitor__.register_callback<__nodetype__>([](__nodetype__* self, auto* visitor) {	\
+			self->__method__(visitor);															\
 		});																						\
 		return true;																			\
 	}();																						\
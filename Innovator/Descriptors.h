@@ -0,0 +1,460 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+// Cache keys and pool bookkeeping for descriptor sets, layouts and pipeline layouts. Vulkan
+// handles and enums are stored as plain integers so everything here can be tested without a GPU.
+
+inline size_t HashCombine(size_t seed, uint64_t value)
+{
+	// 64 bit variant of boost::hash_combine
+	value *= 0x9e3779b97f4a7c15ull;
+	value ^= value >> 32;
+	return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+struct DescriptorBindingKey {
+	uint32_t binding;
+	uint32_t type;
+	uint32_t count;
+	uint32_t stages;
+
+	auto tie() const { return std::tie(binding, type, count, stages); }
+	bool operator==(const DescriptorBindingKey& other) const { return this->tie() == other.tie(); }
+	bool operator<(const DescriptorBindingKey& other) const { return this->tie() < other.tie(); }
+};
+
+// the bindings of a descriptor set layout, in binding order
+class DescriptorLayoutKey {
+public:
+	explicit DescriptorLayoutKey(std::vector<DescriptorBindingKey> bindings) :
+		bindings(std::move(bindings))
+	{
+		std::sort(this->bindings.begin(), this->bindings.end());
+	}
+
+	size_t hash() const
+	{
+		size_t seed = this->bindings.size();
+		for (auto& binding : this->bindings) {
+			seed = HashCombine(seed, binding.binding);
+			seed = HashCombine(seed, binding.type);
+			seed = HashCombine(seed, binding.count);
+			seed = HashCombine(seed, binding.stages);
+		}
+		return seed;
+	}
+
+	// descriptors of each type a set with this layout needs
+	std::map<uint32_t, uint32_t> descriptorCounts() const
+	{
+		std::map<uint32_t, uint32_t> counts;
+		for (auto& binding : this->bindings) {
+			counts[binding.type] += binding.count;
+		}
+		return counts;
+	}
+
+	bool operator==(const DescriptorLayoutKey& other) const { return this->bindings == other.bindings; }
+
+	std::vector<DescriptorBindingKey> bindings;
+};
+
+struct PushConstantKey {
+	uint32_t stages;
+	uint32_t offset;
+	uint32_t size;
+
+	auto tie() const { return std::tie(stages, offset, size); }
+	bool operator==(const PushConstantKey& other) const { return this->tie() == other.tie(); }
+};
+
+// set layouts in set order, push constant ranges as given since their order is part of the layout
+class PipelineLayoutKey {
+public:
+	PipelineLayoutKey(std::vector<uint64_t> set_layouts, std::vector<PushConstantKey> push_constants) :
+		set_layouts(std::move(set_layouts)),
+		push_constants(std::move(push_constants))
+	{}
+
+	size_t hash() const
+	{
+		size_t seed = HashCombine(this->set_layouts.size(), this->push_constants.size());
+		for (uint64_t layout : this->set_layouts) {
+			seed = HashCombine(seed, layout);
+		}
+		for (auto& range : this->push_constants) {
+			seed = HashCombine(seed, range.stages);
+			seed = HashCombine(seed, range.offset);
+			seed = HashCombine(seed, range.size);
+		}
+		return seed;
+	}
+
+	bool operator==(const PipelineLayoutKey& other) const
+	{
+		return this->set_layouts == other.set_layouts && this->push_constants == other.push_constants;
+	}
+
+	std::vector<uint64_t> set_layouts;
+	std::vector<PushConstantKey> push_constants;
+};
+
+// what one binding of a descriptor set points at
+struct DescriptorResourceKey {
+	uint32_t binding;
+	uint32_t type;
+	uint64_t buffer{ 0 };
+	uint64_t offset{ 0 };
+	uint64_t range{ 0 };
+	uint64_t sampler{ 0 };
+	uint64_t view{ 0 };
+	uint32_t image_layout{ 0 };
+	std::vector<uint64_t> acceleration_structures{};
+
+	auto tie() const { return std::tie(binding, type, buffer, offset, range, sampler, view, image_layout, acceleration_structures); }
+	bool operator==(const DescriptorResourceKey& other) const { return this->tie() == other.tie(); }
+	bool operator<(const DescriptorResourceKey& other) const { return this->tie() < other.tie(); }
+};
+
+// a descriptor set is identified by its layout and the resources bound to it
+class DescriptorSetKey {
+public:
+	DescriptorSetKey(uint64_t layout, std::vector<DescriptorResourceKey> resources) :
+		layout(layout),
+		resources(std::move(resources))
+	{
+		std::sort(this->resources.begin(), this->resources.end());
+	}
+
+	size_t hash() const
+	{
+		size_t seed = HashCombine(this->resources.size(), this->layout);
+		for (auto& resource : this->resources) {
+			seed = HashCombine(seed, resource.binding);
+			seed = HashCombine(seed, resource.type);
+			seed = HashCombine(seed, resource.buffer);
+			seed = HashCombine(seed, resource.offset);
+			seed = HashCombine(seed, resource.range);
+			seed = HashCombine(seed, resource.sampler);
+			seed = HashCombine(seed, resource.view);
+			seed = HashCombine(seed, resource.image_layout);
+			for (uint64_t as : resource.acceleration_structures) {
+				seed = HashCombine(seed, as);
+			}
+		}
+		return seed;
+	}
+
+	bool operator==(const DescriptorSetKey& other) const
+	{
+		return this->layout == other.layout && this->resources == other.resources;
+	}
+
+	// whether any of the handles is bound to the set
+	bool refers(const std::unordered_set<uint64_t>& handles) const
+	{
+		auto found = [&](uint64_t handle) { return handle && handles.contains(handle); };
+		for (auto& resource : this->resources) {
+			if (found(resource.buffer) || found(resource.sampler) || found(resource.view) ||
+				std::any_of(resource.acceleration_structures.begin(), resource.acceleration_structures.end(), found)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t layout;
+	std::vector<DescriptorResourceKey> resources;
+};
+
+struct KeyHash {
+	template <typename Key>
+	size_t operator()(const Key& key) const
+	{
+		return key.hash();
+	}
+};
+
+// Shared objects by key. An entry stays cached as long as someone holds it, prune() drops
+// the entries only the cache refers to.
+template <typename Key, typename T>
+class ObjectCache {
+public:
+	std::shared_ptr<T> get(const Key& key, const std::function<std::shared_ptr<T>()>& create)
+	{
+		auto it = this->entries.find(key);
+		if (it != this->entries.end()) {
+			this->hits++;
+			return it->second;
+		}
+		this->misses++;
+		auto object = create();
+		this->entries.emplace(key, object);
+		return object;
+	}
+
+	size_t prune()
+	{
+		return std::erase_if(this->entries, [](const auto& entry) {
+			return entry.second.use_count() == 1;
+			});
+	}
+
+	// drops the entries whose keys match, whoever else holds them
+	template <typename Predicate>
+	size_t evict(Predicate predicate)
+	{
+		return std::erase_if(this->entries, [&](const auto& entry) {
+			return predicate(entry.first);
+			});
+	}
+
+	void clear()
+	{
+		this->entries.clear();
+	}
+
+	size_t size() const
+	{
+		return this->entries.size();
+	}
+
+	uint64_t hits{ 0 };
+	uint64_t misses{ 0 };
+
+private:
+	std::unordered_map<Key, std::shared_ptr<T>, KeyHash> entries;
+};
+
+// Handles of resources destroyed since the descriptor cache last looked. The device may hand
+// the same handle to a new resource, sets written for the old one must not be found for it.
+// Resources are destroyed on any thread, the cache takes the handles on its own.
+class DestroyedHandles {
+public:
+	void add(uint64_t handle)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->handles.insert(handle);
+	}
+
+	std::unordered_set<uint64_t> take()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return std::exchange(this->handles, {});
+	}
+
+private:
+	std::mutex mutex;
+	std::unordered_set<uint64_t> handles;
+};
+
+// Descriptor pools that grow on demand. Each new pool holds twice the sets of the previous
+// one up to max_sets, with room for as many descriptors of each type as the sets allocated
+// so far needed on average. Pools are identified by the handle returned by CreatePool.
+class DescriptorPoolChain {
+public:
+	typedef std::map<uint32_t, uint32_t> Counts;
+	typedef std::function<uint64_t(uint32_t max_sets, const Counts& sizes)> CreatePool;
+	typedef std::function<void(uint64_t pool)> DestroyPool;
+
+	DescriptorPoolChain() = delete;
+
+	DescriptorPoolChain(
+		CreatePool create_pool,
+		DestroyPool destroy_pool,
+		uint32_t initial_sets = 32,
+		uint32_t max_sets = 1024) :
+		create_pool(std::move(create_pool)),
+		destroy_pool(std::move(destroy_pool)),
+		initial_sets(std::max<uint32_t>(initial_sets, 1)),
+		max_sets(std::max(max_sets, initial_sets))
+	{}
+
+	~DescriptorPoolChain()
+	{
+		for (auto& pool : this->pools) {
+			this->destroy_pool(pool.handle);
+		}
+	}
+
+	// pool that has room for one more set with the given descriptor counts
+	uint64_t acquire(const Counts& counts)
+	{
+		this->requested_sets++;
+		for (auto& [type, count] : counts) {
+			this->requested[type] += count;
+		}
+
+		// the newest pool is the most likely to have room
+		for (auto it = this->pools.rbegin(); it != this->pools.rend(); ++it) {
+			if (it->fits(counts)) {
+				it->take(counts);
+				return it->handle;
+			}
+		}
+
+		uint32_t sets = this->pools.empty() ? this->initial_sets :
+			std::min(this->pools.back().max_sets * 2, this->max_sets);
+
+		Counts sizes;
+		for (auto& [type, total] : this->requested) {
+			uint64_t average = (uint64_t(total) + this->requested_sets - 1) / this->requested_sets;
+			sizes[type] = static_cast<uint32_t>(average * sets);
+		}
+		for (auto& [type, count] : counts) {
+			sizes[type] = std::max(sizes[type], count);
+		}
+
+		Pool pool{
+			.handle = this->create_pool(sets, sizes),
+			.max_sets = sets,
+			.free_sets = sets,
+			.free = sizes,
+		};
+		pool.take(counts);
+		this->pools.push_back(pool);
+		return pool.handle;
+	}
+
+	// The device failed to allocate from a pool the counts said had room, i.e. it is fragmented.
+	// The set is given back and the pool is skipped until it drains.
+	void failed(uint64_t handle, const Counts& counts)
+	{
+		auto it = this->find(handle);
+		it->give(counts);
+		if (it->empty()) {
+			throw std::runtime_error("DescriptorPoolChain: allocation failed from an empty pool");
+		}
+		it->exhausted = true;
+	}
+
+	// a set allocated from the pool was freed. Empty pools are destroyed unless it's the last one.
+	void release(uint64_t handle, const Counts& counts)
+	{
+		auto it = this->find(handle);
+		it->give(counts);
+		if (it->empty()) {
+			it->exhausted = false;
+			if (this->pools.size() > 1) {
+				this->destroy_pool(it->handle);
+				this->pools.erase(it);
+			}
+		}
+	}
+
+	size_t poolCount() const
+	{
+		return this->pools.size();
+	}
+
+	uint32_t setCount() const
+	{
+		uint32_t count = 0;
+		for (auto& pool : this->pools) {
+			count += pool.max_sets - pool.free_sets;
+		}
+		return count;
+	}
+
+	uint32_t capacity() const
+	{
+		uint32_t count = 0;
+		for (auto& pool : this->pools) {
+			count += pool.max_sets;
+		}
+		return count;
+	}
+
+private:
+	struct Pool {
+		uint64_t handle;
+		uint32_t max_sets;
+		uint32_t free_sets;
+		Counts free;
+		bool exhausted{ false };
+
+		bool fits(const Counts& counts) const
+		{
+			if (this->exhausted || this->free_sets == 0) {
+				return false;
+			}
+			for (auto& [type, count] : counts) {
+				auto it = this->free.find(type);
+				if (count > 0 && (it == this->free.end() || it->second < count)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void take(const Counts& counts)
+		{
+			this->free_sets--;
+			for (auto& [type, count] : counts) {
+				this->free[type] -= count;
+			}
+		}
+
+		void give(const Counts& counts)
+		{
+			this->free_sets++;
+			for (auto& [type, count] : counts) {
+				this->free[type] += count;
+			}
+		}
+
+		bool empty() const
+		{
+			return this->free_sets == this->max_sets;
+		}
+	};
+
+	std::vector<Pool>::iterator find(uint64_t handle)
+	{
+		auto it = std::find_if(this->pools.begin(), this->pools.end(), [handle](const Pool& pool) {
+			return pool.handle == handle;
+			});
+		if (it == this->pools.end()) {
+			throw std::invalid_argument("DescriptorPoolChain: unknown pool");
+		}
+		return it;
+	}
+
+	CreatePool create_pool;
+	DestroyPool destroy_pool;
+	uint32_t initial_sets;
+	uint32_t max_sets;
+	uint32_t requested_sets{ 0 };
+	Counts requested;
+	std::vector<Pool> pools;
+};
+
+struct DescriptorCacheStats {
+	size_t layouts{ 0 };
+	size_t pipeline_layouts{ 0 };
+	size_t sets{ 0 };
+	size_t pools{ 0 };
+	uint64_t hits{ 0 };
+	uint64_t misses{ 0 };
+
+	void print(std::ostream& out) const
+	{
+		out << "descriptor cache: " << this->layouts << " set layouts, "
+			<< this->pipeline_layouts << " pipeline layouts, "
+			<< this->sets << " sets in " << this->pools << " pools, "
+			<< this->hits << " hits, " << this->misses << " misses" << std::endl;
+	}
+};
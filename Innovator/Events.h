@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <functional>
+
+enum EventType : uint32_t {
+	MOUSE_PRESS = 1 << 0,
+	MOUSE_RELEASE = 1 << 1,
+	// the pointer moved with a button pressed
+	MOUSE_DRAG = 1 << 2,
+	KEY_PRESS = 1 << 3,
+};
+
+struct EventStats {
+	uint64_t events{ 0 };
+	uint64_t dispatches{ 0 };
+	uint64_t handlers{ 0 };
+	uint64_t merged{ 0 };
+
+	void print(std::ostream& stream) const
+	{
+		stream << "Events: " << this->events
+			<< " in " << this->dispatches << " dispatches to "
+			<< this->handlers << " handlers, "
+			<< this->merged << " drags merged" << std::endl;
+	}
+};
+
+
+// Sends input events straight to the handlers that subscribed to their type, in the order they
+// subscribed, instead of through a traversal of the scene. Drags are not sent as they come: the
+// pointer position is recorded, and flush() sends one drag from where the pointer was at the
+// last flush to where it is. The renderer flushes once per frame. Presses and releases flush
+// first, so a drag always ends where the button was released.
+class EventRouter {
+public:
+	typedef std::function<void()> Handler;
+
+	void subscribe(uint32_t types, Handler handler)
+	{
+		this->subscribers.push_back({ types, std::move(handler) });
+	}
+
+	// the handlers are for nodes of a scene, and subscribe again when the scene has changed
+	void clear()
+	{
+		this->subscribers.clear();
+	}
+
+	size_t subscriberCount(EventType type) const
+	{
+		size_t count = 0;
+		for (auto& subscriber : this->subscribers) {
+			count += (subscriber.types & type) ? 1 : 0;
+		}
+		return count;
+	}
+
+	void mousePressed(double x, double y, int button)
+	{
+		this->flush();
+		this->stats.events++;
+		this->press = true;
+		this->button = button;
+		this->position = { x, y };
+		this->dispatch(MOUSE_PRESS);
+		this->previous = this->position;
+	}
+
+	void mouseReleased()
+	{
+		this->flush();
+		this->stats.events++;
+		this->press = false;
+		this->dispatch(MOUSE_RELEASE);
+		this->previous = this->position;
+	}
+
+	void mouseMoved(double x, double y)
+	{
+		this->stats.events++;
+		this->position = { x, y };
+		if (!this->press) {
+			this->previous = this->position;
+			return;
+		}
+		this->stats.merged += this->dragging ? 1 : 0;
+		this->dragging = true;
+	}
+
+	void keyPressed(int key)
+	{
+		this->flush();
+		this->stats.events++;
+		this->key = key;
+		this->dispatch(KEY_PRESS);
+	}
+
+	// sends the drag since the last flush, returns whether there was one
+	bool flush()
+	{
+		if (!this->dragging) {
+			return false;
+		}
+		this->dragging = false;
+		this->dispatch(MOUSE_DRAG);
+		this->previous = this->position;
+		return true;
+	}
+
+	// whether a drag waits for the next flush
+	bool pending() const
+	{
+		return this->dragging;
+	}
+
+	// what handlers see: the pointer now and at the last event sent, the button and key
+	std::array<double, 2> position{ 0.0, 0.0 };
+	std::array<double, 2> previous{ 0.0, 0.0 };
+	bool press{ false };
+	int button{ 0 };
+	int key{ 0 };
+	EventStats stats;
+
+private:
+	void dispatch(EventType type)
+	{
+		this->stats.dispatches++;
+		for (auto& subscriber : this->subscribers) {
+			if (subscriber.types & type) {
+				this->stats.handlers++;
+				subscriber.handler();
+			}
+		}
+	}
+
+	struct Subscriber {
+		uint32_t types;
+		Handler handler;
+	};
+
+	std::vector<Subscriber> subscribers;
+	bool dragging{ false };
+};
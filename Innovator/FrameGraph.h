@@ -0,0 +1,289 @@
+#pragma once
+
+#include <Innovator/Frames.h>
+#include <Innovator/VulkanAPI.h>
+#include <Innovator/RenderGraph.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <optional>
+
+// The device side of the render graph. The scene declares its passes and the images they use
+// each time it is allocated, the graph places the transient images in memory it allocates, and
+// each pass records the barriers the graph inferred ahead of its commands.
+class FrameGraph {
+public:
+	FrameGraph() = delete;
+
+	FrameGraph(std::shared_ptr<VulkanDevice> device, std::shared_ptr<FrameRing> frames) :
+		device(std::move(device)),
+		frames(std::move(frames))
+	{}
+
+	~FrameGraph() = default;
+
+	// before the scene declares the frame again
+	void clear()
+	{
+		this->graph = RenderGraph();
+		this->passes.clear();
+		this->resources.clear();
+		this->images.clear();
+		this->ranges.clear();
+		this->current.reset();
+	}
+
+	// the uses that follow are of this pass, recorded by its owner
+	void pass(const void* owner, std::string name)
+	{
+		this->current = this->graph.pass(std::move(name));
+		this->passes[owner] = *this->current;
+	}
+
+	// an image whose contents only live within the frame, placed in memory the graph allocates
+	void transient(VkImage image, const VkImageSubresourceRange& range, std::string name, const VkMemoryRequirements& requirements)
+	{
+		uint32_t type = this->device->physical_device.getMemoryTypeIndex(
+			requirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		this->add(image, range, this->graph.transient(std::move(name), { requirements.size, requirements.alignment, type }));
+	}
+
+	// an image the graph does not own, left in the final layout at the end of the frame
+	size_t import(VkImage image, const VkImageSubresourceRange& range, std::string name, VkImageLayout initial, VkImageLayout final)
+	{
+		size_t resource = this->graph.import(std::move(name), ToLayout(initial), ToLayout(final));
+		this->add(image, range, resource);
+		return resource;
+	}
+
+	void use(VkImage image, RenderGraph::Usage usage, std::optional<VkImageLayout> after = std::nullopt)
+	{
+		auto it = this->resources.find(image);
+		if (it == this->resources.end()) {
+			throw std::invalid_argument("FrameGraph: image is not declared");
+		}
+		this->use(it->second, usage, after);
+	}
+
+	void use(size_t resource, RenderGraph::Usage usage, std::optional<VkImageLayout> after = std::nullopt)
+	{
+		if (!this->current) {
+			throw std::logic_error("FrameGraph: image used outside of a pass");
+		}
+		std::optional<RenderGraph::Layout> layout;
+		if (after) {
+			layout = ToLayout(*after);
+		}
+		this->graph.use(*this->current, resource, usage, layout);
+	}
+
+	// an imported image that is replaced after it is declared, such as the swapchain images
+	void image(size_t resource, VkImage image)
+	{
+		this->images[resource] = image;
+	}
+
+	// infers the barriers, and allocates memory for the transient images
+	void compile()
+	{
+		this->plan = this->graph.compile();
+		for (auto& heap : this->heaps) {
+			this->frames->retire(std::move(heap));
+		}
+		this->heaps.clear();
+		for (auto& heap : this->plan.heaps) {
+			VkMemoryRequirements requirements{
+				.size = heap.size,
+				.alignment = heap.alignment,
+				.memoryTypeBits = 1u << heap.type,
+			};
+			this->heaps.push_back(std::make_shared<VulkanMemoryAllocation>(
+				this->device,
+				requirements,
+				heap.type,
+				MemoryAllocator::ResourceKind::OPTIMAL));
+		}
+	}
+
+	// the memory a transient image is placed in, and where in it
+	std::pair<std::shared_ptr<VulkanMemoryAllocation>, VkDeviceSize> memory(VkImage image) const
+	{
+		auto it = this->resources.find(image);
+		if (it == this->resources.end() || !this->plan.placements[it->second]) {
+			throw std::invalid_argument("FrameGraph: image is not a transient used by a pass");
+		}
+		const RenderGraph::Placement& placement = *this->plan.placements[it->second];
+		return { this->heaps[placement.heap], placement.offset };
+	}
+
+	bool declared(const void* owner) const
+	{
+		return this->passes.contains(owner);
+	}
+
+	bool declared(VkImage image) const
+	{
+		return this->resources.contains(image);
+	}
+
+	// the barriers before the pass of the owner
+	void record(const void* owner, VulkanCommandBuffers* command, size_t buffer_index = 0)
+	{
+		this->record(this->plan.barriers[this->passes.at(owner)], command, buffer_index);
+	}
+
+	// after the commands of the pass of the owner, the transitions at the end of the frame if it is the last
+	void finish(const void* owner, VulkanCommandBuffers* command, size_t buffer_index = 0)
+	{
+		if (this->passes.at(owner) + 1 == this->graph.passCount()) {
+			this->record(this->plan.barriers.back(), command, buffer_index);
+		}
+	}
+
+	void print(std::ostream& stream) const
+	{
+		size_t barriers = 0;
+		for (auto& pass : this->plan.barriers) {
+			barriers += pass.size();
+		}
+		stream << "Render graph: " << this->graph.passCount() << " passes, "
+			<< barriers << " image barriers, "
+			<< this->plan.transient_bytes / 1024 << " KB of transient images in "
+			<< this->plan.heap_bytes / 1024 << " KB" << std::endl;
+	}
+
+	RenderGraph::Plan plan;
+
+private:
+	void add(VkImage image, const VkImageSubresourceRange& range, size_t resource)
+	{
+		if (image) {
+			this->resources[image] = resource;
+		}
+		this->images.push_back(image);
+		this->ranges.push_back(range);
+	}
+
+	void record(const std::vector<RenderGraph::Barrier>& barriers, VulkanCommandBuffers* command, size_t buffer_index)
+	{
+		if (barriers.empty()) {
+			return;
+		}
+		VkPipelineStageFlags src_stages = 0;
+		VkPipelineStageFlags dst_stages = 0;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		for (auto& barrier : barriers) {
+			src_stages |= barrier.src ? Stages(barrier.src) : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			dst_stages |= barrier.dst ? Stages(barrier.dst) : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			image_barriers.push_back(VulkanImage::MemoryBarrier(
+				this->images[barrier.resource],
+				Access(barrier.src & RenderGraph::WRITES),
+				Access(barrier.dst),
+				ToImageLayout(barrier.old_layout),
+				ToImageLayout(barrier.new_layout),
+				this->ranges[barrier.resource]));
+		}
+		command->pipelineBarrier(src_stages, dst_stages, image_barriers, buffer_index);
+	}
+
+	static VkPipelineStageFlags Stages(uint32_t usage)
+	{
+		VkPipelineStageFlags stages = 0;
+		if (usage & RenderGraph::COLOR_ATTACHMENT) {
+			stages |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		}
+		if (usage & (RenderGraph::DEPTH_ATTACHMENT | RenderGraph::DEPTH_READ)) {
+			stages |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		}
+		if (usage & RenderGraph::INPUT_ATTACHMENT) {
+			stages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		}
+		if (usage & (RenderGraph::SAMPLED | RenderGraph::STORAGE_READ | RenderGraph::STORAGE_WRITE)) {
+			stages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
+		if (usage & (RenderGraph::TRANSFER_SRC | RenderGraph::TRANSFER_DST)) {
+			stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		if (usage & RenderGraph::PRESENT) {
+			stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		}
+		return stages;
+	}
+
+	static VkAccessFlags Access(uint32_t usage)
+	{
+		VkAccessFlags access = 0;
+		if (usage & RenderGraph::COLOR_ATTACHMENT) {
+			access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		}
+		if (usage & RenderGraph::DEPTH_ATTACHMENT) {
+			access |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+		if (usage & RenderGraph::DEPTH_READ) {
+			access |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+		if (usage & RenderGraph::INPUT_ATTACHMENT) {
+			access |= VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		}
+		if (usage & (RenderGraph::SAMPLED | RenderGraph::STORAGE_READ)) {
+			access |= VK_ACCESS_SHADER_READ_BIT;
+		}
+		if (usage & RenderGraph::STORAGE_WRITE) {
+			access |= VK_ACCESS_SHADER_WRITE_BIT;
+		}
+		if (usage & RenderGraph::TRANSFER_SRC) {
+			access |= VK_ACCESS_TRANSFER_READ_BIT;
+		}
+		if (usage & RenderGraph::TRANSFER_DST) {
+			access |= VK_ACCESS_TRANSFER_WRITE_BIT;
+		}
+		return access;
+	}
+
+	static RenderGraph::Layout ToLayout(VkImageLayout layout)
+	{
+		switch (layout) {
+		case VK_IMAGE_LAYOUT_UNDEFINED: return RenderGraph::Layout::UNDEFINED;
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return RenderGraph::Layout::COLOR_ATTACHMENT;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return RenderGraph::Layout::DEPTH_ATTACHMENT;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return RenderGraph::Layout::DEPTH_READ_ONLY;
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return RenderGraph::Layout::SHADER_READ_ONLY;
+		case VK_IMAGE_LAYOUT_GENERAL: return RenderGraph::Layout::GENERAL;
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return RenderGraph::Layout::TRANSFER_SRC;
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return RenderGraph::Layout::TRANSFER_DST;
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return RenderGraph::Layout::PRESENT;
+		default: throw std::invalid_argument("FrameGraph: unsupported image layout");
+		}
+	}
+
+	static VkImageLayout ToImageLayout(RenderGraph::Layout layout)
+	{
+		switch (layout) {
+		case RenderGraph::Layout::COLOR_ATTACHMENT: return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		case RenderGraph::Layout::DEPTH_ATTACHMENT: return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		case RenderGraph::Layout::DEPTH_READ_ONLY: return VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		case RenderGraph::Layout::SHADER_READ_ONLY: return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		case RenderGraph::Layout::GENERAL: return VK_IMAGE_LAYOUT_GENERAL;
+		case RenderGraph::Layout::TRANSFER_SRC: return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		case RenderGraph::Layout::TRANSFER_DST: return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		case RenderGraph::Layout::PRESENT: return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		default: return VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	std::shared_ptr<FrameRing> frames;
+
+	RenderGraph graph;
+	std::optional<size_t> current;
+	std::map<const void*, size_t> passes;
+	std::map<VkImage, size_t> resources;
+	std::vector<VkImage> images;
+	std::vector<VkImageSubresourceRange> ranges;
+	std::vector<std::shared_ptr<VulkanMemoryAllocation>> heaps;
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Innovator/State.h>
+#include <Innovator/Retire.h>
+#include <Innovator/VulkanAPI.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+class FrameStats {
+public:
+	void record(double cpu_ms, double wait_ms, bool signaled)
+	{
+		this->frames++;
+		this->cpu_ms += cpu_ms;
+		this->wait_ms += wait_ms;
+		this->signaled += signaled ? 1 : 0;
+
+		if (this->report_interval && this->frames % this->report_interval == 0) {
+			this->print(std::cout);
+			this->reset();
+		}
+	}
+
+	void reset()
+	{
+		this->frames = 0;
+		this->cpu_ms = 0.0;
+		this->wait_ms = 0.0;
+		this->signaled = 0;
+	}
+
+	// overlap is the fraction of CPU frame time not spent blocked on the GPU,
+	// i.e. 100% means the CPU never had to wait for a frame slot to retire.
+	double overlap() const
+	{
+		return (this->cpu_ms > 0.0) ? 1.0 - std::min(this->wait_ms / this->cpu_ms, 1.0) : 0.0;
+	}
+
+	void print(std::ostream& stream) const
+	{
+		if (!this->frames) {
+			return;
+		}
+		stream << "Frames: " << this->frames
+			<< " cpu: " << this->cpu_ms / this->frames << " ms"
+			<< " wait: " << this->wait_ms / this->frames << " ms"
+			<< " overlap: " << this->overlap() * 100.0 << "%"
+			<< " gpu ahead: " << this->signaled << "/" << this->frames << std::endl;
+	}
+
+	uint64_t report_interval{ 0 };
+	uint64_t frames{ 0 };
+	uint64_t signaled{ 0 };
+	double cpu_ms{ 0.0 };
+	double wait_ms{ 0.0 };
+};
+
+
+class FrameContext {
+public:
+	FrameContext() = delete;
+
+	explicit FrameContext(std::shared_ptr<VulkanDevice> device) :
+		fence(std::make_unique<VulkanFence>(device)),
+		acquire(std::make_unique<VulkanSemaphore>(device)),
+		release(std::make_unique<VulkanSemaphore>(device))
+	{}
+
+	// anything that must outlive the GPU work of this frame
+	void keepAlive(std::shared_ptr<void> object)
+	{
+		this->transients.push_back(std::move(object));
+	}
+
+	std::unique_ptr<VulkanFence> fence;
+	std::unique_ptr<VulkanSemaphore> acquire;
+	std::unique_ptr<VulkanSemaphore> release;
+	std::vector<std::shared_ptr<void>> transients;
+	uint64_t serial{ 0 };
+	bool submitted{ true };
+};
+
+
+class FrameRing {
+public:
+	class Scope {
+	public:
+		Scope(FrameRing* ring, State* state, VkQueue queue) :
+			ring(ring),
+			queue(queue)
+		{
+			state->frame_index = this->ring->begin();
+		}
+
+		// runs while an exception thrown by the frame unwinds, so it must not throw
+		~Scope()
+		{
+			try {
+				this->ring->end(this->queue);
+			}
+			catch (std::exception& e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+
+		FrameRing* ring;
+		VkQueue queue;
+	};
+
+	FrameRing() = delete;
+
+	FrameRing(std::shared_ptr<VulkanDevice> device, uint32_t depth = 2) :
+		device(std::move(device))
+	{
+		if (depth < 1 || depth > 3) {
+			throw std::invalid_argument("FrameRing: frames in flight must be 1, 2 or 3");
+		}
+		for (uint32_t i = 0; i < depth; i++) {
+			this->frames.push_back(std::make_unique<FrameContext>(this->device));
+		}
+	}
+
+	~FrameRing()
+	{
+		try {
+			this->wait();
+		}
+		catch (VkException&) {}
+		this->retired.clear();
+	}
+
+	// waits until the GPU has retired the frame previously recorded in the next slot
+	uint32_t begin()
+	{
+		this->t0 = std::chrono::steady_clock::now();
+		this->index = static_cast<uint32_t>(this->serial % this->frames.size());
+
+		auto frame = this->current();
+		this->signaled = vk.GetFenceStatus(this->device->device, frame->fence->fence) == VK_SUCCESS;
+		// a frame that failed to end never had its fence submitted, there is nothing to wait for
+		if (frame->submitted) {
+			frame->fence->wait();
+		}
+		frame->fence->reset();
+		frame->transients.clear();
+
+		// frames retire in submission order, everything up to the previous frame in this slot is done
+		this->retired.collect(frame->serial);
+
+		frame->submitted = false;
+		frame->serial = ++this->serial;
+
+		this->t1 = std::chrono::steady_clock::now();
+		return this->index;
+	}
+
+	// the fence must be signaled exactly once per frame, even if nothing was submitted with it
+	void end(VkQueue queue)
+	{
+		auto frame = this->current();
+		if (!frame->submitted) {
+			THROW_ON_ERROR(vk.QueueSubmit(queue, 0, nullptr, frame->fence->fence));
+			frame->submitted = true;
+		}
+
+		auto t2 = std::chrono::steady_clock::now();
+		this->stats.record(
+			std::chrono::duration<double, std::milli>(t2 - this->t0).count(),
+			std::chrono::duration<double, std::milli>(this->t1 - this->t0).count(),
+			this->signaled);
+	}
+
+	// fence to pass along with the last submit of the current frame
+	VkFence submitFence()
+	{
+		auto frame = this->current();
+		frame->submitted = true;
+		return frame->fence->fence;
+	}
+
+	// destroy the object once every frame recorded so far has retired
+	template <typename T>
+	void retire(T object)
+	{
+		this->retired.retire(std::move(object), this->serial);
+	}
+
+	// serial of the last frame the GPU has finished, frames retire in submission order
+	uint64_t completed() const
+	{
+		uint64_t completed = this->serial;
+		for (auto& frame : this->frames) {
+			if (vk.GetFenceStatus(this->device->device, frame->fence->fence) != VK_SUCCESS) {
+				completed = std::min(completed, frame->serial - 1);
+			}
+		}
+		return completed;
+	}
+
+	void wait()
+	{
+		for (auto& frame : this->frames) {
+			if (frame->submitted) {
+				frame->fence->wait();
+			}
+		}
+	}
+
+	FrameContext* current()
+	{
+		return this->frames[this->index].get();
+	}
+
+	uint32_t depth() const
+	{
+		return static_cast<uint32_t>(this->frames.size());
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	std::vector<std::unique_ptr<FrameContext>> frames;
+	FrameStats stats;
+	RetireQueue retired;
+	uint32_t index{ 0 };
+	uint64_t serial{ 0 };
+
+private:
+	bool signaled{ false };
+	std::chrono::steady_clock::time_point t0;
+	std::chrono::steady_clock::time_point t1;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <Innovator/Frames.h>
+#include <Innovator/Staging.h>
+#include <Innovator/VulkanAPI.h>
+#include <Innovator/GeometryPool.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <functional>
+
+// The device side of the geometry pool: a vertex and an index buffer per page. Mesh data is
+// uploaded through the staging buffer, ranges are released when the frames that may draw
+// them have retired.
+class GeometryBuffers {
+public:
+	GeometryBuffers() = delete;
+
+	GeometryBuffers(
+		std::shared_ptr<VulkanDevice> device,
+		std::shared_ptr<FrameRing> frames,
+		std::shared_ptr<StagingBuffer> staging,
+		VkQueue queue,
+		uint32_t page_vertices = 1 << 20,
+		uint32_t page_indices = 1 << 22) :
+		device(std::move(device)),
+		frames(std::move(frames)),
+		staging(std::move(staging)),
+		queue(queue)
+	{
+		this->pool = std::make_unique<GeometryPool>(
+			[this](const GeometryFormat& format, uint32_t vertices, uint32_t indices) {
+				return this->createPage(format, vertices, indices);
+			},
+			[this](uint64_t page) {
+				// a page is only empty once the frames drawing from it have retired, but the
+				// secondaries recorded for them may still bind it
+				auto it = this->pages.find(page);
+				this->frames->retire(std::move(it->second.vertices));
+				this->frames->retire(std::move(it->second.indices));
+				this->pages.erase(it);
+			},
+			page_vertices,
+			page_indices);
+	}
+
+	~GeometryBuffers() = default;
+
+	GeometryPool::Handle allocate(
+		const GeometryFormat& format,
+		uint32_t vertex_count,
+		uint32_t index_count,
+		const std::function<void(char*)>& fill_vertices,
+		const std::function<void(char*)>& fill_indices)
+	{
+		this->pool->collect(this->frames->completed());
+
+		GeometryPool::Handle mesh = this->pool->allocate(format, vertex_count, index_count);
+		const GeometryPool::Range& range = this->pool->range(mesh);
+		const Page& page = this->pages.at(range.page);
+
+		this->staging->copy(
+			page.vertices->buffer->buffer,
+			VkDeviceSize(vertex_count) * format.vertex_stride,
+			fill_vertices,
+			VkDeviceSize(range.base_vertex) * format.vertex_stride);
+
+		if (index_count) {
+			this->staging->copy(
+				page.indices->buffer->buffer,
+				VkDeviceSize(index_count) * format.index_size,
+				fill_indices,
+				VkDeviceSize(range.first_index) * format.index_size);
+		}
+		return mesh;
+	}
+
+	// frames recorded so far may still draw the mesh
+	void free(GeometryPool::Handle mesh)
+	{
+		this->pool->free(mesh, this->frames->serial);
+	}
+
+	const GeometryPool::Range& range(GeometryPool::Handle mesh) const
+	{
+		return this->pool->range(mesh);
+	}
+
+	VkBuffer vertexBuffer(uint64_t page) const
+	{
+		return this->pages.at(page).vertices->buffer->buffer;
+	}
+
+	VkBuffer indexBuffer(uint64_t page) const
+	{
+		auto& indices = this->pages.at(page).indices;
+		return indices ? indices->buffer->buffer : VK_NULL_HANDLE;
+	}
+
+	// Moves meshes out of the least used page of each format, see GeometryPool::compact. Draws
+	// must be recorded again to pick up the new ranges, returns the number of meshes moved.
+	size_t compact()
+	{
+		// uploads of the meshes must be ahead of the copies in the queue
+		this->staging->flush();
+		this->pool->collect(this->frames->completed());
+		auto moves = this->pool->compact(this->frames->serial);
+		if (moves.empty()) {
+			return 0;
+		}
+
+		// the source ranges stay reserved until the frames that draw from them retire, and
+		// the destination ranges were free, so frames in flight are not disturbed
+		auto command = std::make_shared<VulkanCommandBuffers>(this->device);
+		command->begin(0, 0, 0, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+		for (auto& move : moves) {
+			const Page& src = this->pages.at(move.src.page);
+			const Page& dst = this->pages.at(move.dst.page);
+
+			VkBufferCopy vertices{
+				.srcOffset = VkDeviceSize(move.src.base_vertex) * move.format.vertex_stride,
+				.dstOffset = VkDeviceSize(move.dst.base_vertex) * move.format.vertex_stride,
+				.size = VkDeviceSize(move.src.vertex_count) * move.format.vertex_stride,
+			};
+			vk.CmdCopyBuffer(command->buffer(), src.vertices->buffer->buffer, dst.vertices->buffer->buffer, 1, &vertices);
+
+			if (move.src.index_count) {
+				VkBufferCopy indices{
+					.srcOffset = VkDeviceSize(move.src.first_index) * move.format.index_size,
+					.dstOffset = VkDeviceSize(move.dst.first_index) * move.format.index_size,
+					.size = VkDeviceSize(move.src.index_count) * move.format.index_size,
+				};
+				vk.CmdCopyBuffer(command->buffer(), src.indices->buffer->buffer, dst.indices->buffer->buffer, 1, &indices);
+			}
+		}
+
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+		};
+
+		vk.CmdPipelineBarrier(
+			command->buffer(),
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+
+		command->end();
+		command->submit(this->queue, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		this->frames->retire(std::move(command));
+
+		return moves.size();
+	}
+
+	GeometryPoolStats stats() const
+	{
+		return this->pool->stats();
+	}
+
+private:
+	struct Page {
+		std::shared_ptr<VulkanBufferObject> vertices;
+		std::shared_ptr<VulkanBufferObject> indices;
+	};
+
+	uint64_t createPage(const GeometryFormat& format, uint32_t vertices, uint32_t indices)
+	{
+		// pages take part in compaction, so they are both copy source and destination
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+		Page page{
+			.vertices = std::make_shared<VulkanBufferObject>(
+				this->device,
+				0,
+				VkDeviceSize(vertices) * format.vertex_stride,
+				usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_SHARING_MODE_EXCLUSIVE,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+			.indices = nullptr,
+		};
+		if (indices) {
+			page.indices = std::make_shared<VulkanBufferObject>(
+				this->device,
+				0,
+				VkDeviceSize(indices) * format.index_size,
+				usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_SHARING_MODE_EXCLUSIVE,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+		uint64_t handle = ++this->next_page;
+		this->pages[handle] = std::move(page);
+		return handle;
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	std::shared_ptr<FrameRing> frames;
+	std::shared_ptr<StagingBuffer> staging;
+	VkQueue queue;
+	std::map<uint64_t, Page> pages;
+	uint64_t next_page{ 0 };
+	// destroyed first, its destructor hands the pages back
+	std::unique_ptr<GeometryPool> pool;
+};
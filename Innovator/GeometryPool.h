@@ -0,0 +1,316 @@
+#pragma once
+
+#include <Innovator/Allocator.h>
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+// Vertex and index data of many meshes in a few large buffers per vertex format. A page is a
+// vertex buffer and an index buffer, meshes are sub-allocated from one page at a base vertex
+// and a first index, so draws of one format bind the same buffers and only differ in offsets.
+// This is the bookkeeping, the buffers are made and destroyed by the page callbacks.
+
+struct GeometryFormat {
+	uint32_t vertex_stride{ 0 };
+	// bytes per index, 0 for pages without an index buffer
+	uint32_t index_size{ 0 };
+
+	auto operator<=>(const GeometryFormat&) const = default;
+};
+
+struct GeometryPoolStats {
+	uint64_t pages{ 0 };
+	uint64_t meshes{ 0 };
+	uint64_t reserved_vertices{ 0 };
+	uint64_t used_vertices{ 0 };
+	uint64_t reserved_indices{ 0 };
+	uint64_t used_indices{ 0 };
+};
+
+class GeometryPool {
+public:
+	typedef uint64_t Handle;
+
+	// where a mesh lives, in vertices and indices from the start of the page buffers
+	struct Range {
+		uint64_t page{ 0 };
+		uint32_t base_vertex{ 0 };
+		uint32_t vertex_count{ 0 };
+		uint32_t first_index{ 0 };
+		uint32_t index_count{ 0 };
+	};
+
+	// the data of the mesh is to be copied from src to dst, the mesh already refers to dst
+	struct Move {
+		Handle mesh;
+		GeometryFormat format;
+		Range src;
+		Range dst;
+	};
+
+	typedef std::function<uint64_t(const GeometryFormat& format, uint32_t vertex_capacity, uint32_t index_capacity)> CreatePage;
+	typedef std::function<void(uint64_t page)> DestroyPage;
+
+	GeometryPool() = delete;
+
+	GeometryPool(
+		CreatePage create_page,
+		DestroyPage destroy_page,
+		uint32_t page_vertices = 1 << 20,
+		uint32_t page_indices = 1 << 22) :
+		create_page(std::move(create_page)),
+		destroy_page(std::move(destroy_page)),
+		page_vertices(page_vertices),
+		page_indices(page_indices)
+	{}
+
+	~GeometryPool()
+	{
+		for (auto& [format, pages] : this->formats) {
+			for (auto& page : pages) {
+				this->destroy_page(page->handle);
+			}
+		}
+	}
+
+	Handle allocate(const GeometryFormat& format, uint32_t vertex_count, uint32_t index_count)
+	{
+		if (vertex_count == 0) {
+			throw std::invalid_argument("GeometryPool: a mesh needs vertices");
+		}
+		if (index_count && !format.index_size) {
+			throw std::invalid_argument("GeometryPool: indices for a format without an index buffer");
+		}
+
+		auto& pages = this->formats[format];
+		std::optional<Range> range;
+		for (auto& page : pages) {
+			range = this->allocate(*page, vertex_count, index_count);
+			if (range) {
+				break;
+			}
+		}
+		if (!range) {
+			// meshes larger than a page get a page of their own size
+			uint32_t vertices = std::max(this->page_vertices, vertex_count);
+			uint32_t indices = format.index_size ? std::max(this->page_indices, index_count) : 0;
+			pages.push_back(std::make_unique<Page>(this->create_page(format, vertices, indices), vertices, indices));
+			range = this->allocate(*pages.back(), vertex_count, index_count);
+		}
+
+		Handle mesh = this->next_handle++;
+		this->meshes[mesh] = { format, *range };
+		return mesh;
+	}
+
+	// The ranges of the mesh are reused once collect() is called with a completed serial at
+	// or after the given one, the GPU may read them until then.
+	void free(Handle mesh, uint64_t serial = 0)
+	{
+		auto it = this->meshes.find(mesh);
+		if (it == this->meshes.end()) {
+			throw std::invalid_argument("GeometryPool: unknown mesh " + std::to_string(mesh));
+		}
+		this->defer(it->second.format, it->second.range, serial);
+		this->meshes.erase(it);
+	}
+
+	// releases ranges freed at or before the completed serial, pages left empty are destroyed
+	void collect(uint64_t completed)
+	{
+		while (!this->pending.empty() && this->pending.front().serial <= completed) {
+			auto released = this->pending.front();
+			this->pending.pop_front();
+			this->release(released.format, released.range);
+		}
+	}
+
+	// Plans moves that empty the least used page of each format into the free space of the
+	// others. The meshes refer to their new ranges right away, the caller copies the data
+	// before the next draws and the sources are released as if freed at serial.
+	std::vector<Move> compact(uint64_t serial = 0)
+	{
+		std::vector<Move> moves;
+		for (auto& [format, pages] : this->formats) {
+			if (pages.size() < 2) {
+				continue;
+			}
+			auto source = std::min_element(pages.begin(), pages.end(), [](auto& a, auto& b) {
+				return a->vertices.used() < b->vertices.used();
+				});
+			const uint64_t source_handle = (*source)->handle;
+
+			std::vector<std::pair<Handle, Range>> live;
+			for (auto& [handle, mesh] : this->meshes) {
+				if (mesh.format == format && mesh.range.page == source_handle) {
+					live.push_back({ handle, mesh.range });
+				}
+			}
+			// largest first packs better, ties in allocation order to be deterministic
+			std::sort(live.begin(), live.end(), [](auto& a, auto& b) {
+				return a.second.vertex_count != b.second.vertex_count ?
+					a.second.vertex_count > b.second.vertex_count : a.first < b.first;
+				});
+
+			std::vector<Move> planned;
+			for (auto& [handle, range] : live) {
+				std::optional<Range> dst;
+				for (auto& page : pages) {
+					// moving into an empty page gains nothing
+					if (page->handle == source_handle || page->vertices.empty()) {
+						continue;
+					}
+					dst = this->allocate(*page, range.vertex_count, range.index_count);
+					if (dst) {
+						break;
+					}
+				}
+				if (!dst) {
+					break;
+				}
+				planned.push_back({ handle, format, range, *dst });
+			}
+
+			if (planned.size() != live.size()) {
+				// the page can't be emptied, moving part of it gains nothing
+				for (auto& move : planned) {
+					this->release(format, move.dst);
+				}
+				continue;
+			}
+			for (auto& move : planned) {
+				this->meshes[move.mesh].range = move.dst;
+				this->defer(format, move.src, serial);
+			}
+			moves.insert(moves.end(), planned.begin(), planned.end());
+		}
+		return moves;
+	}
+
+	const Range& range(Handle mesh) const
+	{
+		return this->meshes.at(mesh).range;
+	}
+
+	// pages of the format, i.e. the vertex and index buffer bindings its meshes need
+	size_t pageCount(const GeometryFormat& format) const
+	{
+		auto it = this->formats.find(format);
+		return it != this->formats.end() ? it->second.size() : 0;
+	}
+
+	GeometryPoolStats stats() const
+	{
+		GeometryPoolStats stats;
+		stats.meshes = this->meshes.size();
+		for (auto& [format, pages] : this->formats) {
+			for (auto& page : pages) {
+				stats.pages++;
+				stats.reserved_vertices += page->vertices.size();
+				stats.used_vertices += page->vertices.used();
+				if (page->indices) {
+					stats.reserved_indices += page->indices->size();
+					stats.used_indices += page->indices->used();
+				}
+			}
+		}
+		return stats;
+	}
+
+private:
+	struct Page {
+		Page(uint64_t handle, uint32_t vertices, uint32_t indices) :
+			handle(handle),
+			vertices(vertices),
+			indices(indices ? std::make_unique<TlsfAllocator>(indices) : nullptr)
+		{}
+
+		uint64_t handle;
+		TlsfAllocator vertices;
+		std::unique_ptr<TlsfAllocator> indices;
+	};
+
+	struct Mesh {
+		GeometryFormat format;
+		Range range;
+	};
+
+	struct Pending {
+		uint64_t serial;
+		GeometryFormat format;
+		Range range;
+	};
+
+	// vertices and indices of a mesh come from the same page, so one binding serves both
+	std::optional<Range> allocate(Page& page, uint32_t vertex_count, uint32_t index_count)
+	{
+		auto base_vertex = page.vertices.allocate(vertex_count);
+		if (!base_vertex) {
+			return std::nullopt;
+		}
+		std::optional<uint64_t> first_index = 0;
+		if (index_count) {
+			first_index = page.indices ? page.indices->allocate(index_count) : std::nullopt;
+			if (!first_index) {
+				page.vertices.free(*base_vertex);
+				return std::nullopt;
+			}
+		}
+		return Range{
+			.page = page.handle,
+			.base_vertex = static_cast<uint32_t>(*base_vertex),
+			.vertex_count = vertex_count,
+			.first_index = static_cast<uint32_t>(*first_index),
+			.index_count = index_count,
+		};
+	}
+
+	void defer(const GeometryFormat& format, const Range& range, uint64_t serial)
+	{
+		// serials normally arrive in order, keep the queue sorted if they don't
+		auto it = std::upper_bound(this->pending.begin(), this->pending.end(), serial,
+			[](uint64_t value, const Pending& pending) { return value < pending.serial; });
+		this->pending.insert(it, { serial, format, range });
+	}
+
+	void release(const GeometryFormat& format, const Range& range)
+	{
+		auto& pages = this->formats.at(format);
+		auto it = std::find_if(pages.begin(), pages.end(), [&](auto& page) {
+			return page->handle == range.page;
+			});
+		if (it == pages.end()) {
+			throw std::invalid_argument("GeometryPool: unknown page");
+		}
+		Page& page = **it;
+		page.vertices.free(range.base_vertex);
+		if (range.index_count) {
+			page.indices->free(range.first_index);
+		}
+
+		// keep one empty page around per format to avoid allocation churn
+		if (page.vertices.empty() && pages.size() > 1) {
+			this->destroy_page(page.handle);
+			pages.erase(it);
+		}
+	}
+
+	CreatePage create_page;
+	DestroyPage destroy_page;
+	uint32_t page_vertices;
+	uint32_t page_indices;
+
+	std::map<GeometryFormat, std::vector<std::unique_ptr<Page>>> formats;
+	std::unordered_map<Handle, Mesh> meshes;
+	std::deque<Pending> pending;
+	Handle next_handle{ 1 };
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+// Pixels read back from an image of 4 bytes per pixel, rows tightly packed. The channel order
+// is that of the image format, images are compared byte by byte.
+struct Pixels {
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	std::vector<uint8_t> data;
+};
+
+// How far two images are apart: the largest difference of a channel, and the pixels where a
+// channel differs by more than the tolerance.
+struct ImageDifference {
+	uint32_t max{ 0 };
+	size_t pixels{ 0 };
+	size_t count{ 0 };
+
+	double fraction() const
+	{
+		return this->count ? static_cast<double>(this->pixels) / this->count : 0.0;
+	}
+};
+
+inline ImageDifference Compare(const Pixels& a, const Pixels& b, uint32_t tolerance)
+{
+	if (a.width != b.width || a.height != b.height) {
+		throw std::invalid_argument("Compare: images are not the same size");
+	}
+	size_t count = static_cast<size_t>(a.width) * a.height;
+	if (a.data.size() != count * 4 || b.data.size() != count * 4) {
+		throw std::invalid_argument("Compare: image is not 4 bytes per pixel");
+	}
+
+	ImageDifference difference{ .count = count };
+	for (size_t p = 0; p < count; p++) {
+		uint32_t max = 0;
+		for (size_t c = p * 4; c < p * 4 + 4; c++) {
+			max = std::max(max, static_cast<uint32_t>(std::abs(a.data[c] - b.data[c])));
+		}
+		difference.max = std::max(difference.max, max);
+		difference.pixels += max > tolerance;
+	}
+	return difference;
+}
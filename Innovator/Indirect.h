@@ -0,0 +1,224 @@
+#pragma once
+
+#include <Innovator/Bounds.h>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Draw parameters for GPU driven indexed draws. The draws of a batch share pipeline, vertex
+// and index buffers and are packed into one indirect buffer. A compute pass culls them
+// against the frustum by zeroing the instance count of draws outside it, and the batch is
+// drawn with a single vkCmdDrawIndexedIndirect. The first instance of each draw is its index
+// in the batch, so shaders can look up per draw data with gl_InstanceIndex.
+
+// mirrors VkDrawIndexedIndirectCommand
+struct DrawIndexedIndirectCommand {
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+};
+static_assert(sizeof(DrawIndexedIndirectCommand) == 20);
+
+struct IndirectDraw {
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+};
+
+// push constants of the culling shader
+struct IndirectCullConstants {
+	std::array<float, 24> planes;
+	uint32_t draw_count;
+	uint32_t output_offset;
+	// where the batch's mesh starts in shared vertex and index buffers
+	int32_t base_vertex;
+	uint32_t first_index;
+};
+static_assert(sizeof(IndirectCullConstants) == 112);
+
+class IndirectBatch {
+public:
+	// floats per draw in the bounds buffer: min.xyz, cullable, max.xyz, unused
+	static constexpr uint32_t BOUNDS_FLOATS = 8;
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+	static std::vector<DrawIndexedIndirectCommand> Commands(const std::vector<IndirectDraw>& draws)
+	{
+		std::vector<DrawIndexedIndirectCommand> commands;
+		for (auto& draw : draws) {
+			commands.push_back({
+				.indexCount = draw.index_count,
+				.instanceCount = 1,
+				.firstIndex = draw.first_index,
+				.vertexOffset = draw.vertex_offset,
+				.firstInstance = static_cast<uint32_t>(commands.size()),
+				});
+		}
+		return commands;
+	}
+
+	// bounds of the float3 positions the indices of a draw refer to
+	static BoundingBox Bounds(
+		const IndirectDraw& draw,
+		const char* indices,
+		size_t index_count,
+		uint32_t index_size,
+		const char* positions,
+		size_t position_count,
+		size_t stride,
+		size_t offset)
+	{
+		if (size_t(draw.first_index) + draw.index_count > index_count) {
+			throw std::out_of_range("IndirectBatch: draw reads past the end of the index buffer");
+		}
+		BoundingBox box;
+		for (uint32_t i = draw.first_index; i < draw.first_index + draw.index_count; i++) {
+			uint32_t index = 0;
+			if (index_size == sizeof(uint16_t)) {
+				uint16_t index16;
+				std::memcpy(&index16, indices + size_t(i) * index_size, sizeof(index16));
+				index = index16;
+			}
+			else {
+				std::memcpy(&index, indices + size_t(i) * index_size, sizeof(index));
+			}
+			int64_t vertex = int64_t(index) + draw.vertex_offset;
+			if (vertex < 0 || size_t(vertex) >= position_count) {
+				throw std::out_of_range("IndirectBatch: draw reads past the end of the vertex buffer");
+			}
+			float p[3];
+			std::memcpy(p, positions + size_t(vertex) * stride + offset, sizeof(p));
+			box.extend({ p[0], p[1], p[2] });
+		}
+		return box;
+	}
+
+	static std::vector<float> PackBounds(const std::vector<BoundingBox>& bounds)
+	{
+		std::vector<float> packed;
+		for (auto& box : bounds) {
+			bool cullable = !box.empty() && !box.infinite();
+			for (int i = 0; i < 3; i++) {
+				packed.push_back(cullable ? static_cast<float>(box.min[i]) : 0.0f);
+			}
+			packed.push_back(cullable ? 1.0f : 0.0f);
+			for (int i = 0; i < 3; i++) {
+				packed.push_back(cullable ? static_cast<float>(box.max[i]) : 0.0f);
+			}
+			packed.push_back(0.0f);
+		}
+		return packed;
+	}
+
+	// The frustum planes must be in the space of the bounds, i.e. from projection * view * model.
+	// Each frame in flight culls into its own region of the output buffer. The draws are offset
+	// by where their mesh is in a shared geometry pool page, which may change when it compacts.
+	static IndirectCullConstants Constants(
+		const Frustum& frustum,
+		uint32_t draw_count,
+		uint32_t frame,
+		int32_t base_vertex = 0,
+		uint32_t first_index = 0)
+	{
+		IndirectCullConstants constants{
+			.planes = {},
+			.draw_count = draw_count,
+			.output_offset = draw_count * frame,
+			.base_vertex = base_vertex,
+			.first_index = first_index,
+		};
+		for (size_t i = 0; i < 6; i++) {
+			for (size_t j = 0; j < 4; j++) {
+				constants.planes[i * 4 + j] = static_cast<float>(frustum.planes[i][j]);
+			}
+		}
+		return constants;
+	}
+
+	static uint32_t WorkgroupCount(uint32_t draw_count)
+	{
+		return (draw_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+	}
+
+	// what the culling shader does, in the same order and precision
+	static void Cull(
+		const std::vector<DrawIndexedIndirectCommand>& commands,
+		const std::vector<float>& bounds,
+		const IndirectCullConstants& constants,
+		DrawIndexedIndirectCommand* visible)
+	{
+		for (uint32_t i = 0; i < constants.draw_count; i++) {
+			DrawIndexedIndirectCommand command = commands[i];
+			command.firstIndex += constants.first_index;
+			command.vertexOffset += constants.base_vertex;
+			const float* box = bounds.data() + size_t(i) * BOUNDS_FLOATS;
+			if (box[3] != 0.0f) {
+				for (size_t p = 0; p < 6; p++) {
+					const float* plane = constants.planes.data() + p * 4;
+					float distance = 0.0f;
+					for (size_t j = 0; j < 3; j++) {
+						distance += plane[j] * (plane[j] > 0.0f ? box[4 + j] : box[j]);
+					}
+					if (distance + plane[3] < 0.0f) {
+						command.instanceCount = 0;
+						break;
+					}
+				}
+			}
+			visible[constants.output_offset + i] = command;
+		}
+	}
+};
+
+inline const char* IndirectCullShader = R"(
+	#version 450
+	layout(local_size_x = 64) in;
+
+	struct Command {
+		uint indexCount;
+		uint instanceCount;
+		uint firstIndex;
+		int vertexOffset;
+		uint firstInstance;
+	};
+
+	layout(std430, binding = 0) readonly buffer Commands { Command commands[]; };
+	layout(std430, binding = 1) readonly buffer Bounds { vec4 bounds[]; };
+	layout(std430, binding = 2) writeonly buffer Visible { Command visible[]; };
+
+	layout(push_constant) uniform Cull {
+		vec4 planes[6];
+		uint draw_count;
+		uint output_offset;
+		int base_vertex;
+		uint first_index;
+	};
+
+	void main()
+	{
+		uint i = gl_GlobalInvocationID.x;
+		if (i >= draw_count) {
+			return;
+		}
+		Command command = commands[i];
+		command.firstIndex += first_index;
+		command.vertexOffset += base_vertex;
+		vec4 bmin = bounds[i * 2];
+		vec4 bmax = bounds[i * 2 + 1];
+		if (bmin.w != 0.0) {
+			for (int p = 0; p < 6; p++) {
+				vec3 outer = mix(bmin.xyz, bmax.xyz, greaterThan(planes[p].xyz, vec3(0.0)));
+				if (dot(planes[p].xyz, outer) + planes[p].w < 0.0) {
+					command.instanceCount = 0;
+					break;
+				}
+			}
+		}
+		visible[output_offset + i] = command;
+	}
+)";
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Innovator/Bounds.h>
+
+#include <map>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Per instance vertex data for instanced draws. Each instance is a transform, a color and an
+// id, packed interleaved and read by the vertex shader at instance input rate as
+//
+//   layout(location = L + 0) in mat4 InstanceMatrix;   // four vec4 columns, L to L + 3
+//   layout(location = L + 4) in vec4 InstanceColor;
+//   layout(location = L + 5) in uint InstanceId;
+
+struct Instance {
+	Matrix4 transform{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	std::array<float, 4> color{ 1, 1, 1, 1 };
+	uint32_t id{ 0 };
+
+	static Instance FromTranslationScale(const Point3& translation, const Point3& scale)
+	{
+		Instance instance;
+		for (int i = 0; i < 3; i++) {
+			instance.transform[i * 4 + i] = scale[i];
+			instance.transform[12 + i] = translation[i];
+		}
+		return instance;
+	}
+};
+
+struct InstanceAttribute {
+	enum Format { VEC4, UINT };
+
+	uint32_t location;
+	uint32_t offset;
+	Format format;
+};
+
+class InstanceLayout {
+public:
+	static constexpr uint32_t STRIDE = sizeof(float) * 16 + sizeof(float) * 4 + sizeof(uint32_t);
+	static constexpr uint32_t LOCATIONS = 6;
+
+	static std::vector<InstanceAttribute> Attributes(uint32_t first_location)
+	{
+		std::vector<InstanceAttribute> attributes;
+		const uint32_t column_size = sizeof(float) * 4;
+		for (uint32_t column = 0; column < 4; column++) {
+			attributes.push_back({ first_location + column, column * column_size, InstanceAttribute::VEC4 });
+		}
+		attributes.push_back({ first_location + 4, 4 * column_size, InstanceAttribute::VEC4 });
+		attributes.push_back({ first_location + 5, 5 * column_size, InstanceAttribute::UINT });
+		return attributes;
+	}
+
+	static void Pack(const std::vector<Instance>& instances, char* dst)
+	{
+		for (auto& instance : instances) {
+			float matrix[16];
+			for (int i = 0; i < 16; i++) {
+				matrix[i] = static_cast<float>(instance.transform[i]);
+			}
+			std::memcpy(dst, matrix, sizeof(matrix));
+			std::memcpy(dst + sizeof(matrix), instance.color.data(), sizeof(float) * 4);
+			std::memcpy(dst + sizeof(matrix) + sizeof(float) * 4, &instance.id, sizeof(instance.id));
+			dst += STRIDE;
+		}
+	}
+
+	// bounds of the geometry drawn at every instance
+	static BoundingBox Bounds(const BoundingBox& geometry, const std::vector<Instance>& instances)
+	{
+		BoundingBox bounds;
+		for (auto& instance : instances) {
+			bounds.extend(geometry.transformed(instance.transform));
+		}
+		return bounds;
+	}
+};
+
+
+// Buffers to bind for a draw, as runs of consecutive bindings for vkCmdBindVertexBuffers.
+// The inputs are per vertex attribute, several attributes can read from the same binding.
+template <typename Buffer>
+struct VertexBindingRange {
+	uint32_t first_binding;
+	std::vector<Buffer> buffers{};
+	std::vector<uint64_t> offsets{};
+};
+
+template <typename Buffer>
+std::vector<VertexBindingRange<Buffer>> VertexBindingRanges(
+	const std::vector<uint32_t>& attribute_bindings,
+	const std::vector<Buffer>& buffers,
+	const std::vector<uint64_t>& offsets)
+{
+	std::map<uint32_t, std::pair<Buffer, uint64_t>> bindings;
+	for (size_t i = 0; i < attribute_bindings.size(); i++) {
+		auto [it, inserted] = bindings.emplace(attribute_bindings[i], std::make_pair(buffers[i], offsets[i]));
+		if (!inserted && it->second != std::make_pair(buffers[i], offsets[i])) {
+			throw std::invalid_argument("VertexBindingRanges: attributes of one binding read from different buffers");
+		}
+	}
+
+	std::vector<VertexBindingRange<Buffer>> ranges;
+	for (auto& [binding, buffer] : bindings) {
+		if (ranges.empty() || ranges.back().first_binding + ranges.back().buffers.size() != binding) {
+			ranges.push_back({ .first_binding = binding });
+		}
+		ranges.back().buffers.push_back(buffer.first);
+		ranges.back().offsets.push_back(buffer.second);
+	}
+	return ranges;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only view of a whole file through the OS page cache
+class MappedFile {
+public:
+	MappedFile() = delete;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	explicit MappedFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		this->file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (this->file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("MappedFile: failed to open " + path.string());
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(this->file, &size);
+		this->length = static_cast<size_t>(size.QuadPart);
+		if (this->length > 0) {
+			this->mapping = CreateFileMappingW(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!this->mapping) {
+				CloseHandle(this->file);
+				throw std::runtime_error("MappedFile: failed to map " + path.string());
+			}
+			this->view = static_cast<const char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		this->file = open(path.c_str(), O_RDONLY);
+		if (this->file < 0) {
+			throw std::runtime_error("MappedFile: failed to open " + path.string());
+		}
+		struct stat info;
+		fstat(this->file, &info);
+		this->length = static_cast<size_t>(info.st_size);
+		if (this->length > 0) {
+			void* view = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, this->file, 0);
+			if (view == MAP_FAILED) {
+				close(this->file);
+				throw std::runtime_error("MappedFile: failed to map " + path.string());
+			}
+			this->view = static_cast<const char*>(view);
+		}
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (this->view) {
+			UnmapViewOfFile(this->view);
+		}
+		if (this->mapping) {
+			CloseHandle(this->mapping);
+		}
+		CloseHandle(this->file);
+#else
+		if (this->view) {
+			munmap(const_cast<char*>(this->view), this->length);
+		}
+		close(this->file);
+#endif
+	}
+
+	const char* data() const
+	{
+		return this->view;
+	}
+
+	size_t size() const
+	{
+		return this->length;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ nullptr };
+#else
+	int file{ -1 };
+#endif
+	const char* view{ nullptr };
+	size_t length{ 0 };
+};
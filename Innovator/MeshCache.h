@@ -0,0 +1,426 @@
+#pragma once
+
+#include <Innovator/StlLoader.h>
+#include <Innovator/MappedFile.h>
+#include <Innovator/MeshOptimizer.h>
+#include <Innovator/MeshSimplifier.h>
+
+#include <span>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <filesystem>
+#include <type_traits>
+
+// A vertex attribute of a cached mesh, in the terms of VkVertexInputAttributeDescription
+struct MeshCacheAttribute {
+	uint32_t location;
+	uint32_t format;
+	uint32_t offset;
+	uint32_t reserved;
+};
+
+// where a level of detail's streams are in the file, counts in vertices and indices
+struct MeshCacheLevel {
+	uint64_t vertex_offset;
+	uint64_t vertex_count;
+	uint64_t index_offset;
+	uint64_t index_count;
+	float error;
+	uint32_t reserved;
+};
+
+// The start of a mesh cache file, followed by the level table and the streams. Everything is
+// stored in the byte order of the machine that wrote it.
+struct MeshCacheHeader {
+	static constexpr uint32_t MAX_ATTRIBUTES = 4;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t file_size;
+	// size and modification time of the file the cache was made from
+	uint64_t source_size;
+	int64_t source_time;
+	uint32_t vertex_stride;
+	uint32_t attribute_count;
+	MeshCacheAttribute attributes[MAX_ATTRIBUTES];
+	uint32_t index_type;
+	uint32_t level_count;
+	// simplification may have stopped before as many levels as were asked for
+	uint32_t requested_levels;
+	uint32_t reserved;
+	// of the positions of the full resolution mesh
+	float min[3];
+	float max[3];
+	uint64_t levels_offset;
+};
+
+static_assert(std::is_trivially_copyable_v<MeshCacheHeader> && sizeof(MeshCacheHeader) == 160);
+static_assert(std::is_trivially_copyable_v<MeshCacheLevel> && sizeof(MeshCacheLevel) == 40);
+
+// A mesh and its levels of detail laid out the way the GPU reads them, ready to be copied into
+// buffers as they are. Held in memory, or mapped from a file.
+class MeshStreams {
+public:
+	virtual ~MeshStreams() = default;
+
+	virtual const MeshCacheHeader& header() const = 0;
+	virtual std::span<const MeshCacheLevel> levels() const = 0;
+	virtual std::span<const char> vertices(size_t level) const = 0;
+	virtual std::span<const char> indices(size_t level) const = 0;
+
+	size_t levelCount() const
+	{
+		return this->levels().size();
+	}
+
+	float error(size_t level) const
+	{
+		return this->levels()[level].error;
+	}
+
+	BoundingBox bounds() const
+	{
+		const MeshCacheHeader& header = this->header();
+		if (this->levels()[0].vertex_count == 0) {
+			return BoundingBox();
+		}
+		return BoundingBox(
+			{ header.min[0], header.min[1], header.min[2] },
+			{ header.max[0], header.max[1], header.max[2] });
+	}
+};
+
+// streams built from a source mesh, before they are written
+class MeshCacheContents : public MeshStreams {
+public:
+	const MeshCacheHeader& header() const override
+	{
+		return this->file_header;
+	}
+
+	std::span<const MeshCacheLevel> levels() const override
+	{
+		return this->level_table;
+	}
+
+	std::span<const char> vertices(size_t level) const override
+	{
+		return this->vertex_data[level];
+	}
+
+	std::span<const char> indices(size_t level) const override
+	{
+		return this->index_data[level];
+	}
+
+	MeshCacheHeader file_header{};
+	std::vector<MeshCacheLevel> level_table;
+	std::vector<std::vector<char>> vertex_data;
+	std::vector<std::vector<char>> index_data;
+};
+
+// A mesh cache file mapped into memory. The header and the level table are checked against
+// the size of the file, the streams are handed out as they are, pages are read in when the
+// streams are first touched.
+class MeshCacheFile : public MeshStreams {
+public:
+	MeshCacheFile() = delete;
+	MeshCacheFile(const MeshCacheFile&) = delete;
+	MeshCacheFile& operator=(const MeshCacheFile&) = delete;
+
+	explicit MeshCacheFile(const std::filesystem::path& path);
+
+	const MeshCacheHeader& header() const override
+	{
+		return this->file_header;
+	}
+
+	std::span<const MeshCacheLevel> levels() const override
+	{
+		return this->level_table;
+	}
+
+	std::span<const char> vertices(size_t level) const override
+	{
+		const MeshCacheLevel& l = this->level_table[level];
+		return { this->file.data() + l.vertex_offset, l.vertex_count * this->file_header.vertex_stride };
+	}
+
+	std::span<const char> indices(size_t level) const override
+	{
+		const MeshCacheLevel& l = this->level_table[level];
+		return { this->file.data() + l.index_offset, l.index_count * sizeof(uint32_t) };
+	}
+
+private:
+	MappedFile file;
+	MeshCacheHeader file_header{};
+	std::vector<MeshCacheLevel> level_table;
+};
+
+// what a cache was made from, to tell when it is stale
+struct MeshSource {
+	uint64_t size{ 0 };
+	int64_t time{ 0 };
+};
+
+class MeshCache {
+public:
+	static constexpr char MAGIC[8] = { 'I', 'N', 'V', 'M', 'E', 'S', 'H', '\0' };
+	static constexpr uint32_t VERSION = 1;
+	// enough for any minStorageBufferOffsetAlignment and for the copy to stay on cache lines
+	static constexpr uint64_t STREAM_ALIGNMENT = 256;
+	// VkFormat and VkIndexType values, so the format does not need the Vulkan headers
+	static constexpr uint32_t FORMAT_R32G32B32_SFLOAT = 106;
+	static constexpr uint32_t INDEX_TYPE_UINT32 = 1;
+
+	// next to the source, bunny.stl.meshcache or bunny.stl.normals.meshcache
+	static std::filesystem::path PathFor(const std::filesystem::path& source, bool normals)
+	{
+		auto path = source;
+		path += normals ? ".normals.meshcache" : ".meshcache";
+		return path;
+	}
+
+	static MeshSource Stamp(const std::filesystem::path& source)
+	{
+		return {
+			.size = std::filesystem::file_size(source),
+			.time = static_cast<int64_t>(std::filesystem::last_write_time(source).time_since_epoch().count()),
+		};
+	}
+
+	static bool IsCurrent(const MeshCacheHeader& header, const MeshSource& source, bool normals, size_t levels)
+	{
+		return header.source_size == source.size &&
+			header.source_time == source.time &&
+			(header.attribute_count == 2) == normals &&
+			header.requested_levels >= levels;
+	}
+
+	// Simplifies the mesh into levels of detail, then orders each level's triangles for the
+	// post-transform cache and its vertices for fetch locality, dropping the vertices
+	// simplification left unused.
+	static std::unique_ptr<MeshCacheContents> Build(const StlMesh& mesh, size_t levels, std::ostream* report = nullptr)
+	{
+		std::vector<LodLevel> chain{ { .indices = mesh.indices, .error = 0.0f } };
+		if (levels > 1) {
+			chain = MeshSimplifier::LodChain(mesh.vertices.data(), mesh.vertexCount(), mesh.floatsPerVertex(), mesh.indices, levels);
+		}
+
+		auto contents = std::make_unique<MeshCacheContents>();
+		MeshCacheHeader& header = contents->file_header;
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.header_size = sizeof(MeshCacheHeader);
+		header.vertex_stride = mesh.vertexStride();
+		header.attributes[header.attribute_count++] = { .location = 0, .format = FORMAT_R32G32B32_SFLOAT, .offset = 0, .reserved = 0 };
+		if (mesh.normals) {
+			header.attributes[header.attribute_count++] = { .location = 1, .format = FORMAT_R32G32B32_SFLOAT, .offset = 3 * sizeof(float), .reserved = 0 };
+		}
+		header.index_type = INDEX_TYPE_UINT32;
+		header.level_count = static_cast<uint32_t>(chain.size());
+		header.requested_levels = static_cast<uint32_t>(std::max<size_t>(levels, 1));
+
+		for (size_t v = 0; v < mesh.vertexCount(); v++) {
+			for (size_t k = 0; k < 3; k++) {
+				float x = mesh.vertices[v * mesh.floatsPerVertex() + k];
+				header.min[k] = v ? std::min(header.min[k], x) : x;
+				header.max[k] = v ? std::max(header.max[k], x) : x;
+			}
+		}
+
+		for (size_t i = 0; i < chain.size(); i++) {
+			std::vector<uint32_t>& indices = chain[i].indices;
+			std::vector<char> vertices(mesh.vertices.size() * sizeof(float));
+			std::memcpy(vertices.data(), mesh.vertices.data(), vertices.size());
+
+			VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, mesh.vertexCount());
+			indices = MeshOptimizer::OptimizeVertexCache(indices, mesh.vertexCount());
+			size_t count = MeshOptimizer::OptimizeVertexFetch(indices, vertices.data(), mesh.vertexCount(), mesh.vertexStride());
+			vertices.resize(count * mesh.vertexStride());
+
+			if (report) {
+				VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, count);
+				*report << "level " << i << ": " << indices.size() / 3 << " triangles, error " << chain[i].error << ", ";
+				before.print(*report);
+				*report << " -> ";
+				after.print(*report);
+				*report << std::endl;
+			}
+
+			contents->level_table.push_back({
+				.vertex_offset = 0,
+				.vertex_count = count,
+				.index_offset = 0,
+				.index_count = indices.size(),
+				.error = chain[i].error,
+				.reserved = 0,
+			});
+			std::vector<char> index_bytes(indices.size() * sizeof(uint32_t));
+			std::memcpy(index_bytes.data(), indices.data(), index_bytes.size());
+			contents->vertex_data.push_back(std::move(vertices));
+			contents->index_data.push_back(std::move(index_bytes));
+		}
+		return contents;
+	}
+
+	// The header, the level table, then the vertex and index streams of each level, every
+	// stream starting on STREAM_ALIGNMENT. Written to a temporary and renamed, so readers never
+	// see a partial file.
+	static void Write(const MeshStreams& streams, const MeshSource& source, const std::filesystem::path& path)
+	{
+		MeshCacheHeader header = streams.header();
+		std::vector<MeshCacheLevel> levels(streams.levels().begin(), streams.levels().end());
+		header.source_size = source.size;
+		header.source_time = source.time;
+		header.header_size = sizeof(MeshCacheHeader);
+		header.level_count = static_cast<uint32_t>(levels.size());
+		header.levels_offset = sizeof(MeshCacheHeader);
+
+		uint64_t offset = header.levels_offset + levels.size() * sizeof(MeshCacheLevel);
+		for (auto& level : levels) {
+			level.vertex_offset = Align(offset);
+			offset = level.vertex_offset + level.vertex_count * header.vertex_stride;
+			level.index_offset = Align(offset);
+			offset = level.index_offset + level.index_count * sizeof(uint32_t);
+		}
+		header.file_size = offset;
+
+		std::ostringstream suffix;
+		suffix << ".tmp" << std::this_thread::get_id();
+		auto temporary = path;
+		temporary += suffix.str();
+		bool written = false;
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			uint64_t end = 0;
+			auto write = [&](uint64_t at, const void* data, size_t size) {
+				static const char zeros[STREAM_ALIGNMENT]{};
+				file.write(zeros, static_cast<std::streamsize>(at - end));
+				file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+				end = at + size;
+			};
+			write(0, &header, sizeof(header));
+			write(header.levels_offset, levels.data(), levels.size() * sizeof(MeshCacheLevel));
+			for (size_t i = 0; i < levels.size(); i++) {
+				write(levels[i].vertex_offset, streams.vertices(i).data(), streams.vertices(i).size());
+				write(levels[i].index_offset, streams.indices(i).data(), streams.indices(i).size());
+			}
+			file.close();
+			written = !file.fail();
+		}
+		std::error_code error;
+		if (!written) {
+			std::filesystem::remove(temporary, error);
+			throw std::runtime_error("MeshCache: failed to write " + temporary.string());
+		}
+		std::filesystem::rename(temporary, path, error);
+		if (error) {
+			std::filesystem::remove(temporary, error);
+			throw std::runtime_error("MeshCache: failed to replace " + path.string());
+		}
+	}
+
+	// Maps the cache next to the source if it is current, otherwise loads the source, builds
+	// the cache and writes it for next time. If it can not be written the streams stay in memory.
+	static std::unique_ptr<MeshStreams> Load(const std::filesystem::path& source, bool normals, size_t levels, std::ostream* report = nullptr)
+	{
+		auto path = PathFor(source, normals);
+		MeshSource stamp = Stamp(source);
+		std::error_code error;
+		if (std::filesystem::exists(path, error)) {
+			try {
+				auto file = std::make_unique<MeshCacheFile>(path);
+				if (IsCurrent(file->header(), stamp, normals, levels)) {
+					return file;
+				}
+			}
+			catch (std::runtime_error& e) {
+				if (report) {
+					*report << e.what() << ", rebuilding" << std::endl;
+				}
+			}
+		}
+
+		std::ostringstream log;
+		log << source.string() << ":" << std::endl;
+		auto contents = Build(StlLoader::Load(source, normals), levels, &log);
+		if (report) {
+			*report << log.str();
+		}
+		try {
+			Write(*contents, stamp, path);
+			return std::make_unique<MeshCacheFile>(path);
+		}
+		catch (std::exception& e) {
+			if (report) {
+				*report << e.what() << ", keeping " << source.string() << " in memory" << std::endl;
+			}
+		}
+		contents->file_header.source_size = stamp.size;
+		contents->file_header.source_time = stamp.time;
+		return contents;
+	}
+
+private:
+	static uint64_t Align(uint64_t offset)
+	{
+		return (offset + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+	}
+};
+
+inline MeshCacheFile::MeshCacheFile(const std::filesystem::path& path) :
+	file(path)
+{
+	const uint64_t size = this->file.size();
+	auto fail = [&](const std::string& reason) {
+		return std::runtime_error("MeshCacheFile: " + path.string() + " " + reason);
+	};
+	if (size < sizeof(MeshCacheHeader)) {
+		throw fail("is truncated");
+	}
+	std::memcpy(&this->file_header, this->file.data(), sizeof(MeshCacheHeader));
+	const MeshCacheHeader& header = this->file_header;
+
+	if (std::memcmp(header.magic, MeshCache::MAGIC, sizeof(header.magic)) != 0) {
+		throw fail("is not a mesh cache");
+	}
+	if (header.version != MeshCache::VERSION || header.header_size != sizeof(MeshCacheHeader)) {
+		throw fail("has version " + std::to_string(header.version) + ", expected " + std::to_string(MeshCache::VERSION));
+	}
+	if (header.file_size != size) {
+		throw fail("is truncated");
+	}
+	if (header.attribute_count == 0 || header.attribute_count > MeshCacheHeader::MAX_ATTRIBUTES ||
+		header.vertex_stride == 0 || header.index_type != MeshCache::INDEX_TYPE_UINT32) {
+		throw fail("has an unsupported vertex format");
+	}
+	if (header.level_count == 0 || header.levels_offset % alignof(MeshCacheLevel) != 0 ||
+		header.levels_offset > size || header.level_count > (size - header.levels_offset) / sizeof(MeshCacheLevel)) {
+		throw fail("has a bad level table");
+	}
+	this->level_table.resize(header.level_count);
+	std::memcpy(this->level_table.data(), this->file.data() + header.levels_offset, header.level_count * sizeof(MeshCacheLevel));
+
+	// divisions rather than products, counts from a damaged file must not overflow
+	auto inside = [&](uint64_t offset, uint64_t count, uint64_t element) {
+		return offset % MeshCache::STREAM_ALIGNMENT == 0 && offset <= size && count <= (size - offset) / element;
+	};
+	for (auto& level : this->level_table) {
+		if (!inside(level.vertex_offset, level.vertex_count, header.vertex_stride) ||
+			!inside(level.index_offset, level.index_count, sizeof(uint32_t)) ||
+			level.index_count % 3 != 0) {
+			throw fail("has a stream past the end of the file");
+		}
+	}
+}
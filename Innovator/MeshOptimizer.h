@@ -0,0 +1,285 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+
+// Transformed vertices a FIFO post-transform cache of the given size would miss, per triangle
+// (ACMR, 0.5 at best on large regular meshes, 3 without reuse) and per vertex (ATVR, 1 at best).
+struct VertexCacheStats {
+	double acmr{ 0.0 };
+	double atvr{ 0.0 };
+
+	void print(std::ostream& out) const
+	{
+		out << "ACMR " << this->acmr << ", ATVR " << this->atvr;
+	}
+};
+
+// positions in R16G16B16A16_UNORM and the matrix that maps them back
+struct QuantizedPositions {
+	// x, y, z and 0 per vertex
+	std::vector<uint16_t> positions;
+	// column major, a uniform scale so normals need no correction
+	std::array<float, 16> dequantize;
+	// largest distance of a dequantized position from the original
+	float max_error{ 0.0f };
+};
+
+// Reorders indexed triangle lists for the GPU. The triangles and their winding stay the same,
+// only the order they are drawn in and the order of the vertices in memory change.
+class MeshOptimizer {
+public:
+	static constexpr uint32_t CACHE_SIZE = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size = CACHE_SIZE)
+	{
+		// a vertex is in the cache if fewer than cache_size misses happened since it was loaded
+		std::vector<uint64_t> loaded(vertex_count, 0);
+		uint64_t misses = 0;
+		size_t used = 0;
+		for (uint32_t index : indices) {
+			if (index >= vertex_count) {
+				throw std::out_of_range("MeshOptimizer: index past the end of the vertices");
+			}
+			if (loaded[index] == 0) {
+				used++;
+			}
+			if (loaded[index] == 0 || misses - loaded[index] >= cache_size) {
+				misses++;
+				loaded[index] = misses;
+			}
+		}
+		VertexCacheStats stats;
+		if (!indices.empty()) {
+			stats.acmr = double(misses) / double(indices.size() / 3);
+			stats.atvr = double(misses) / double(used);
+		}
+		return stats;
+	}
+
+	// Tipsify (Sander, Nehab and Barczak, Fast Triangle Reordering for Vertex Locality and
+	// Reduced Overdraw, 2007): fans around vertices, moving on to the neighbour that is still
+	// in the cache and will stay in it while its remaining triangles are emitted.
+	static std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size = CACHE_SIZE)
+	{
+		if (indices.size() % 3) {
+			throw std::invalid_argument("MeshOptimizer: not a triangle list");
+		}
+		const size_t triangle_count = indices.size() / 3;
+
+		// triangles around each vertex, and how many of them are yet to be emitted
+		std::vector<uint32_t> live(vertex_count, 0);
+		for (uint32_t index : indices) {
+			if (index >= vertex_count) {
+				throw std::out_of_range("MeshOptimizer: index past the end of the vertices");
+			}
+			live[index]++;
+		}
+		std::vector<uint32_t> offsets(vertex_count + 1, 0);
+		for (size_t v = 0; v < vertex_count; v++) {
+			offsets[v + 1] = offsets[v] + live[v];
+		}
+		std::vector<uint32_t> adjacency(indices.size());
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++) {
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<uint32_t> timestamps(vertex_count, 0);
+		std::vector<uint8_t> emitted(triangle_count, 0);
+		std::vector<uint32_t> dead_ends;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		uint32_t time = cache_size + 1;
+		size_t cursor = 0;
+		int64_t fan = vertex_count ? 0 : -1;
+
+		while (fan >= 0) {
+			candidates.clear();
+			for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+				uint32_t triangle = adjacency[a];
+				if (emitted[triangle]) {
+					continue;
+				}
+				for (size_t k = 0; k < 3; k++) {
+					uint32_t v = indices[size_t(triangle) * 3 + k];
+					output.push_back(v);
+					dead_ends.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - timestamps[v] > cache_size) {
+						timestamps[v] = time++;
+					}
+				}
+				emitted[triangle] = 1;
+			}
+
+			// the candidate that is cached and stays cached while fanning around it, the one
+			// that has been in the cache the longest if there are several
+			fan = -1;
+			int64_t best = -1;
+			for (uint32_t v : candidates) {
+				if (live[v] == 0) {
+					continue;
+				}
+				int64_t priority = 0;
+				if (int64_t(time) - timestamps[v] + 2 * int64_t(live[v]) <= int64_t(cache_size)) {
+					priority = time - timestamps[v];
+				}
+				if (priority > best) {
+					best = priority;
+					fan = v;
+				}
+			}
+			if (fan < 0) {
+				fan = SkipDeadEnd(live, dead_ends, cursor);
+			}
+		}
+		return output;
+	}
+
+	// Moves the vertices into the order the indices first use them and rewrites the indices.
+	// Unused vertices are dropped, returns the number of vertices left.
+	static size_t OptimizeVertexFetch(std::vector<uint32_t>& indices, void* vertices, size_t vertex_count, size_t stride)
+	{
+		constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> remap(vertex_count, UNUSED);
+		uint32_t next = 0;
+		for (uint32_t& index : indices) {
+			if (index >= vertex_count) {
+				throw std::out_of_range("MeshOptimizer: index past the end of the vertices");
+			}
+			if (remap[index] == UNUSED) {
+				remap[index] = next++;
+			}
+			index = remap[index];
+		}
+
+		char* data = static_cast<char*>(vertices);
+		std::vector<char> copy(data, data + vertex_count * stride);
+		for (size_t v = 0; v < vertex_count; v++) {
+			if (remap[v] != UNUSED) {
+				std::memcpy(data + size_t(remap[v]) * stride, copy.data() + v * stride, stride);
+			}
+		}
+		return next;
+	}
+
+	// float xyz at the start of each vertex, stride floats apart
+	static QuantizedPositions QuantizePositions(const float* vertices, size_t vertex_count, size_t stride)
+	{
+		float min[3]{ 0, 0, 0 };
+		float max[3]{ 0, 0, 0 };
+		for (size_t v = 0; v < vertex_count; v++) {
+			for (size_t k = 0; k < 3; k++) {
+				float x = vertices[v * stride + k];
+				min[k] = v ? std::min(min[k], x) : x;
+				max[k] = v ? std::max(max[k], x) : x;
+			}
+		}
+		float scale = std::max({ max[0] - min[0], max[1] - min[1], max[2] - min[2] });
+		if (scale == 0.0f) {
+			scale = 1.0f;
+		}
+
+		QuantizedPositions quantized{
+			.positions = std::vector<uint16_t>(vertex_count * 4, 0),
+			.dequantize = {
+				scale, 0, 0, 0,
+				0, scale, 0, 0,
+				0, 0, scale, 0,
+				min[0], min[1], min[2], 1,
+			},
+			.max_error = 0.0f,
+		};
+		for (size_t v = 0; v < vertex_count; v++) {
+			float error = 0.0f;
+			for (size_t k = 0; k < 3; k++) {
+				float x = vertices[v * stride + k];
+				float unorm = std::clamp((x - min[k]) / scale, 0.0f, 1.0f);
+				uint16_t q = static_cast<uint16_t>(std::lround(unorm * 65535.0f));
+				quantized.positions[v * 4 + k] = q;
+				float back = min[k] + float(q) / 65535.0f * scale;
+				error += (back - x) * (back - x);
+			}
+			quantized.max_error = std::max(quantized.max_error, std::sqrt(error));
+		}
+		return quantized;
+	}
+
+	// Octahedral encoding (Meyer et al., On Floating-Point Normal Vectors, 2010) in two
+	// R16G16_SNORM components: the unit sphere is projected onto an octahedron, and the lower
+	// half of it folded over the upper.
+	static std::array<int16_t, 2> EncodeOctahedral(const float* normal)
+	{
+		float l1 = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+		if (l1 == 0.0f) {
+			return { 0, 0 };
+		}
+		float x = normal[0] / l1;
+		float y = normal[1] / l1;
+		if (normal[2] < 0.0f) {
+			float folded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+			float folded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+			x = folded_x;
+			y = folded_y;
+		}
+		return { Snorm16(x), Snorm16(y) };
+	}
+
+	// what a shader does with the R16G16_SNORM attribute
+	static std::array<float, 3> DecodeOctahedral(const std::array<int16_t, 2>& encoded)
+	{
+		float x = std::max(encoded[0] / 32767.0f, -1.0f);
+		float y = std::max(encoded[1] / 32767.0f, -1.0f);
+		float z = 1.0f - std::abs(x) - std::abs(y);
+		if (z < 0.0f) {
+			float unfolded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+			float unfolded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+			x = unfolded_x;
+			y = unfolded_y;
+		}
+		float length = std::sqrt(x * x + y * y + z * z);
+		return { x / length, y / length, z / length };
+	}
+
+private:
+	static int64_t SkipDeadEnd(const std::vector<uint32_t>& live, std::vector<uint32_t>& dead_ends, size_t& cursor)
+	{
+		// the most recently used vertex with triangles left is likely still cached
+		while (!dead_ends.empty()) {
+			uint32_t v = dead_ends.back();
+			dead_ends.pop_back();
+			if (live[v] > 0) {
+				return v;
+			}
+		}
+		for (; cursor < live.size(); cursor++) {
+			if (live[cursor] > 0) {
+				return static_cast<int64_t>(cursor);
+			}
+		}
+		return -1;
+	}
+
+	static float SignNotZero(float x)
+	{
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	static int16_t Snorm16(float x)
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+	}
+};
@@ -0,0 +1,604 @@
+#pragma once
+
+#include <Innovator/Bounds.h>
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+// one level of a chain of simplified meshes, the indices refer to the vertices of the full mesh
+struct LodLevel {
+	std::vector<uint32_t> indices;
+	// object space distance from the full resolution mesh to the level
+	float error{ 0.0f };
+
+	size_t triangleCount() const
+	{
+		return this->indices.size() / 3;
+	}
+};
+
+// Quadric error metric simplification (Garland and Heckbert, Surface Simplification Using Quadric
+// Error Metrics, 1997). Edges are collapsed into one of their vertices, cheapest first, so every
+// level can draw from the vertices of the full mesh. The quadrics are sums of squared distances
+// to the planes of the original triangles, which overestimates the error on curved surfaces, so
+// the error of a result is measured against the full mesh instead.
+class MeshSimplifier {
+public:
+	MeshSimplifier() = delete;
+	~MeshSimplifier() = default;
+	MeshSimplifier(const MeshSimplifier&) = delete;
+	MeshSimplifier& operator=(const MeshSimplifier&) = delete;
+
+	// float xyz at the start of each vertex, stride floats apart
+	MeshSimplifier(const float* vertices, size_t vertex_count, size_t stride, const std::vector<uint32_t>& indices) :
+		positions(vertex_count),
+		quadrics(vertex_count),
+		triangles(vertex_count),
+		versions(vertex_count, 0),
+		removed(vertex_count, 0),
+		original(indices),
+		corners(indices),
+		alive(indices.size() / 3, 1)
+	{
+		if (indices.size() % 3) {
+			throw std::invalid_argument("MeshSimplifier: not a triangle list");
+		}
+		for (size_t v = 0; v < vertex_count; v++) {
+			this->positions[v] = { vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2] };
+		}
+
+		// triangles around each edge, to find the borders and the edges to collapse
+		std::unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(indices.size());
+		for (uint32_t t = 0; t < this->alive.size(); t++) {
+			const uint32_t* c = &this->corners[size_t(t) * 3];
+			if (c[0] >= vertex_count || c[1] >= vertex_count || c[2] >= vertex_count) {
+				throw std::out_of_range("MeshSimplifier: index past the end of the vertices");
+			}
+			if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0]) {
+				this->alive[t] = 0;
+				continue;
+			}
+			this->live_triangles++;
+			Point3 normal = Normal(this->positions[c[0]], this->positions[c[1]], this->positions[c[2]]);
+			double length = Length(normal);
+			for (size_t k = 0; k < 3; k++) {
+				this->triangles[c[k]].push_back(t);
+				if (length > 0.0) {
+					this->quadrics[c[k]].add(Quadric::Plane(Scale(normal, 1.0 / length), this->positions[c[0]]));
+				}
+				edges[EdgeKey(c[k], c[(k + 1) % 3])]++;
+			}
+		}
+
+		// planes through border edges, perpendicular to their triangle, keep borders in place
+		for (uint32_t t = 0; t < this->alive.size(); t++) {
+			if (!this->alive[t]) {
+				continue;
+			}
+			const uint32_t* c = &this->corners[size_t(t) * 3];
+			Point3 normal = Normal(this->positions[c[0]], this->positions[c[1]], this->positions[c[2]]);
+			for (size_t k = 0; k < 3; k++) {
+				uint32_t a = c[k], b = c[(k + 1) % 3];
+				if (edges[EdgeKey(a, b)] != 1) {
+					continue;
+				}
+				Point3 border = Cross(Subtract(this->positions[b], this->positions[a]), normal);
+				double length = Length(border);
+				if (length > 0.0) {
+					Quadric plane = Quadric::Plane(Scale(border, 1.0 / length), this->positions[a]);
+					this->quadrics[a].add(plane);
+					this->quadrics[b].add(plane);
+				}
+			}
+		}
+
+		for (auto& [key, count] : edges) {
+			this->push(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+		}
+	}
+
+	// Collapses edges until at most target triangles are left, or the quadric error of the next
+	// collapse exceeds max_error. Returns whether the target was reached.
+	bool simplify(size_t target_triangles, float max_error = std::numeric_limits<float>::max())
+	{
+		const double max_cost = double(max_error) * double(max_error);
+		while (this->live_triangles > target_triangles && !this->heap.empty()) {
+			Collapse collapse = this->heap.top();
+			if (this->stale(collapse)) {
+				this->heap.pop();
+				continue;
+			}
+			if (collapse.cost > max_cost) {
+				break;
+			}
+			this->heap.pop();
+			if (this->valid(collapse.from, collapse.to)) {
+				this->collapse(collapse.from, collapse.to);
+			}
+		}
+		return this->live_triangles <= target_triangles;
+	}
+
+	std::vector<uint32_t> indices() const
+	{
+		std::vector<uint32_t> indices;
+		indices.reserve(this->live_triangles * 3);
+		for (size_t t = 0; t < this->alive.size(); t++) {
+			if (this->alive[t]) {
+				indices.insert(indices.end(), &this->corners[t * 3], &this->corners[t * 3] + 3);
+			}
+		}
+		return indices;
+	}
+
+	size_t triangleCount() const
+	{
+		return this->live_triangles;
+	}
+
+	// How far apart the full mesh and the current one are, in both directions, at the corners,
+	// edge midpoints and centers of their triangles.
+	float error()
+	{
+		if (!this->near_original) {
+			this->near_original = std::make_unique<TriangleGrid>(this->positions, this->original);
+		}
+		std::vector<uint32_t> current = this->indices();
+		TriangleGrid near_current(this->positions, current);
+		double error = near_current.deviation(this->original, 0.0);
+		return static_cast<float>(this->near_original->deviation(current, error));
+	}
+
+	// The full mesh and levels with about ratio as many triangles as the one before, as long as
+	// simplification makes progress. Errors grow from level to level.
+	static std::vector<LodLevel> LodChain(const float* vertices, size_t vertex_count, size_t stride, const std::vector<uint32_t>& indices, size_t levels, double ratio = 0.25)
+	{
+		std::vector<LodLevel> chain{ { .indices = indices, .error = 0.0f } };
+		MeshSimplifier simplifier(vertices, vertex_count, stride, indices);
+		size_t target = simplifier.triangleCount();
+		while (chain.size() < levels && target > 0) {
+			size_t previous = simplifier.triangleCount();
+			target = static_cast<size_t>(double(target) * ratio);
+			simplifier.simplify(target);
+			if (simplifier.triangleCount() == 0 || simplifier.triangleCount() * 10 > previous * 9) {
+				break;
+			}
+			chain.push_back({ .indices = simplifier.indices(), .error = std::max(chain.back().error, simplifier.error()) });
+		}
+		return chain;
+	}
+
+private:
+	struct Quadric {
+		double a2{ 0 }, ab{ 0 }, ac{ 0 }, ad{ 0 };
+		double b2{ 0 }, bc{ 0 }, bd{ 0 };
+		double c2{ 0 }, cd{ 0 };
+		double d2{ 0 };
+
+		// squared distance to the plane with the unit normal n through p
+		static Quadric Plane(const Point3& n, const Point3& p)
+		{
+			double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+			return {
+				n[0] * n[0], n[0] * n[1], n[0] * n[2], n[0] * d,
+				n[1] * n[1], n[1] * n[2], n[1] * d,
+				n[2] * n[2], n[2] * d,
+				d * d,
+			};
+		}
+
+		void add(const Quadric& q)
+		{
+			this->a2 += q.a2; this->ab += q.ab; this->ac += q.ac; this->ad += q.ad;
+			this->b2 += q.b2; this->bc += q.bc; this->bd += q.bd;
+			this->c2 += q.c2; this->cd += q.cd;
+			this->d2 += q.d2;
+		}
+
+		double evaluate(const Point3& p) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double error =
+				this->a2 * x * x + 2 * this->ab * x * y + 2 * this->ac * x * z + 2 * this->ad * x +
+				this->b2 * y * y + 2 * this->bc * y * z + 2 * this->bd * y +
+				this->c2 * z * z + 2 * this->cd * z +
+				this->d2;
+			return std::max(error, 0.0);
+		}
+	};
+
+	// Triangles binned in a sparse uniform grid, for the distance to the closest one.
+	class TriangleGrid {
+	public:
+		TriangleGrid(const std::vector<Point3>& positions, const std::vector<uint32_t>& indices) :
+			positions(positions),
+			indices(indices)
+		{
+			for (uint32_t v : indices) {
+				this->bounds.extend(positions[v]);
+			}
+			if (indices.empty()) {
+				return;
+			}
+			// cells the size of an average triangle, a few cells per triangle and triangles per cell
+			double extents = 0.0;
+			for (size_t t = 0; t < indices.size(); t += 3) {
+				BoundingBox box;
+				for (size_t k = 0; k < 3; k++) {
+					box.extend(positions[indices[t + k]]);
+				}
+				extents += std::max({ box.max[0] - box.min[0], box.max[1] - box.min[1], box.max[2] - box.min[2] });
+			}
+			double size = std::max({ this->bounds.max[0] - this->bounds.min[0], this->bounds.max[1] - this->bounds.min[1], this->bounds.max[2] - this->bounds.min[2] });
+			this->cell = std::max(extents / double(indices.size() / 3), size * 1e-4 + 1e-12);
+			for (size_t i = 0; i < 3; i++) {
+				this->cells[i] = static_cast<int64_t>((this->bounds.max[i] - this->bounds.min[i]) / this->cell) + 1;
+			}
+			std::vector<std::pair<uint64_t, uint32_t>> entries;
+			for (uint32_t t = 0; t < indices.size() / 3; t++) {
+				BoundingBox box;
+				for (size_t k = 0; k < 3; k++) {
+					box.extend(positions[indices[size_t(t) * 3 + k]]);
+				}
+				std::array<int64_t, 3> lo = this->coordinates(box.min), hi = this->coordinates(box.max);
+				for (int64_t x = lo[0]; x <= hi[0]; x++) {
+					for (int64_t y = lo[1]; y <= hi[1]; y++) {
+						for (int64_t z = lo[2]; z <= hi[2]; z++) {
+							entries.push_back({ this->bin(x, y, z), t });
+						}
+					}
+				}
+			}
+			std::sort(entries.begin(), entries.end());
+			this->triangles.reserve(entries.size());
+			for (size_t i = 0; i < entries.size(); i++) {
+				if (i == 0 || entries[i].first != entries[i - 1].first) {
+					this->bins[entries[i].first] = { static_cast<uint32_t>(i), static_cast<uint32_t>(i) };
+				}
+				this->bins[entries[i].first].second++;
+				this->triangles.push_back(entries[i].second);
+			}
+		}
+
+		// Distance from p to the closest triangle, searching shells of cells outwards until they
+		// are further away than the closest triangle found. Stops early once within enough.
+		double distance(const Point3& p, double enough) const
+		{
+			double nearest = std::numeric_limits<double>::max();
+			if (this->indices.empty()) {
+				return nearest;
+			}
+			std::array<int64_t, 3> c = this->coordinates(p);
+			int64_t rings = std::max({ this->cells[0], this->cells[1], this->cells[2] });
+			for (int64_t ring = 0; ring <= rings; ring++) {
+				if (nearest <= enough || double(ring - 1) * this->cell > nearest) {
+					break;
+				}
+				for (int64_t x = c[0] - ring; x <= c[0] + ring; x++) {
+					for (int64_t y = c[1] - ring; y <= c[1] + ring; y++) {
+						for (int64_t z = c[2] - ring; z <= c[2] + ring; z++) {
+							bool shell = std::abs(x - c[0]) == ring || std::abs(y - c[1]) == ring || std::abs(z - c[2]) == ring;
+							if (!shell || x < 0 || y < 0 || z < 0 || x >= this->cells[0] || y >= this->cells[1] || z >= this->cells[2]) {
+								continue;
+							}
+							auto range = this->bins.find(this->bin(x, y, z));
+							if (range == this->bins.end()) {
+								continue;
+							}
+							for (uint32_t i = range->second.first; i < range->second.second; i++) {
+								const uint32_t* n = &this->indices[size_t(this->triangles[i]) * 3];
+								nearest = std::min(nearest, Distance(p, this->positions[n[0]], this->positions[n[1]], this->positions[n[2]]));
+							}
+						}
+					}
+				}
+			}
+			return nearest;
+		}
+
+		// the furthest samples of the triangles are from the closest triangle in the grid, or error if that is further
+		double deviation(const std::vector<uint32_t>& triangles, double error) const
+		{
+			if (this->indices.empty()) {
+				return error;
+			}
+			for (size_t t = 0; t < triangles.size(); t += 3) {
+				const Point3& a = this->positions[triangles[t]];
+				const Point3& b = this->positions[triangles[t + 1]];
+				const Point3& c = this->positions[triangles[t + 2]];
+				auto mean = [](const Point3& p, const Point3& q, const Point3& r, double s) {
+					return Point3{ (p[0] + q[0] + r[0]) * s, (p[1] + q[1] + r[1]) * s, (p[2] + q[2] + r[2]) * s };
+				};
+				const Point3 o{ 0, 0, 0 };
+				for (const Point3& p : { a, b, c, mean(a, b, o, 0.5), mean(b, c, o, 0.5), mean(c, a, o, 0.5), mean(a, b, c, 1.0 / 3.0) }) {
+					error = std::max(error, this->distance(p, error));
+				}
+			}
+			return error;
+		}
+
+	private:
+		std::array<int64_t, 3> coordinates(const Point3& p) const
+		{
+			std::array<int64_t, 3> c;
+			for (size_t i = 0; i < 3; i++) {
+				c[i] = std::clamp(static_cast<int64_t>((p[i] - this->bounds.min[i]) / this->cell), int64_t(0), this->cells[i] - 1);
+			}
+			return c;
+		}
+
+		uint64_t bin(int64_t x, int64_t y, int64_t z) const
+		{
+			return uint64_t((x * this->cells[1] + y) * this->cells[2] + z);
+		}
+
+		const std::vector<Point3>& positions;
+		const std::vector<uint32_t>& indices;
+		BoundingBox bounds;
+		double cell{ 1.0 };
+		std::array<int64_t, 3> cells{ 1, 1, 1 };
+		// the triangles of each occupied cell are a range of triangles
+		std::unordered_map<uint64_t, std::pair<uint32_t, uint32_t>> bins;
+		std::vector<uint32_t> triangles;
+	};
+
+	// from is moved onto to, valid while neither has changed since the cost was computed
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t from_version, to_version;
+
+		bool operator<(const Collapse& other) const
+		{
+			return this->cost > other.cost;
+		}
+	};
+
+	void push(uint32_t a, uint32_t b)
+	{
+		for (auto [from, to] : { std::pair{ a, b }, { b, a } }) {
+			Quadric q = this->quadrics[from];
+			q.add(this->quadrics[to]);
+			this->heap.push({ q.evaluate(this->positions[to]), from, to, this->versions[from], this->versions[to] });
+		}
+	}
+
+	bool stale(const Collapse& collapse) const
+	{
+		return this->removed[collapse.from] || this->removed[collapse.to] ||
+			this->versions[collapse.from] != collapse.from_version ||
+			this->versions[collapse.to] != collapse.to_version;
+	}
+
+	bool contains(uint32_t t, uint32_t v) const
+	{
+		const uint32_t* c = &this->corners[size_t(t) * 3];
+		return c[0] == v || c[1] == v || c[2] == v;
+	}
+
+	std::vector<uint32_t> neighbours(uint32_t v) const
+	{
+		std::vector<uint32_t> result;
+		for (uint32_t t : this->triangles[v]) {
+			if (!this->alive[t]) {
+				continue;
+			}
+			for (size_t k = 0; k < 3; k++) {
+				uint32_t w = this->corners[size_t(t) * 3 + k];
+				if (w != v) {
+					result.push_back(w);
+				}
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+		return result;
+	}
+
+	bool valid(uint32_t from, uint32_t to) const
+	{
+		// the vertices around both ends are the ones opposite the edge, or the surface pinches
+		size_t shared = 0;
+		for (uint32_t t : this->triangles[from]) {
+			shared += this->alive[t] && this->contains(t, to);
+		}
+		std::vector<uint32_t> a = this->neighbours(from), b = this->neighbours(to), common;
+		std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(common));
+		if (shared == 0 || common.size() > shared) {
+			return false;
+		}
+
+		// triangles that stay must not fold over
+		for (uint32_t t : this->triangles[from]) {
+			if (!this->alive[t] || this->contains(t, to)) {
+				continue;
+			}
+			std::array<Point3, 3> p;
+			for (size_t k = 0; k < 3; k++) {
+				p[k] = this->positions[this->corners[size_t(t) * 3 + k]];
+			}
+			Point3 before = Normal(p[0], p[1], p[2]);
+			for (size_t k = 0; k < 3; k++) {
+				if (this->corners[size_t(t) * 3 + k] == from) {
+					p[k] = this->positions[to];
+				}
+			}
+			Point3 after = Normal(p[0], p[1], p[2]);
+			if (Dot(before, after) < 0.1 * Length(before) * Length(after)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void collapse(uint32_t from, uint32_t to)
+	{
+		for (uint32_t t : this->triangles[from]) {
+			if (!this->alive[t]) {
+				continue;
+			}
+			if (this->contains(t, to)) {
+				this->alive[t] = 0;
+				this->live_triangles--;
+				continue;
+			}
+			for (size_t k = 0; k < 3; k++) {
+				uint32_t& corner = this->corners[size_t(t) * 3 + k];
+				corner = corner == from ? to : corner;
+			}
+			this->triangles[to].push_back(t);
+		}
+		this->triangles[from].clear();
+		this->triangles[from].shrink_to_fit();
+		std::erase_if(this->triangles[to], [this](uint32_t t) { return !this->alive[t]; });
+
+		this->quadrics[to].add(this->quadrics[from]);
+		this->removed[from] = 1;
+		this->versions[to]++;
+		for (uint32_t w : this->neighbours(to)) {
+			this->push(to, w);
+		}
+	}
+
+	static uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+	}
+
+	static Point3 Subtract(const Point3& a, const Point3& b)
+	{
+		return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+	}
+
+	static Point3 Scale(const Point3& a, double s)
+	{
+		return { a[0] * s, a[1] * s, a[2] * s };
+	}
+
+	static Point3 Cross(const Point3& a, const Point3& b)
+	{
+		return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+	}
+
+	static double Dot(const Point3& a, const Point3& b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	static double Length(const Point3& a)
+	{
+		return std::sqrt(Dot(a, a));
+	}
+
+	static Point3 Normal(const Point3& a, const Point3& b, const Point3& c)
+	{
+		return Cross(Subtract(b, a), Subtract(c, a));
+	}
+
+	// distance to the closest point on a triangle (Ericson, Real-Time Collision Detection, 5.1.5)
+	static double Distance(const Point3& p, const Point3& a, const Point3& b, const Point3& c)
+	{
+		auto along = [](const Point3& o, const Point3& d, double t) {
+			return Point3{ o[0] + d[0] * t, o[1] + d[1] * t, o[2] + d[2] * t };
+		};
+		auto to = [&p](const Point3& q) {
+			return Length(Subtract(p, q));
+		};
+		Point3 ab = Subtract(b, a), ac = Subtract(c, a), ap = Subtract(p, a);
+		double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0) {
+			return to(a);
+		}
+		Point3 bp = Subtract(p, b);
+		double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+		if (d3 >= 0 && d4 <= d3) {
+			return to(b);
+		}
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+			return to(along(a, ab, d1 / (d1 - d3)));
+		}
+		Point3 cp = Subtract(p, c);
+		double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+		if (d6 >= 0 && d5 <= d6) {
+			return to(c);
+		}
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+			return to(along(a, ac, d2 / (d2 - d6)));
+		}
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+			return to(along(b, Subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		}
+		double denom = 1.0 / (va + vb + vc);
+		return to(along(along(a, ab, vb * denom), ac, vc * denom));
+	}
+
+	std::vector<Point3> positions;
+	std::vector<Quadric> quadrics;
+	std::vector<std::vector<uint32_t>> triangles;
+	std::vector<uint32_t> versions;
+	std::vector<uint8_t> removed;
+	std::vector<uint32_t> original;
+	std::vector<uint32_t> corners;
+	std::vector<uint8_t> alive;
+	size_t live_triangles{ 0 };
+	std::priority_queue<Collapse> heap;
+	std::unique_ptr<TriangleGrid> near_original;
+};
+
+
+// Picks a level of detail from how large its error is on screen.
+class LodSelection {
+public:
+	// pixels a world space distance at the nearest point of the bounds covers on a screen of the given height
+	static double ProjectedError(double error, const BoundingBox& world, const Matrix4& view, const Matrix4& projection, uint32_t height)
+	{
+		double pixels = error * std::abs(projection[5]) * double(height) * 0.5;
+		// orthographic projections don't divide by depth
+		if (projection[11] == 0.0) {
+			return pixels;
+		}
+		if (world.empty() || world.infinite()) {
+			return std::numeric_limits<double>::infinity();
+		}
+		// the camera looks down -z, the nearest point has the largest z
+		double depth = -world.transformed(view).max[2];
+		if (depth <= 0.0) {
+			return std::numeric_limits<double>::infinity();
+		}
+		return pixels / depth;
+	}
+
+	// how much a transform stretches distances at most, the longest of its axes
+	static double MaxScale(const Matrix4& m)
+	{
+		double scale = 0.0;
+		for (size_t j = 0; j < 3; j++) {
+			scale = std::max(scale, std::sqrt(m[j * 4] * m[j * 4] + m[j * 4 + 1] * m[j * 4 + 1] + m[j * 4 + 2] * m[j * 4 + 2]));
+		}
+		return scale;
+	}
+
+	// the coarsest level whose error covers at most max_pixels, errors from finest to coarsest
+	static size_t Select(const std::vector<float>& errors, double pixels_per_unit, double max_pixels)
+	{
+		size_t level = 0;
+		for (size_t i = 1; i < errors.size(); i++) {
+			if (double(errors[i]) * pixels_per_unit <= max_pixels) {
+				level = i;
+			}
+		}
+		return level;
+	}
+};
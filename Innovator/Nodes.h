@@ -1,6 +1,24 @@
 #pragma once
 
 #include <Innovator/Timer.h>
+#include <Innovator/AssetLoader.h>
+#include <Innovator/Bvh.h>
+#include <Innovator/Frames.h>
+#include <Innovator/FrameGraph.h>
+#include <Innovator/Instancing.h>
+#include <Innovator/Occlusion.h>
+#include <Innovator/Transforms.h>
+#include <Innovator/MeshCache.h>
+#include <Innovator/MeshOptimizer.h>
+#include <Innovator/MeshSimplifier.h>
+#include <Innovator/Indirect.h>
+#include <Innovator/GeometryBuffers.h>
+#include <Innovator/Staging.h>
+#include <Innovator/StlLoader.h>
+#include <Innovator/Uniforms.h>
+#include <Innovator/ShaderCache.h>
+#include <Innovator/Specialization.h>
+#include <Innovator/ImageCompare.h>
 #include <Innovator/Visitor.h>
 #include <Innovator/Defines.h>
 #include <Innovator/Factory.h>
@@ -14,9 +32,14 @@
 
 #include <map>
 #include <set>
+#include <span>
 #include <deque>
+#include <mutex>
+#include <atomic>
 #include <memory>
 #include <vector>
+#include <numeric>
+#include <sstream>
 #include <utility>
 #include <fstream>
 #include <algorithm>
@@ -61,10 +84,214 @@ public:
 		Group(std::move(children))
 	{}
 
+	// Subtrees outside the view frustum or behind occluders are skipped in the render traversal.
+	// World bounds are gathered when the subtree is rendered and reused until a transform changes.
 	void visit(Visitor* visitor) override
 	{
-		StateScope scope(visitor->state.get());
-		Group::visit(visitor);
+		State* state = visitor->state.get();
+		// read once, contexts on other threads may invalidate while this one traverses
+		const uint64_t revision = Separator::bounds_revision;
+		BoundingBox bounds;
+		{
+			StateScope scope(state);
+			if (state->cull && this->subtree.cull(state->frustum, state->cull_planes, revision)) {
+				bounds = this->subtree.bounds;
+			}
+			else if (state->cull && state->occlusion && !state->occluder &&
+				this->subtree.valid(revision) && state->occlusion->occluded(this->subtree.bounds)) {
+				bounds = this->subtree.bounds;
+			}
+			else {
+				state->bounds = BoundingBox();
+				Group::visit(visitor);
+				bounds = state->bounds;
+				if (state->cull) {
+					this->subtree.update(bounds, revision);
+				}
+			}
+		}
+		state->bounds.extend(bounds);
+	}
+
+	static void invalidateBounds()
+	{
+		Separator::bounds_revision++;
+	}
+
+	static inline std::atomic<uint64_t> bounds_revision{ 0 };
+
+private:
+	SubtreeBounds subtree;
+};
+
+
+inline Matrix4 ToMatrix4(const glm::dmat4& mat)
+{
+	Matrix4 m;
+	std::copy(glm::value_ptr(mat), glm::value_ptr(mat) + 16, m.begin());
+	return m;
+}
+
+
+// the model matrix of the current state, the cached world of the transform the traversal is
+// below when there is a transform hierarchy
+inline Matrix4 WorldMatrix(const State* state)
+{
+	if (state->transforms && state->transform != TransformHierarchy::ROOT) {
+		std::array<float, 16> world = state->transforms->world(state->transform);
+		Matrix4 m;
+		std::copy(world.begin(), world.end(), m.begin());
+		return m;
+	}
+	return ToMatrix4(state->ModelMatrix);
+}
+
+
+// the camera has changed, cull against the new frustum
+inline void UpdateFrustum(State* state)
+{
+	state->frustum = Frustum(ToMatrix4(state->ProjectionMatrix * state->ViewMatrix));
+	state->cull_planes = Frustum::ALL_PLANES;
+}
+
+
+// for nodes whose render work is not drawing, the subtrees they are in are never culled
+inline void NeverCull(State* state)
+{
+	state->bounds.extend(BoundingBox::Infinite());
+}
+
+
+// Renders one of its children, levels of detail of the same object from finest to coarsest, and
+// traverses all of them otherwise. The level is picked each frame from the bounds the last one
+// rendered with: the coarsest whose error covers at most the given number of pixels on screen.
+// Errors are those the levels leave in the state, see GeometricError.
+class LevelOfDetail : public Group {
+public:
+	LevelOfDetail() = delete;
+	virtual ~LevelOfDetail() = default;
+
+	LevelOfDetail(double pixels, std::vector<std::shared_ptr<Node>> children) :
+		Group(std::move(children)),
+		pixels(pixels),
+		errors(this->children.size(), 0.0f)
+	{}
+
+	void visit(Visitor* visitor) override
+	{
+		State* state = visitor->state.get();
+		// picks hit and occluders hide what was rendered last
+		if (visitor->is(visitors::pickvisitor) || visitor->is(visitors::occludervisitor)) {
+			if (this->level < this->children.size()) {
+				StateScope scope(state);
+				this->children[this->level]->visit(visitor);
+			}
+			return;
+		}
+		if (!visitor->is(visitors::rendervisitor)) {
+			for (size_t i = 0; i < this->children.size(); i++) {
+				StateScope scope(state);
+				state->geometric_error = 0.0f;
+				this->children[i]->visit(visitor);
+				this->errors[i] = state->geometric_error;
+			}
+			return;
+		}
+		if (this->children.empty()) {
+			return;
+		}
+
+		this->level = 0;
+		if (!this->bounds.empty()) {
+			double pixels_per_unit = LodSelection::ProjectedError(
+				LodSelection::MaxScale(WorldMatrix(state)),
+				this->bounds,
+				ToMatrix4(state->ViewMatrix),
+				ToMatrix4(state->ProjectionMatrix),
+				state->extent.height);
+			this->level = LodSelection::Select(this->errors, pixels_per_unit, this->pixels);
+		}
+
+		BoundingBox bounds;
+		{
+			StateScope scope(state);
+			state->bounds = BoundingBox();
+			this->children[this->level]->visit(visitor);
+			bounds = state->bounds;
+		}
+		// levels that draw nothing have no bounds, keep the last ones
+		if (!bounds.empty()) {
+			this->bounds = bounds;
+		}
+		state->bounds.extend(bounds);
+	}
+
+	// the level rendered last
+	size_t level{ 0 };
+
+private:
+	double pixels;
+	std::vector<float> errors;
+	BoundingBox bounds;
+};
+
+
+// Renders its children with what is hidden behind occluders among them culled. Occluders are
+// the draws after an Occluder node, rasterized on the CPU before any draw of the frame is
+// recorded, under the camera they are drawn with. Culled draws are counted in the buffer.
+class OcclusionCulling : public Separator {
+public:
+	OcclusionCulling() = delete;
+	virtual ~OcclusionCulling() = default;
+
+	OcclusionCulling(uint32_t width, uint32_t height, std::vector<std::shared_ptr<Node>> children) :
+		Separator(std::move(children)),
+		buffer(width, height)
+	{}
+
+	void visit(Visitor* visitor) override
+	{
+		if (!visitor->is(visitors::rendervisitor)) {
+			Separator::visit(visitor);
+			return;
+		}
+		State* state = visitor->state.get();
+		OcclusionBuffer* outer = state->occlusion;
+
+		this->buffer.clear();
+		{
+			// occluders are not culled, and leave the cached bounds alone
+			StateScope scope(state);
+			state->occlusion = &this->buffer;
+			state->cull = false;
+			Group::visit(&state->context->occludervisitor);
+		}
+		this->buffer.rasterize(&OcclusionBuffer::Threads());
+
+		state->occlusion = &this->buffer;
+		Separator::visit(visitor);
+		state->occlusion = outer;
+	}
+
+	OcclusionBuffer buffer;
+};
+
+
+// draws after it in the same separator are occluders
+class Occluder : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	virtual ~Occluder() = default;
+
+	Occluder()
+	{
+		REGISTER_VISITOR(occludervisitor, Occluder, update);
+		REGISTER_VISITOR(rendervisitor, Occluder, update);
+	}
+
+	void update(Visitor* context)
+	{
+		context->state->occluder = true;
 	}
 };
 
@@ -83,6 +310,8 @@ public:
 	{
 		REGISTER_VISITOR(resizevisitor, ProjMatrix, resize);
 		REGISTER_VISITOR(rendervisitor, ProjMatrix, render);
+		REGISTER_VISITOR(pickvisitor, ProjMatrix, render);
+		REGISTER_VISITOR(occludervisitor, ProjMatrix, render);
 	}
 
 	void resize(CommandVisitor* context)
@@ -98,9 +327,11 @@ public:
 			this->farplane);
 	}
 
-	void render(CommandVisitor* context)
+	void render(Visitor* context)
 	{
 		context->state->ProjectionMatrix = this->mat;
+		UpdateFrustum(context->state.get());
+		NeverCull(context->state.get());
 	}
 
 private:
@@ -123,6 +354,8 @@ public:
 		eye(eye), target(target)
 	{
 		REGISTER_VISITOR(rendervisitor, ViewMatrix, render);
+		REGISTER_VISITOR(pickvisitor, ViewMatrix, render);
+		REGISTER_VISITOR(occludervisitor, ViewMatrix, render);
 
 		this->rot[1] = up;
 		this->updateOrientation();
@@ -151,10 +384,12 @@ public:
 		this->updateOrientation();
 	}
 
-	void render(CommandVisitor* context)
+	void render(Visitor* context)
 	{
 		context->state->ViewMatrix = glm::dmat4(glm::transpose(this->rot));
 		context->state->ViewMatrix = glm::translate(context->state->ViewMatrix, -this->eye);
+		UpdateFrustum(context->state.get());
+		NeverCull(context->state.get());
 	}
 
 	void updateOrientation()
@@ -173,27 +408,96 @@ public:
 
 #include <numbers>
 
+// With a transform hierarchy in the state, the model matrix has a transform below each parent
+// transform it is rendered under, and the traversal only moves to it. Its world is cached and
+// recomputed when the matrix is set.
 class ModelMatrix : public Node {
 public:
 	IMPLEMENT_VISITABLE;
 	ModelMatrix() = default;
-	virtual ~ModelMatrix() = default;
+
+	virtual ~ModelMatrix()
+	{
+		this->free();
+	}
 
 	ModelMatrix(const glm::dvec3& t, const glm::dvec3& s)
 	{
 		REGISTER_VISITOR(rendervisitor, ModelMatrix, render);
+		REGISTER_VISITOR(pickvisitor, ModelMatrix, render);
+		REGISTER_VISITOR(occludervisitor, ModelMatrix, render);
 
 		this->mat = glm::scale(this->mat, s);
 		this->mat = glm::rotate(this->mat, -std::numbers::pi / 2, glm::dvec3(0, 1, 0));
 		this->mat = glm::translate(this->mat, t);
 	}
 
-	void render(CommandVisitor* context)
+	void render(Visitor* context)
+	{
+		State* state = context->state.get();
+		if (state->transforms) {
+			state->transform = this->transform(state->transforms, state->transform);
+		}
+		else {
+			state->ModelMatrix *= this->mat;
+		}
+	}
+
+	const glm::dmat4& matrix() const
+	{
+		return this->mat;
+	}
+
+	void set(const glm::dmat4& mat)
 	{
-		context->state->ModelMatrix *= this->mat;
+		this->mat = mat;
+		if (this->transforms) {
+			glm::mat4 local(this->mat);
+			for (auto& [parent, transform] : this->transforms_below) {
+				if (this->transforms->valid(transform)) {
+					this->transforms->set(transform, glm::value_ptr(local));
+				}
+			}
+		}
+		// cached subtree bounds include this transform
+		Separator::invalidateBounds();
+	}
+
+private:
+	TransformHandle transform(const std::shared_ptr<TransformHierarchy>& transforms, TransformHandle parent)
+	{
+		if (this->transforms != transforms) {
+			this->free();
+			this->transforms = transforms;
+		}
+		auto it = this->transforms_below.find(parent);
+		if (it != this->transforms_below.end() && this->transforms->valid(it->second)) {
+			return it->second;
+		}
+		// transforms freed with their parents
+		std::erase_if(this->transforms_below, [this](const auto& entry) {
+			return !this->transforms->valid(entry.second);
+		});
+		glm::mat4 local(this->mat);
+		TransformHandle transform = this->transforms->allocate(parent, glm::value_ptr(local));
+		this->transforms_below[parent] = transform;
+		return transform;
+	}
+
+	void free()
+	{
+		if (this->transforms) {
+			for (auto& [parent, transform] : this->transforms_below) {
+				this->transforms->free(transform);
+			}
+		}
+		this->transforms_below.clear();
 	}
 
 	glm::dmat4 mat{ 1.0 };
+	std::shared_ptr<TransformHierarchy> transforms;
+	// the transform below each parent transform
+	std::map<TransformHandle, TransformHandle> transforms_below;
 };
 
 
@@ -282,10 +586,11 @@ public:
 	TextureData() = delete;
 	virtual ~TextureData() = default;
 
-	explicit TextureData(const std::string& filename) :
-		texture(VulkanImageFactory::Create(filename))
+	explicit TextureData(std::string filename) :
+		filename(std::move(filename))
 	{
-		REGISTER_VISITOR(allocvisitor, TextureData, update);
+		REGISTER_VISITOR(loadvisitor, TextureData, load);
+		REGISTER_VISITOR(allocvisitor, TextureData, alloc);
 		REGISTER_VISITOR(pipelinevisitor, TextureData, update);
 		REGISTER_VISITOR(recordvisitor, TextureData, update);
 		REGISTER_VISITOR(rendervisitor, TextureData, update);
@@ -306,6 +611,25 @@ public:
 		return this->texture->element_size();
 	}
 
+	// queued once, the node may be visited more than once before the read is done
+	void load(Visitor* context)
+	{
+		if (!this->texture && !this->queued && context->state->assets) {
+			this->queued = true;
+			context->state->assets->load(this->filename, [this] {
+				this->texture = VulkanImageFactory::Create(this->filename);
+				});
+		}
+	}
+
+	void alloc(Visitor* context)
+	{
+		if (!this->texture) {
+			this->texture = VulkanImageFactory::Create(this->filename);
+		}
+		this->update(context);
+	}
+
 	void update(Visitor* context)
 	{
 		context->state->bufferdata = this;
@@ -314,7 +638,9 @@ public:
 	}
 
 private:
+	std::string filename;
 	std::shared_ptr<VulkanTextureImage> texture;
+	bool queued{ false };
 };
 
 
@@ -327,7 +653,8 @@ public:
 	explicit STLBufferData(std::string filename) :
 		filename(std::move(filename))
 	{
-		REGISTER_VISITOR(allocvisitor, STLBufferData, update);
+		REGISTER_VISITOR(loadvisitor, STLBufferData, load);
+		REGISTER_VISITOR(allocvisitor, STLBufferData, alloc);
 		REGISTER_VISITOR(pipelinevisitor, STLBufferData, update);
 		REGISTER_VISITOR(recordvisitor, STLBufferData, update);
 		REGISTER_VISITOR(rendervisitor, STLBufferData, update);
@@ -341,26 +668,36 @@ public:
 		this->values_size = num_triangles * 36;
 	}
 
-	void copy(char* dst) const override
+	// the file is read once, on the asset loader's threads if the scene was loaded with it
+	void read()
 	{
 		std::ifstream input(this->filename, std::ios::binary);
 		// header is first 80 bytes
 		char header[80];
 		input.read(header, 80);
-		std::cout << "header: " << std::string(header) << std::endl;
 
 		// num triangles is next 4 bytes after header
 		uint32_t num_triangles;
 		input.read(reinterpret_cast<char*>(&num_triangles), 4);
-		std::cout << "num triangles: " << num_triangles << std::endl;
+		if (!input || size_t(num_triangles) * 36 > this->values_size) {
+			throw std::runtime_error("STLBufferData: " + this->filename + " is not a binary STL file");
+		}
 
+		std::vector<char> values(this->values_size);
 		char normal[12];
 		char attrib[2];
 		for (size_t i = 0; i < num_triangles; i++) {
 			input.read(normal, 12); // skip normal
-			input.read(dst + i * 36, 36);
+			input.read(values.data() + i * 36, 36);
 			input.read(attrib, 2);  // skip attribute
 		}
+		this->values = std::move(values);
+		this->loaded = true;
+	}
+
+	void copy(char* dst) const override
+	{
+		std::copy(this->values.begin(), this->values.end(), dst);
 	}
 
 	std::string filename;
@@ -376,10 +713,261 @@ public:
 		return sizeof(float);
 	}
 
+	// queued once, the node may be visited more than once before the read is done
+	void load(Visitor* context)
+	{
+		if (!this->loaded && !this->queued && context->state->assets) {
+			this->queued = true;
+			context->state->assets->load(this->filename, [this] { this->read(); });
+		}
+	}
+
+	void alloc(Visitor* context)
+	{
+		if (!this->loaded) {
+			this->read();
+		}
+		this->update(context);
+	}
+
+	void update(Visitor* context)
+	{
+		context->state->bufferdata = this;
+	}
+
+private:
+	std::vector<char> values;
+	bool loaded{ false };
+	bool queued{ false };
+};
+
+
+// An STL file welded into indexed triangles, read once for the STLMeshData nodes that hand
+// its vertices and indices to the scene. Levels of detail beyond the full mesh are simplified
+// from it as it is read.
+class STLMesh {
+public:
+	STLMesh() = delete;
+	~STLMesh() = default;
+
+	explicit STLMesh(std::string filename, bool normals = false) :
+		filename(std::move(filename)),
+		normals(normals)
+	{}
+
+	// Levels are simplified when the cache is built, nodes ask for theirs before that. False
+	// once the read has started without this level, the mesh can't give it any more.
+	bool require(size_t level)
+	{
+		std::lock_guard lock(this->mutex);
+		if (level < this->level_count) {
+			return true;
+		}
+		if (this->reading) {
+			return false;
+		}
+		this->level_count = level + 1;
+		return true;
+	}
+
+	// Safe to call from any thread, also from the nodes of scenes in different contexts. Maps
+	// the mesh cache next to the file, building it first if it is missing or stale.
+	void read()
+	{
+		std::call_once(this->once, [this] {
+			size_t level_count;
+			{
+				std::lock_guard lock(this->mutex);
+				this->reading = true;
+				level_count = this->level_count;
+			}
+			std::ostringstream report;
+			this->streams = MeshCache::Load(this->filename, this->normals, level_count, &report);
+			this->report = report.str();
+			});
+	}
+
+	// what building the cache did, printed once by whichever traversal gets here first
+	void printReport()
+	{
+		this->read();
+		std::call_once(this->reported, [this] {
+			std::cout << this->report;
+			});
+	}
+
+	// empty until the file is read, simplification may stop before the coarsest level asked
+	// for, that one is drawn instead
+	std::span<const char> vertices(size_t level) const
+	{
+		return this->streams ? this->streams->vertices(this->clamp(level)) : std::span<const char>();
+	}
+
+	std::span<const char> indices(size_t level) const
+	{
+		return this->streams ? this->streams->indices(this->clamp(level)) : std::span<const char>();
+	}
+
+	float error(size_t level) const
+	{
+		return this->streams ? this->streams->error(this->clamp(level)) : 0.0f;
+	}
+
+	std::string filename;
+	bool normals;
+	// the nodes that share the mesh queue one read between them
+	std::atomic<bool> queued{ false };
+
+private:
+	size_t clamp(size_t level) const
+	{
+		return std::min(level, this->streams->levelCount() - 1);
+	}
+
+	std::mutex mutex;
+	size_t level_count{ 1 };
+	bool reading{ false };
+	std::unique_ptr<MeshStreams> streams;
+	std::string report;
+	std::once_flag once;
+	std::once_flag reported;
+};
+
+
+class STLMeshData : public BufferData {
+public:
+	IMPLEMENT_VISITABLE;
+	STLMeshData() = delete;
+	virtual ~STLMeshData() = default;
+
+	enum class Part { VERTICES, INDICES };
+
+	explicit STLMeshData(std::shared_ptr<STLMesh> mesh, Part part, size_t level = 0) :
+		mesh(std::move(mesh)),
+		part(part),
+		level(level)
+	{
+		if (!this->mesh->require(level)) {
+			throw std::logic_error("STLMeshData: " + this->mesh->filename + " is already read without level " + std::to_string(level));
+		}
+		REGISTER_VISITOR(loadvisitor, STLMeshData, load);
+		REGISTER_VISITOR(allocvisitor, STLMeshData, alloc);
+		REGISTER_VISITOR(pipelinevisitor, STLMeshData, update);
+		REGISTER_VISITOR(recordvisitor, STLMeshData, update);
+		REGISTER_VISITOR(rendervisitor, STLMeshData, update);
+	}
+
+	// straight from the mapped cache, empty until the file is read
+	void copy(char* dst) const override
+	{
+		std::span<const char> data = this->data();
+		std::copy(data.begin(), data.end(), dst);
+	}
+
+	size_t size() const override
+	{
+		return this->data().size();
+	}
+
+	size_t stride() const override
+	{
+		return this->part == Part::VERTICES ?
+			(this->mesh->normals ? 6 : 3) * sizeof(float) :
+			sizeof(uint32_t);
+	}
+
+	void load(Visitor* context)
+	{
+		if (context->state->assets && !this->mesh->queued.exchange(true)) {
+			auto mesh = this->mesh;
+			context->state->assets->load(mesh->filename, [mesh] { mesh->read(); });
+		}
+	}
+
+	void alloc(Visitor* context)
+	{
+		this->mesh->printReport();
+		this->update(context);
+	}
+
 	void update(Visitor* context)
 	{
 		context->state->bufferdata = this;
 	}
+
+private:
+	std::span<const char> data() const
+	{
+		return this->part == Part::VERTICES ? this->mesh->vertices(this->level) : this->mesh->indices(this->level);
+	}
+
+	std::shared_ptr<STLMesh> mesh;
+	Part part;
+	size_t level;
+};
+
+
+// The object space error of the geometry that follows against the full resolution mesh, for a
+// LevelOfDetail to pick levels by. Known up front, or once the geometry is loaded.
+class GeometricError : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	GeometricError() = delete;
+	virtual ~GeometricError() = default;
+
+	explicit GeometricError(float error) :
+		GeometricError([error] { return error; })
+	{}
+
+	explicit GeometricError(std::function<float()> error) :
+		error(std::move(error))
+	{
+		REGISTER_VISITOR(allocvisitor, GeometricError, update);
+		REGISTER_VISITOR(pipelinevisitor, GeometricError, update);
+		REGISTER_VISITOR(recordvisitor, GeometricError, update);
+	}
+
+	void update(Visitor* context)
+	{
+		context->state->geometric_error = this->error();
+	}
+
+private:
+	std::function<float()> error;
+};
+
+
+// per instance transforms, colors and ids for the instance rate binding of an instanced draw
+class InstanceData : public BufferData {
+public:
+	IMPLEMENT_VISITABLE;
+	InstanceData() = delete;
+	virtual ~InstanceData() = default;
+
+	explicit InstanceData(std::vector<Instance> instances) :
+		instances(std::move(instances))
+	{
+		REGISTER_VISITOR(allocvisitor, InstanceData, update);
+		REGISTER_VISITOR(pipelinevisitor, InstanceData, update);
+		REGISTER_VISITOR(recordvisitor, InstanceData, update);
+	}
+
+	void copy(char* dst) const override
+	{
+		InstanceLayout::Pack(this->instances, dst);
+	}
+
+	size_t size() const override
+	{
+		return this->instances.size() * InstanceLayout::STRIDE;
+	}
+
+	size_t stride() const override
+	{
+		return InstanceLayout::STRIDE;
+	}
+
+	std::vector<Instance> instances;
 };
 
 
@@ -403,6 +991,7 @@ public:
 
 	void alloc(CommandVisitor* context)
 	{
+		context->state->frames->retire(std::move(this->bufferobject));
 		this->bufferobject = std::make_shared<VulkanBufferObject>(
 			context->state->device,
 			this->create_flags,
@@ -447,26 +1036,22 @@ public:
 
 	void alloc(CommandVisitor* context)
 	{
+		context->state->frames->retire(std::move(this->bufferobject));
 		this->bufferobject = std::make_shared<VulkanBufferObject>(
 			context->state->device,
 			this->create_flags,
 			context->state->bufferdata->size(),
-			this->usage_flags,
+			this->usage_flags | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		std::vector<VkBufferCopy> regions = { {
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = context->state->bufferdata->size(),
-		} };
-
-		vk.CmdCopyBuffer(
-			context->state->default_command->buffer(),
-			context->state->buffer,
+		BufferData* bufferdata = context->state->bufferdata;
+		context->state->staging->copy(
 			this->bufferobject->buffer->buffer,
-			static_cast<uint32_t>(regions.size()),
-			regions.data());
+			bufferdata->size(),
+			[bufferdata](char* dst) { bufferdata->copy(dst); });
+
+		context->state->buffer = this->bufferobject->buffer->buffer;
 	}
 
 	void update(Visitor* context)
@@ -481,10 +1066,148 @@ private:
 };
 
 
+// Vertex and optional index data sub-allocated from the shared geometry pool, so meshes of
+// the same vertex format bind the same buffers. Sets the vertex buffer like GpuMemoryBuffer
+// does, the index buffer like IndexBufferDescription does, and where the mesh starts in them
+// for the draws that follow. Keep it under a Separator with its draw command.
+class PooledGeometry : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	PooledGeometry() = delete;
+
+	virtual ~PooledGeometry()
+	{
+		if (this->mesh) {
+			this->geometry->free(this->mesh);
+		}
+	}
+
+	explicit PooledGeometry(
+		uint32_t vertex_stride,
+		VkIndexType index_type,
+		std::shared_ptr<BufferData> vertices,
+		std::shared_ptr<BufferData> indices = nullptr) :
+		format({
+			.vertex_stride = vertex_stride,
+			.index_size = indices ? IndexSize(index_type) : 0,
+			}),
+		index_type(index_type),
+		vertices(std::move(vertices)),
+		indices(std::move(indices))
+	{
+		if (!this->format.vertex_stride) {
+			throw std::invalid_argument("PooledGeometry: vertex stride is 0");
+		}
+		REGISTER_VISITOR(loadvisitor, PooledGeometry, load);
+		REGISTER_VISITOR(allocvisitor, PooledGeometry, alloc);
+		REGISTER_VISITOR(pipelinevisitor, PooledGeometry, update);
+		REGISTER_VISITOR(recordvisitor, PooledGeometry, update);
+		REGISTER_VISITOR(rendervisitor, PooledGeometry, update);
+	}
+
+	// the data isn't part of the scene graph, loading it is up to this node
+	void load(Visitor* context)
+	{
+		this->vertices->visit(context);
+		if (this->indices) {
+			this->indices->visit(context);
+		}
+	}
+
+	void alloc(CommandVisitor* context)
+	{
+		this->load(context);
+		if (this->vertices->size() % this->format.vertex_stride) {
+			throw std::invalid_argument("PooledGeometry: vertex data is not a whole number of vertices");
+		}
+		if (this->indices && this->indices->size() % this->format.index_size) {
+			throw std::invalid_argument("PooledGeometry: index data is not a whole number of indices");
+		}
+		if (this->mesh) {
+			this->geometry->free(this->mesh);
+		}
+		this->geometry = context->state->geometry;
+
+		BufferData* vertices = this->vertices.get();
+		BufferData* indices = this->indices.get();
+		this->mesh = this->geometry->allocate(
+			this->format,
+			static_cast<uint32_t>(vertices->size() / this->format.vertex_stride),
+			indices ? static_cast<uint32_t>(indices->size() / this->format.index_size) : 0,
+			[vertices](char* dst) { vertices->copy(dst); },
+			[indices](char* dst) { indices->copy(dst); });
+
+		this->update(context);
+	}
+
+	void update(Visitor* context)
+	{
+		// compaction may have moved the mesh since the last traversal
+		const GeometryPool::Range& range = this->geometry->range(this->mesh);
+
+		context->state->buffer = this->geometry->vertexBuffer(range.page);
+		context->state->bufferdata = this->vertices.get();
+		context->state->base_vertex = static_cast<int32_t>(range.base_vertex);
+		context->state->first_index = range.first_index;
+
+		if (this->indices) {
+			context->state->index_buffer = this->geometry->indexBuffer(range.page);
+			context->state->index_buffer_type = this->index_type;
+			context->state->index_count = range.index_count;
+			context->state->index_data = this->indices.get();
+		}
+	}
+
+private:
+	static uint32_t IndexSize(VkIndexType type)
+	{
+		switch (type) {
+		case VK_INDEX_TYPE_UINT16: return sizeof(uint16_t);
+		case VK_INDEX_TYPE_UINT32: return sizeof(uint32_t);
+		default: throw std::invalid_argument("PooledGeometry: indices must be VK_INDEX_TYPE_UINT16 or VK_INDEX_TYPE_UINT32");
+		}
+	}
+
+	GeometryFormat format;
+	VkIndexType index_type;
+	std::shared_ptr<BufferData> vertices;
+	std::shared_ptr<BufferData> indices;
+	std::shared_ptr<GeometryBuffers> geometry;
+	GeometryPool::Handle mesh{ 0 };
+};
+
+
+// model view, projection and texture matrix of the current state, as the shaders see them
+inline std::array<glm::mat4, 3> TransformMatrices(const State* state)
+{
+	if (state->transforms) {
+		glm::mat4 view(state->ViewMatrix);
+		glm::mat4 modelview;
+		state->transforms->multiply(glm::value_ptr(view), state->transform, glm::value_ptr(modelview));
+		return {
+		  modelview,
+		  glm::mat4(state->ProjectionMatrix),
+		  glm::mat4(state->TextureMatrix)
+		};
+	}
+	return {
+	  glm::mat4(state->ViewMatrix * state->ModelMatrix),
+	  glm::mat4(state->ProjectionMatrix),
+	  glm::mat4(state->TextureMatrix)
+	};
+}
+
+
 class TransformBuffer : public Node {
 public:
 	IMPLEMENT_VISITABLE;
-	virtual ~TransformBuffer() = default;
+
+	virtual ~TransformBuffer()
+	{
+		if (this->uniforms) {
+			this->uniforms->free(this->slot);
+		}
+	}
 
 	TransformBuffer()
 	{
@@ -495,35 +1218,55 @@ public:
 
 	void alloc(Visitor* context)
 	{
-		this->buffer = std::make_shared<VulkanBufferObject>(
-			context->state->device,
-			0,
-			sizeof(glm::mat4) * 3,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (!this->uniforms) {
+			this->uniforms = context->state->uniforms;
+			this->slot = this->uniforms->allocate();
+		}
 	}
 
 	void pipeline(Visitor* context)
 	{
-		context->state->buffer = this->buffer->buffer->buffer;
+		context->state->buffer = this->uniforms->getBuffer();
+		context->state->uniform_slot = this->slot;
 	}
 
 	void render(Visitor* context)
 	{
-		std::array<glm::mat4, 3> data = {
-		  glm::mat4(context->state->ViewMatrix * context->state->ModelMatrix),
-		  glm::mat4(context->state->ProjectionMatrix),
-		  glm::mat4(context->state->TextureMatrix)
-		};
-
-		MemoryMap map(this->buffer->memory.get());
-		std::copy(data.begin(), data.end(), reinterpret_cast<glm::mat4*>(map.mem));
+		auto data = TransformMatrices(context->state.get());
+		std::copy(data.begin(), data.end(), reinterpret_cast<glm::mat4*>(
+			this->uniforms->data(context->state->frame_index, this->slot)));
 	}
 
 private:
-	std::shared_ptr<VulkanBufferObject> buffer;
-	VkDescriptorBufferInfo descriptor_buffer_info{};
+	std::shared_ptr<UniformRing> uniforms;
+	uint32_t slot{ 0 };
+};
+
+
+// Passes the transform matrices as push constants instead, recorded per frame by the draw commands
+class TransformPushConstants : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	virtual ~TransformPushConstants() = default;
+
+	TransformPushConstants()
+	{
+		REGISTER_VISITOR(pipelinevisitor, TransformPushConstants, pipeline);
+	}
+
+	void pipeline(Visitor* context)
+	{
+		const uint32_t size = sizeof(glm::mat4) * 3;
+		if (context->state->device->physical_device.properties.limits.maxPushConstantsSize < size) {
+			throw std::runtime_error("TransformPushConstants: device push constant space is too small");
+		}
+		context->state->pushConstantRanges.push_back({
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			.offset = 0,
+			.size = size,
+			});
+		context->state->push_transform = true;
+	}
 };
 
 
@@ -545,6 +1288,7 @@ public:
 		context->state->index_buffer = context->state->buffer;
 		context->state->index_buffer_type = this->type;
 		context->state->index_count = context->state->bufferdata->count();
+		context->state->index_data = context->state->bufferdata;
 	}
 
 private:
@@ -581,6 +1325,7 @@ public:
 		context->state->vertex_attribute_buffers.push_back(context->state->buffer);
 		context->state->vertex_attribute_buffer_offsets.push_back(0);
 		context->state->vertex_counts.push_back(context->state->bufferdata->count());
+		context->state->vertex_attribute_data.push_back(context->state->bufferdata);
 	}
 
 private:
@@ -622,6 +1367,80 @@ private:
 };
 
 
+// Binds the instance data in the current buffer at instance input rate. The instance
+// matrix, color and id take six attribute locations from first_location.
+class InstanceAttributes : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	InstanceAttributes() = delete;
+	virtual ~InstanceAttributes() = default;
+
+	InstanceAttributes(uint32_t binding, uint32_t first_location) :
+		binding(binding),
+		first_location(first_location)
+	{
+		REGISTER_VISITOR(allocvisitor, InstanceAttributes, update);
+		REGISTER_VISITOR(pipelinevisitor, InstanceAttributes, update);
+		REGISTER_VISITOR(recordvisitor, InstanceAttributes, update);
+	}
+
+	void update(Visitor* context)
+	{
+		auto instances = dynamic_cast<InstanceData*>(context->state->bufferdata);
+		if (!instances) {
+			throw std::invalid_argument("InstanceAttributes: buffer data is not instance data");
+		}
+		context->state->instances = instances;
+
+		context->state->vertex_input_bindings.push_back({
+			.binding = this->binding,
+			.stride = InstanceLayout::STRIDE,
+			.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+			});
+
+		for (auto& attribute : InstanceLayout::Attributes(this->first_location)) {
+			context->state->vertex_attributes.push_back({
+				.location = attribute.location,
+				.binding = this->binding,
+				.format = attribute.format == InstanceAttribute::VEC4 ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R32_UINT,
+				.offset = attribute.offset,
+				});
+			context->state->vertex_attribute_buffers.push_back(context->state->buffer);
+			context->state->vertex_attribute_buffer_offsets.push_back(0);
+			context->state->vertex_counts.push_back(static_cast<uint32_t>(instances->count()));
+			context->state->vertex_attribute_data.push_back(instances);
+		}
+	}
+
+private:
+	uint32_t binding;
+	uint32_t first_location;
+};
+
+
+// Draws the geometry once per instance in one instanced draw. The instance data is uploaded
+// to a vertex buffer and overrides the instance count of the draw commands in the geometry.
+class Instances : public Separator {
+public:
+	Instances() = delete;
+	virtual ~Instances() = default;
+
+	Instances(
+		uint32_t binding,
+		uint32_t first_location,
+		std::shared_ptr<InstanceData> instances,
+		std::vector<std::shared_ptr<Node>> geometry)
+	{
+		this->children = {
+			std::move(instances),
+			std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+			std::make_shared<InstanceAttributes>(binding, first_location),
+		};
+		this->children.insert(this->children.end(), geometry.begin(), geometry.end());
+	}
+};
+
+
 class DescriptorSetLayoutBinding : public Node {
 public:
 	IMPLEMENT_VISITABLE;
@@ -642,6 +1461,7 @@ public:
 
 	void pipeline(Visitor* context)
 	{
+		DescriptorSetInfo info = this->info;
 		if (info.descriptorType == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR) {
 			info.descriptor_set_acceleration_structure = {
 				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
@@ -650,6 +1470,16 @@ public:
 				.pAccelerationStructures = context->state->top_level_acceleration_structures.data(),
 			};
 		}
+		else if (context->state->uniforms && context->state->buffer == context->state->uniforms->getBuffer()) {
+			// per draw data in the uniform ring, the frame's region is picked by the dynamic offset
+			info.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			info.uniform_slot = context->state->uniform_slot;
+			info.descriptor_buffer_info = {
+				.buffer = context->state->buffer,
+				.offset = 0,
+				.range = context->state->uniforms->getStride()
+			};
+		}
 		else {
 			info.descriptor_buffer_info = {
 				.buffer = context->state->buffer,
@@ -663,7 +1493,7 @@ public:
 				.imageLayout = context->state->imageLayout
 			};
 		}
-		context->state->descriptor_set_infos.push_back(this->info);
+		context->state->descriptor_set_infos.push_back(info);
 	}
 
 private:
@@ -671,17 +1501,56 @@ private:
 };
 
 
+// The shaderc the build links with, set by the build from the library itself. Otherwise the
+// time this was compiled, so a rebuild against another shaderc doesn't reuse cached SPIR-V.
+#ifndef INNOVATOR_SHADERC_BUILD
+#define INNOVATOR_SHADERC_BUILD __DATE__ " " __TIME__
+#endif
+
+// Shared by all shader nodes. SPIR-V is cached in Innovator.spirvcache, keyed by the source,
+// the shaderc build and the SPIR-V version it targets.
+inline ShaderCompiler& GetShaderCompiler()
+{
+	static ShaderCompiler compiler(
+		[](const ShaderSource& source) {
+			shaderc::Compiler compiler;
+			shaderc::CompileOptions options;
+			for (auto& [name, value] : source.defines) {
+				options.AddMacroDefinition(name, value);
+			}
+			shaderc::SpvCompilationResult spv = compiler.CompileGlslToSpv(
+				source.glsl, static_cast<shaderc_shader_kind>(source.kind), "", options);
+
+			if (spv.GetCompilationStatus() != shaderc_compilation_status_success) {
+				throw std::runtime_error(spv.GetErrorMessage());
+			}
+			return std::vector<uint32_t>(spv.cbegin(), spv.cend());
+		},
+		"Innovator.spirvcache",
+		[]() {
+			unsigned int version, revision;
+			shaderc_get_spv_version(&version, &revision);
+			return std::string("shaderc ") + INNOVATOR_SHADERC_BUILD +
+				" spv " + std::to_string(version) + "." + std::to_string(revision);
+		}());
+
+	return compiler;
+}
+
+
 class Shader : public Node {
 public:
 	IMPLEMENT_VISITABLE;
 	Shader() = delete;
 	virtual ~Shader() = default;
 
-	explicit Shader(const VkShaderStageFlagBits stage, std::string glsl) :
+	explicit Shader(
+		const VkShaderStageFlagBits stage,
+		std::string glsl,
+		const SpecializationConstants& constants = {}) :
 		stage(stage)
 	{
 		REGISTER_VISITOR(devicevisitor, Shader, device);
-		REGISTER_VISITOR(allocvisitor, Shader, alloc);
 		REGISTER_VISITOR(pipelinevisitor, Shader, pipeline);
 		REGISTER_VISITOR(recordvisitor, Shader, record);
 
@@ -715,14 +1584,27 @@ public:
 			}
 		}();
 
-		shaderc::Compiler compiler;
-		shaderc::CompileOptions options;
-		shaderc::SpvCompilationResult spv = compiler.CompileGlslToSpv(glsl, kind, "", options);
-
-		if (spv.GetCompilationStatus() != shaderc_compilation_status_success) {
-			throw std::runtime_error(spv.GetErrorMessage());
+		// resolved against the source up front, so a misspelled name fails when the scene is read
+		this->specialization = constants.pack(ParseSpecializationConstants(glsl));
+		for (auto& entry : this->specialization.entries) {
+			this->map_entries.push_back({
+				.constantID = entry.constantID,
+				.offset = entry.offset,
+				.size = entry.size,
+				});
 		}
-		this->spv = { spv.cbegin(), spv.cend() };
+		this->specialization_info = {
+			.mapEntryCount = static_cast<uint32_t>(this->map_entries.size()),
+			.pMapEntries = this->map_entries.data(),
+			.dataSize = this->specialization.data.size(),
+			.pData = this->specialization.data.data(),
+		};
+
+		// compiles in the background, the pipeline pass waits for it
+		this->spv = GetShaderCompiler().compile({
+			.glsl = std::move(glsl),
+			.kind = static_cast<uint32_t>(kind),
+			});
 	}
 
 	void device(DeviceVisitor* context)
@@ -741,11 +1623,6 @@ public:
 		}
 	}
 
-	void alloc(CommandVisitor* context)
-	{
-		this->shader = std::make_unique<VulkanShaderModule>(context->state->device, this->spv);
-	}
-
 	void updateState(Visitor* context)
 	{
 		context->state->shader_stage_infos.push_back({
@@ -755,12 +1632,15 @@ public:
 			.stage = this->stage,
 			.module = this->shader->shadermodule,
 			.pName = "main",
-			.pSpecializationInfo = nullptr,
+			.pSpecializationInfo = this->map_entries.empty() ? nullptr : &this->specialization_info,
 			});
 	}
 
 	void pipeline(Visitor* context)
 	{
+		if (!this->shader) {
+			this->shader = context->state->pipelinecache->getShaderModule(this->spv.get());
+		}
 		this->updateState(context);
 	}
 
@@ -770,9 +1650,12 @@ public:
 	}
 
 public:
-	std::vector<uint32_t> spv;
+	std::shared_future<std::vector<uint32_t>> spv;
 	VkShaderStageFlagBits stage;
-	std::unique_ptr<VulkanShaderModule> shader;
+	std::shared_ptr<VulkanShaderModule> shader;
+	SpecializationData specialization;
+	std::vector<VkSpecializationMapEntry> map_entries;
+	VkSpecializationInfo specialization_info{};
 };
 
 
@@ -1043,13 +1926,12 @@ public:
 
 	void alloc(CommandVisitor* context)
 	{
-		this->command = std::make_unique<VulkanCommandBuffers>(context->state->device);
+		this->command = std::make_unique<VulkanCommandBuffers>(context->state->device, context->state->frames->depth());
 		this->queue = context->state->device->getQueue(VK_QUEUE_GRAPHICS_BIT);
 	}
 
 	void pipeline(Visitor* context)
 	{
-		std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
 		std::vector<VkWriteDescriptorSet> write_descriptor_sets;
 		std::vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_bindings;
 
@@ -1074,11 +1956,6 @@ public:
 			write_descriptor_set.pBufferInfo = &info.descriptor_buffer_info;
 			write_descriptor_set.pImageInfo = &info.descriptor_image_info;
 
-			descriptor_pool_sizes.push_back({
-				.type = info.descriptorType,
-				.descriptorCount = 1,
-				});
-
 			descriptor_set_layout_bindings.push_back({
 				.binding = info.binding,
 				.descriptorType = info.descriptorType,
@@ -1090,32 +1967,22 @@ public:
 			write_descriptor_sets.push_back(write_descriptor_set);
 		}
 
-		auto descriptor_pool = std::make_shared<VulkanDescriptorPool>(
-			context->state->device,
-			descriptor_pool_sizes);
-
-		this->descriptor_set_layout = std::make_unique<VulkanDescriptorSetLayout>(
-			context->state->device,
-			descriptor_set_layout_bindings);
+		this->descriptor_set_layout = context->state->descriptors->getLayout(descriptor_set_layout_bindings);
 
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
 			this->descriptor_set_layout->layout
 		};
 
-		this->pipeline_layout = std::make_unique<VulkanPipelineLayout>(
-			context->state->device,
+		this->pipeline_layout = context->state->descriptors->getPipelineLayout(
 			descriptor_set_layouts,
 			context->state->pushConstantRanges);
 
-		this->descriptor_sets = std::make_unique<VulkanDescriptorSets>(
-			context->state->device,
-			descriptor_pool,
-			descriptor_set_layouts);
+		this->descriptor_sets = context->state->descriptors->getDescriptorSet(
+			this->descriptor_set_layout.get(),
+			write_descriptor_sets);
 
-		for (auto& write_descriptor_set : write_descriptor_sets) {
-			write_descriptor_set.dstSet = this->descriptor_sets->descriptor_sets[0];
-		}
-		this->descriptor_sets->update(write_descriptor_sets);
+		this->uniforms = context->state->uniforms;
+		this->dynamic_slots = UniformRing::DynamicSlots(context->state->descriptor_set_infos);
 
 		for (size_t i = 0; i < context->state->shader_stage_infos.size(); i++) {
 			VkRayTracingShaderGroupCreateInfoKHR rtx_group_info{
@@ -1161,6 +2028,7 @@ public:
 		const VkDeviceSize shader_binding_table_size = shader_binding_table_stride * shader_binding_table_count;
 		const VkDeviceSize shader_binding_table_handle_size = ray_tracing_properties.shaderGroupHandleSize;
 
+		context->state->frames->retire(std::move(this->shader_binding_table));
 		this->shader_binding_table = std::make_shared<VulkanBufferObject>(
 			context->state->device,
 			0,
@@ -1221,34 +2089,34 @@ public:
 			}
 		}
 
-		VulkanCommandBuffers::Scope scope(this->command.get());
-
-		vk.CmdBindPipeline(this->command->buffer(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, this->rtx_pipeline->pipeline);
-
-		vk.CmdBindDescriptorSets(
-			this->command->buffer(),
-			VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
-			this->pipeline_layout->layout,
-			0,
-			static_cast<uint32_t>(this->descriptor_sets->descriptor_sets.size()),
-			this->descriptor_sets->descriptor_sets.data(),
-			0,
-			nullptr);
-
-		context->state->vulkan->vkCmdTraceRaysKHR(
-			this->command->buffer(),
-			&raygen_shader_sbt_entry,
-			&miss_shader_sbt_entry,
-			&hit_shader_sbt_entry,
-			&callable_shader_sbt_entry,
-			context->state->extent.width,
-			context->state->extent.height,
-			1);
+		// one command buffer per frame in flight, each bound to its frame's uniform ring region
+		for (uint32_t frame = 0; frame < context->state->frames->depth(); frame++) {
+			VulkanCommandBuffers::Scope scope(this->command.get(), frame);
+
+			vk.CmdBindPipeline(this->command->buffer(frame), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, this->rtx_pipeline->pipeline);
+
+			this->descriptor_sets->bind(
+				this->command->buffer(frame),
+				this->pipeline_layout->layout,
+				this->uniforms->offsets(frame, this->dynamic_slots),
+				VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR);
+
+			context->state->vulkan->vkCmdTraceRaysKHR(
+				this->command->buffer(frame),
+				&raygen_shader_sbt_entry,
+				&miss_shader_sbt_entry,
+				&hit_shader_sbt_entry,
+				&callable_shader_sbt_entry,
+				context->state->extent.width,
+				context->state->extent.height,
+				1);
+		}
 	}
 
 	void render(Visitor* context)
 	{
-		this->command->submit(this->queue, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		NeverCull(context->state.get());
+		this->command->submit(this->queue, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context->state->frame_index);
 	}
 
 	std::shared_ptr<VulkanDescriptorSetLayout> descriptor_set_layout{ nullptr };
@@ -1258,6 +2126,8 @@ public:
 	std::vector<VkRayTracingShaderGroupCreateInfoKHR> shader_groups;
 	std::shared_ptr<VulkanRayTracingPipeline> rtx_pipeline;
 	std::unique_ptr<VulkanCommandBuffers> command;
+	std::shared_ptr<UniformRing> uniforms;
+	std::vector<uint32_t> dynamic_slots;
 	VkQueue queue{ nullptr };
 
 };
@@ -1273,6 +2143,7 @@ public:
 	Extent(uint32_t width, uint32_t height, uint32_t depth = 1) :
 		extent{ width, height, depth }
 	{
+		REGISTER_VISITOR(graphvisitor, Extent, update);
 		REGISTER_VISITOR(allocvisitor, Extent, update);
 		REGISTER_VISITOR(pipelinevisitor, Extent, update);
 		REGISTER_VISITOR(recordvisitor, Extent, update);
@@ -1331,7 +2202,6 @@ public:
 
 	void pipeline(Visitor* context)
 	{
-		std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
 		std::vector<VkWriteDescriptorSet> write_descriptor_sets;
 		std::vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_bindings;
 
@@ -1356,11 +2226,6 @@ public:
 			write_descriptor_set.pBufferInfo = &info.descriptor_buffer_info;
 			write_descriptor_set.pImageInfo = &info.descriptor_image_info;
 
-			descriptor_pool_sizes.push_back({
-				.type = info.descriptorType,
-				.descriptorCount = 1,
-				});
-
 			descriptor_set_layout_bindings.push_back({
 				.binding = info.binding,
 				.descriptorType = info.descriptorType,
@@ -1372,32 +2237,19 @@ public:
 			write_descriptor_sets.push_back(write_descriptor_set);
 		}
 
-		auto descriptor_pool = std::make_shared<VulkanDescriptorPool>(
-			context->state->device,
-			descriptor_pool_sizes);
-
-		this->descriptor_set_layout = std::make_unique<VulkanDescriptorSetLayout>(
-			context->state->device,
-			descriptor_set_layout_bindings);
+		this->descriptor_set_layout = context->state->descriptors->getLayout(descriptor_set_layout_bindings);
 
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
 			this->descriptor_set_layout->layout
 		};
 
-		this->pipeline_layout = std::make_unique<VulkanPipelineLayout>(
-			context->state->device,
+		this->pipeline_layout = context->state->descriptors->getPipelineLayout(
 			descriptor_set_layouts,
 			context->state->pushConstantRanges);
 
-		this->descriptor_sets = std::make_unique<VulkanDescriptorSets>(
-			context->state->device,
-			descriptor_pool,
-			descriptor_set_layouts);
-
-		for (auto& write_descriptor_set : write_descriptor_sets) {
-			write_descriptor_set.dstSet = this->descriptor_sets->descriptor_sets[0];
-		}
-		this->descriptor_sets->update(write_descriptor_sets);
+		this->descriptor_sets = context->state->descriptors->getDescriptorSet(
+			this->descriptor_set_layout.get(),
+			write_descriptor_sets);
 
 		this->compute_pipeline = std::make_unique<VulkanComputePipeline>(
 			context->state->device,
@@ -1438,7 +2290,61 @@ private:
 	std::shared_ptr<VulkanDescriptorSetLayout> descriptor_set_layout;
 	std::shared_ptr<VulkanDescriptorSets> descriptor_sets;
 	std::shared_ptr<VulkanPipelineLayout> pipeline_layout;
-	std::shared_ptr<VulkanDescriptorPool> descriptor_pool;
+};
+
+
+// The draws a pick traversal passed, under the transforms they were rendered with, and a BVH over
+// them. Kept from one pick to the next, the same draws in the same order only refit it.
+class Picking {
+public:
+	void begin()
+	{
+		this->scene.begin();
+		this->nodes.clear();
+	}
+
+	void add(Node* node, std::shared_ptr<const TriangleBvh> mesh, const State* state)
+	{
+		size_t size = this->scene.size();
+		this->scene.add(std::move(mesh), WorldMatrix(state));
+		if (this->scene.size() > size) {
+			this->nodes.push_back(node);
+		}
+		this->ViewMatrix = state->ViewMatrix;
+		this->ProjectionMatrix = state->ProjectionMatrix;
+	}
+
+	// the nearest hit along the ray from the eye through the center of pixel x, y
+	std::optional<PickResult> end(int x, int y, VkExtent3D extent)
+	{
+		this->scene.end(&Bvh::Threads());
+		if (this->nodes.empty() || !extent.width || !extent.height) {
+			return std::nullopt;
+		}
+		glm::dvec2 ndc(
+			2.0 * (x + 0.5) / extent.width - 1.0,
+			2.0 * (y + 0.5) / extent.height - 1.0);
+
+		glm::dmat4 inverse = glm::inverse(this->ProjectionMatrix * this->ViewMatrix);
+		glm::dvec4 point = inverse * glm::dvec4(ndc, 0.5, 1.0);
+		glm::dvec3 eye(glm::inverse(this->ViewMatrix)[3]);
+		glm::dvec3 direction = glm::dvec3(point) / point.w - eye;
+
+		auto hit = this->scene.intersect({ eye.x, eye.y, eye.z }, { direction.x, direction.y, direction.z });
+		if (!hit) {
+			return std::nullopt;
+		}
+		return PickResult{
+			.node = this->nodes[hit->instance],
+			.triangle = hit->triangle,
+			.point = glm::dvec3(hit->point[0], hit->point[1], hit->point[2]),
+		};
+	}
+
+	BvhScene scene;
+	std::vector<Node*> nodes;
+	glm::dmat4 ViewMatrix{ 1.0 };
+	glm::dmat4 ProjectionMatrix{ 1.0 };
 };
 
 
@@ -1452,19 +2358,57 @@ public:
 		topology(topology)
 	{}
 
-	void alloc(Visitor* context)
+	virtual void execute(VkCommandBuffer command, uint32_t frame) = 0;
+
+	// GPU work the draw of this frame depends on, submitted before the render pass is
+	virtual void prepare(State*, uint32_t)
+	{}
+
+	// bounds of count float3 positions, stride bytes apart starting at offset
+	virtual BoundingBox positionBounds(State*, const char* positions, size_t count, size_t stride, size_t offset)
 	{
-		this->command = std::make_unique<VulkanCommandBuffers>(
-			context->state->device,
-			1,
-			VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		return BoundingBox::FromPositions(positions, count, stride, offset);
 	}
 
-	virtual void execute(VkCommandBuffer command, Visitor*) = 0;
+	// object space bounds of the positions, the three component float attribute at location 0
+	void alloc(Visitor* context)
+	{
+		State* state = context->state.get();
+		this->bounds = BoundingBox::Infinite();
+		this->position_data = nullptr;
+
+		for (size_t i = 0; i < state->vertex_attributes.size(); i++) {
+			auto& attribute = state->vertex_attributes[i];
+			if (attribute.location != 0 ||
+				(attribute.format != VK_FORMAT_R32G32B32_SFLOAT && attribute.format != VK_FORMAT_R32G32B32A32_SFLOAT)) {
+				continue;
+			}
+			auto binding = std::find_if(state->vertex_input_bindings.begin(), state->vertex_input_bindings.end(),
+				[&attribute](auto& description) { return description.binding == attribute.binding; });
+			if (binding != state->vertex_input_bindings.end() && binding->inputRate != VK_VERTEX_INPUT_RATE_VERTEX) {
+				continue;
+			}
+			size_t stride = (binding != state->vertex_input_bindings.end() && binding->stride) ? binding->stride : sizeof(float) * 3;
+
+			BufferData* bufferdata = state->vertex_attribute_data[i];
+			std::vector<char> data(bufferdata->size());
+			bufferdata->copy(data.data());
+
+			size_t count = data.size() >= attribute.offset + sizeof(float) * 3 ?
+				(data.size() - attribute.offset - sizeof(float) * 3) / stride + 1 : 0;
+			this->bounds = this->positionBounds(state, data.data(), count, stride, attribute.offset);
+			this->position_data = bufferdata;
+			this->position_stride = stride;
+			this->position_offset = attribute.offset;
+		}
+		if (state->instances) {
+			this->bounds = InstanceLayout::Bounds(this->bounds, state->instances->instances);
+		}
+		Separator::invalidateBounds();
+	}
 
 	void pipeline(Visitor* context)
 	{
-		std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
 		std::vector<VkWriteDescriptorSet> write_descriptor_sets;
 		std::vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_bindings;
 
@@ -1489,11 +2433,6 @@ public:
 			write_descriptor_set.pBufferInfo = &info.descriptor_buffer_info;
 			write_descriptor_set.pImageInfo = &info.descriptor_image_info;
 
-			descriptor_pool_sizes.push_back({
-				.type = info.descriptorType,
-				.descriptorCount = 1,
-				});
-
 			descriptor_set_layout_bindings.push_back({
 				.binding = info.binding,
 				.descriptorType = info.descriptorType,
@@ -1505,46 +2444,33 @@ public:
 			write_descriptor_sets.push_back(write_descriptor_set);
 		}
 
-		auto descriptor_pool = std::make_shared<VulkanDescriptorPool>(
-			context->state->device,
-			descriptor_pool_sizes);
+		context->state->frames->retire(std::move(this->graphics_pipeline));
+		context->state->frames->retire(std::move(this->descriptor_sets));
 
-		this->descriptor_set_layout = std::make_unique<VulkanDescriptorSetLayout>(
-			context->state->device,
-			descriptor_set_layout_bindings);
+		this->descriptor_set_layout = context->state->descriptors->getLayout(descriptor_set_layout_bindings);
 
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
 			this->descriptor_set_layout->layout
 		};
 
-		//context->state->pushConstantRanges.push_back({
-		//	VK_SHADER_STAGE_FRAGMENT_BIT,
-		//	0,
-		//	sizeof(glm::vec3) * 1,
-		//});
-
-		this->pipeline_layout = std::make_unique<VulkanPipelineLayout>(
-			context->state->device,
+		this->pipeline_layout = context->state->descriptors->getPipelineLayout(
 			descriptor_set_layouts,
 			context->state->pushConstantRanges);
 
-		this->descriptor_sets = std::make_unique<VulkanDescriptorSets>(
-			context->state->device,
-			descriptor_pool,
-			descriptor_set_layouts);
+		this->descriptor_sets = context->state->descriptors->getDescriptorSet(
+			this->descriptor_set_layout.get(),
+			write_descriptor_sets);
 
-		for (auto& write_descriptor_set : write_descriptor_sets) {
-			write_descriptor_set.dstSet = this->descriptor_sets->descriptor_sets[0];
-		}
-		this->descriptor_sets->update(write_descriptor_sets);
+		this->uniforms = context->state->uniforms;
+		this->dynamic_slots = UniformRing::DynamicSlots(context->state->descriptor_set_infos);
+		this->push_transform = context->state->push_transform;
 
-		this->graphics_pipeline = std::make_unique<VulkanGraphicsPipeline>(
-			context->state->device,
+		this->graphics_pipeline = context->state->pipelinecache->getGraphicsPipeline(
 			context->state->renderpass->renderpass,
-			context->state->pipelinecache->cache,
 			this->pipeline_layout->layout,
 			this->topology,
 			context->state->rasterization_state,
+			context->state->samples,
 			this->dynamic_states,
 			context->state->shader_stage_infos,
 			context->state->vertex_input_bindings,
@@ -1553,22 +2479,117 @@ public:
 
 	void record(Visitor* context)
 	{
+		// the render traversal doesn't see buffers and extent, keep what per frame recording needs
+		this->renderpass = context->state->renderpass->renderpass;
+		this->extent = context->state->extent;
+		std::vector<uint32_t> attribute_bindings;
+		for (auto& attribute : context->state->vertex_attributes) {
+			attribute_bindings.push_back(attribute.binding);
+		}
+		this->vertex_bindings = VertexBindingRanges(
+			attribute_bindings,
+			context->state->vertex_attribute_buffers,
+			context->state->vertex_attribute_buffer_offsets);
+		this->instance_count = context->state->instances ?
+			static_cast<uint32_t>(context->state->instances->count()) : 0;
+		this->index_buffer = context->state->index_buffer;
+		this->index_buffer_type = context->state->index_buffer_type;
+		this->base_vertex = context->state->base_vertex;
+		this->first_index = context->state->first_index;
+		this->index_count = context->state->index_count;
+
+		// re-recording a secondary that pending primaries reference is not allowed, record into fresh ones
+		context->state->frames->retire(std::move(this->command));
+		this->command = std::make_unique<VulkanCommandBuffers>(
+			context->state->device,
+			context->state->frames->depth(),
+			VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+		// push constants change every frame and are recorded in render
+		if (!this->push_transform) {
+			for (uint32_t frame = 0; frame < context->state->frames->depth(); frame++) {
+				this->recordFrame(frame, nullptr);
+			}
+		}
+	}
+
+	void render(Visitor* context)
+	{
+		BoundingBox bounds = this->bounds.transformed(WorldMatrix(context->state.get()));
+		context->state->bounds.extend(bounds);
+
+		uint32_t planes = context->state->cull_planes;
+		if (context->state->cull && context->state->frustum.cull(bounds, planes)) {
+			return;
+		}
+		// occluders are not tested against themselves
+		if (context->state->cull && context->state->occlusion && !context->state->occluder &&
+			context->state->occlusion->occluded(bounds)) {
+			return;
+		}
+
+		uint32_t frame = context->state->frame_index;
+		this->prepare(context->state.get(), frame);
+
+		if (this->push_transform) {
+			auto transform = TransformMatrices(context->state.get());
+			this->recordFrame(frame, &transform);
+		}
+
+		vk.CmdExecuteCommands(
+			context->state->command->buffer(frame),
+			1,
+			&this->command->buffers[frame]);
+	}
+
+protected:
+	VkBuffer index_buffer{ 0 };
+	VkIndexType index_buffer_type{ VK_INDEX_TYPE_NONE_KHR };
+	// offsets of a mesh in the shared geometry pool, added to those of the draw
+	int32_t base_vertex{ 0 };
+	uint32_t first_index{ 0 };
+	// of the current index buffer, for draws of all of it
+	uint32_t index_count{ 0 };
+	// set when drawn under an Instances node
+	uint32_t instance_count{ 0 };
+	// where alloc found the positions
+	BufferData* position_data{ nullptr };
+	size_t position_stride{ 0 };
+	size_t position_offset{ 0 };
+	VkPrimitiveTopology topology;
+
+private:
+	// the secondary of each frame in flight binds that frame's region of the uniform ring
+	void recordFrame(uint32_t frame, const std::array<glm::mat4, 3>* transform)
+	{
+		VkCommandBuffer command = this->command->buffer(frame);
+
 		this->command->begin(
-			0,
-			context->state->renderpass->renderpass,
+			frame,
+			this->renderpass,
 			0,
 			VK_NULL_HANDLE,
 			VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
 
-		this->descriptor_sets->bind(this->command->buffer(), this->pipeline_layout->layout);
-		this->graphics_pipeline->bind(this->command->buffer());
+		this->descriptor_sets->bind(command, this->pipeline_layout->layout, this->uniforms->offsets(frame, this->dynamic_slots));
+		this->graphics_pipeline->bind(command);
+
+		if (transform) {
+			vk.CmdPushConstants(
+				command,
+				this->pipeline_layout->layout,
+				VK_SHADER_STAGE_VERTEX_BIT,
+				0,
+				sizeof(*transform),
+				transform->data());
+		}
 
 		std::vector<VkRect2D> scissors{ {
 			{ 0, 0 },
-			VkExtent2D{ context->state->extent.width, context->state->extent.width }
+			VkExtent2D{ this->extent.width, this->extent.width }
 		} };
 
-		vk.CmdSetScissor(this->command->buffer(),
+		vk.CmdSetScissor(command,
 			0,
 			static_cast<uint32_t>(scissors.size()),
 			scissors.data());
@@ -1576,50 +2597,32 @@ public:
 		std::vector<VkViewport> viewports{ {
 			.x = 0.0f,
 			.y = 0.0f,
-			.width = static_cast<float>(context->state->extent.width),
-			.height = static_cast<float>(context->state->extent.height),
+			.width = static_cast<float>(this->extent.width),
+			.height = static_cast<float>(this->extent.height),
 			.minDepth = 0.0f,
 			.maxDepth = 1.0f
 		} };
 
-		vk.CmdSetViewport(this->command->buffer(),
+		vk.CmdSetViewport(command,
 			0,
 			static_cast<uint32_t>(viewports.size()),
 			viewports.data());
 
-		vk.CmdBindVertexBuffers(this->command->buffer(),
-			0,
-			static_cast<uint32_t>(context->state->vertex_attribute_buffers.size()),
-			context->state->vertex_attribute_buffers.data(),
-			context->state->vertex_attribute_buffer_offsets.data());
-
-		this->execute(this->command->buffer(), context);
-		this->command->end();
-	}
-
-	void render(Visitor* context)
-	{
-		//std::vector<glm::vec3> push_constants;
-		//push_constants.push_back(glm::vec3(2048, 8192, 1024));
-
-		//vk.CmdPushConstants(
-		//	context->state->command->buffer(),
-		//	this->pipeline_layout->layout,
-		//	VK_SHADER_STAGE_FRAGMENT_BIT,
-		//	0,
-		//	push_constants.size() * sizeof(glm::vec3),
-		//	push_constants.data());
+		for (auto& range : this->vertex_bindings) {
+			vk.CmdBindVertexBuffers(command,
+				range.first_binding,
+				static_cast<uint32_t>(range.buffers.size()),
+				range.buffers.data(),
+				range.offsets.data());
+		}
 
-		vk.CmdExecuteCommands(
-			context->state->command->buffer(),
-			static_cast<uint32_t>(this->command->buffers.size()),
-			this->command->buffers.data());
+		this->execute(command, frame);
+		this->command->end(frame);
 	}
 
 private:
-	VkPrimitiveTopology topology;
 	std::unique_ptr<VulkanCommandBuffers> command;
-	std::unique_ptr<VulkanGraphicsPipeline> graphics_pipeline;
+	std::shared_ptr<VulkanGraphicsPipeline> graphics_pipeline;
 	std::vector<VkDynamicState> dynamic_states{
 		VK_DYNAMIC_STATE_VIEWPORT,
 		VK_DYNAMIC_STATE_SCISSOR
@@ -1627,6 +2630,13 @@ private:
 	std::shared_ptr<VulkanDescriptorSetLayout> descriptor_set_layout;
 	std::shared_ptr<VulkanDescriptorSets> descriptor_sets;
 	std::shared_ptr<VulkanPipelineLayout> pipeline_layout;
+	std::shared_ptr<UniformRing> uniforms;
+	std::vector<uint32_t> dynamic_slots;
+	bool push_transform{ false };
+	VkRenderPass renderpass{ 0 };
+	VkExtent3D extent{ 0, 0, 0 };
+	std::vector<VertexBindingRange<VkBuffer>> vertex_bindings;
+	BoundingBox bounds{ BoundingBox::Infinite() };
 };
 
 
@@ -1654,13 +2664,13 @@ public:
 	}
 
 private:
-	void execute(VkCommandBuffer command, Visitor*) override
+	void execute(VkCommandBuffer command, uint32_t) override
 	{
 		vk.CmdDraw(
 			command,
 			this->vertexcount,
-			this->instancecount,
-			this->firstvertex,
+			this->instance_count ? this->instance_count : this->instancecount,
+			this->firstvertex + this->base_vertex,
 			this->firstinstance);
 	}
 
@@ -1670,6 +2680,7 @@ private:
 	uint32_t firstinstance;
 };
 
+// an index count of 0 draws the whole index buffer of the current state
 class IndexedDrawCommand : public DrawCommandBase {
 public:
 	IMPLEMENT_VISITABLE;
@@ -1694,23 +2705,129 @@ public:
 		REGISTER_VISITOR(pipelinevisitor, IndexedDrawCommand, pipeline);
 		REGISTER_VISITOR(recordvisitor, IndexedDrawCommand, record);
 		REGISTER_VISITOR(rendervisitor, IndexedDrawCommand, render);
+		REGISTER_VISITOR(pickvisitor, IndexedDrawCommand, pick);
+		REGISTER_VISITOR(occludervisitor, IndexedDrawCommand, occlude);
 	}
 
-private:
-	void execute(VkCommandBuffer command, Visitor* context) override
+	void alloc(Visitor* context)
 	{
-		vk.CmdBindIndexBuffer(
-			command,
-			context->state->index_buffer,
-			this->offset,
-			context->state->index_buffer_type);
+		DrawCommandBase::alloc(context);
+		this->index_data = context->state->index_data;
+		this->index_data_type = context->state->index_buffer_type;
+		this->bvh.reset();
+		this->occluder.reset();
+	}
+
+	// Triangle lists are picked against a BVH over their triangles, built on the first pick
+	// after alloc. Instanced draws are not picked.
+	void pick(Visitor* context)
+	{
+		if (this->topology != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST ||
+			this->instance_count || this->instancecount > 1 ||
+			!this->position_data || !this->index_data || !context->state->picking) {
+			return;
+		}
+		if (!this->bvh) {
+			this->bvh = this->buildBvh();
+		}
+		context->state->picking->add(this, this->bvh, context->state.get());
+	}
+
+	// triangle lists after an Occluder node are rasterized for occlusion culling, gathered on the
+	// first frame after alloc
+	void occlude(Visitor* context)
+	{
+		State* state = context->state.get();
+		if (this->topology != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST ||
+			this->instance_count || this->instancecount > 1 ||
+			!this->position_data || !this->index_data || !state->occlusion || !state->occluder) {
+			return;
+		}
+		if (!this->occluder) {
+			this->occluder = std::make_unique<Triangles>(this->triangles());
+		}
+		state->occlusion->add(
+			this->occluder->positions.data(),
+			this->occluder->positions.size() / 3,
+			this->occluder->indices.data(),
+			this->occluder->indices.size(),
+			WorldMatrix(state),
+			ToMatrix4(state->ProjectionMatrix * state->ViewMatrix));
+	}
+
+private:
+	struct Triangles {
+		std::vector<float> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	std::shared_ptr<TriangleBvh> buildBvh()
+	{
+		Triangles triangles = this->triangles();
+		return std::make_shared<TriangleBvh>(
+			triangles.positions.data(),
+			triangles.positions.size() / 3,
+			3,
+			std::move(triangles.indices),
+			&Bvh::Threads());
+	}
+
+	// packed positions and the indices of the draw, with its first index and vertex offset applied
+	Triangles triangles()
+	{
+		std::vector<char> vertices(this->position_data->size());
+		this->position_data->copy(vertices.data());
+		size_t vertex_count = vertices.size() >= this->position_offset + sizeof(float) * 3 ?
+			(vertices.size() - this->position_offset - sizeof(float) * 3) / this->position_stride + 1 : 0;
+		Triangles triangles;
+		std::vector<float>& positions = triangles.positions;
+		positions.resize(vertex_count * 3);
+		for (size_t i = 0; i < vertex_count; i++) {
+			std::memcpy(&positions[i * 3], vertices.data() + i * this->position_stride + this->position_offset, sizeof(float) * 3);
+		}
+
+		std::vector<char> data(this->index_data->size());
+		this->index_data->copy(data.data());
+		size_t index_size = this->index_data_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		size_t available = data.size() / index_size;
+		size_t first = std::min<size_t>(this->firstindex, available);
+		size_t count = std::min<size_t>(this->indexcount ? this->indexcount : available, available - first);
+		count -= count % 3;
+
+		std::vector<uint32_t>& indices = triangles.indices;
+		indices.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			int64_t index = 0;
+			if (index_size == sizeof(uint16_t)) {
+				uint16_t value;
+				std::memcpy(&value, data.data() + (first + i) * index_size, sizeof(value));
+				index = value;
+			}
+			else {
+				uint32_t value;
+				std::memcpy(&value, data.data() + (first + i) * index_size, sizeof(value));
+				index = value;
+			}
+			// indices the offset takes out of the vertices wrap around, and are rejected as such
+			indices[i] = static_cast<uint32_t>(index + this->vertexoffset);
+		}
+		return triangles;
+	}
+
+	void execute(VkCommandBuffer command, uint32_t) override
+	{
+		vk.CmdBindIndexBuffer(
+			command,
+			this->index_buffer,
+			this->offset,
+			this->index_buffer_type);
 
 		vk.CmdDrawIndexed(
 			command,
-			this->indexcount,
-			this->instancecount,
-			this->firstindex,
-			this->vertexoffset,
+			this->indexcount ? this->indexcount : this->index_count,
+			this->instance_count ? this->instance_count : this->instancecount,
+			this->firstindex + this->first_index,
+			this->vertexoffset + this->base_vertex,
 			this->firstinstance);
 	}
 
@@ -1720,6 +2837,317 @@ private:
 	int32_t vertexoffset;
 	uint32_t firstinstance;
 	VkDeviceSize offset;
+	BufferData* index_data{ nullptr };
+	VkIndexType index_data_type{ VK_INDEX_TYPE_NONE_KHR };
+	std::shared_ptr<TriangleBvh> bvh;
+	std::unique_ptr<Triangles> occluder;
+};
+
+
+// Draws that share buffers and pipeline, culled against the frustum in a compute pass and
+// drawn with one vkCmdDrawIndexedIndirect. Culled draws get an instance count of zero.
+class IndirectDrawCommand : public DrawCommandBase {
+public:
+	IMPLEMENT_VISITABLE;
+	IndirectDrawCommand() = delete;
+	virtual ~IndirectDrawCommand() = default;
+
+	explicit IndirectDrawCommand(
+		std::vector<IndirectDraw> draws,
+		VkPrimitiveTopology topology) :
+		DrawCommandBase(topology),
+		draws(std::move(draws)),
+		commands(IndirectBatch::Commands(this->draws))
+	{
+		if (this->draws.empty()) {
+			throw std::invalid_argument("IndirectDrawCommand: no draws");
+		}
+		REGISTER_VISITOR(devicevisitor, IndirectDrawCommand, device);
+		REGISTER_VISITOR(allocvisitor, IndirectDrawCommand, alloc);
+		REGISTER_VISITOR(pipelinevisitor, IndirectDrawCommand, pipeline);
+		REGISTER_VISITOR(recordvisitor, IndirectDrawCommand, record);
+		REGISTER_VISITOR(rendervisitor, IndirectDrawCommand, render);
+
+		this->spv = GetShaderCompiler().compile({
+			.glsl = IndirectCullShader,
+			.kind = static_cast<uint32_t>(shaderc_compute_shader),
+			});
+	}
+
+	void device(DeviceVisitor* context)
+	{
+		context->device_features.multiDrawIndirect = VK_TRUE;
+		context->device_features.drawIndirectFirstInstance = VK_TRUE;
+	}
+
+	void alloc(Visitor* context)
+	{
+		State* state = context->state.get();
+		if (state->instances) {
+			// the first instance of each draw is its index in the batch
+			throw std::runtime_error("IndirectDrawCommand: indirect draws can not be instanced");
+		}
+
+		this->draw_bounds.clear();
+		DrawCommandBase::alloc(context);
+		if (this->draw_bounds.empty()) {
+			this->draw_bounds.assign(this->draws.size(), BoundingBox::Infinite());
+		}
+
+		const std::vector<float> bounds = IndirectBatch::PackBounds(this->draw_bounds);
+		const VkDeviceSize commands_size = this->commands.size() * sizeof(DrawIndexedIndirectCommand);
+		const VkDeviceSize bounds_size = bounds.size() * sizeof(float);
+
+		state->frames->retire(std::move(this->command_buffer));
+		state->frames->retire(std::move(this->bounds_buffer));
+		state->frames->retire(std::move(this->visible_buffer));
+		state->frames->retire(std::move(this->cull_command));
+
+		this->command_buffer = std::make_shared<VulkanBufferObject>(
+			state->device,
+			0,
+			commands_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		this->bounds_buffer = std::make_shared<VulkanBufferObject>(
+			state->device,
+			0,
+			bounds_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// written by the culling pass, one region for each frame in flight
+		this->visible_buffer = std::make_shared<VulkanBufferObject>(
+			state->device,
+			0,
+			commands_size * state->frames->depth(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		state->staging->copy(
+			this->command_buffer->buffer->buffer,
+			commands_size,
+			[this, commands_size](char* dst) { std::memcpy(dst, this->commands.data(), commands_size); });
+
+		state->staging->copy(
+			this->bounds_buffer->buffer->buffer,
+			bounds_size,
+			[&bounds, bounds_size](char* dst) { std::memcpy(dst, bounds.data(), bounds_size); });
+
+		this->cull_command = std::make_unique<VulkanCommandBuffers>(
+			state->device,
+			state->frames->depth());
+
+		this->queue = state->device->getQueue(VK_QUEUE_GRAPHICS_BIT);
+	}
+
+	void pipeline(Visitor* context)
+	{
+		DrawCommandBase::pipeline(context);
+		State* state = context->state.get();
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		for (uint32_t binding = 0; binding < 3; binding++) {
+			bindings.push_back({
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr,
+				});
+		}
+		this->cull_set_layout = state->descriptors->getLayout(bindings);
+
+		std::vector<VkPushConstantRange> push_constant_ranges{ {
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(IndirectCullConstants),
+		} };
+
+		this->cull_pipeline_layout = state->descriptors->getPipelineLayout(
+			{ this->cull_set_layout->layout },
+			push_constant_ranges);
+
+		std::vector<VkDescriptorBufferInfo> buffer_infos{
+			{ this->command_buffer->buffer->buffer, 0, VK_WHOLE_SIZE },
+			{ this->bounds_buffer->buffer->buffer, 0, VK_WHOLE_SIZE },
+			{ this->visible_buffer->buffer->buffer, 0, VK_WHOLE_SIZE },
+		};
+
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t binding = 0; binding < 3; binding++) {
+			writes.push_back({
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = nullptr,
+				.dstSet = nullptr,
+				.dstBinding = binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pImageInfo = nullptr,
+				.pBufferInfo = &buffer_infos[binding],
+				.pTexelBufferView = nullptr,
+				});
+		}
+
+		state->frames->retire(std::move(this->cull_descriptor_sets));
+		this->cull_descriptor_sets = state->descriptors->getDescriptorSet(
+			this->cull_set_layout.get(),
+			writes);
+
+		if (!this->cull_pipeline) {
+			this->cull_shader = state->pipelinecache->getShaderModule(this->spv.get());
+
+			VkPipelineShaderStageCreateInfo stage{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.pNext = nullptr,
+				.flags = 0,
+				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+				.module = this->cull_shader->shadermodule,
+				.pName = "main",
+				.pSpecializationInfo = nullptr,
+			};
+
+			this->cull_pipeline = std::make_unique<VulkanComputePipeline>(
+				state->device,
+				state->pipelinecache->cache,
+				stage,
+				this->cull_pipeline_layout->layout);
+		}
+	}
+
+private:
+	// culls this frame's draws in object space, the planes come from projection * view * model
+	void prepare(State* state, uint32_t frame) override
+	{
+		const uint32_t draw_count = static_cast<uint32_t>(this->commands.size());
+		const Frustum frustum = state->cull ?
+			Frustum(ToMatrix4(state->ProjectionMatrix * state->ViewMatrix * glm::make_mat4(WorldMatrix(state).data()))) : Frustum();
+		const IndirectCullConstants constants = IndirectBatch::Constants(
+			frustum,
+			draw_count,
+			frame,
+			this->base_vertex,
+			this->first_index);
+
+		{
+			VulkanCommandBuffers::Scope command_scope(this->cull_command.get(), frame);
+			VkCommandBuffer command = this->cull_command->buffer(frame);
+
+			vk.CmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, this->cull_pipeline->pipeline);
+
+			this->cull_descriptor_sets->bind(
+				command,
+				this->cull_pipeline_layout->layout,
+				{},
+				VK_PIPELINE_BIND_POINT_COMPUTE);
+
+			vk.CmdPushConstants(
+				command,
+				this->cull_pipeline_layout->layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+
+			vk.CmdDispatch(command, IndirectBatch::WorkgroupCount(draw_count), 1, 1);
+
+			VkBufferMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer = this->visible_buffer->buffer->buffer,
+				.offset = this->outputOffset(frame),
+				.size = draw_count * sizeof(DrawIndexedIndirectCommand),
+			};
+
+			vk.CmdPipelineBarrier(
+				command,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+				0,
+				0, nullptr,
+				1, &barrier,
+				0, nullptr);
+		}
+
+		// the render pass goes to the same queue after this, and the frame's fence covers both
+		this->cull_command->submit(
+			this->queue,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			frame);
+	}
+
+	BoundingBox positionBounds(State* state, const char* positions, size_t count, size_t stride, size_t offset) override
+	{
+		if (!state->index_data) {
+			throw std::runtime_error("IndirectDrawCommand: indirect draws need an index buffer");
+		}
+		std::vector<char> indices(state->index_data->size());
+		state->index_data->copy(indices.data());
+		const uint32_t index_size = state->index_buffer_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+		BoundingBox bounds;
+		this->draw_bounds.clear();
+		for (auto& draw : this->draws) {
+			this->draw_bounds.push_back(IndirectBatch::Bounds(
+				draw,
+				indices.data(),
+				indices.size() / index_size,
+				index_size,
+				positions,
+				count,
+				stride,
+				offset));
+			bounds.extend(this->draw_bounds.back());
+		}
+		return bounds;
+	}
+
+	void execute(VkCommandBuffer command, uint32_t frame) override
+	{
+		vk.CmdBindIndexBuffer(
+			command,
+			this->index_buffer,
+			0,
+			this->index_buffer_type);
+
+		vk.CmdDrawIndexedIndirect(
+			command,
+			this->visible_buffer->buffer->buffer,
+			this->outputOffset(frame),
+			static_cast<uint32_t>(this->commands.size()),
+			sizeof(DrawIndexedIndirectCommand));
+	}
+
+	VkDeviceSize outputOffset(uint32_t frame) const
+	{
+		return VkDeviceSize(frame) * this->commands.size() * sizeof(DrawIndexedIndirectCommand);
+	}
+
+	std::vector<IndirectDraw> draws;
+	std::vector<DrawIndexedIndirectCommand> commands;
+	std::vector<BoundingBox> draw_bounds;
+
+	std::shared_future<std::vector<uint32_t>> spv;
+	std::shared_ptr<VulkanShaderModule> cull_shader;
+	std::unique_ptr<VulkanComputePipeline> cull_pipeline;
+	std::shared_ptr<VulkanDescriptorSetLayout> cull_set_layout;
+	std::shared_ptr<VulkanPipelineLayout> cull_pipeline_layout;
+	std::shared_ptr<VulkanDescriptorSets> cull_descriptor_sets;
+
+	std::shared_ptr<VulkanBufferObject> command_buffer;
+	std::shared_ptr<VulkanBufferObject> bounds_buffer;
+	std::shared_ptr<VulkanBufferObject> visible_buffer;
+	std::unique_ptr<VulkanCommandBuffers> cull_command;
+	VkQueue queue{ nullptr };
 };
 
 
@@ -1732,31 +3160,78 @@ public:
 		VkFormat format,
 		VkImageLayout layout,
 		VkImageUsageFlags usage,
-		VkImageAspectFlags aspectMask) :
+		VkImageAspectFlags aspectMask,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT) :
 		format(format),
 		layout(layout),
 		usage(usage),
+		samples(samples),
 		subresourceRange({ aspectMask, 0, 1, 0, 1 })
 	{
+		REGISTER_VISITOR(graphvisitor, FramebufferAttachment, declare);
 		REGISTER_VISITOR(allocvisitor, FramebufferAttachment, alloc);
 		REGISTER_VISITOR(resizevisitor, FramebufferAttachment, alloc);
 	}
 
-	void alloc(Visitor* context)
+	// the image is created here and bound in alloc, to memory it may share with other attachments
+	void declare(Visitor* context)
 	{
-		this->image = std::make_shared<VulkanImageObject>(
+		this->unbound = std::make_shared<VulkanImage>(
 			context->state->device,
 			VK_IMAGE_TYPE_2D,
 			this->format,
 			context->state->extent,
 			1,
 			1,
-			VK_SAMPLE_COUNT_1_BIT,
+			this->samples,
 			VK_IMAGE_TILING_OPTIMAL,
 			this->usage,
-			VK_SHARING_MODE_EXCLUSIVE,
-			0,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_SHARING_MODE_EXCLUSIVE);
+
+		context->state->graph->transient(
+			this->unbound->image,
+			this->subresourceRange,
+			"framebuffer attachment",
+			this->unbound->getMemoryRequirements());
+
+		// the render pass leaves the attachment in its layout
+		context->state->graph->use(
+			this->unbound->image,
+			(this->subresourceRange.aspectMask & VK_IMAGE_ASPECT_DEPTH_BIT) ?
+				RenderGraph::DEPTH_ATTACHMENT :
+				RenderGraph::COLOR_ATTACHMENT,
+			this->layout);
+	}
+
+	void alloc(Visitor* context)
+	{
+		context->state->frames->retire(std::move(this->image));
+		context->state->frames->retire(std::move(this->view));
+
+		const bool declared = this->unbound != nullptr;
+		if (declared) {
+			auto [memory, offset] = context->state->graph->memory(this->unbound->image);
+			this->image = std::make_shared<VulkanImageObject>(
+				context->state->device,
+				std::move(this->unbound),
+				memory,
+				offset);
+		}
+		else {
+			this->image = std::make_shared<VulkanImageObject>(
+				context->state->device,
+				VK_IMAGE_TYPE_2D,
+				this->format,
+				context->state->extent,
+				1,
+				1,
+				this->samples,
+				VK_IMAGE_TILING_OPTIMAL,
+				this->usage,
+				VK_SHARING_MODE_EXCLUSIVE,
+				0,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
 
 		VkComponentMapping componentMapping{
 			.r = VK_COMPONENT_SWIZZLE_R,
@@ -1773,6 +3248,10 @@ public:
 			componentMapping,
 			this->subresourceRange);
 
+		// the render graph transitions the attachment before each use
+		if (declared) {
+			return;
+		}
 		context->state->default_command->pipelineBarrier(
 			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
 			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
@@ -1785,14 +3264,28 @@ public:
 				this->subresourceRange) });
 	}
 
+	// a framebuffer is made for each image of the attachment with the most of them
+	virtual size_t imageCount() const
+	{
+		return 1;
+	}
+
+	virtual VkImageView imageView(size_t) const
+	{
+		return this->view->view;
+	}
+
 public:
 	VkFormat format;
 	VkImageLayout layout;
 	VkImageUsageFlags usage;
+	VkSampleCountFlagBits samples;
 	VkImageSubresourceRange subresourceRange;
 
 	std::shared_ptr<VulkanImageObject> image;
 	std::shared_ptr<VulkanImageView> view;
+	// declared to the render graph, not yet bound to memory
+	std::shared_ptr<VulkanImage> unbound;
 };
 
 
@@ -1829,11 +3322,512 @@ public:
 			.subresourceRange = attachment0->subresourceRange
 		};
 
-		context->state->imageView = attachment0->view->view;
-		context->state->imageLayout = attachment0->layout;
+		context->state->imageView = attachment0->view->view;
+		context->state->imageLayout = attachment0->layout;
+	}
+
+	VkExtent3D extent{ 1920, 1080, 1 };
+};
+
+
+class Swapchain : public Node {
+public:
+	IMPLEMENT_VISITABLE;
+	virtual ~Swapchain() = default;
+
+	Swapchain(std::shared_ptr<VulkanSurface> surface, VkPresentModeKHR present_mode) :
+		surface(surface),
+		present_mode(present_mode),
+		present_queue(nullptr)
+	{
+		REGISTER_VISITOR(graphvisitor, Swapchain, declare);
+		REGISTER_VISITOR(allocvisitor, Swapchain, alloc);
+		REGISTER_VISITOR(resizevisitor, Swapchain, resize);
+		REGISTER_VISITOR(recordvisitor, Swapchain, record);
+		REGISTER_VISITOR(presentvisitor, Swapchain, present);
+	}
+
+	// the copy to the swapchain image is the last pass, unless the render target is not in the graph
+	// or the render pass draws to the swapchain images
+	void declare(Visitor* context)
+	{
+		FrameGraph* graph = context->state->graph.get();
+		if (this->direct || !graph->declared(context->state->renderTarget.image)) {
+			return;
+		}
+		graph->pass(this, "swapchain");
+		graph->use(context->state->renderTarget.image, RenderGraph::TRANSFER_SRC);
+		// the swapchain images are created in resize, and set for each command buffer in record
+		this->resource = graph->import(
+			VK_NULL_HANDLE,
+			context->state->renderTarget.subresourceRange,
+			"swapchain image",
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		graph->use(this->resource, RenderGraph::TRANSFER_DST);
+	}
+
+	// a swapchain attachment made the swapchain when the scene was allocated
+	void alloc(Visitor* context)
+	{
+		if (!this->direct) {
+			this->create(context, context->state->renderTarget.format);
+		}
+	}
+
+	void resize(Visitor* context)
+	{
+		this->alloc(context);
+	}
+
+	void create(Visitor* context, VkFormat format)
+	{
+		if (!this->present_queue) {
+			this->surface->checkPresentModeSupport(context->state->device, this->present_mode);
+			// the frame fence only covers the queue the frame is submitted on, the frame renders,
+			// copies and presents on that one
+			this->surface->checkQueueSupport(context->state->device, context->state->queue);
+			this->present_queue = context->state->queue;
+		}
+
+		VkSurfaceFormatKHR surface_format =
+			this->surface->getSupportedSurfaceFormat(context->state->device, format);
+		this->format = surface_format.format;
+
+		VkSwapchainKHR prevswapchain = (this->swapchain) ? this->swapchain->swapchain : 0;
+
+		auto swapchain = std::make_unique<VulkanSwapchain>(
+			context->state->device,
+			this->surface->surface,
+			3,
+			surface_format.format,
+			surface_format.colorSpace,
+			VkExtent2D{ context->state->extent.width, context->state->extent.height },
+			1,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			std::vector<uint32_t>{ 0, },
+			VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+			VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			this->present_mode,
+			VK_FALSE,
+			prevswapchain);
+
+		// the old swapchain may still have images queued for presentation
+		context->state->frames->retire(std::move(this->swapchain));
+		this->swapchain = std::move(swapchain);
+
+		uint32_t count;
+		THROW_ON_ERROR(vk.GetSwapchainImagesKHR(
+			context->state->device->device,
+			this->swapchain->swapchain,
+			&count,
+			nullptr));
+
+		this->swapchain_images.resize(count);
+		THROW_ON_ERROR(vk.GetSwapchainImagesKHR(
+			context->state->device->device,
+			this->swapchain->swapchain,
+			&count,
+			this->swapchain_images.data()));
+
+		for (uint32_t i = 0; i < count; i++) {
+			context->state->default_command->pipelineBarrier(
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
+					VulkanImage::MemoryBarrier(
+						this->swapchain_images[i],
+						0,
+						0,
+						VK_IMAGE_LAYOUT_UNDEFINED,
+						VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+						this->subresource_range) });
+		}
+	}
+
+	// Images can be acquired out of order and several frames can be in flight, so a command
+	// buffer recorded once per image could be submitted again while still pending. The copy
+	// is recorded each frame instead, into the command buffer of the frame slot.
+	void record(Visitor* context)
+	{
+		if (this->direct) {
+			return;
+		}
+		context->state->frames->retire(std::move(this->swap_buffers_command));
+		this->swap_buffers_command = std::make_unique<VulkanCommandBuffers>(
+			context->state->device,
+			context->state->frames->depth(),
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+		this->source = context->state->renderTarget;
+		this->extent = { context->state->extent.width, context->state->extent.height, 1 };
+	}
+
+	// the next image is ready for the commands that wait on the acquire semaphore of the frame
+	uint32_t acquire(Visitor* context)
+	{
+		THROW_ON_ERROR(vk.AcquireNextImageKHR(
+			context->state->device->device,
+			this->swapchain->swapchain,
+			UINT64_MAX,
+			context->state->frames->current()->acquire->semaphore,
+			VK_NULL_HANDLE,
+			&this->image_index));
+
+		return this->image_index;
+	}
+
+	// when direct, the render pass acquired the image and signals the release semaphore
+	void present(Visitor* context)
+	{
+		auto frame = context->state->frames->current();
+
+		std::vector<VkSemaphore> wait_semaphores = { frame->acquire->semaphore };
+		std::vector<VkSemaphore> signal_semaphores = { frame->release->semaphore };
+
+		if (!this->direct) {
+			this->acquire(context);
+			this->copy(context, context->state->frame_index);
+			this->swap_buffers_command->submit(
+				this->present_queue,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				context->state->frame_index,
+				context->state->frames->submitFence(),
+				wait_semaphores,
+				signal_semaphores);
+		}
+
+		if (this->capturing) {
+			this->readback(context, signal_semaphores);
+			signal_semaphores = { this->captured->semaphore };
+			this->capturing = false;
+		}
+
+		VkPresentInfoKHR present_info{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+			.pNext = nullptr,
+			.waitSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size()),
+			.pWaitSemaphores = signal_semaphores.data(),
+			.swapchainCount = 1,
+			.pSwapchains = &this->swapchain->swapchain,
+			.pImageIndices = &this->image_index,
+			.pResults = nullptr,
+		};
+
+		THROW_ON_ERROR(vk.QueuePresentKHR(this->present_queue, &present_info));
+	}
+
+	const std::vector<VkImage>& images() const
+	{
+		return this->swapchain_images;
+	}
+
+	// the image of the next present is read back before it is presented
+	void capture()
+	{
+		this->capturing = true;
+	}
+
+	// the image read back by the last capture, waits for the copy if it is not done
+	Pixels pixels()
+	{
+		if (!this->capture_fence) {
+			throw std::logic_error("Swapchain: no image was captured");
+		}
+		this->capture_fence->wait();
+
+		auto data = reinterpret_cast<const uint8_t*>(this->capture_buffer->memory->map(VK_WHOLE_SIZE));
+		size_t size = static_cast<size_t>(this->capture_extent.width) * this->capture_extent.height * 4;
+		return { this->capture_extent.width, this->capture_extent.height, std::vector<uint8_t>(data, data + size) };
+	}
+
+	// set by a swapchain attachment, the render pass draws to the swapchain images
+	bool direct{ false };
+
+private:
+	// Copies the acquired image to a host visible buffer. The image is still acquired, the copy
+	// waits for the commands that signal the wait semaphores and the present waits for the copy.
+	void readback(Visitor* context, const std::vector<VkSemaphore>& wait_semaphores)
+	{
+		switch (this->format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			break;
+		default:
+			throw std::runtime_error("Swapchain: only images of 4 bytes per pixel can be captured");
+		}
+
+		VkExtent2D extent{ context->state->extent.width, context->state->extent.height };
+		VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+		if (this->capture_fence) {
+			this->capture_fence->wait();
+		}
+		if (!this->capture_buffer || this->capture_extent.width != extent.width || this->capture_extent.height != extent.height) {
+			this->capture_fence = std::make_unique<VulkanFence>(context->state->device);
+			this->capture_buffer = std::make_unique<VulkanBufferObject>(
+				context->state->device,
+				0,
+				size,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_SHARING_MODE_EXCLUSIVE,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			this->capture_command = std::make_unique<VulkanCommandBuffers>(context->state->device);
+			this->captured = std::make_unique<VulkanSemaphore>(context->state->device);
+			this->capture_extent = extent;
+		}
+		this->capture_fence->reset();
+
+		VkImage image = this->swapchain_images[this->image_index];
+		{
+			VulkanCommandBuffers::Scope command_scope(this->capture_command.get());
+
+			this->capture_command->pipelineBarrier(
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				VulkanImage::MemoryBarrier(
+					image,
+					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					this->subresource_range) });
+
+			VkBufferImageCopy region{
+				.bufferOffset = 0,
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+				.imageOffset = { 0, 0, 0 },
+				.imageExtent = { extent.width, extent.height, 1 },
+			};
+			vk.CmdCopyImageToBuffer(this->capture_command->buffer(),
+				image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				this->capture_buffer->buffer->buffer,
+				1, &region);
+
+			this->capture_command->pipelineBarrier(
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
+				VulkanImage::MemoryBarrier(
+					image,
+					0,
+					0,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+					this->subresource_range) });
+
+			// the copy is visible to the host once the fence is signaled
+			VkMemoryBarrier host_barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			};
+			vk.CmdPipelineBarrier(this->capture_command->buffer(),
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT,
+				0, 1, &host_barrier, 0, nullptr, 0, nullptr);
+		}
+
+		this->capture_command->submit(
+			this->present_queue,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			this->capture_fence->fence,
+			wait_semaphores,
+			{ this->captured->semaphore });
+	}
+
+	// copies the render target to the acquired image, in command buffer i
+	void copy(Visitor* context, size_t i)
+	{
+		const VkImageSubresourceLayers subresource_layers{
+			.aspectMask = this->source.subresourceRange.aspectMask,
+			.mipLevel = this->source.subresourceRange.baseMipLevel,
+			.baseArrayLayer = this->source.subresourceRange.baseArrayLayer,
+			.layerCount = this->source.subresourceRange.layerCount,
+		};
+
+		VkOffset3D offset = {
+			.x = 0,
+			.y = 0,
+			.z = 0
+		};
+
+		std::vector<VkImageCopy> regions{ {
+			.srcSubresource = subresource_layers,
+			.srcOffset = offset,
+			.dstSubresource = subresource_layers,
+			.dstOffset = offset,
+			.extent = this->extent
+		} };
+
+		VulkanCommandBuffers::Scope command_scope(this->swap_buffers_command.get(), i);
+
+		VkImage srcImage = this->source.image;
+		VkImage dstImage = this->swapchain_images[this->image_index];
+
+		FrameGraph* graph = context->state->graph.get();
+		if (graph && graph->declared(this)) {
+			graph->image(this->resource, dstImage);
+			graph->record(this, this->swap_buffers_command.get(), i);
+
+			vk.CmdCopyImage(this->swap_buffers_command->buffer(i),
+				srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(regions.size()), regions.data());
+
+			graph->finish(this, this->swap_buffers_command.get(), i);
+			return;
+		}
+
+		this->swap_buffers_command->pipelineBarrier(
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,		// wait until color attachment is written
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,				// no later stages to block, we're done
+			{
+			  VulkanImage::MemoryBarrier(
+				srcImage,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,			// srcAccessMask
+				0,												// dstAccessMask 
+				this->source.layout,							// oldLayout
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,			// newLayout
+				this->source.subresourceRange),
+			  VulkanImage::MemoryBarrier(
+				dstImage,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				0,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				this->source.subresourceRange)
+			}, i);
+
+		vk.CmdCopyImage(this->swap_buffers_command->buffer(i),
+			srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+
+		this->swap_buffers_command->pipelineBarrier(
+			VK_PIPELINE_STAGE_TRANSFER_BIT,						// wait until copy is done
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,		// before the next frame in flight renders to the source
+			{
+			  VulkanImage::MemoryBarrier(
+				srcImage,
+				0,												// srcAccessMask
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,			// dstAccessMask
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				this->source.layout,
+				this->source.subresourceRange),
+			  VulkanImage::MemoryBarrier(
+				dstImage,
+				0,												// srcAccessMask
+				0,												// dstAccessMask 
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				this->source.subresourceRange)
+			}, i);
+	}
+
+	std::shared_ptr<VulkanSurface> surface;
+	VkPresentModeKHR present_mode;
+	VkQueue present_queue;
+
+	std::unique_ptr<VulkanSwapchain> swapchain;
+	std::vector<VkImage> swapchain_images;
+	std::unique_ptr<VulkanCommandBuffers> swap_buffers_command;
+	RenderTarget source;
+	VkExtent3D extent{ 0, 0, 1 };
+
+	uint32_t image_index{ 0 };
+	size_t resource{ 0 };
+	const VkImageSubresourceRange subresource_range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkFormat format{ VK_FORMAT_UNDEFINED };
+	bool capturing{ false };
+	VkExtent2D capture_extent{ 0, 0 };
+	std::unique_ptr<VulkanBufferObject> capture_buffer;
+	std::unique_ptr<VulkanCommandBuffers> capture_command;
+	std::unique_ptr<VulkanSemaphore> captured;
+	std::unique_ptr<VulkanFence> capture_fence;
+};
+
+
+// The swapchain images as the attachment of the last render pass, which draws to them directly
+// instead of to an image that is copied to them. A multisampled color attachment is resolved to it.
+class SwapchainAttachment : public FramebufferAttachment {
+public:
+	IMPLEMENT_VISITABLE;
+	virtual ~SwapchainAttachment() = default;
+
+	explicit SwapchainAttachment(VkFormat format) :
+		FramebufferAttachment(
+			format,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_COLOR_BIT)
+	{
+		REGISTER_VISITOR(graphvisitor, SwapchainAttachment, declare);
+		REGISTER_VISITOR(allocvisitor, SwapchainAttachment, alloc);
+		REGISTER_VISITOR(resizevisitor, SwapchainAttachment, alloc);
+	}
+
+	// the render pass moves the images from and to the present layout, there is nothing to declare
+	void declare(Visitor* context)
+	{
+		SwapchainAttachment::swapchain(context)->direct = true;
+	}
+
+	void alloc(Visitor* context)
+	{
+		Swapchain* swapchain = SwapchainAttachment::swapchain(context);
+		swapchain->direct = true;
+		swapchain->create(context, this->format);
+
+		for (auto& view : this->views) {
+			context->state->frames->retire(std::move(view));
+		}
+		this->views.clear();
+
+		VkComponentMapping componentMapping{
+			.r = VK_COMPONENT_SWIZZLE_R,
+			.g = VK_COMPONENT_SWIZZLE_G,
+			.b = VK_COMPONENT_SWIZZLE_B,
+			.a = VK_COMPONENT_SWIZZLE_A,
+		};
+
+		for (VkImage image : swapchain->images()) {
+			this->views.push_back(std::make_shared<VulkanImageView>(
+				context->state->device,
+				image,
+				VK_IMAGE_VIEW_TYPE_2D,
+				this->format,
+				componentMapping,
+				this->subresourceRange));
+		}
+		context->state->present = true;
+	}
+
+	size_t imageCount() const override
+	{
+		return this->views.size();
+	}
+
+	VkImageView imageView(size_t i) const override
+	{
+		return this->views[i]->view;
 	}
 
-	VkExtent3D extent{ 1920, 1080, 1 };
+	std::vector<std::shared_ptr<VulkanImageView>> views;
+
+private:
+	// the window's, or the headless surface's
+	static Swapchain* swapchain(Visitor* context)
+	{
+		if (!context->state->swapchain) {
+			throw std::runtime_error("swapchain attachment used without a swapchain");
+		}
+		return context->state->swapchain;
+	}
 };
 
 
@@ -1845,14 +3839,36 @@ public:
 	explicit Framebuffer(std::vector<std::shared_ptr<Node>> children) :
 		Group(std::move(children))
 	{
+		REGISTER_VISITOR(graphvisitor, Framebuffer, declare);
 		REGISTER_VISITOR(allocvisitor, Framebuffer, alloc);
 		REGISTER_VISITOR(resizevisitor, Framebuffer, alloc);
 		REGISTER_VISITOR(recordvisitor, Framebuffer, update);
 	}
 
+	void declare(Visitor* context)
+	{
+		Group::visit(context);
+		auto attachment0 = static_pointer_cast<FramebufferAttachment>(this->children[0]);
+		if (!attachment0->unbound) {
+			return;
+		}
+
+		// for the passes that follow to declare their uses of the render target
+		context->state->renderTarget = {
+			.image = attachment0->unbound->image,
+			.format = attachment0->format,
+			.layout = attachment0->layout,
+			.subresourceRange = attachment0->subresourceRange
+		};
+	}
+
+	// the swapchain images are not a render target that later passes can read
 	void update(Visitor* context)
 	{
 		auto attachment0 = static_pointer_cast<FramebufferAttachment>(this->children[0]);
+		if (!attachment0->image) {
+			return;
+		}
 
 		context->state->renderTarget = {
 			.image = attachment0->image->image->image,
@@ -1864,21 +3880,28 @@ public:
 
 	void alloc(Visitor* context)
 	{
-		std::vector<VkImageView> framebuffer_attachments;
-
+		size_t count = 1;
 		for (auto child : this->children) {
 			child->visit(context);
-			auto attachment = static_pointer_cast<FramebufferAttachment>(child);
-			framebuffer_attachments.push_back(attachment->view->view);
+			count = std::max(count, static_pointer_cast<FramebufferAttachment>(child)->imageCount());
 		}
 
-		context->state->framebuffer = std::make_unique<VulkanFramebuffer>(
-			context->state->device,
-			context->state->renderpass,
-			framebuffer_attachments,
-			context->state->extent.width,
-			context->state->extent.height,
-			1);
+		context->state->framebuffers.clear();
+		for (size_t i = 0; i < count; i++) {
+			std::vector<VkImageView> framebuffer_attachments;
+			for (auto child : this->children) {
+				auto attachment = static_pointer_cast<FramebufferAttachment>(child);
+				framebuffer_attachments.push_back(attachment->imageView(i % attachment->imageCount()));
+			}
+
+			context->state->framebuffers.push_back(std::make_shared<VulkanFramebuffer>(
+				context->state->device,
+				context->state->renderpass,
+				framebuffer_attachments,
+				context->state->extent.width,
+				context->state->extent.height,
+				1));
+		}
 
 		this->update(context);
 	}
@@ -2082,6 +4105,7 @@ public:
 	Renderpass(std::vector<std::shared_ptr<Node>> children) :
 		Group(std::move(children))
 	{
+		REGISTER_VISITOR(graphvisitor, Renderpass, declare);
 		REGISTER_VISITOR(allocvisitor, Renderpass, alloc);
 		REGISTER_VISITOR(resizevisitor, Renderpass, resize);
 		REGISTER_VISITOR(rendervisitor, Renderpass, render);
@@ -2096,25 +4120,42 @@ public:
 		Group::visit(context);
 	}
 
+	void declare(Visitor* context)
+	{
+		context->state->graph->pass(this, "renderpass");
+		Group::visit(context);
+	}
+
 	void alloc(Visitor* context)
 	{
+		context->state->present = false;
 		Group::visit(context);
 
-		this->render_command = std::make_unique<VulkanCommandBuffers>(context->state->device);
-		this->render_queue = context->state->device->getQueue(VK_QUEUE_GRAPHICS_BIT);
+		this->render_command = std::make_unique<VulkanCommandBuffers>(
+			context->state->device,
+			context->state->frames->depth());
+
+		// the queue the frame fence is submitted on, which the swapchain copies and presents on
+		this->render_queue = context->state->queue;
 
 		this->renderpass = context->state->renderpass;
-		this->framebuffer = context->state->framebuffer;
+		this->framebuffers = context->state->framebuffers;
+		this->present = context->state->present;
 	}
 
 	void resize(Visitor* context)
 	{
 		Group::visit(context);
-		this->framebuffer = context->state->framebuffer;
+		for (auto& framebuffer : this->framebuffers) {
+			context->state->frames->retire(std::move(framebuffer));
+		}
+		this->framebuffers = context->state->framebuffers;
 	}
 
 	void render(Visitor* context)
 	{
+		NeverCull(context->state.get());
+
 		const VkRect2D renderarea{
 			.offset = { 0, 0 },
 			.extent = VkExtent2D{ context->state->extent.width, context->state->extent.height }
@@ -2125,31 +4166,62 @@ public:
 			{.depthStencil = { 1.0f, 0 } }
 		};
 
+		// drawing to a swapchain image waits until it is acquired, and is what it is presented after
+		uint32_t image_index = 0;
+		if (this->present) {
+			image_index = context->state->swapchain->acquire(context);
+		}
+
 		{
-			VulkanCommandBuffers::Scope render_command_scope(this->render_command.get());
+			VulkanCommandBuffers::Scope render_command_scope(
+				this->render_command.get(),
+				context->state->frame_index);
+
+			FrameGraph* graph = context->state->graph.get();
+			if (graph && graph->declared(this)) {
+				graph->record(this, this->render_command.get(), context->state->frame_index);
+			}
+			{
+				VulkanRenderPassScope renderpass_scope(
+					this->renderpass->renderpass,
+					this->framebuffers[image_index]->framebuffer,
+					renderarea,
+					clearvalues,
+					this->render_command->buffer(context->state->frame_index));
 
-			VulkanRenderPassScope renderpass_scope(
-				this->renderpass->renderpass,
-				this->framebuffer->framebuffer,
-				renderarea,
-				clearvalues,
-				this->render_command->buffer());
+				context->state->command = this->render_command.get();
 
-			context->state->command = this->render_command.get();
+				Group::visit(context);
+			}
+			if (graph && graph->declared(this)) {
+				graph->finish(this, this->render_command.get(), context->state->frame_index);
+			}
+		}
 
-			Group::visit(context);
+		if (this->present) {
+			auto frame = context->state->frames->current();
+			this->render_command->submit(
+				this->render_queue,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				context->state->frame_index,
+				context->state->frames->submitFence(),
+				{ frame->acquire->semaphore },
+				{ frame->release->semaphore });
+			return;
 		}
 
 		this->render_command->submit(
 			this->render_queue,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			context->state->frame_index);
 	}
 
 public:
 	VkQueue render_queue{ nullptr };
 	std::unique_ptr<VulkanCommandBuffers> render_command;
 	std::shared_ptr<VulkanRenderpass> renderpass;
-	std::shared_ptr<VulkanFramebuffer> framebuffer;
+	std::vector<std::shared_ptr<VulkanFramebuffer>> framebuffers;
+	bool present{ false };
 };
 
 
@@ -2170,235 +4242,47 @@ public:
 	{
 		Group::visit(context);
 
+		// pipelines rasterize with as many samples as the attachments have
+		this->samples = VK_SAMPLE_COUNT_1_BIT;
+		std::vector<VkSubpassDependency> dependencies;
+		for (auto& description : context->state->attachment_descriptions) {
+			this->samples = std::max(this->samples, description.samples);
+
+			// the layout transition of a swapchain image must wait for the acquire semaphore,
+			// which is waited on in the color attachment output stage
+			if (description.finalLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR && dependencies.empty()) {
+				dependencies.push_back({
+					.srcSubpass = VK_SUBPASS_EXTERNAL,
+					.dstSubpass = 0,
+					.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					.srcAccessMask = 0,
+					.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+					.dependencyFlags = 0,
+				});
+			}
+		}
+
 		this->renderpass = std::make_shared<VulkanRenderpass>(
 			context->state->device,
 			context->state->attachment_descriptions,
-			context->state->subpass_descriptions);
+			context->state->subpass_descriptions,
+			dependencies);
 
 		context->state->renderpass = this->renderpass;
+		context->state->samples = this->samples;
 	}
 
 	void visitChildren(Visitor* context)
 	{
 		Group::visit(context);
 		context->state->renderpass = this->renderpass;
+		context->state->samples = this->samples;
 	}
 
 public:
 	std::shared_ptr<VulkanRenderpass> renderpass;
-};
-
-
-class Swapchain : public Node {
-public:
-	IMPLEMENT_VISITABLE;
-	virtual ~Swapchain() = default;
-
-	Swapchain(std::shared_ptr<VulkanSurface> surface, VkPresentModeKHR present_mode) :
-		surface(surface),
-		present_mode(present_mode),
-		present_queue(nullptr)
-	{
-		REGISTER_VISITOR(allocvisitor, Swapchain, alloc);
-		REGISTER_VISITOR(resizevisitor, Swapchain, resize);
-		REGISTER_VISITOR(recordvisitor, Swapchain, record);
-		REGISTER_VISITOR(presentvisitor, Swapchain, present);
-	}
-
-	void alloc(Visitor* context)
-	{
-		this->surface->checkPresentModeSupport(context->state->device, this->present_mode);
-		this->present_queue = context->state->device->getQueue(0, this->surface->surface);
-		this->swapchain_image_ready = std::make_unique<VulkanSemaphore>(context->state->device);
-		this->swap_buffers_finished = std::make_unique<VulkanSemaphore>(context->state->device);
-
-		this->resize(context);
-	}
-
-	void resize(Visitor* context)
-	{
-		VkSurfaceFormatKHR surface_format =
-			this->surface->getSupportedSurfaceFormat(context->state->device, context->state->renderTarget.format);
-
-		VkSwapchainKHR prevswapchain = (this->swapchain) ? this->swapchain->swapchain : 0;
-
-		this->swapchain = std::make_unique<VulkanSwapchain>(
-			context->state->device,
-			this->surface->surface,
-			3,
-			surface_format.format,
-			surface_format.colorSpace,
-			VkExtent2D{ context->state->extent.width, context->state->extent.height },
-			1,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			std::vector<uint32_t>{ 0, },
-			VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
-			VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-			this->present_mode,
-			VK_FALSE,
-			prevswapchain);
-
-		uint32_t count;
-		THROW_ON_ERROR(vk.GetSwapchainImagesKHR(
-			context->state->device->device,
-			this->swapchain->swapchain,
-			&count,
-			nullptr));
-
-		this->swapchain_images.resize(count);
-		THROW_ON_ERROR(vk.GetSwapchainImagesKHR(
-			context->state->device->device,
-			this->swapchain->swapchain,
-			&count,
-			this->swapchain_images.data()));
-
-		for (uint32_t i = 0; i < count; i++) {
-			context->state->default_command->pipelineBarrier(
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
-					VulkanImage::MemoryBarrier(
-						this->swapchain_images[i],
-						0,
-						0,
-						VK_IMAGE_LAYOUT_UNDEFINED,
-						VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-						context->state->renderTarget.subresourceRange) });
-		}
-	}
-
-	void record(Visitor* context)
-	{
-		this->swap_buffers_command = std::make_unique<VulkanCommandBuffers>(
-			context->state->device,
-			this->swapchain_images.size(),
-			VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-		for (size_t i = 0; i < this->swapchain_images.size(); i++) {
-			const VkImageSubresourceLayers subresource_layers{
-				.aspectMask = context->state->renderTarget.subresourceRange.aspectMask,
-				.mipLevel = context->state->renderTarget.subresourceRange.baseMipLevel,
-				.baseArrayLayer = context->state->renderTarget.subresourceRange.baseArrayLayer,
-				.layerCount = context->state->renderTarget.subresourceRange.layerCount,
-			};
-
-			VkOffset3D offset = {
-				.x = 0,
-				.y = 0,
-				.z = 0
-			};
-
-			std::vector<VkImageCopy> regions{ {
-				.srcSubresource = subresource_layers,
-				.srcOffset = offset,
-				.dstSubresource = subresource_layers,
-				.dstOffset = offset,
-				.extent = {
-					.width = context->state->extent.width,
-					.height = context->state->extent.height,
-					.depth = 1
-				}
-			} };
-
-			VulkanCommandBuffers::Scope command_scope(this->swap_buffers_command.get(), i);
-
-			VkImage srcImage = context->state->renderTarget.image;
-			VkImage dstImage = this->swapchain_images[i];
-
-			this->swap_buffers_command->pipelineBarrier(
-				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,		// wait until color attachment is written
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,				// no later stages to block, we're done
-				{
-				  VulkanImage::MemoryBarrier(
-					srcImage,
-					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,			// srcAccessMask
-					0,												// dstAccessMask 
-					context->state->renderTarget.layout,			// oldLayout
-					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,			// newLayout
-					context->state->renderTarget.subresourceRange),
-				  VulkanImage::MemoryBarrier(
-					dstImage,
-					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-					0,
-					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					context->state->renderTarget.subresourceRange)
-				}, i);
-
-			vk.CmdCopyImage(this->swap_buffers_command->buffer(i),
-				srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				static_cast<uint32_t>(regions.size()), regions.data());
-
-			this->swap_buffers_command->pipelineBarrier(
-				VK_PIPELINE_STAGE_TRANSFER_BIT,						// wait until copy is done
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,				// nothing to block
-				{
-				  VulkanImage::MemoryBarrier(
-					srcImage,
-					0,												// srcAccessMask
-					0,												// dstAccessMask
-					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-					context->state->renderTarget.layout,
-					context->state->renderTarget.subresourceRange),
-				  VulkanImage::MemoryBarrier(
-					dstImage,
-					0,												// srcAccessMask
-					0,												// dstAccessMask 
-					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-					context->state->renderTarget.subresourceRange)
-				}, i);
-		}
-	}
-
-	void present(Visitor* context)
-	{
-		THROW_ON_ERROR(vk.AcquireNextImageKHR(
-			context->state->device->device,
-			this->swapchain->swapchain,
-			UINT64_MAX,
-			this->swapchain_image_ready->semaphore,
-			VK_NULL_HANDLE,
-			&this->image_index));
-
-		std::vector<VkSemaphore> wait_semaphores = { this->swapchain_image_ready->semaphore };
-		std::vector<VkSemaphore> signal_semaphores = { this->swap_buffers_finished->semaphore };
-
-		this->swap_buffers_command->submit(
-			this->present_queue,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			this->image_index,
-			VK_NULL_HANDLE,
-			wait_semaphores,
-			signal_semaphores);
-
-		VkPresentInfoKHR present_info{
-			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			.pNext = nullptr,
-			.waitSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size()),
-			.pWaitSemaphores = signal_semaphores.data(),
-			.swapchainCount = 1,
-			.pSwapchains = &this->swapchain->swapchain,
-			.pImageIndices = &this->image_index,
-			.pResults = nullptr,
-		};
-
-		THROW_ON_ERROR(vk.QueuePresentKHR(this->present_queue, &present_info));
-	}
-
-private:
-	std::shared_ptr<VulkanSurface> surface;
-	VkPresentModeKHR present_mode;
-	VkQueue present_queue;
-
-	std::unique_ptr<VulkanSwapchain> swapchain;
-	std::vector<VkImage> swapchain_images;
-	std::unique_ptr<VulkanCommandBuffers> swap_buffers_command;
-	std::unique_ptr<VulkanSemaphore> swapchain_image_ready;
-	std::unique_ptr<VulkanSemaphore> swap_buffers_finished;
-
-	uint32_t image_index{ 0 };
+	VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
 };
 
 
@@ -2409,6 +4293,7 @@ public:
 
 	OffscreenImage()
 	{
+		REGISTER_VISITOR(graphvisitor, OffscreenImage, declare);
 		REGISTER_VISITOR(allocvisitor, OffscreenImage, alloc);
 		REGISTER_VISITOR(resizevisitor, OffscreenImage, alloc);
 		REGISTER_VISITOR(recordvisitor, OffscreenImage, record);
@@ -2417,6 +4302,11 @@ public:
 
 	void alloc(Visitor* context)
 	{
+		// a readback may still be pending on the fence and the command buffer
+		context->state->frames->retire(std::move(this->image));
+		context->state->frames->retire(std::move(this->fence));
+		context->state->frames->retire(std::move(this->get_image_command));
+
 		this->fence = std::make_unique<VulkanFence>(context->state->device);
 		this->get_image_command = std::make_unique<VulkanCommandBuffers>(context->state->device);
 		// https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkQueueFlagBits.html
@@ -2457,6 +4347,17 @@ public:
 		this->dataOffset = subresource_layout.offset;
 	}
 
+	// the render target is read by the copy, the image it is copied to is not shared
+	void declare(Visitor* context)
+	{
+		FrameGraph* graph = context->state->graph.get();
+		if (!graph->declared(context->state->renderTarget.image)) {
+			return;
+		}
+		graph->pass(this, "offscreen image");
+		graph->use(context->state->renderTarget.image, RenderGraph::TRANSFER_SRC);
+	}
+
 	void record(Visitor* context)
 	{
 		const VkImageSubresourceLayers subresource_layers{
@@ -2480,6 +4381,42 @@ public:
 
 		VulkanCommandBuffers::Scope command_scope(this->get_image_command.get());
 
+		FrameGraph* graph = context->state->graph.get();
+		if (graph && graph->declared(this)) {
+			graph->record(this, this->get_image_command.get());
+
+			this->get_image_command->pipelineBarrier(
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				this->image->image->memoryBarrier(
+					0,
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					this->subresource_range) });
+
+			vk.CmdCopyImage(
+				this->get_image_command->buffer(),
+				context->state->renderTarget.image,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				this->image->image->image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &image_copy);
+
+			this->get_image_command->pipelineBarrier(
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT, {
+				this->image->image->memoryBarrier(
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_ACCESS_HOST_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_IMAGE_LAYOUT_GENERAL,
+					this->subresource_range) });
+
+			graph->finish(this, this->get_image_command.get());
+			return;
+		}
+
 		this->get_image_command->pipelineBarrier(
 			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,				// don't wait for anything, the color attachment was rendered to in preceding render pass
 			VK_PIPELINE_STAGE_TRANSFER_BIT,					// block transfer stage (copy)
@@ -2566,6 +4503,7 @@ public:
 
 	void render(RenderVisitor* context)
 	{
+		NeverCull(context->state.get());
 		context->image = this;
 	}
 
@@ -2599,15 +4537,35 @@ public:
 		filter(filter),
 		mipmapMode(mipmapMode),
 		addressMode(addressMode),
-		texture(VulkanImageFactory::Create(filename))
+		filename(filename)
 	{
+		REGISTER_VISITOR(loadvisitor, TextureImage, load);
 		REGISTER_VISITOR(allocvisitor, TextureImage, alloc);
 		REGISTER_VISITOR(pipelinevisitor, TextureImage, updateState);
 		REGISTER_VISITOR(recordvisitor, TextureImage, updateState);
 	}
 
+	// queued once, the node may be visited more than once before the read is done
+	void load(Visitor* context)
+	{
+		if (!this->texture && !this->queued && context->state->assets) {
+			this->queued = true;
+			context->state->assets->load(this->filename, [this] {
+				this->texture = VulkanImageFactory::Create(this->filename);
+				});
+		}
+	}
+
 	void alloc(Visitor* context)
 	{
+		if (!this->texture) {
+			this->texture = VulkanImageFactory::Create(this->filename);
+		}
+		// a texture swap must not destroy the image while frames in flight still sample it
+		context->state->frames->retire(std::move(this->sampler));
+		context->state->frames->retire(std::move(this->image));
+		context->state->frames->retire(std::move(this->view));
+
 		this->sampler = std::make_unique<VulkanSampler>(
 			context->state->device,
 			this->filter,
@@ -2641,17 +4599,6 @@ public:
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED);
 
-		this->buffer = std::make_unique<VulkanBufferObject>(
-			context->state->device,
-			0,
-			this->texture->size(),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-		MemoryMap memmap(this->buffer->memory.get());
-		std::copy(this->texture->data(), this->texture->data() + this->texture->size(), memmap.mem);
-
 		VkComponentMapping componentMapping{
 			.r = VK_COMPONENT_SWIZZLE_R,
 			.g = VK_COMPONENT_SWIZZLE_G,
@@ -2669,41 +4616,16 @@ public:
 			componentMapping,
 			subresourceRange);
 
-		std::vector<VkBufferImageCopy> regions = this->texture->getRegions();
-
-		context->state->default_command->pipelineBarrier(
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,					// don't wait for anything
-			VK_PIPELINE_STAGE_TRANSFER_BIT,						// but block transfer
-			{
-				VulkanImage::MemoryBarrier(
-					this->image->image->image,
-					0,
-					0,
-					VK_IMAGE_LAYOUT_UNDEFINED,					// old layout
-					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,		// new layout
-					subresourceRange)
-			});
-
-		vk.CmdCopyBufferToImage(
-			context->state->default_command->buffer(),
-			this->buffer->buffer->buffer,
+		// buffer offsets must be a multiple of both the texel block size and 4
+		auto texture = this->texture;
+		context->state->staging->copy(
 			this->image->image->image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			static_cast<uint32_t>(regions.size()),
-			regions.data());
-
-		context->state->default_command->pipelineBarrier(
-			VK_PIPELINE_STAGE_TRANSFER_BIT,						// wait for transfer
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,				// don't block anything
-			{
-				VulkanImage::MemoryBarrier(
-					this->image->image->image,
-					0,
-					0,
-					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,		// old layout
-					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,	// new layout
-					subresourceRange)
-			});
+			subresourceRange,
+			texture->getRegions(),
+			texture->size(),
+			[texture](char* dst) { std::copy(texture->data(), texture->data() + texture->size(), dst); },
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			std::lcm<VkDeviceSize>(texture->element_size(), 4));
 
 		this->updateState(context);
 	}
@@ -2732,10 +4654,11 @@ public:
 	VkSamplerMipmapMode mipmapMode;
 	VkSamplerAddressMode addressMode;
 
+	std::string filename;
 	std::shared_ptr<VulkanTextureImage> texture;
+	bool queued{ false };
 	std::unique_ptr<VulkanSampler> sampler;
 	std::unique_ptr<VulkanImageObject> image;
-	std::unique_ptr<VulkanBufferObject> buffer;
 	std::unique_ptr<VulkanImageView> view;
 };
 
@@ -2979,7 +4902,9 @@ public:
 
 		this->bind_sparse_finished = std::make_unique<VulkanSemaphore>(context->state->device);
 		this->copy_sparse_finished = std::make_unique<VulkanSemaphore>(context->state->device);
-		this->copy_sparse_command = std::make_unique<VulkanCommandBuffers>(context->state->device);
+		this->copy_sparse_command = std::make_unique<VulkanCommandBuffers>(
+			context->state->device,
+			context->state->frames->depth());
 		this->copy_sparse_queue = context->state->device->getQueue(VK_QUEUE_SPARSE_BINDING_BIT);
 
 		VkMemoryRequirements memory_requirements = this->image->getMemoryRequirements();
@@ -3038,6 +4963,7 @@ public:
 
 	void render(RenderVisitor* context)
 	{
+		NeverCull(context->state.get());
 		if (!this->updatelod) {
 			return;
 		}
@@ -3136,7 +5062,9 @@ public:
 
 		VkImageSubresourceRange subresourceRange = this->texture->subresourceRange();
 
-		this->copy_sparse_command->begin();
+		// the command buffer of the previous frame in this slot has retired, safe to re-record
+		const uint32_t frame_index = context->state->frame_index;
+		this->copy_sparse_command->begin(frame_index);
 
 		this->copy_sparse_command->pipelineBarrier(
 			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
@@ -3149,10 +5077,10 @@ public:
 				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				subresourceRange)
-			});
+			}, frame_index);
 
 		vk.CmdCopyBufferToImage(
-			this->copy_sparse_command->buffer(),
+			this->copy_sparse_command->buffer(frame_index),
 			this->buffer->buffer->buffer,
 			this->image->image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -3170,15 +5098,16 @@ public:
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 				subresourceRange)
-			});
+			}, frame_index);
 
-		this->copy_sparse_command->end();
+		this->copy_sparse_command->end(frame_index);
 
 		std::vector<VkSemaphore> copy_sparse_signal_semaphores{};
 
 		this->copy_sparse_command->submit(
 			this->copy_sparse_queue,
 			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			frame_index,
 			VK_NULL_HANDLE,
 			bind_sparse_signal_semaphores,			// wait semaphores
 			copy_sparse_signal_semaphores);			// signal semaphores
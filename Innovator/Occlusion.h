@@ -0,0 +1,387 @@
+#pragma once
+
+#include <Innovator/Simd.h>
+#include <Innovator/Bounds.h>
+#include <Innovator/ThreadPool.h>
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+// Occluder triangles rasterized into a small depth buffer on the CPU, and boxes tested against
+// a hierarchical z buffer built from it. Depth is z / w of a [0, w] projection, smaller is
+// nearer, pixel x, y is at normalized device coordinates 2 * (x + 0.5) / width - 1, same for y.
+// The buffer is split in tiles that are rasterized in parallel, each tile holds the triangles
+// that overlap it in the order they were added.
+class OcclusionBuffer {
+public:
+	static constexpr uint32_t TILE_SIZE = 32;
+	// pixels of a row rasterized together
+	static constexpr uint32_t LANES = 4;
+	// occluders are clipped this many times outside the sides of the view, and rasterized
+	// without clipping in between
+	static constexpr double GUARD_BAND = 4.0;
+	// boxes this close behind the occluders are not culled, for rounding in the rasterizer
+	static constexpr float DEPTH_BIAS = 1e-6f;
+
+	static ThreadPool& Threads()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	OcclusionBuffer() = delete;
+
+	// the width is a whole number of lanes
+	OcclusionBuffer(uint32_t width, uint32_t height) :
+		width(width),
+		height(height),
+		tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+		tiles_y((height + TILE_SIZE - 1) / TILE_SIZE)
+	{
+		if (!width || !height || width % LANES) {
+			throw std::invalid_argument("OcclusionBuffer: width must be a nonzero multiple of 4, and height nonzero");
+		}
+		this->depth.resize(size_t(width) * height);
+		this->bins.resize(size_t(this->tiles_x) * this->tiles_y);
+		for (uint32_t w = width, h = height; w > 1 || h > 1;) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			this->levels.push_back({ w, h, std::vector<float>(size_t(w) * h) });
+		}
+		this->clear();
+	}
+
+	// everything at the far plane, and no occluders
+	void clear()
+	{
+		std::fill(this->depth.begin(), this->depth.end(), 1.0f);
+		for (auto& level : this->levels) {
+			std::fill(level.depth.begin(), level.depth.end(), 1.0f);
+		}
+		for (auto& bin : this->bins) {
+			bin.clear();
+		}
+		this->triangles.clear();
+		this->camera = false;
+		this->tested = 0;
+		this->culled = 0;
+	}
+
+	// Adds the triangles of a mesh of packed float3 positions under the model and view projection
+	// transforms. Boxes are tested against the view projection of the last occluder added.
+	void add(const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count,
+		const Matrix4& model, const Matrix4& viewprojection)
+	{
+		Matrix4 m = Multiply(viewprojection, model);
+		this->viewprojection = viewprojection;
+		this->camera = true;
+
+		std::vector<Clip> clip(vertex_count);
+		for (size_t i = 0; i < vertex_count; i++) {
+			const float* p = positions + i * 3;
+			for (int k = 0; k < 4; k++) {
+				clip[i][k] = m[k] * p[0] + m[4 + k] * p[1] + m[8 + k] * p[2] + m[12 + k];
+			}
+		}
+		for (size_t i = 0; i + 2 < index_count; i += 3) {
+			if (indices[i] >= vertex_count || indices[i + 1] >= vertex_count || indices[i + 2] >= vertex_count) {
+				throw std::out_of_range("OcclusionBuffer: index past the end of the vertices");
+			}
+			this->addTriangle(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+		}
+	}
+
+	// rasterizes the occluders added since clear, and builds the hierarchy from the result
+	void rasterize(ThreadPool* pool = nullptr)
+	{
+		if (pool && pool->size() > 1 && this->triangles.size() > this->bins.size()) {
+			std::vector<std::future<void>> tiles;
+			for (size_t tile = 0; tile < this->bins.size(); tile++) {
+				tiles.push_back(pool->submit([this, tile] { this->rasterizeTile(tile); }));
+			}
+			for (auto& tile : tiles) {
+				tile.get();
+			}
+		}
+		else {
+			for (size_t tile = 0; tile < this->bins.size(); tile++) {
+				this->rasterizeTile(tile);
+			}
+		}
+		this->buildHierarchy();
+	}
+
+	// True when the world box is behind the occluders everywhere it covers on screen. Boxes that
+	// reach in front of the near plane or are off screen are not culled here.
+	bool occluded(const BoundingBox& box)
+	{
+		this->tested++;
+		if (!this->camera || box.empty() || box.infinite()) {
+			return false;
+		}
+		const Matrix4& m = this->viewprojection;
+		double nearest = std::numeric_limits<double>::max();
+		double xmin = nearest, ymin = nearest;
+		double xmax = std::numeric_limits<double>::lowest(), ymax = xmax;
+		for (int i = 0; i < 8; i++) {
+			double p[3]{ (i & 1) ? box.max[0] : box.min[0], (i & 2) ? box.max[1] : box.min[1], (i & 4) ? box.max[2] : box.min[2] };
+			double c[4];
+			for (int k = 0; k < 4; k++) {
+				c[k] = m[k] * p[0] + m[4 + k] * p[1] + m[8 + k] * p[2] + m[12 + k];
+			}
+			if (c[2] < 0.0 || c[3] <= 0.0) {
+				return false;
+			}
+			nearest = std::min(nearest, c[2] / c[3]);
+			xmin = std::min(xmin, c[0] / c[3]);
+			xmax = std::max(xmax, c[0] / c[3]);
+			ymin = std::min(ymin, c[1] / c[3]);
+			ymax = std::max(ymax, c[1] / c[3]);
+		}
+		xmin = (xmin * 0.5 + 0.5) * this->width;
+		xmax = (xmax * 0.5 + 0.5) * this->width;
+		ymin = (ymin * 0.5 + 0.5) * this->height;
+		ymax = (ymax * 0.5 + 0.5) * this->height;
+		if (xmax < 0.0 || ymax < 0.0 || xmin >= this->width || ymin >= this->height) {
+			return false;
+		}
+		// the pixels the box touches, at the finest level where they are at most 4 by 4 texels
+		uint32_t x0 = uint32_t(std::max(xmin, 0.0));
+		uint32_t y0 = uint32_t(std::max(ymin, 0.0));
+		uint32_t x1 = uint32_t(std::min(xmax, this->width - 1.0));
+		uint32_t y1 = uint32_t(std::min(ymax, this->height - 1.0));
+		size_t level = 0;
+		while (level < this->levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+			level++;
+		}
+		uint32_t level_width = level ? this->levels[level - 1].width : this->width;
+		const float* texels = level ? this->levels[level - 1].depth.data() : this->depth.data();
+		for (uint32_t y = y0 >> level; y <= y1 >> level; y++) {
+			for (uint32_t x = x0 >> level; x <= x1 >> level; x++) {
+				if (nearest <= texels[size_t(y) * level_width + x] + DEPTH_BIAS) {
+					return false;
+				}
+			}
+		}
+		this->culled++;
+		return true;
+	}
+
+	float depthAt(uint32_t x, uint32_t y) const
+	{
+		return this->depth[size_t(y) * this->width + x];
+	}
+
+	// the farthest depth of the 2^level by 2^level pixels at x, y of the level
+	float farthest(size_t level, uint32_t x, uint32_t y) const
+	{
+		if (!level) {
+			return this->depthAt(x, y);
+		}
+		return this->levels[level - 1].depth[size_t(y) * this->levels[level - 1].width + x];
+	}
+
+	size_t levelCount() const
+	{
+		return this->levels.size() + 1;
+	}
+
+	size_t triangleCount() const
+	{
+		return this->triangles.size();
+	}
+
+	uint32_t width;
+	uint32_t height;
+	// boxes tested and culled since clear
+	uint64_t tested{ 0 };
+	uint64_t culled{ 0 };
+
+private:
+	typedef std::array<double, 4> Clip;
+
+	// inside where all edge functions a * x + b * y + c are not negative at the pixel center,
+	// depth is z0 + dzdx * x + dzdy * y there. Both are relative to xmin, ymin for precision.
+	struct Triangle {
+		float a[3], b[3], c[3];
+		float z0, dzdx, dzdy;
+		int32_t xmin, ymin, xmax, ymax;
+	};
+
+	struct Level {
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> depth;
+	};
+
+	static Matrix4 Multiply(const Matrix4& a, const Matrix4& b)
+	{
+		Matrix4 m{};
+		for (int column = 0; column < 4; column++) {
+			for (int row = 0; row < 4; row++) {
+				for (int k = 0; k < 4; k++) {
+					m[column * 4 + row] += a[k * 4 + row] * b[column * 4 + k];
+				}
+			}
+		}
+		return m;
+	}
+
+	// clipped to the near and far planes and the guard band, then set up as a fan
+	void addTriangle(const Clip& v0, const Clip& v1, const Clip& v2)
+	{
+		std::array<Clip, 9> polygon{ v0, v1, v2 }, clipped;
+		size_t count = 3;
+		auto distance = [](const Clip& v, int plane) {
+			switch (plane) {
+			case 0: return v[2];
+			case 1: return v[3] - v[2];
+			case 2: return v[0] + GUARD_BAND * v[3];
+			case 3: return GUARD_BAND * v[3] - v[0];
+			case 4: return v[1] + GUARD_BAND * v[3];
+			default: return GUARD_BAND * v[3] - v[1];
+			}
+		};
+		for (int plane = 0; plane < 6 && count >= 3; plane++) {
+			size_t n = 0;
+			for (size_t i = 0; i < count; i++) {
+				const Clip& a = polygon[i];
+				const Clip& b = polygon[(i + 1) % count];
+				double da = distance(a, plane), db = distance(b, plane);
+				if (da >= 0.0) {
+					clipped[n++] = a;
+				}
+				if ((da >= 0.0) != (db >= 0.0)) {
+					double t = da / (da - db);
+					for (int k = 0; k < 4; k++) {
+						clipped[n][k] = a[k] + (b[k] - a[k]) * t;
+					}
+					n++;
+				}
+			}
+			polygon = clipped;
+			count = n;
+		}
+		for (size_t i = 1; i + 1 < count; i++) {
+			this->setup(polygon[0], polygon[i], polygon[i + 1]);
+		}
+	}
+
+	void setup(const Clip& c0, const Clip& c1, const Clip& c2)
+	{
+		if (c0[3] <= 0.0 || c1[3] <= 0.0 || c2[3] <= 0.0) {
+			return;
+		}
+		double x[3], y[3], z[3];
+		const Clip* c[3]{ &c0, &c1, &c2 };
+		for (int i = 0; i < 3; i++) {
+			x[i] = ((*c[i])[0] / (*c[i])[3] * 0.5 + 0.5) * this->width;
+			y[i] = ((*c[i])[1] / (*c[i])[3] * 0.5 + 0.5) * this->height;
+			z[i] = (*c[i])[2] / (*c[i])[3];
+		}
+		double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (!std::isnormal(area)) {
+			return;
+		}
+		// pixel centers from the first to the last covered by the bounds of the triangle
+		double xmin = std::min({ x[0], x[1], x[2] }), xmax = std::max({ x[0], x[1], x[2] });
+		double ymin = std::min({ y[0], y[1], y[2] }), ymax = std::max({ y[0], y[1], y[2] });
+		Triangle triangle;
+		triangle.xmin = std::max(int32_t(std::ceil(xmin - 0.5)), 0);
+		triangle.ymin = std::max(int32_t(std::ceil(ymin - 0.5)), 0);
+		triangle.xmax = std::min(int32_t(std::floor(xmax - 0.5)), int32_t(this->width) - 1);
+		triangle.ymax = std::min(int32_t(std::floor(ymax - 0.5)), int32_t(this->height) - 1);
+		if (triangle.xmin > triangle.xmax || triangle.ymin > triangle.ymax) {
+			return;
+		}
+		// both windings are occluders
+		double sign = area > 0.0 ? 1.0 : -1.0;
+		for (int i = 0; i < 3; i++) {
+			x[i] -= triangle.xmin;
+			y[i] -= triangle.ymin;
+		}
+		for (int i = 0; i < 3; i++) {
+			int j = (i + 1) % 3;
+			triangle.a[i] = float(sign * (y[i] - y[j]));
+			triangle.b[i] = float(sign * (x[j] - x[i]));
+			triangle.c[i] = float(sign * (x[i] * y[j] - y[i] * x[j]));
+		}
+		double dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+		double dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+		triangle.dzdx = float(dzdx);
+		triangle.dzdy = float(dzdy);
+		triangle.z0 = float(z[0] - dzdx * x[0] - dzdy * y[0]);
+
+		uint32_t index = uint32_t(this->triangles.size());
+		this->triangles.push_back(triangle);
+		for (int32_t ty = triangle.ymin / int32_t(TILE_SIZE); ty <= triangle.ymax / int32_t(TILE_SIZE); ty++) {
+			for (int32_t tx = triangle.xmin / int32_t(TILE_SIZE); tx <= triangle.xmax / int32_t(TILE_SIZE); tx++) {
+				this->bins[size_t(ty) * this->tiles_x + tx].push_back(index);
+			}
+		}
+	}
+
+	void rasterizeTile(size_t tile)
+	{
+		int32_t tx0 = int32_t(tile % this->tiles_x * TILE_SIZE);
+		int32_t ty0 = int32_t(tile / this->tiles_x * TILE_SIZE);
+		int32_t tx1 = std::min(tx0 + int32_t(TILE_SIZE), int32_t(this->width)) - 1;
+		int32_t ty1 = std::min(ty0 + int32_t(TILE_SIZE), int32_t(this->height)) - 1;
+
+		for (uint32_t index : this->bins[tile]) {
+			const Triangle& t = this->triangles[index];
+			int32_t x0 = std::max(t.xmin, tx0), x1 = std::min(t.xmax, tx1);
+			int32_t y0 = std::max(t.ymin, ty0), y1 = std::min(t.ymax, ty1);
+			// whole blocks of lanes, tiles start on one
+			x0 -= (x0 - tx0) % int32_t(LANES);
+			Float4 a0 = Float4::Set(t.a[0]), a1 = Float4::Set(t.a[1]), a2 = Float4::Set(t.a[2]), dzdx = Float4::Set(t.dzdx);
+			for (int32_t y = y0; y <= y1; y++) {
+				float py = float(y - t.ymin) + 0.5f;
+				Float4 r0 = Float4::Set(t.b[0] * py + t.c[0]);
+				Float4 r1 = Float4::Set(t.b[1] * py + t.c[1]);
+				Float4 r2 = Float4::Set(t.b[2] * py + t.c[2]);
+				Float4 rz = Float4::Set(t.dzdy * py + t.z0);
+				float* row = this->depth.data() + size_t(y) * this->width;
+				for (int32_t x = x0; x <= x1; x += LANES) {
+					Float4 px = Float4::Ramp(float(x - t.xmin) + 0.5f);
+					Float4::Nearer(a0 * px + r0, a1 * px + r1, a2 * px + r2, dzdx * px + rz, Float4::Load(row + x)).store(row + x);
+				}
+			}
+		}
+	}
+
+	// each texel the farthest of the 2 by 2 below it, texels past an odd edge repeat the last
+	void buildHierarchy()
+	{
+		const float* below = this->depth.data();
+		uint32_t below_width = this->width, below_height = this->height;
+		for (auto& level : this->levels) {
+			for (uint32_t y = 0; y < level.height; y++) {
+				uint32_t y0 = y * 2, y1 = std::min(y0 + 1, below_height - 1);
+				for (uint32_t x = 0; x < level.width; x++) {
+					uint32_t x0 = x * 2, x1 = std::min(x0 + 1, below_width - 1);
+					level.depth[size_t(y) * level.width + x] = std::max(
+						std::max(below[size_t(y0) * below_width + x0], below[size_t(y0) * below_width + x1]),
+						std::max(below[size_t(y1) * below_width + x0], below[size_t(y1) * below_width + x1]));
+				}
+			}
+			below = level.depth.data();
+			below_width = level.width;
+			below_height = level.height;
+		}
+	}
+
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	std::vector<float> depth;
+	std::vector<Level> levels;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins;
+	Matrix4 viewprojection{};
+	bool camera{ false };
+};
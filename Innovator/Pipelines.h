@@ -0,0 +1,205 @@
+#pragma once
+
+#include <Innovator/Descriptors.h>
+
+#include <bit>
+#include <array>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+
+// Canonical description of pipeline state as a stream of words. Every section is length
+// prefixed so different states can't produce the same stream, and state whose order doesn't
+// matter (vertex bindings, attributes, shader stages) is sorted before it's added.
+class PipelineKey {
+public:
+	typedef std::vector<uint64_t> Item;
+
+	void add(uint64_t word)
+	{
+		this->words.push_back(word);
+	}
+
+	void addFloat(float value)
+	{
+		this->words.push_back(std::bit_cast<uint32_t>(value));
+	}
+
+	void addString(const std::string& text)
+	{
+		this->words.push_back(text.size());
+		for (char c : text) {
+			this->words.push_back(static_cast<uint8_t>(c));
+		}
+	}
+
+	template <typename Word>
+	void addList(const std::vector<Word>& list)
+	{
+		this->words.push_back(list.size());
+		for (Word word : list) {
+			this->words.push_back(static_cast<uint64_t>(word));
+		}
+	}
+
+	void addUnordered(std::vector<Item> items)
+	{
+		std::sort(items.begin(), items.end());
+		this->words.push_back(items.size());
+		for (auto& item : items) {
+			this->addList(item);
+		}
+	}
+
+	size_t hash() const
+	{
+		size_t seed = this->words.size();
+		for (uint64_t word : this->words) {
+			seed = HashCombine(seed, word);
+		}
+		return seed;
+	}
+
+	bool operator==(const PipelineKey& other) const { return this->words == other.words; }
+
+	std::vector<uint64_t> words;
+};
+
+// identifies the driver a pipeline cache blob was created by
+struct PipelineCacheHeader {
+	static constexpr uint32_t MAGIC = 0x43504e49; // "INPC"
+	static constexpr uint32_t VERSION = 2;
+	// the fields one after the other, without the padding between them in memory
+	static constexpr size_t SIZE = 5 * sizeof(uint32_t) + 16 + 2 * sizeof(uint64_t);
+
+	uint32_t magic{ MAGIC };
+	uint32_t version{ VERSION };
+	uint32_t vendor_id{ 0 };
+	uint32_t device_id{ 0 };
+	uint32_t driver_version{ 0 };
+	std::array<uint8_t, 16> uuid{};
+	uint64_t size{ 0 };
+	uint64_t checksum{ 0 };
+
+	bool compatible(const PipelineCacheHeader& other) const
+	{
+		return this->magic == other.magic &&
+			this->version == other.version &&
+			this->vendor_id == other.vendor_id &&
+			this->device_id == other.device_id &&
+			this->driver_version == other.driver_version &&
+			this->uuid == other.uuid;
+	}
+
+	auto tie() const { return std::tie(magic, version, vendor_id, device_id, driver_version, uuid, size, checksum); }
+	auto tie() { return std::tie(magic, version, vendor_id, device_id, driver_version, uuid, size, checksum); }
+
+	void write(char* bytes) const
+	{
+		std::apply([&](const auto&... field) {
+			((std::memcpy(bytes, &field, sizeof(field)), bytes += sizeof(field)), ...);
+			}, this->tie());
+	}
+
+	void read(const char* bytes)
+	{
+		std::apply([&](auto&... field) {
+			((std::memcpy(&field, bytes, sizeof(field)), bytes += sizeof(field)), ...);
+			}, this->tie());
+	}
+};
+
+// The VkPipelineCache blob on disk, behind a header that is validated against the running
+// device. Anything that doesn't match or fails the checksum is ignored, the driver then
+// starts with an empty cache.
+class PipelineCacheFile {
+public:
+	static uint64_t Checksum(const std::vector<char>& data)
+	{
+		// FNV-1a
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (char c : data) {
+			hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	static std::vector<char> Serialize(PipelineCacheHeader header, const std::vector<char>& data)
+	{
+		header.magic = PipelineCacheHeader::MAGIC;
+		header.version = PipelineCacheHeader::VERSION;
+		header.size = data.size();
+		header.checksum = Checksum(data);
+
+		std::vector<char> bytes(PipelineCacheHeader::SIZE + data.size());
+		header.write(bytes.data());
+		std::copy(data.begin(), data.end(), bytes.begin() + PipelineCacheHeader::SIZE);
+		return bytes;
+	}
+
+	static std::optional<std::vector<char>> Parse(const std::vector<char>& bytes, const PipelineCacheHeader& expected)
+	{
+		PipelineCacheHeader header;
+		if (bytes.size() < PipelineCacheHeader::SIZE) {
+			return std::nullopt;
+		}
+		header.read(bytes.data());
+
+		if (!header.compatible(expected) || header.size != bytes.size() - PipelineCacheHeader::SIZE) {
+			return std::nullopt;
+		}
+		std::vector<char> data(bytes.begin() + PipelineCacheHeader::SIZE, bytes.end());
+		if (Checksum(data) != header.checksum) {
+			return std::nullopt;
+		}
+		return data;
+	}
+
+	static std::optional<std::vector<char>> Read(const std::filesystem::path& path, const PipelineCacheHeader& expected)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return std::nullopt;
+		}
+		std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return Parse(bytes, expected);
+	}
+
+	// writes to a temporary next to the file and renames it, a crash never leaves a torn file
+	static void Write(const std::filesystem::path& path, const PipelineCacheHeader& header, const std::vector<char>& data)
+	{
+		auto bytes = Serialize(header, data);
+		auto temporary = path;
+		temporary += ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			file.write(bytes.data(), bytes.size());
+			if (!file) {
+				throw std::runtime_error("PipelineCacheFile: failed to write " + temporary.string());
+			}
+		}
+		std::filesystem::rename(temporary, path);
+	}
+};
+
+struct PipelineStats {
+	uint64_t created{ 0 };
+	uint64_t reused{ 0 };
+	double create_ms{ 0 };
+	size_t loaded_bytes{ 0 };
+
+	void print(std::ostream& out) const
+	{
+		out << "pipelines: " << this->created << " created in " << this->create_ms << " ms, "
+			<< this->reused << " reused, " << this->loaded_bytes << " cache bytes loaded" << std::endl;
+	}
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+
+// The passes of a frame in the order they run, and the images they use. From the uses alone the
+// graph works out the barriers and layout transitions between passes, and where in shared memory
+// to put transient images: images whose contents only live within a frame share memory with those
+// whose lifetimes do not overlap theirs. Layouts and uses are the graph's own, mapped to Vulkan by
+// whoever records the barriers, so all decisions here can be tested without a GPU.
+class RenderGraph {
+public:
+	enum class Layout : uint32_t {
+		UNDEFINED,
+		COLOR_ATTACHMENT,
+		DEPTH_ATTACHMENT,
+		DEPTH_READ_ONLY,
+		SHADER_READ_ONLY,
+		GENERAL,
+		TRANSFER_SRC,
+		TRANSFER_DST,
+		PRESENT,
+	};
+
+	// how a pass uses an image, every use has a layout and is either a read or a write
+	enum Usage : uint32_t {
+		COLOR_ATTACHMENT = 1 << 0,
+		DEPTH_ATTACHMENT = 1 << 1,
+		DEPTH_READ = 1 << 2,
+		INPUT_ATTACHMENT = 1 << 3,
+		SAMPLED = 1 << 4,
+		STORAGE_READ = 1 << 5,
+		STORAGE_WRITE = 1 << 6,
+		TRANSFER_SRC = 1 << 7,
+		TRANSFER_DST = 1 << 8,
+		PRESENT = 1 << 9,
+	};
+
+	static constexpr uint32_t WRITES = COLOR_ATTACHMENT | DEPTH_ATTACHMENT | STORAGE_WRITE | TRANSFER_DST;
+
+	static Layout LayoutOf(Usage usage)
+	{
+		switch (usage) {
+		case COLOR_ATTACHMENT: return Layout::COLOR_ATTACHMENT;
+		case DEPTH_ATTACHMENT: return Layout::DEPTH_ATTACHMENT;
+		case DEPTH_READ: return Layout::DEPTH_READ_ONLY;
+		case INPUT_ATTACHMENT:
+		case SAMPLED: return Layout::SHADER_READ_ONLY;
+		case STORAGE_READ:
+		case STORAGE_WRITE: return Layout::GENERAL;
+		case TRANSFER_SRC: return Layout::TRANSFER_SRC;
+		case TRANSFER_DST: return Layout::TRANSFER_DST;
+		case PRESENT: return Layout::PRESENT;
+		default: throw std::invalid_argument("RenderGraph: a use must be exactly one Usage");
+		}
+	}
+
+	// what a transient image needs of the memory it is placed in
+	struct Memory {
+		uint64_t size;
+		uint64_t alignment;
+		uint32_t type;
+	};
+
+	struct Barrier {
+		size_t resource;
+		// uses that must be done before, none for the first use of an imported image
+		uint32_t src;
+		uint32_t dst;
+		Layout old_layout;
+		Layout new_layout;
+	};
+
+	// where a transient image is placed, the heaps are one per memory type
+	struct Placement {
+		size_t heap;
+		uint64_t offset;
+	};
+
+	struct Heap {
+		uint32_t type;
+		uint64_t size;
+		uint64_t alignment;
+	};
+
+	struct Plan {
+		// the barriers before each pass, and after the last one at the end
+		std::vector<std::vector<Barrier>> barriers;
+		// of the transient images that are used, empty for the others
+		std::vector<std::optional<Placement>> placements;
+		std::vector<Heap> heaps;
+		// sum of the sizes of the transient images placed, and of the heaps they share
+		uint64_t transient_bytes{ 0 };
+		uint64_t heap_bytes{ 0 };
+
+		std::vector<std::string> pass_names;
+		std::vector<std::string> resource_names;
+
+		// the barriers and placements as text, one per line
+		void print(std::ostream& out) const
+		{
+			for (size_t pass = 0; pass < this->barriers.size(); pass++) {
+				if (this->barriers[pass].empty()) {
+					continue;
+				}
+				out << (pass < this->pass_names.size() ? "before " + this->pass_names[pass] : std::string("at the end")) << ":" << std::endl;
+				for (auto& barrier : this->barriers[pass]) {
+					out << "  " << this->resource_names[barrier.resource] << ": "
+						<< UsageName(barrier.src) << " -> " << UsageName(barrier.dst);
+					if (barrier.old_layout != barrier.new_layout) {
+						out << ", " << LayoutName(barrier.old_layout) << " -> " << LayoutName(barrier.new_layout);
+					}
+					out << std::endl;
+				}
+			}
+			for (size_t resource = 0; resource < this->placements.size(); resource++) {
+				if (this->placements[resource]) {
+					out << this->resource_names[resource] << ": heap " << this->placements[resource]->heap
+						<< " at " << this->placements[resource]->offset << std::endl;
+				}
+			}
+			for (auto& heap : this->heaps) {
+				out << "heap of type " << heap.type << ": " << heap.size << " bytes" << std::endl;
+			}
+		}
+	};
+
+	// an image whose contents come from outside the graph, left in the final layout at the end
+	size_t import(std::string name, Layout initial, Layout final)
+	{
+		this->resources.push_back({ std::move(name), std::nullopt, initial, final });
+		return this->resources.size() - 1;
+	}
+
+	// an image whose contents are written and read within the frame only
+	size_t transient(std::string name, Memory memory)
+	{
+		if (memory.alignment == 0 || (memory.alignment & (memory.alignment - 1))) {
+			throw std::invalid_argument("RenderGraph: alignment must be a power of two");
+		}
+		this->resources.push_back({ std::move(name), memory, Layout::UNDEFINED, Layout::UNDEFINED });
+		return this->resources.size() - 1;
+	}
+
+	size_t pass(std::string name)
+	{
+		this->passes.push_back({ std::move(name), {} });
+		return this->passes.size() - 1;
+	}
+
+	// the pass uses the image, and leaves it in the layout after, if it is given
+	void use(size_t pass, size_t resource, Usage usage, std::optional<Layout> after = std::nullopt)
+	{
+		if (pass >= this->passes.size() || resource >= this->resources.size()) {
+			throw std::out_of_range("RenderGraph: no such pass or image");
+		}
+		LayoutOf(usage);
+		for (auto& use : this->passes[pass].uses) {
+			if (use.resource == resource) {
+				throw std::invalid_argument("RenderGraph: " + this->passes[pass].name + " uses " +
+					this->resources[resource].name + " more than once");
+			}
+		}
+		this->passes[pass].uses.push_back({ resource, usage, after });
+	}
+
+	size_t passCount() const
+	{
+		return this->passes.size();
+	}
+
+	size_t resourceCount() const
+	{
+		return this->resources.size();
+	}
+
+	Plan compile() const
+	{
+		Plan plan;
+		plan.barriers.resize(this->passes.size() + 1);
+		for (auto& pass : this->passes) {
+			plan.pass_names.push_back(pass.name);
+		}
+		for (auto& resource : this->resources) {
+			plan.resource_names.push_back(resource.name);
+		}
+
+		// first and last pass that uses each image, and its last use
+		const size_t unused = SIZE_MAX;
+		std::vector<size_t> first(this->resources.size(), unused), last(this->resources.size(), unused);
+		std::vector<uint32_t> last_use(this->resources.size(), 0);
+		for (size_t pass = 0; pass < this->passes.size(); pass++) {
+			for (auto& use : this->passes[pass].uses) {
+				if (first[use.resource] == unused) {
+					first[use.resource] = pass;
+				}
+				last[use.resource] = pass;
+				last_use[use.resource] = use.usage;
+			}
+		}
+		this->place(plan, first, last);
+
+		struct Tracked {
+			Layout layout;
+			uint32_t write{ 0 };
+			uint32_t readers{ 0 };
+			// reads that have seen the last write
+			uint32_t visible{ 0 };
+		};
+		std::vector<Tracked> tracked;
+		for (auto& resource : this->resources) {
+			tracked.push_back({ resource.initial });
+		}
+
+		for (size_t pass = 0; pass < this->passes.size(); pass++) {
+			for (auto& use : this->passes[pass].uses) {
+				const Resource& resource = this->resources[use.resource];
+				Tracked& t = tracked[use.resource];
+				const Layout layout = LayoutOf(use.usage);
+				const bool write = use.usage & WRITES;
+				auto barrier = [&](uint32_t src) {
+					plan.barriers[pass].push_back({ use.resource, src, use.usage, t.layout, layout });
+				};
+
+				if (resource.memory && pass == first[use.resource]) {
+					if (!write) {
+						throw std::invalid_argument("RenderGraph: " + this->passes[pass].name + " reads " +
+							resource.name + " before it is written");
+					}
+					// contents are discarded, after whatever used the memory last is done with it
+					t.layout = Layout::UNDEFINED;
+					barrier(this->previousOccupants(plan, use.resource, last_use));
+				}
+				else if (write) {
+					uint32_t src = t.readers ? t.readers : t.write;
+					if (src || t.layout != layout) {
+						barrier(src);
+					}
+				}
+				else if (t.layout != layout) {
+					barrier(t.write | t.readers);
+					t.readers = t.visible = 0;
+				}
+				else if (t.write && !(t.visible & use.usage)) {
+					barrier(t.write);
+				}
+
+				if (write) {
+					t.write = use.usage;
+					t.readers = t.visible = 0;
+				}
+				else {
+					t.readers |= use.usage;
+					t.visible |= use.usage;
+				}
+				t.layout = use.after.value_or(layout);
+			}
+		}
+
+		for (size_t resource = 0; resource < this->resources.size(); resource++) {
+			const Tracked& t = tracked[resource];
+			const Resource& r = this->resources[resource];
+			if (!r.memory && r.final != Layout::UNDEFINED && t.layout != r.final) {
+				plan.barriers.back().push_back({ resource, t.write | t.readers, 0, t.layout, r.final });
+			}
+		}
+		for (auto& barriers : plan.barriers) {
+			std::stable_sort(barriers.begin(), barriers.end(), [](const Barrier& a, const Barrier& b) {
+				return a.resource < b.resource;
+			});
+		}
+		return plan;
+	}
+
+	static std::string UsageName(uint32_t usage)
+	{
+		static const char* names[]{
+			"COLOR_ATTACHMENT", "DEPTH_ATTACHMENT", "DEPTH_READ", "INPUT_ATTACHMENT", "SAMPLED",
+			"STORAGE_READ", "STORAGE_WRITE", "TRANSFER_SRC", "TRANSFER_DST", "PRESENT" };
+		std::string name;
+		for (uint32_t bit = 0; bit < 10; bit++) {
+			if (usage & (1u << bit)) {
+				name += (name.empty() ? "" : "|") + std::string(names[bit]);
+			}
+		}
+		return name.empty() ? "none" : name;
+	}
+
+	static std::string LayoutName(Layout layout)
+	{
+		static const char* names[]{
+			"UNDEFINED", "COLOR_ATTACHMENT", "DEPTH_ATTACHMENT", "DEPTH_READ_ONLY", "SHADER_READ_ONLY",
+			"GENERAL", "TRANSFER_SRC", "TRANSFER_DST", "PRESENT" };
+		return names[static_cast<uint32_t>(layout)];
+	}
+
+private:
+	struct Resource {
+		std::string name;
+		std::optional<Memory> memory;
+		Layout initial;
+		Layout final;
+	};
+
+	struct Use {
+		size_t resource;
+		Usage usage;
+		std::optional<Layout> after;
+	};
+
+	struct Pass {
+		std::string name;
+		std::vector<Use> uses;
+	};
+
+	static bool Overlaps(uint64_t a, uint64_t a_size, uint64_t b, uint64_t b_size)
+	{
+		return a < b + b_size && b < a + a_size;
+	}
+
+	// largest first, each at the lowest offset where it overlaps no image that lives at the same time
+	void place(Plan& plan, const std::vector<size_t>& first, const std::vector<size_t>& last) const
+	{
+		plan.placements.resize(this->resources.size());
+		std::vector<size_t> order;
+		for (size_t resource = 0; resource < this->resources.size(); resource++) {
+			if (this->resources[resource].memory && first[resource] != SIZE_MAX) {
+				order.push_back(resource);
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+			return this->resources[a].memory->size > this->resources[b].memory->size;
+		});
+
+		std::map<uint32_t, size_t> heaps;
+		std::vector<size_t> placed;
+		for (size_t resource : order) {
+			const Memory& memory = *this->resources[resource].memory;
+			auto heap = heaps.find(memory.type);
+			if (heap == heaps.end()) {
+				heap = heaps.insert({ memory.type, plan.heaps.size() }).first;
+				plan.heaps.push_back({ memory.type, 0, 1 });
+			}
+
+			std::vector<std::pair<uint64_t, uint64_t>> taken;
+			for (size_t other : placed) {
+				if (plan.placements[other]->heap == heap->second &&
+					first[other] <= last[resource] && first[resource] <= last[other]) {
+					taken.push_back({ plan.placements[other]->offset, this->resources[other].memory->size });
+				}
+			}
+			std::sort(taken.begin(), taken.end());
+			uint64_t offset = 0;
+			for (auto& [start, size] : taken) {
+				if (Overlaps(offset, memory.size, start, size)) {
+					offset = (start + size + memory.alignment - 1) / memory.alignment * memory.alignment;
+				}
+			}
+			plan.placements[resource] = Placement{ heap->second, offset };
+			placed.push_back(resource);
+
+			Heap& h = plan.heaps[heap->second];
+			h.size = std::max(h.size, offset + memory.size);
+			h.alignment = std::max(h.alignment, memory.alignment);
+			plan.transient_bytes += memory.size;
+		}
+		for (auto& heap : plan.heaps) {
+			plan.heap_bytes += heap.size;
+		}
+	}
+
+	// the last uses of all images placed over the memory of a transient image, itself included:
+	// before it is first used, those earlier in the frame are done with the memory, and those
+	// later in the frame were done with it in the frame before
+	uint32_t previousOccupants(const Plan& plan, size_t resource, const std::vector<uint32_t>& last_use) const
+	{
+		const Placement& placement = *plan.placements[resource];
+		const uint64_t size = this->resources[resource].memory->size;
+		uint32_t src = 0;
+		for (size_t other = 0; other < this->resources.size(); other++) {
+			if (plan.placements[other] && plan.placements[other]->heap == placement.heap &&
+				Overlaps(placement.offset, size, plan.placements[other]->offset, this->resources[other].memory->size)) {
+				src |= last_use[other];
+			}
+		}
+		return src;
+	}
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+// Defers destruction of objects the GPU may still be using. Each object is tagged with
+// the fence serial (or timeline value) of the last frame that may reference it, and is
+// released in a batch once the completed serial has reached that value.
+class RetireQueue {
+public:
+	RetireQueue() = default;
+	~RetireQueue() = default;
+
+	template <typename T>
+	void retire(std::shared_ptr<T> object, uint64_t serial)
+	{
+		if (!object) {
+			return;
+		}
+		// serials normally arrive in order, keep the queue sorted if they don't
+		auto it = std::upper_bound(this->entries.begin(), this->entries.end(), serial,
+			[](uint64_t value, const Entry& entry) { return value < entry.first; });
+
+		this->entries.insert(it, { serial, std::move(object) });
+	}
+
+	template <typename T>
+	void retire(std::unique_ptr<T> object, uint64_t serial)
+	{
+		this->retire(std::shared_ptr<T>(std::move(object)), serial);
+	}
+
+	// releases everything retired at or before the completed serial, returns the number of objects released
+	size_t collect(uint64_t completed)
+	{
+		size_t count = 0;
+		while (!this->entries.empty() && this->entries.front().first <= completed) {
+			this->entries.pop_front();
+			count++;
+		}
+		return count;
+	}
+
+	// releases everything, the device must be idle
+	void clear()
+	{
+		this->entries.clear();
+	}
+
+	size_t size() const
+	{
+		return this->entries.size();
+	}
+
+	bool empty() const
+	{
+		return this->entries.empty();
+	}
+
+private:
+	typedef std::pair<uint64_t, std::shared_ptr<void>> Entry;
+	std::deque<Entry> entries;
+};
@@ -3,11 +3,15 @@
 #include <Innovator/Nodes.h>
 #include <Scheme/Scheme.h>
 
+#include <map>
 #include <string>
 #include <memory>
 #include <vector>
+#include <thread>
 #include <fstream>
 #include <utility>
+#include <exception>
+#include <algorithm>
 
 using namespace scm;
 
@@ -94,11 +98,293 @@ int window(const List& lst)
 {
 	auto extent = std::any_cast<VkExtent2D>(lst[0]);
 	auto scene = std::any_cast<std::shared_ptr<Node>>(lst[1]);
-	auto window = std::make_shared<VulkanWindow>(extent, scene);
+	uint32_t frames_in_flight = (lst.size() > 2) ? std::any_cast<uint32_t>(lst[2]) : 2;
+	auto window = std::make_shared<VulkanWindow>(extent, scene, frames_in_flight);
 	return window->show();
 }
 #endif
 
+// Renders a scene for a number of frames in a rendering context of its own. To present, the
+// scene is given a swapchain on a headless surface, as a window gives it one of its own, and
+// the image of the last frame is read back.
+Pixels render_headless(VkExtent2D extent, uint32_t frames, std::shared_ptr<Node> scene, bool present)
+{
+	std::vector<const char*> instance_extensions;
+	std::vector<const char*> device_extensions;
+	if (present) {
+#ifdef VK_EXT_headless_surface
+		instance_extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+		device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+#else
+		throw std::runtime_error("headless-present: VK_EXT_headless_surface is not available");
+#endif
+	}
+
+	RenderContext context;
+	context.create(scene.get(), instance_extensions, device_extensions);
+	context.state->extent = VkExtent3D{ extent.width, extent.height, 1 };
+
+	// made on the context's device, freed before it
+	auto root = std::make_shared<Group>();
+	root->children = { scene };
+	std::shared_ptr<Swapchain> swapchain;
+#ifdef VK_EXT_headless_surface
+	if (present) {
+		swapchain = std::make_shared<Swapchain>(
+			std::make_shared<VulkanSurface>(context.state->vulkan),
+			VK_PRESENT_MODE_FIFO_KHR);
+		context.state->swapchain = swapchain.get();
+		root->children.push_back(swapchain);
+	}
+#endif
+
+	context.alloc(root.get());
+	// what the window does when it is first sized, the command buffers are recorded here
+	context.resize(root.get(), context.state->extent);
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		if (swapchain && frame + 1 == frames) {
+			swapchain->capture();
+		}
+		context.redraw(root.get());
+	}
+	// the scene is freed on the context's device, after the last frame
+	context.wait();
+	return (swapchain && frames > 0) ? swapchain->pixels() : Pixels{};
+}
+
+// each scene on a thread of its own, the images are those render_headless reads back
+std::vector<Pixels> render_parallel(const List& lst, bool present)
+{
+	auto extent = std::any_cast<VkExtent2D>(lst[0]);
+	uint32_t frames = std::any_cast<uint32_t>(lst[1]);
+
+	std::vector<std::exception_ptr> errors(lst.size() - 2);
+	std::vector<Pixels> images(lst.size() - 2);
+	std::vector<std::thread> threads;
+	for (size_t i = 2; i < lst.size(); i++) {
+		auto scene = std::any_cast<std::shared_ptr<Node>>(lst[i]);
+		threads.emplace_back([scene, extent, frames, present, &error = errors[i - 2], &image = images[i - 2]] {
+			try {
+				image = render_headless(extent, frames, scene, present);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	for (auto& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+	return images;
+}
+
+// (headless extent frames scene...) renders each scene offscreen
+int headless(const List& lst)
+{
+	render_parallel(lst, false);
+	return 0;
+}
+
+// (headless-present extent frames scene...) renders each scene and presents it to a surface
+// that shows nothing, so scenes that render to the swapchain images run without a window. The
+// scenes are variants of one picture, the last image of each is compared with that of the
+// first. A channel may be off by one, and edges may differ where the variants sample them
+// differently, as a multisampled one does.
+int headless_present(const List& lst)
+{
+	constexpr uint32_t tolerance = 1;
+	constexpr double edge_fraction = 0.01;
+
+	std::vector<Pixels> images = render_parallel(lst, true);
+	if (!images.empty()) {
+		Pixels background = images[0];
+		// every pixel the color of the first
+		for (size_t p = 4; p < background.data.size(); p += 4) {
+			std::copy_n(background.data.begin(), 4, background.data.begin() + p);
+		}
+		if (Compare(images[0], background, 0).pixels == 0) {
+			throw std::runtime_error("headless-present: the first scene draws nothing to compare with");
+		}
+	}
+	for (size_t i = 1; i < images.size(); i++) {
+		ImageDifference difference = Compare(images[0], images[i], tolerance);
+		if (difference.fraction() > edge_fraction) {
+			throw std::runtime_error("headless-present: image of scene " + std::to_string(i + 1) +
+				" differs from the first in " + std::to_string(difference.pixels) + " of " +
+				std::to_string(difference.count) + " pixels, by up to " + std::to_string(difference.max));
+		}
+	}
+	return 0;
+}
+
+// (specialization "NAME" value) pairs, passed to shader after the source
+typedef std::pair<std::string, Number> Specialization;
+
+Specialization specialization(const List& lst)
+{
+	return { std::any_cast<std::string>(lst[0]), std::any_cast<Number>(lst[1]) };
+}
+
+std::shared_ptr<Node> shader(const List& lst)
+{
+	SpecializationConstants constants;
+	for (size_t i = 2; i < lst.size(); i++) {
+		auto [name, value] = std::any_cast<Specialization>(lst[i]);
+		constants.set(name, value);
+	}
+	return std::make_shared<Shader>(
+		std::any_cast<VkShaderStageFlagBits>(lst[0]),
+		std::any_cast<std::string>(lst[1]),
+		constants);
+}
+
+// (instance translation scale [r g b a] [id])
+Instance instance(const List& lst)
+{
+	auto translation = std::any_cast<glm::dvec3>(lst[0]);
+	auto scale = std::any_cast<glm::dvec3>(lst[1]);
+	Instance instance = Instance::FromTranslationScale(
+		{ translation.x, translation.y, translation.z },
+		{ scale.x, scale.y, scale.z });
+
+	if (lst.size() > 2) {
+		if (lst.size() < 6) {
+			throw std::invalid_argument("instance color needs 4 components");
+		}
+		for (size_t i = 0; i < 4; i++) {
+			instance.color[i] = static_cast<float>(std::any_cast<Number>(lst[2 + i]));
+		}
+	}
+	if (lst.size() > 6) {
+		instance.id = static_cast<uint32_t>(std::any_cast<Number>(lst[6]));
+	}
+	return instance;
+}
+
+std::shared_ptr<Node> instancedata(const List& lst)
+{
+	return std::make_shared<InstanceData>(scm::any_cast<Instance>(lst));
+}
+
+// (instances binding first_location instancedata geometry...)
+std::shared_ptr<Node> instances(const List& lst)
+{
+	auto data = std::dynamic_pointer_cast<InstanceData>(std::any_cast<std::shared_ptr<Node>>(lst[2]));
+	if (!data) {
+		throw std::invalid_argument("instances needs instancedata as its third argument");
+	}
+	std::vector<std::shared_ptr<Node>> geometry;
+	for (size_t i = 3; i < lst.size(); i++) {
+		geometry.push_back(std::any_cast<std::shared_ptr<Node>>(lst[i]));
+	}
+	return std::make_shared<Instances>(
+		std::any_cast<uint32_t>(lst[0]),
+		std::any_cast<uint32_t>(lst[1]),
+		data,
+		geometry);
+}
+
+// (indirectdraw index_count first_index vertex_offset)
+IndirectDraw indirectdraw(const List& lst)
+{
+	return {
+		.index_count = static_cast<uint32_t>(std::any_cast<Number>(lst[0])),
+		.first_index = static_cast<uint32_t>(std::any_cast<Number>(lst[1])),
+		.vertex_offset = static_cast<int32_t>(std::any_cast<Number>(lst[2])),
+	};
+}
+
+// (indirectdrawcommand topology indirectdraw...)
+std::shared_ptr<Node> indirectdrawcommand(const List& lst)
+{
+	std::vector<IndirectDraw> draws;
+	for (size_t i = 1; i < lst.size(); i++) {
+		draws.push_back(std::any_cast<IndirectDraw>(lst[i]));
+	}
+	return std::make_shared<IndirectDrawCommand>(
+		draws,
+		std::any_cast<VkPrimitiveTopology>(lst[0]));
+}
+
+// (pooledgeometry vertex_stride index_type vertices [indices])
+std::shared_ptr<Node> pooledgeometry(const List& lst)
+{
+	auto bufferdata = [&lst](size_t i) {
+		auto data = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(lst[i]));
+		if (!data) {
+			throw std::invalid_argument("pooledgeometry needs buffer data for vertices and indices");
+		}
+		return data;
+	};
+	return std::make_shared<PooledGeometry>(
+		std::any_cast<uint32_t>(lst[0]),
+		std::any_cast<VkIndexType>(lst[1]),
+		bufferdata(2),
+		lst.size() > 3 ? bufferdata(3) : nullptr);
+}
+
+// the meshes read by the stlgeometry of one environment
+typedef std::map<std::pair<std::string, bool>, std::weak_ptr<STLMesh>> STLMeshes;
+
+// (stlgeometry filename [normals] [level]), welded vertices and 32 bit indices in the geometry
+// pool, and the error of the level. Levels of the same file share one read, unless it has
+// started without the level asked for.
+std::shared_ptr<Node> stlgeometry(STLMeshes& meshes, const List& lst)
+{
+	auto filename = std::any_cast<std::string>(lst[0]);
+	bool normals = lst.size() > 1 ? std::any_cast<bool>(lst[1]) : false;
+	size_t level = lst.size() > 2 ? std::any_cast<uint32_t>(lst[2]) : 0;
+
+	auto mesh = meshes[{ filename, normals }].lock();
+	if (!mesh || !mesh->require(level)) {
+		mesh = std::make_shared<STLMesh>(filename, normals);
+		meshes[{ filename, normals }] = mesh;
+	}
+
+	auto vertices = std::make_shared<STLMeshData>(mesh, STLMeshData::Part::VERTICES, level);
+	auto geometry = std::make_shared<PooledGeometry>(
+		static_cast<uint32_t>(vertices->stride()),
+		VK_INDEX_TYPE_UINT32,
+		vertices,
+		std::make_shared<STLMeshData>(mesh, STLMeshData::Part::INDICES, level));
+
+	auto error = std::make_shared<GeometricError>([mesh, level] { return mesh->error(level); });
+	return std::make_shared<Group>(std::vector<std::shared_ptr<Node>>{ geometry, error });
+}
+
+std::shared_ptr<Node> geometricerror(const List& lst)
+{
+	return std::make_shared<GeometricError>(static_cast<float>(std::any_cast<Number>(lst[0])));
+}
+
+// (levelofdetail pixels level...), levels from finest to coarsest
+std::shared_ptr<Node> levelofdetail(const List& lst)
+{
+	std::vector<std::shared_ptr<Node>> levels;
+	for (size_t i = 1; i < lst.size(); i++) {
+		levels.push_back(std::any_cast<std::shared_ptr<Node>>(lst[i]));
+	}
+	return std::make_shared<LevelOfDetail>(static_cast<double>(std::any_cast<Number>(lst[0])), levels);
+}
+
+// (occlusionculling width height child...), the size of the depth buffer occluders are rasterized into
+std::shared_ptr<Node> occlusionculling(const List& lst)
+{
+	std::vector<std::shared_ptr<Node>> children;
+	for (size_t i = 2; i < lst.size(); i++) {
+		children.push_back(std::any_cast<std::shared_ptr<Node>>(lst[i]));
+	}
+	return std::make_shared<OcclusionCulling>(
+		static_cast<uint32_t>(std::any_cast<Number>(lst[0])),
+		static_cast<uint32_t>(std::any_cast<Number>(lst[1])),
+		children);
+}
+
 VkComponentMapping componentMapping(const List& lst)
 {
 	return VkComponentMapping{ 
@@ -163,11 +449,14 @@ env_ptr innovator_env()
 	innovator_env->inner.insert({ "bottom-level-acceleration-structure", fun_ptr(node<BottomLevelAccelerationStructure>) });
 	innovator_env->inner.insert({ "top-level-acceleration-structure", fun_ptr(node<TopLevelAccelerationStructure>) });
 #endif
+	innovator_env->inner.insert({ "headless", fun_ptr(headless) });
+	innovator_env->inner.insert({ "headless-present", fun_ptr(headless_present) });
 	innovator_env->inner.insert({ "extent", fun_ptr(node<Extent, uint32_t, uint32_t>) });
 	innovator_env->inner.insert({ "offscreen-image", fun_ptr(node<OffscreenImage>) });
 	innovator_env->inner.insert({ "pipeline-bindpoint", fun_ptr(node<PipelineBindpoint, VkPipelineBindPoint>) });
 	innovator_env->inner.insert({ "color-attachment", fun_ptr(node<ColorAttachment, uint32_t, VkImageLayout>) });
 	innovator_env->inner.insert({ "depth-attachment", fun_ptr(node<DepthStencilAttachment, uint32_t, VkImageLayout>) });
+	innovator_env->inner.insert({ "resolve-attachment", fun_ptr(node<ResolveAttachment, uint32_t, VkImageLayout>) });
 	innovator_env->inner.insert({ "subpass", fun_ptr(shared_from_node_list<SubpassDescription, std::shared_ptr<Node>>) });
 	innovator_env->inner.insert({ "renderpass-attachment", fun_ptr(node<RenderpassAttachment, VkFormat, VkSampleCountFlagBits, VkAttachmentLoadOp, VkAttachmentStoreOp, VkAttachmentLoadOp, VkAttachmentStoreOp, VkImageLayout, VkImageLayout>) });
 	innovator_env->inner.insert({ "renderpass-description", fun_ptr(shared_from_node_list<RenderpassDescription, std::shared_ptr<Node>>) });
@@ -178,9 +467,19 @@ env_ptr innovator_env()
 	innovator_env->inner.insert({ "texturematrix", fun_ptr(node<TextureMatrix, glm::dvec3, glm::dvec3>) });
 	innovator_env->inner.insert({ "framebuffer", fun_ptr(shared_from_node_list<Framebuffer, std::shared_ptr<Node>>) });
 	innovator_env->inner.insert({ "framebuffer-attachment", fun_ptr(node<FramebufferAttachment, VkFormat, VkImageLayout, VkImageUsageFlags, VkImageAspectFlags>) });
-	innovator_env->inner.insert({ "shader", fun_ptr(node<Shader, VkShaderStageFlagBits, std::string>) });
+	innovator_env->inner.insert({ "multisample-attachment", fun_ptr(node<FramebufferAttachment, VkFormat, VkImageLayout, VkImageUsageFlags, VkImageAspectFlags, VkSampleCountFlagBits>) });
+	innovator_env->inner.insert({ "swapchain-attachment", fun_ptr(node<SwapchainAttachment, VkFormat>) });
+	innovator_env->inner.insert({ "shader", fun_ptr(shader) });
+	innovator_env->inner.insert({ "specialization", fun_ptr(specialization) });
 	innovator_env->inner.insert({ "texturedata", fun_ptr(node<TextureData, std::string>) });
 	innovator_env->inner.insert({ "stldata", fun_ptr(node<STLBufferData, std::string>) });
+	innovator_env->inner.insert({ "stlgeometry", fun_ptr([meshes = std::make_shared<STLMeshes>()](const List& lst) {
+		return stlgeometry(*meshes, lst);
+		}) });
+	innovator_env->inner.insert({ "geometricerror", fun_ptr(geometricerror) });
+	innovator_env->inner.insert({ "levelofdetail", fun_ptr(levelofdetail) });
+	innovator_env->inner.insert({ "occlusionculling", fun_ptr(occlusionculling) });
+	innovator_env->inner.insert({ "occluder", fun_ptr(node<Occluder>) });
 	innovator_env->inner.insert({ "textureimage", fun_ptr(node<TextureImage, uint32_t, VkShaderStageFlags, VkFilter, VkSamplerMipmapMode, VkSamplerAddressMode, std::string>) });
 	innovator_env->inner.insert({ "sparsetextureimage", fun_ptr(node<SparseTextureImage, uint32_t, VkShaderStageFlags, VkFilter, VkSamplerMipmapMode, VkSamplerAddressMode, std::string>) });
 	innovator_env->inner.insert({ "rtxbuffer", fun_ptr(shared_from_node_list<RTXbuffer, std::shared_ptr<Node>>) });
@@ -190,11 +489,18 @@ env_ptr innovator_env()
 	innovator_env->inner.insert({ "separator", fun_ptr(shared_from_node_list<Separator, std::shared_ptr<Node>>) });
 	innovator_env->inner.insert({ "bufferdata-float", fun_ptr(bufferdata<float>) });
 	innovator_env->inner.insert({ "bufferdata-uint32", fun_ptr(bufferdata<uint32_t>) });
+	innovator_env->inner.insert({ "instance", fun_ptr(instance) });
+	innovator_env->inner.insert({ "instancedata", fun_ptr(instancedata) });
+	innovator_env->inner.insert({ "instances", fun_ptr(instances) });
 	innovator_env->inner.insert({ "cpumemorybuffer", fun_ptr(node<CpuMemoryBuffer, VkBufferUsageFlags>) });
 	innovator_env->inner.insert({ "gpumemorybuffer", fun_ptr(node<GpuMemoryBuffer, VkBufferUsageFlags>) });
 	innovator_env->inner.insert({ "transformbuffer", fun_ptr(node<TransformBuffer>) });
+	innovator_env->inner.insert({ "transformpushconstants", fun_ptr(node<TransformPushConstants>) });
 	innovator_env->inner.insert({ "drawcommand", fun_ptr(node<DrawCommand, uint32_t, uint32_t, uint32_t, uint32_t, VkPrimitiveTopology>) });
 	innovator_env->inner.insert({ "indexeddrawcommand", fun_ptr(node<IndexedDrawCommand, uint32_t, uint32_t, uint32_t, int32_t, uint32_t, VkPrimitiveTopology>) });
+	innovator_env->inner.insert({ "indirectdraw", fun_ptr(indirectdraw) });
+	innovator_env->inner.insert({ "indirectdrawcommand", fun_ptr(indirectdrawcommand) });
+	innovator_env->inner.insert({ "pooledgeometry", fun_ptr(pooledgeometry) });
 	innovator_env->inner.insert({ "indexbufferdescription", fun_ptr(node<IndexBufferDescription, VkIndexType>) });
 	innovator_env->inner.insert({ "descriptorsetlayoutbinding", fun_ptr(node<DescriptorSetLayoutBinding, uint32_t, VkDescriptorType, VkShaderStageFlagBits>) });
 	innovator_env->inner.insert({ "vertexinputbindingdescription", fun_ptr(node<VertexInputBindingDescription, uint32_t, uint32_t, VkVertexInputRate>) });
@@ -366,6 +672,7 @@ env_ptr innovator_env()
 
 	innovator_env->inner.insert({ "VK_INDEX_TYPE_UINT16", VK_INDEX_TYPE_UINT16 });
 	innovator_env->inner.insert({ "VK_INDEX_TYPE_UINT32", VK_INDEX_TYPE_UINT32 });
+	innovator_env->inner.insert({ "VK_INDEX_TYPE_NONE_KHR", VK_INDEX_TYPE_NONE_KHR });
 
 	innovator_env->inner.insert({ "VK_VERTEX_INPUT_RATE_VERTEX", VK_VERTEX_INPUT_RATE_VERTEX });
 	innovator_env->inner.insert({ "VK_VERTEX_INPUT_RATE_INSTANCE", VK_VERTEX_INPUT_RATE_INSTANCE });
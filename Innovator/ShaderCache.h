@@ -0,0 +1,205 @@
+#pragma once
+
+#include <Innovator/ThreadPool.h>
+#include <Innovator/MappedFile.h>
+
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <utility>
+#include <optional>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+
+// everything that decides what SPIR-V a shader compiles to
+struct ShaderSource {
+	std::string glsl;
+	uint32_t kind{ 0 };
+	std::vector<std::pair<std::string, std::string>> defines{};
+};
+
+// Compiled SPIR-V on disk, one file per shader named by a hash of its source, stage, defines
+// and the compiler version. Files are written once and never modified, hits are read through
+// a memory mapping.
+class SpirvCache {
+public:
+	static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+	SpirvCache() = delete;
+
+	SpirvCache(std::filesystem::path directory, std::string compiler_version) :
+		directory(std::move(directory)),
+		compiler_version(std::move(compiler_version))
+	{}
+
+	// 128 bit content address as hex, two independently seeded FNV-1a hashes of the inputs
+	std::string key(const ShaderSource& source) const
+	{
+		std::string bytes;
+		auto append = [&](const std::string& text) {
+			uint64_t size = text.size();
+			bytes.append(reinterpret_cast<const char*>(&size), sizeof(size));
+			bytes.append(text);
+		};
+		append(this->compiler_version);
+		append(std::to_string(source.kind));
+		for (auto& [name, value] : source.defines) {
+			append(name);
+			append(value);
+		}
+		append(source.glsl);
+
+		auto fnv = [&](uint64_t hash) {
+			for (char c : bytes) {
+				hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+			}
+			return hash;
+		};
+
+		std::ostringstream hex;
+		hex << std::hex;
+		hex.width(16);
+		hex.fill('0');
+		hex << fnv(0xcbf29ce484222325ull);
+		hex.width(16);
+		hex << fnv(0x84222325cbf29ce4ull);
+		return hex.str();
+	}
+
+	std::filesystem::path path(const std::string& key) const
+	{
+		return this->directory / (key + ".spv");
+	}
+
+	std::optional<std::vector<uint32_t>> load(const std::string& key) const
+	{
+		auto path = this->path(key);
+		std::error_code error;
+		if (!std::filesystem::exists(path, error)) {
+			return std::nullopt;
+		}
+		try {
+			MappedFile file(path);
+			if (file.size() < 5 * sizeof(uint32_t) || file.size() % sizeof(uint32_t) != 0) {
+				return std::nullopt;
+			}
+			std::vector<uint32_t> spv(file.size() / sizeof(uint32_t));
+			std::memcpy(spv.data(), file.data(), file.size());
+			if (spv[0] != SPIRV_MAGIC) {
+				return std::nullopt;
+			}
+			return spv;
+		}
+		catch (std::runtime_error&) {
+			return std::nullopt;
+		}
+	}
+
+	// written to a temporary and renamed, concurrent writers of the same key are harmless
+	void store(const std::string& key, const std::vector<uint32_t>& spv) const
+	{
+		std::filesystem::create_directories(this->directory);
+		auto path = this->path(key);
+		std::ostringstream suffix;
+		suffix << ".tmp" << std::this_thread::get_id();
+		auto temporary = path;
+		temporary += suffix.str();
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(spv.data()), spv.size() * sizeof(uint32_t));
+			if (!file) {
+				throw std::runtime_error("SpirvCache: failed to write " + temporary.string());
+			}
+		}
+		std::filesystem::rename(temporary, path);
+	}
+
+private:
+	std::filesystem::path directory;
+	std::string compiler_version;
+};
+
+struct ShaderCompilerStats {
+	std::atomic<uint64_t> hits{ 0 };
+	std::atomic<uint64_t> compiles{ 0 };
+	std::atomic<uint64_t> shared{ 0 };
+
+	void print(std::ostream& out) const
+	{
+		out << "shaders: " << this->compiles << " compiled, " << this->hits << " loaded from cache, "
+			<< this->shared << " shared with identical shaders" << std::endl;
+	}
+};
+
+// Hands out SPIR-V as futures. Cache hits are ready immediately, misses are compiled on a
+// thread pool and stored, so the caller only waits once it needs the code.
+class ShaderCompiler {
+public:
+	typedef std::vector<uint32_t> Spirv;
+	typedef std::function<Spirv(const ShaderSource&)> Compile;
+
+	ShaderCompiler() = delete;
+
+	ShaderCompiler(
+		Compile compile,
+		std::filesystem::path directory,
+		std::string compiler_version,
+		size_t threads = std::thread::hardware_concurrency()) :
+		compile_function(std::move(compile)),
+		cache(std::move(directory), std::move(compiler_version)),
+		pool(threads)
+	{}
+
+	std::shared_future<Spirv> compile(const ShaderSource& source)
+	{
+		std::string key = this->cache.key(source);
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->results.find(key);
+		if (it != this->results.end()) {
+			this->stats.shared++;
+			return it->second;
+		}
+
+		std::shared_future<Spirv> result;
+		if (auto spv = this->cache.load(key)) {
+			this->stats.hits++;
+			std::promise<Spirv> promise;
+			promise.set_value(std::move(*spv));
+			result = promise.get_future().share();
+		}
+		else {
+			result = this->pool.submit([this, key, source]() {
+				this->stats.compiles++;
+				Spirv spv = this->compile_function(source);
+				try {
+					this->cache.store(key, spv);
+				}
+				catch (std::exception&) {
+					// an unwritable cache only costs a compile on the next start
+				}
+				return spv;
+				}).share();
+		}
+		this->results.emplace(key, result);
+		return result;
+	}
+
+	ShaderCompilerStats stats;
+
+private:
+	Compile compile_function;
+	SpirvCache cache;
+	std::mutex mutex;
+	std::unordered_map<std::string, std::shared_future<Spirv>> results;
+	ThreadPool pool;
+};
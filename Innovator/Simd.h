@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Four floats in a SIMD register, SSE2 on x86, NEON on ARM, and plain floats elsewhere.
+struct Float4 {
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+	__m128 v;
+
+	static Float4 Set(float a) { return { _mm_set1_ps(a) }; }
+	static Float4 Ramp(float a) { return { _mm_setr_ps(a, a + 1.0f, a + 2.0f, a + 3.0f) }; }
+	static Float4 Load(const float* p) { return { _mm_loadu_ps(p) }; }
+	void store(float* p) const { _mm_storeu_ps(p, this->v); }
+	Float4 operator+(Float4 b) const { return { _mm_add_ps(this->v, b.v) }; }
+	Float4 operator-(Float4 b) const { return { _mm_sub_ps(this->v, b.v) }; }
+	Float4 operator*(Float4 b) const { return { _mm_mul_ps(this->v, b.v) }; }
+	static Float4 Min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+	static Float4 Max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+	static Float4 Abs(Float4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+	// bit i set where lane i compares true
+	static uint32_t Less(Float4 a, Float4 b) { return uint32_t(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v))); }
+	static uint32_t LessEqual(Float4 a, Float4 b) { return uint32_t(_mm_movemask_ps(_mm_cmple_ps(a.v, b.v))); }
+
+	// the smaller of z and depth where e0, e1 and e2 are not negative, depth elsewhere
+	static Float4 Nearer(Float4 e0, Float4 e1, Float4 e2, Float4 z, Float4 depth)
+	{
+		__m128 zero = _mm_setzero_ps();
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0.v, zero), _mm_cmpge_ps(e1.v, zero)), _mm_cmpge_ps(e2.v, zero));
+		return { _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(z.v, depth.v)), _mm_andnot_ps(inside, depth.v)) };
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t v;
+
+	static Float4 Set(float a) { return { vdupq_n_f32(a) }; }
+	static Float4 Ramp(float a) { const float r[4]{ a, a + 1.0f, a + 2.0f, a + 3.0f }; return { vld1q_f32(r) }; }
+	static Float4 Load(const float* p) { return { vld1q_f32(p) }; }
+	void store(float* p) const { vst1q_f32(p, this->v); }
+	Float4 operator+(Float4 b) const { return { vaddq_f32(this->v, b.v) }; }
+	Float4 operator-(Float4 b) const { return { vsubq_f32(this->v, b.v) }; }
+	Float4 operator*(Float4 b) const { return { vmulq_f32(this->v, b.v) }; }
+	static Float4 Min(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+	static Float4 Max(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+	static Float4 Abs(Float4 a) { return { vabsq_f32(a.v) }; }
+	static uint32_t Less(Float4 a, Float4 b) { return Bits(vcltq_f32(a.v, b.v)); }
+	static uint32_t LessEqual(Float4 a, Float4 b) { return Bits(vcleq_f32(a.v, b.v)); }
+
+	static uint32_t Bits(uint32x4_t mask)
+	{
+		const uint32_t weights[4]{ 1, 2, 4, 8 };
+		uint32x4_t bits = vandq_u32(mask, vld1q_u32(weights));
+		uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+		return vget_lane_u32(vpadd_u32(sum, sum), 0);
+	}
+
+	static Float4 Nearer(Float4 e0, Float4 e1, Float4 e2, Float4 z, Float4 depth)
+	{
+		float32x4_t zero = vdupq_n_f32(0.0f);
+		uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(e0.v, zero), vcgeq_f32(e1.v, zero)), vcgeq_f32(e2.v, zero));
+		return { vbslq_f32(inside, vminq_f32(z.v, depth.v), depth.v) };
+	}
+#else
+	std::array<float, 4> v;
+
+	static Float4 Set(float a) { return { a, a, a, a }; }
+	static Float4 Ramp(float a) { return { a, a + 1.0f, a + 2.0f, a + 3.0f }; }
+	static Float4 Load(const float* p) { return { p[0], p[1], p[2], p[3] }; }
+	void store(float* p) const { std::copy(this->v.begin(), this->v.end(), p); }
+	Float4 operator+(Float4 b) const { return { this->v[0] + b.v[0], this->v[1] + b.v[1], this->v[2] + b.v[2], this->v[3] + b.v[3] }; }
+	Float4 operator-(Float4 b) const { return { this->v[0] - b.v[0], this->v[1] - b.v[1], this->v[2] - b.v[2], this->v[3] - b.v[3] }; }
+	Float4 operator*(Float4 b) const { return { this->v[0] * b.v[0], this->v[1] * b.v[1], this->v[2] * b.v[2], this->v[3] * b.v[3] }; }
+	static Float4 Min(Float4 a, Float4 b) { return { std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) }; }
+	static Float4 Max(Float4 a, Float4 b) { return { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) }; }
+	static Float4 Abs(Float4 a) { return { std::abs(a.v[0]), std::abs(a.v[1]), std::abs(a.v[2]), std::abs(a.v[3]) }; }
+	static uint32_t Less(Float4 a, Float4 b) { return (a.v[0] < b.v[0]) | (a.v[1] < b.v[1]) << 1 | (a.v[2] < b.v[2]) << 2 | (a.v[3] < b.v[3]) << 3; }
+	static uint32_t LessEqual(Float4 a, Float4 b) { return (a.v[0] <= b.v[0]) | (a.v[1] <= b.v[1]) << 1 | (a.v[2] <= b.v[2]) << 2 | (a.v[3] <= b.v[3]) << 3; }
+
+	static Float4 Nearer(Float4 e0, Float4 e1, Float4 e2, Float4 z, Float4 depth)
+	{
+		for (int i = 0; i < 4; i++) {
+			bool inside = e0.v[i] >= 0.0f && e1.v[i] >= 0.0f && e2.v[i] >= 0.0f;
+			depth.v[i] = inside ? std::min(z.v[i], depth.v[i]) : depth.v[i];
+		}
+		return depth;
+	}
+#endif
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <map>
+#include <regex>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+// Named specialization constants. Shaders declare them in GLSL as
+//
+//   layout(constant_id = 0) const uint TILE_SIZE = 64;
+//
+// and scenes set them by name. The declarations are read from the source so names resolve to
+// constant ids and values are packed in the declared type, one SPIR-V module then serves
+// every set of values. Nothing here depends on Vulkan, the entries mirror VkSpecializationMapEntry.
+
+struct SpecializationDeclaration {
+	enum Type { BOOL, INT, UINT, FLOAT };
+
+	std::string name;
+	uint32_t id;
+	Type type;
+};
+
+struct SpecializationEntry {
+	uint32_t constantID;
+	uint32_t offset;
+	size_t size;
+};
+
+// map entries and data in constant id order, so equal values give equal pipeline keys
+struct SpecializationData {
+	std::vector<SpecializationEntry> entries;
+	std::vector<char> data;
+};
+
+// GLSL has no string literals, so comments can be blanked without a tokenizer. Newlines are
+// kept, a block comment becomes a space so the tokens around it stay apart.
+inline std::string StripComments(const std::string& glsl)
+{
+	std::string stripped;
+	stripped.reserve(glsl.size());
+	for (size_t i = 0; i < glsl.size(); i++) {
+		if (glsl.compare(i, 2, "//") == 0) {
+			i = glsl.find('\n', i);
+			if (i == std::string::npos) {
+				break;
+			}
+			stripped.push_back('\n');
+		}
+		else if (glsl.compare(i, 2, "/*") == 0) {
+			size_t end = glsl.find("*/", i + 2);
+			end = (end == std::string::npos) ? glsl.size() : end + 2;
+			stripped.append(std::count(glsl.begin() + i, glsl.begin() + end, '\n'), '\n');
+			stripped.push_back(' ');
+			i = end - 1;
+		}
+		else {
+			stripped.push_back(glsl[i]);
+		}
+	}
+	return stripped;
+}
+
+inline std::vector<SpecializationDeclaration> ParseSpecializationConstants(const std::string& source)
+{
+	static const std::regex declaration(
+		R"(layout\s*\(\s*constant_id\s*=\s*(\d+)\s*\)\s*const\s+(bool|int|uint|float)\s+(\w+))");
+
+	static const std::map<std::string, SpecializationDeclaration::Type> types{
+		{ "bool", SpecializationDeclaration::BOOL },
+		{ "int", SpecializationDeclaration::INT },
+		{ "uint", SpecializationDeclaration::UINT },
+		{ "float", SpecializationDeclaration::FLOAT },
+	};
+
+	const std::string glsl = StripComments(source);
+	std::vector<SpecializationDeclaration> declarations;
+	for (auto it = std::sregex_iterator(glsl.begin(), glsl.end(), declaration); it != std::sregex_iterator(); ++it) {
+		declarations.push_back({
+			.name = (*it)[3].str(),
+			.id = static_cast<uint32_t>(std::stoul((*it)[1].str())),
+			.type = types.at((*it)[2].str()),
+			});
+	}
+	return declarations;
+}
+
+class SpecializationConstants {
+public:
+	void set(const std::string& name, double value)
+	{
+		this->values[name] = value;
+	}
+
+	bool empty() const
+	{
+		return this->values.empty();
+	}
+
+	// Packs the values that were set. Names the shader doesn't declare and values that don't fit
+	// the declared type are errors, constants that aren't set keep their default in the shader.
+	SpecializationData pack(std::vector<SpecializationDeclaration> declarations) const
+	{
+		for (auto& [name, value] : this->values) {
+			auto it = std::find_if(declarations.begin(), declarations.end(), [&](auto& declaration) {
+				return declaration.name == name;
+				});
+			if (it == declarations.end()) {
+				throw std::invalid_argument("SpecializationConstants: shader has no constant named " + name);
+			}
+		}
+
+		std::sort(declarations.begin(), declarations.end(), [](auto& a, auto& b) {
+			return a.id < b.id;
+			});
+
+		SpecializationData packed;
+		for (auto& declaration : declarations) {
+			auto it = this->values.find(declaration.name);
+			if (it == this->values.end()) {
+				continue;
+			}
+			uint32_t word = Encode(declaration, it->second);
+			packed.entries.push_back({
+				.constantID = declaration.id,
+				.offset = static_cast<uint32_t>(packed.data.size()),
+				.size = sizeof(word),
+				});
+			packed.data.resize(packed.data.size() + sizeof(word));
+			std::memcpy(packed.data.data() + packed.entries.back().offset, &word, sizeof(word));
+		}
+		return packed;
+	}
+
+private:
+	// every declared type is 32 bits, bools as VkBool32
+	static uint32_t Encode(const SpecializationDeclaration& declaration, double value)
+	{
+		auto invalid = [&]() {
+			return std::invalid_argument("SpecializationConstants: " + std::to_string(value) +
+				" is not a valid value for " + declaration.name);
+		};
+
+		switch (declaration.type) {
+		case SpecializationDeclaration::BOOL:
+			if (value != 0 && value != 1) {
+				throw invalid();
+			}
+			return static_cast<uint32_t>(value);
+		case SpecializationDeclaration::INT:
+			if (value != std::floor(value) ||
+				value < std::numeric_limits<int32_t>::min() ||
+				value > std::numeric_limits<int32_t>::max()) {
+				throw invalid();
+			}
+			return static_cast<uint32_t>(static_cast<int32_t>(value));
+		case SpecializationDeclaration::UINT:
+			if (value != std::floor(value) || value < 0 || value > std::numeric_limits<uint32_t>::max()) {
+				throw invalid();
+			}
+			return static_cast<uint32_t>(value);
+		case SpecializationDeclaration::FLOAT: {
+			float f = static_cast<float>(value);
+			uint32_t word;
+			std::memcpy(&word, &f, sizeof(word));
+			return word;
+		}
+		}
+		throw invalid();
+	}
+
+	std::map<std::string, double> values;
+};
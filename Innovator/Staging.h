@@ -0,0 +1,410 @@
+#pragma once
+
+#include <Innovator/Allocator.h>
+#include <Innovator/VulkanAPI.h>
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+struct StagingStats {
+	uint64_t uploads{ 0 };
+	uint64_t bytes{ 0 };
+	uint64_t submits{ 0 };
+	uint64_t stalls{ 0 };
+	uint64_t oversized{ 0 };
+
+	void print(std::ostream& stream) const
+	{
+		stream << "Uploads: " << this->uploads
+			<< " (" << this->bytes / (1024.0 * 1024.0) << " mb)"
+			<< " in " << this->submits << " submits, "
+			<< this->stalls << " stalls on a full ring, "
+			<< this->oversized << " oversized" << std::endl;
+	}
+};
+
+
+// Uploads buffer and image data through one persistently mapped staging buffer. Copies are
+// recorded into a batch that goes out in a single submit on flush(), optionally on a dedicated
+// transfer queue. The staging memory of a batch is reused once its fence has signaled.
+class StagingBuffer {
+public:
+	StagingBuffer() = delete;
+
+	StagingBuffer(
+		std::shared_ptr<VulkanDevice> device,
+		VkQueue queue,
+		VkDeviceSize capacity = 32 * 1024 * 1024,
+		bool use_transfer_queue = false) :
+		device(std::move(device)),
+		queue(queue),
+		transfer_queue(queue),
+		ring(capacity)
+	{
+		this->queue_family = this->device->getQueueFamily(queue);
+		this->transfer_family = this->queue_family;
+
+		if (use_transfer_queue) {
+			// a transfer only family is backed by the copy engines on most hardware
+			auto& families = this->device->physical_device.queue_family_properties;
+			for (uint32_t family = 0; family < families.size(); family++) {
+				VkQueueFlags flags = families[family].queueFlags;
+				if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+					this->transfer_family = family;
+					this->transfer_queue = this->device->queues[family];
+					break;
+				}
+			}
+		}
+
+		this->pool = std::make_unique<VulkanCommandPool>(this->device, this->queue_family);
+		if (this->transfer_family != this->queue_family) {
+			this->transfer_pool = std::make_unique<VulkanCommandPool>(this->device, this->transfer_family);
+		}
+
+		this->buffer = std::make_unique<VulkanBufferObject>(
+			this->device,
+			0,
+			capacity,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		this->mapped = this->buffer->memory->map(capacity, 0);
+
+		for (size_t i = 0; i < 3; i++) {
+			auto batch = std::make_unique<Batch>();
+			batch->fence = std::make_unique<VulkanFence>(this->device);
+			if (this->transfer_pool) {
+				batch->command = std::make_unique<VulkanCommandBuffers>(
+					this->device, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->transfer_pool->pool);
+				batch->acquire = std::make_unique<VulkanCommandBuffers>(
+					this->device, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->pool->pool);
+				batch->semaphore = std::make_unique<VulkanSemaphore>(this->device);
+			}
+			else {
+				batch->command = std::make_unique<VulkanCommandBuffers>(
+					this->device, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->pool->pool);
+			}
+			this->batches.push_back(std::move(batch));
+		}
+	}
+
+	~StagingBuffer()
+	{
+		try {
+			this->wait();
+		}
+		catch (VkException&) {}
+	}
+
+	// copies size bytes written by fill into the buffer
+	void copy(
+		VkBuffer dst,
+		VkDeviceSize size,
+		const std::function<void(char*)>& fill,
+		VkDeviceSize dst_offset = 0)
+	{
+		auto [src, src_offset] = this->stage(size, 4, fill);
+
+		VkBufferCopy region{
+			.srcOffset = src_offset,
+			.dstOffset = dst_offset,
+			.size = size,
+		};
+
+		vk.CmdCopyBuffer(this->recording->command->buffer(), src, dst, 1, &region);
+
+		if (this->transfer_family != this->queue_family) {
+			this->recording->buffer_barriers.push_back({
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = 0,
+				.srcQueueFamilyIndex = this->transfer_family,
+				.dstQueueFamilyIndex = this->queue_family,
+				.buffer = dst,
+				.offset = dst_offset,
+				.size = size,
+				});
+		}
+	}
+
+	// copies size bytes written by fill into the image regions, region buffer offsets are relative
+	// to the start of the data. The image is left in the given layout.
+	void copy(
+		VkImage dst,
+		const VkImageSubresourceRange& subresource_range,
+		std::vector<VkBufferImageCopy> regions,
+		VkDeviceSize size,
+		const std::function<void(char*)>& fill,
+		VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VkDeviceSize alignment = 16)
+	{
+		auto [src, src_offset] = this->stage(size, alignment, fill);
+		VkCommandBuffer command = this->recording->command->buffer();
+
+		VulkanCommandBuffers::PipelineBarrier(
+			command,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			{
+				VulkanImage::MemoryBarrier(
+					dst,
+					0,
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					subresource_range)
+			});
+
+		for (auto& region : regions) {
+			region.bufferOffset += src_offset;
+		}
+
+		vk.CmdCopyBufferToImage(
+			command,
+			src,
+			dst,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()),
+			regions.data());
+
+		// the layout transition is batched with the end of transfer barrier
+		VkImageMemoryBarrier barrier = VulkanImage::MemoryBarrier(
+			dst,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			layout,
+			subresource_range);
+
+		if (this->transfer_family != this->queue_family) {
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = this->transfer_family;
+			barrier.dstQueueFamilyIndex = this->queue_family;
+		}
+		this->recording->image_barriers.push_back(barrier);
+	}
+
+	// submits everything recorded since the last flush. Work submitted to the queue afterwards
+	// sees the uploaded data.
+	void flush()
+	{
+		Batch* batch = this->recording;
+		if (!batch) {
+			return;
+		}
+		this->recording = nullptr;
+		batch->serial = ++this->serial;
+
+		VkCommandBuffer command = batch->command->buffer();
+
+		if (this->transfer_family == this->queue_family) {
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			};
+
+			vk.CmdPipelineBarrier(
+				command,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				1, &barrier,
+				0, nullptr,
+				static_cast<uint32_t>(batch->image_barriers.size()),
+				batch->image_barriers.data());
+
+			batch->command->end();
+			batch->fence->reset();
+			batch->command->submit(this->queue, VK_PIPELINE_STAGE_TRANSFER_BIT, batch->fence->fence);
+		}
+		else {
+			// release on the transfer queue, acquire on the rendering queue
+			vk.CmdPipelineBarrier(
+				command,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(batch->buffer_barriers.size()),
+				batch->buffer_barriers.data(),
+				static_cast<uint32_t>(batch->image_barriers.size()),
+				batch->image_barriers.data());
+
+			batch->command->end();
+			batch->command->submit(
+				this->transfer_queue,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_NULL_HANDLE,
+				{},
+				{ batch->semaphore->semaphore });
+
+			for (auto& barrier : batch->buffer_barriers) {
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			for (auto& barrier : batch->image_barriers) {
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			}
+
+			batch->acquire->begin(0, 0, 0, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			vk.CmdPipelineBarrier(
+				batch->acquire->buffer(),
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(batch->buffer_barriers.size()),
+				batch->buffer_barriers.data(),
+				static_cast<uint32_t>(batch->image_barriers.size()),
+				batch->image_barriers.data());
+			batch->acquire->end();
+
+			batch->fence->reset();
+			batch->acquire->submit(
+				this->queue,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				batch->fence->fence,
+				{ batch->semaphore->semaphore });
+		}
+
+		batch->buffer_barriers.clear();
+		batch->image_barriers.clear();
+		batch->pending = true;
+		this->ring.close(batch->serial);
+		this->stats.submits++;
+	}
+
+	// releases the staging memory of batches the GPU has finished with
+	void reclaim()
+	{
+		for (auto& batch : this->batches) {
+			if (batch->pending && vk.GetFenceStatus(this->device->device, batch->fence->fence) == VK_SUCCESS) {
+				batch->pending = false;
+				batch->transients.clear();
+				// batches complete in submission order
+				this->completed = std::max(this->completed, batch->serial);
+			}
+		}
+		this->ring.reclaim(this->completed);
+	}
+
+	void wait()
+	{
+		this->flush();
+		for (auto& batch : this->batches) {
+			if (batch->pending) {
+				batch->fence->wait();
+			}
+		}
+		this->reclaim();
+	}
+
+	StagingStats stats;
+
+private:
+	struct Batch {
+		std::unique_ptr<VulkanCommandBuffers> command;
+		std::unique_ptr<VulkanCommandBuffers> acquire;
+		std::unique_ptr<VulkanSemaphore> semaphore;
+		std::unique_ptr<VulkanFence> fence;
+		std::vector<VkBufferMemoryBarrier> buffer_barriers;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		std::vector<std::shared_ptr<void>> transients;
+		uint64_t serial{ 0 };
+		bool pending{ false };
+	};
+
+	void begin()
+	{
+		if (this->recording) {
+			return;
+		}
+		Batch* batch = this->batches[this->next++ % this->batches.size()].get();
+		batch->fence->wait();
+		this->reclaim();
+
+		batch->command->begin(0, 0, 0, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		this->recording = batch;
+	}
+
+	// copies the data into staging memory, returns the buffer and offset to copy from
+	std::pair<VkBuffer, VkDeviceSize> stage(
+		VkDeviceSize size,
+		VkDeviceSize alignment,
+		const std::function<void(char*)>& fill)
+	{
+		this->begin();
+		this->stats.uploads++;
+		this->stats.bytes += size;
+
+		if (size > this->ring.capacity()) {
+			// too large for the ring, stage it in a buffer of its own that lives as long as the batch
+			auto oversized = std::make_shared<VulkanBufferObject>(
+				this->device,
+				0,
+				size,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_SHARING_MODE_EXCLUSIVE,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+			fill(oversized->memory->map(size, 0));
+			this->recording->transients.push_back(oversized);
+			this->stats.oversized++;
+			return { oversized->buffer->buffer, 0 };
+		}
+
+		auto offset = this->ring.allocate(size, alignment);
+		while (!offset) {
+			// the ring is full of data the GPU has not consumed yet
+			this->stats.stalls++;
+			this->flush();
+			this->waitOldest();
+			this->begin();
+			offset = this->ring.allocate(size, alignment);
+		}
+		fill(this->mapped + *offset);
+		return { this->buffer->buffer->buffer, *offset };
+	}
+
+	void waitOldest()
+	{
+		Batch* oldest = nullptr;
+		for (auto& batch : this->batches) {
+			if (batch->pending && (!oldest || batch->serial < oldest->serial)) {
+				oldest = batch.get();
+			}
+		}
+		if (oldest) {
+			oldest->fence->wait();
+		}
+		this->reclaim();
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	VkQueue queue;
+	VkQueue transfer_queue;
+	uint32_t queue_family{ 0 };
+	uint32_t transfer_family{ 0 };
+
+	std::unique_ptr<VulkanCommandPool> pool;
+	std::unique_ptr<VulkanCommandPool> transfer_pool;
+	std::unique_ptr<VulkanBufferObject> buffer;
+	char* mapped{ nullptr };
+
+	StagingRing ring;
+	std::vector<std::unique_ptr<Batch>> batches;
+	Batch* recording{ nullptr };
+	uint64_t next{ 0 };
+	uint64_t serial{ 0 };
+	uint64_t completed{ 0 };
+};
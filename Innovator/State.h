@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Innovator/Bounds.h>
 #include <Innovator/VulkanAPI.h>
 
 #include <glm/glm.hpp>
@@ -12,6 +13,7 @@ typedef struct DescriptorSetInfo {
 	VkDescriptorImageInfo descriptor_image_info{};
 	VkDescriptorBufferInfo descriptor_buffer_info{};
 	VkWriteDescriptorSetAccelerationStructureKHR descriptor_set_acceleration_structure{};
+	uint32_t uniform_slot{ 0 };
 } DescriptorSetInfo;
 
 struct RenderTarget {
@@ -22,23 +24,44 @@ struct RenderTarget {
 };
 
 struct State {
+	// the rendering context the state belongs to, with the traversals that share it
+	class RenderContext* context{ nullptr };
 	std::shared_ptr<VulkanInstance> vulkan{ nullptr };
 	std::shared_ptr<VulkanDevice> device{ nullptr };
 	std::shared_ptr<VulkanPipelineCache> pipelinecache{ nullptr };
+	std::shared_ptr<VulkanDescriptorCache> descriptors{ nullptr };
 
 	VkQueue queue{ nullptr };
 	std::shared_ptr<VulkanFence> fence{ nullptr };
 	std::vector<VkSemaphore> wait_semaphores;
 	std::shared_ptr<VulkanCommandBuffers> default_command{ nullptr };
+	std::shared_ptr<class FrameRing> frames{ nullptr };
+	std::shared_ptr<class StagingBuffer> staging{ nullptr };
+	std::shared_ptr<class UniformRing> uniforms{ nullptr };
+	std::shared_ptr<class GeometryBuffers> geometry{ nullptr };
+	std::shared_ptr<class AssetLoader> assets{ nullptr };
+	// cached world matrices of the model matrices, and the one the traversal is below
+	std::shared_ptr<class TransformHierarchy> transforms{ nullptr };
+	uint64_t transform{ 0 };
+	// the passes of the frame and the images they use, declared by the graph traversal
+	std::shared_ptr<class FrameGraph> graph{ nullptr };
+	uint32_t frame_index{ 0 };
 
 	VkDescriptorBufferInfo descriptor_buffer_info{
 		0, 0, 0
 	};
 	VkBuffer buffer{ 0 };
+	uint32_t uniform_slot{ 0 };
+	bool push_transform{ false };
 	class BufferData* bufferdata{ 0 };
 	class VulkanTextureImage* texture{ 0 };
 	std::shared_ptr<VulkanRenderpass> renderpass{ 0 };
-	std::shared_ptr<VulkanFramebuffer> framebuffer{ 0 };
+	// one for each swapchain image when the render pass draws to them, one otherwise
+	std::vector<std::shared_ptr<VulkanFramebuffer>> framebuffers;
+	// the render pass the traversal is below presents, with the swapchain that makes its images
+	class Swapchain* swapchain{ nullptr };
+	bool present{ false };
+	VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
 
 	VkExtent3D extent{ 0, 0, 0 };
 
@@ -90,10 +113,29 @@ struct State {
 	VkIndexType index_buffer_type{ VK_INDEX_TYPE_NONE_KHR };
 	VkBuffer index_buffer{ 0 };
 	uint32_t index_count{ 0 };
+	class BufferData* index_data{ nullptr };
+	// where the current mesh starts in shared vertex and index buffers
+	int32_t base_vertex{ 0 };
+	uint32_t first_index{ 0 };
+	// object space distance of the current mesh from its full resolution
+	float geometric_error{ 0.0f };
 
 	std::vector<VkBuffer> vertex_attribute_buffers;
 	std::vector<VkDeviceSize> vertex_attribute_buffer_offsets;
 	std::vector<uint32_t> vertex_counts;
+	std::vector<class BufferData*> vertex_attribute_data;
+	class InstanceData* instances{ nullptr };
+
+	// world bounds of what the traversal has rendered so far, and the frustum it is culled against
+	BoundingBox bounds;
+	Frustum frustum;
+	uint32_t cull_planes{ Frustum::ALL_PLANES };
+	bool cull{ false };
+	// set in the pick traversal, collects the draws it passes
+	class Picking* picking{ nullptr };
+	// occluders are rasterized into it, and the render traversal culls against it
+	class OcclusionBuffer* occlusion{ nullptr };
+	bool occluder{ false };
 
 	glm::dmat4 ViewMatrix{ 1.0 };
 	glm::dmat4 ModelMatrix{ 1.0 };
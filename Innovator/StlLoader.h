@@ -0,0 +1,470 @@
+#pragma once
+
+#include <Innovator/ThreadPool.h>
+#include <Innovator/MappedFile.h>
+
+#include <cmath>
+#include <bit>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <filesystem>
+#include <string_view>
+
+// Triangles of an STL file with identical positions welded into one vertex. Vertices are
+// float xyz, followed by an area weighted vertex normal when loaded with normals.
+struct StlMesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	bool normals{ false };
+
+	uint32_t floatsPerVertex() const
+	{
+		return this->normals ? 6 : 3;
+	}
+
+	uint32_t vertexStride() const
+	{
+		return this->floatsPerVertex() * sizeof(float);
+	}
+
+	size_t vertexCount() const
+	{
+		return this->vertices.size() / this->floatsPerVertex();
+	}
+
+	size_t triangleCount() const
+	{
+		return this->indices.size() / 3;
+	}
+};
+
+// Positions added to it get the index of the first identical position. Open addressing with
+// the positions stored in the slots, so a probe touches one cache line. -0.0 and 0.0 are the
+// same position.
+class StlWeldTable {
+public:
+	explicit StlWeldTable(size_t expected = 0)
+	{
+		this->positions.reserve(expected * 3);
+		this->rehash(std::bit_ceil(std::max<size_t>(expected * 2, 64)));
+	}
+
+	uint32_t insert(const float* p)
+	{
+		Slot key{ .bits = {}, .index = 0 };
+		const float position[3]{ p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f };
+		std::memcpy(key.bits, position, sizeof(key.bits));
+
+		size_t slot = static_cast<size_t>(Hash(key.bits)) & this->mask;
+		while (this->slots[slot].index != EMPTY) {
+			const Slot& other = this->slots[slot];
+			if (other.bits[0] == key.bits[0] && other.bits[1] == key.bits[1] && other.bits[2] == key.bits[2]) {
+				return other.index;
+			}
+			slot = (slot + 1) & this->mask;
+		}
+		if (this->count() >= EMPTY) {
+			throw std::overflow_error("StlWeldTable: more vertices than 32 bit indices can address");
+		}
+		key.index = static_cast<uint32_t>(this->count());
+		this->slots[slot] = key;
+		this->positions.insert(this->positions.end(), position, position + 3);
+		if (this->count() * 2 > this->slots.size()) {
+			this->rehash(this->slots.size() * 2);
+		}
+		return key.index;
+	}
+
+	size_t count() const
+	{
+		return this->positions.size() / 3;
+	}
+
+	// of a position already in a table, the top bits are free for partitioning tables
+	static uint64_t Hash(const float* position)
+	{
+		uint32_t bits[3];
+		std::memcpy(bits, position, sizeof(bits));
+		return Hash(bits);
+	}
+
+	std::vector<float> positions;
+
+private:
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+
+	struct Slot {
+		uint32_t bits[3];
+		uint32_t index{ EMPTY };
+	};
+
+	static uint64_t Hash(const uint32_t* bits)
+	{
+		uint64_t h = (uint64_t(bits[0]) << 32 | bits[1]) * 0x9E3779B97F4A7C15ull;
+		h ^= bits[2] * 0xC2B2AE3D27D4EB4Full;
+		h ^= h >> 32;
+		h *= 0xD6E8FEB86659FD93ull;
+		return h ^ (h >> 29);
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Slot> old(capacity);
+		std::swap(old, this->slots);
+		this->mask = capacity - 1;
+		for (auto& entry : old) {
+			if (entry.index == EMPTY) {
+				continue;
+			}
+			size_t slot = static_cast<size_t>(Hash(entry.bits)) & this->mask;
+			while (this->slots[slot].index != EMPTY) {
+				slot = (slot + 1) & this->mask;
+			}
+			this->slots[slot] = entry;
+		}
+	}
+
+	std::vector<Slot> slots;
+	size_t mask{ 0 };
+};
+
+// Reads binary and ASCII STL through a memory mapping. The file is split into chunks of
+// whole triangles that are parsed and welded in parallel. The chunks' vertices are then
+// welded across chunks in partitions by hash, also in parallel, and numbered in the order
+// they first appear in the file, so the result doesn't depend on the number of threads.
+class StlLoader {
+public:
+	static constexpr size_t BINARY_HEADER_SIZE = 84;
+	static constexpr size_t BINARY_TRIANGLE_SIZE = 50;
+	// small enough for a chunk's weld table to stay in cache
+	static constexpr size_t CHUNK_TRIANGLES = 1 << 14;
+	static constexpr size_t CHUNK_BYTES = 1 << 20;
+	static constexpr uint32_t PARTITION_BITS = 6;
+
+	// shared by all loads, they only wait on their own chunks
+	static ThreadPool& Threads()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	static StlMesh Load(const std::filesystem::path& path, bool normals = false, ThreadPool* pool = &Threads())
+	{
+		MappedFile file(path);
+		try {
+			return Parse(file.data(), file.size(), normals, pool);
+		}
+		catch (std::exception& e) {
+			throw std::runtime_error(path.string() + ": " + e.what());
+		}
+	}
+
+	// ASCII files start with "solid", but so do the headers of many binary files, the size of
+	// a binary file is what tells them apart
+	static bool IsBinary(const char* data, size_t size)
+	{
+		if (size < BINARY_HEADER_SIZE) {
+			return false;
+		}
+		uint32_t triangles;
+		std::memcpy(&triangles, data + 80, sizeof(triangles));
+		return size == BINARY_HEADER_SIZE + BINARY_TRIANGLE_SIZE * size_t(triangles);
+	}
+
+	// without a pool the file is parsed as one chunk on the calling thread
+	static StlMesh Parse(const char* data, size_t size, bool normals = false, ThreadPool* pool = nullptr)
+	{
+		std::vector<std::function<Chunk()>> parsers;
+
+		if (IsBinary(data, size)) {
+			size_t triangles = (size - BINARY_HEADER_SIZE) / BINARY_TRIANGLE_SIZE;
+			size_t chunks = std::max<size_t>(triangles / CHUNK_TRIANGLES, 1);
+			for (size_t i = 0; i < chunks; i++) {
+				size_t first = triangles * i / chunks;
+				size_t last = triangles * (i + 1) / chunks;
+				parsers.push_back([=] { return ParseBinary(data + BINARY_HEADER_SIZE + first * BINARY_TRIANGLE_SIZE, last - first); });
+			}
+		}
+		else {
+			std::string_view text(data, size);
+			size_t start = text.find_first_not_of(" \t\r\n");
+			if (start == std::string_view::npos || text.compare(start, 5, "solid") != 0) {
+				throw std::runtime_error("StlLoader: neither binary nor ASCII STL");
+			}
+			size_t chunks = std::max<size_t>(size / CHUNK_BYTES, 1);
+			std::vector<size_t> bounds{ 0 };
+			for (size_t i = 1; i < chunks; i++) {
+				size_t bound = std::max(FacetStart(text, size * i / chunks), bounds.back());
+				bounds.push_back(bound);
+			}
+			bounds.push_back(size);
+			for (size_t i = 0; i + 1 < bounds.size(); i++) {
+				std::string_view chunk = text.substr(bounds[i], bounds[i + 1] - bounds[i]);
+				parsers.push_back([chunk] { return ParseAscii(chunk); });
+			}
+		}
+
+		std::vector<Chunk> chunks = Run(parsers, pool);
+		const size_t partition_count = size_t(1) << PARTITION_BITS;
+
+		// each partition welds the positions that hash to it, chunk by chunk, and notes which
+		// vertex of which chunk was first with each position
+		std::vector<Partition> partitions(partition_count);
+		std::vector<std::function<int()>> tasks;
+		for (size_t p = 0; p < partition_count; p++) {
+			tasks.push_back([&chunks, &partitions, p] {
+				size_t expected = 0;
+				for (auto& chunk : chunks) {
+					expected += chunk.partitions[p].size();
+				}
+				// vertices on chunk borders count once per chunk, so this is an upper bound
+				Partition& partition = partitions[p];
+				partition.welded = StlWeldTable(expected);
+				for (auto& chunk : chunks) {
+					for (uint32_t v : chunk.partitions[p]) {
+						uint32_t id = partition.welded.insert(chunk.welded.positions.data() + size_t(v) * 3);
+						if (id == partition.global.size()) {
+							partition.global.push_back(0);
+							chunk.first[v] = 1;
+						}
+						chunk.remap[v] = id;
+					}
+				}
+				return 0;
+				});
+		}
+		Run(tasks, pool);
+
+		// vertices are numbered in the order they first appear in the file
+		StlMesh mesh;
+		mesh.normals = normals;
+		std::vector<size_t> vertex_offsets, index_offsets;
+		size_t vertices = 0, indices = 0;
+		for (auto& chunk : chunks) {
+			vertex_offsets.push_back(vertices);
+			index_offsets.push_back(indices);
+			vertices += std::count(chunk.first.begin(), chunk.first.end(), uint8_t(1));
+			indices += chunk.indices.size();
+		}
+		if (vertices >= UINT32_MAX) {
+			throw std::overflow_error("StlLoader: more vertices than 32 bit indices can address");
+		}
+		std::vector<float> positions(vertices * 3);
+		mesh.indices.resize(indices);
+
+		tasks.clear();
+		for (size_t c = 0; c < chunks.size(); c++) {
+			tasks.push_back([&chunks, &partitions, &positions, &vertex_offsets, c] {
+				Chunk& chunk = chunks[c];
+				uint32_t global = static_cast<uint32_t>(vertex_offsets[c]);
+				for (size_t v = 0; v < chunk.first.size(); v++) {
+					if (chunk.first[v]) {
+						partitions[chunk.partition[v]].global[chunk.remap[v]] = global;
+						std::memcpy(&positions[size_t(global) * 3], &chunk.welded.positions[v * 3], sizeof(float) * 3);
+						global++;
+					}
+				}
+				return 0;
+				});
+		}
+		Run(tasks, pool);
+
+		tasks.clear();
+		for (size_t c = 0; c < chunks.size(); c++) {
+			tasks.push_back([&chunks, &partitions, &mesh, &index_offsets, c] {
+				Chunk& chunk = chunks[c];
+				for (size_t v = 0; v < chunk.remap.size(); v++) {
+					chunk.remap[v] = partitions[chunk.partition[v]].global[chunk.remap[v]];
+				}
+				uint32_t* dst = mesh.indices.data() + index_offsets[c];
+				for (uint32_t index : chunk.indices) {
+					*dst++ = chunk.remap[index];
+				}
+				return 0;
+				});
+		}
+		Run(tasks, pool);
+
+		if (!normals) {
+			mesh.vertices = std::move(positions);
+			return mesh;
+		}
+
+		mesh.vertices.resize(vertices * 6);
+		for (size_t v = 0; v < vertices; v++) {
+			std::memcpy(&mesh.vertices[v * 6], &positions[v * 3], sizeof(float) * 3);
+		}
+		// the cross product is twice the triangle area, so larger triangles weigh more
+		for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+			const float* a = &positions[size_t(mesh.indices[t + 0]) * 3];
+			const float* b = &positions[size_t(mesh.indices[t + 1]) * 3];
+			const float* c = &positions[size_t(mesh.indices[t + 2]) * 3];
+			const float u[3]{ b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			const float w[3]{ c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			const float n[3]{
+				u[1] * w[2] - u[2] * w[1],
+				u[2] * w[0] - u[0] * w[2],
+				u[0] * w[1] - u[1] * w[0],
+			};
+			for (size_t k = 0; k < 3; k++) {
+				float* normal = &mesh.vertices[size_t(mesh.indices[t + k]) * 6 + 3];
+				normal[0] += n[0];
+				normal[1] += n[1];
+				normal[2] += n[2];
+			}
+		}
+		for (size_t v = 0; v < vertices; v++) {
+			float* normal = &mesh.vertices[v * 6 + 3];
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length > 0.0f) {
+				normal[0] /= length;
+				normal[1] /= length;
+				normal[2] /= length;
+			}
+		}
+		return mesh;
+	}
+
+private:
+	struct Chunk {
+		Chunk(size_t expected_vertices) :
+			welded(expected_vertices)
+		{}
+
+		// sorts the chunk's vertices into the partitions that weld them across chunks
+		void partitionVertices()
+		{
+			this->partitions.resize(size_t(1) << PARTITION_BITS);
+			for (uint32_t v = 0; v < this->welded.count(); v++) {
+				uint8_t p = static_cast<uint8_t>(StlWeldTable::Hash(&this->welded.positions[size_t(v) * 3]) >> (64 - PARTITION_BITS));
+				this->partition.push_back(p);
+				this->partitions[p].push_back(v);
+			}
+			this->first.resize(this->welded.count(), 0);
+			this->remap.resize(this->welded.count(), 0);
+		}
+
+		StlWeldTable welded;
+		std::vector<uint32_t> indices;
+		std::vector<uint8_t> partition;
+		std::vector<std::vector<uint32_t>> partitions;
+		// per vertex of the chunk, whether it is the first in the file with its position
+		std::vector<uint8_t> first;
+		std::vector<uint32_t> remap;
+	};
+
+	struct Partition {
+		StlWeldTable welded;
+		std::vector<uint32_t> global;
+	};
+
+	template <typename Result>
+	static std::vector<Result> Run(const std::vector<std::function<Result()>>& tasks, ThreadPool* pool)
+	{
+		std::vector<Result> results;
+		if (!pool || tasks.size() == 1) {
+			for (auto& task : tasks) {
+				results.push_back(task());
+			}
+			return results;
+		}
+		std::vector<std::future<Result>> futures;
+		for (auto& task : tasks) {
+			futures.push_back(pool->submit(task));
+		}
+		// the tasks refer to the caller's data, none may outlive a failing one
+		for (auto& future : futures) {
+			future.wait();
+		}
+		for (auto& future : futures) {
+			results.push_back(future.get());
+		}
+		return results;
+	}
+
+	static Chunk ParseBinary(const char* data, size_t triangles)
+	{
+		Chunk chunk(triangles / 2);
+		chunk.indices.reserve(triangles * 3);
+		for (size_t t = 0; t < triangles; t++) {
+			// a triangle is its normal, three positions and a two byte attribute
+			const char* triangle = data + t * BINARY_TRIANGLE_SIZE + sizeof(float) * 3;
+			for (size_t k = 0; k < 3; k++) {
+				float position[3];
+				std::memcpy(position, triangle + k * sizeof(position), sizeof(position));
+				chunk.indices.push_back(chunk.welded.insert(position));
+			}
+		}
+		chunk.partitionVertices();
+		return chunk;
+	}
+
+	// offset of the first "facet" keyword at or after offset, "endfacet" doesn't count
+	static size_t FacetStart(std::string_view text, size_t offset)
+	{
+		while ((offset = text.find("facet", offset)) != std::string_view::npos) {
+			if (offset == 0 || std::strchr(" \t\r\n", text[offset - 1])) {
+				return offset;
+			}
+			offset += 5;
+		}
+		return text.size();
+	}
+
+	static bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	static std::string_view NextToken(std::string_view text, size_t& pos)
+	{
+		while (pos < text.size() && IsSpace(text[pos])) {
+			pos++;
+		}
+		size_t start = pos;
+		while (pos < text.size() && !IsSpace(text[pos])) {
+			pos++;
+		}
+		return text.substr(start, pos - start);
+	}
+
+	// only the vertex lines matter, facet normals are recomputed from the positions
+	static Chunk ParseAscii(std::string_view text)
+	{
+		Chunk chunk(text.size() / 256);
+		size_t pos = 0;
+		while (pos < text.size()) {
+			std::string_view token = NextToken(text, pos);
+			if (token == "solid" || token == "endsolid") {
+				// the name may be anything, including keywords
+				pos = std::min(text.find('\n', pos), text.size());
+			}
+			else if (token == "vertex") {
+				float position[3];
+				for (size_t k = 0; k < 3; k++) {
+					std::string_view number = NextToken(text, pos);
+					if (!number.empty() && number[0] == '+') {
+						number.remove_prefix(1);
+					}
+					auto [end, error] = std::from_chars(number.data(), number.data() + number.size(), position[k]);
+					if (error != std::errc() || end != number.data() + number.size()) {
+						throw std::runtime_error("StlLoader: bad vertex coordinate '" + std::string(number) + "'");
+					}
+				}
+				chunk.indices.push_back(chunk.welded.insert(position));
+			}
+		}
+		if (chunk.indices.size() % 3) {
+			throw std::runtime_error("StlLoader: facet without three vertices");
+		}
+		chunk.partitionVertices();
+		return chunk;
+	}
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Innovator/Bounds.h>
+
+#include <cmath>
+#include <stdexcept>
+#include <functional>
+
+// Helpers the tests share: matrices in the column major doubles of Bounds.h, built the way glm
+// builds them, and a check that a call throws.
+
+inline Matrix4 Identity()
+{
+	return { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+}
+
+inline Matrix4 Multiply(const Matrix4& a, const Matrix4& b)
+{
+	Matrix4 m{};
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			for (int k = 0; k < 4; k++) {
+				m[col * 4 + row] += a[k * 4 + row] * b[col * 4 + k];
+			}
+		}
+	}
+	return m;
+}
+
+inline Matrix4 Translate(double x, double y, double z)
+{
+	Matrix4 m = Identity();
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+	return m;
+}
+
+// right handed, depth 0 to 1, as glm::perspective with GLM_FORCE_DEPTH_ZERO_TO_ONE
+inline Matrix4 Perspective(double fovy, double aspect, double near, double far)
+{
+	double f = 1.0 / std::tan(fovy / 2.0);
+	Matrix4 m{};
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = far / (near - far);
+	m[11] = -1.0;
+	m[14] = -(far * near) / (far - near);
+	return m;
+}
+
+inline Matrix4 LookAt(const Point3& eye, const Point3& center, const Point3& up)
+{
+	auto normalize = [](Point3 v) {
+		double l = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		return Point3{ v[0] / l, v[1] / l, v[2] / l };
+	};
+	auto cross = [](const Point3& a, const Point3& b) {
+		return Point3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+	};
+	auto dot = [](const Point3& a, const Point3& b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	};
+	Point3 f = normalize({ center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] });
+	Point3 s = normalize(cross(f, up));
+	Point3 u = cross(s, f);
+
+	Matrix4 m = Identity();
+	m[0] = s[0]; m[4] = s[1]; m[8] = s[2];
+	m[1] = u[0]; m[5] = u[1]; m[9] = u[2];
+	m[2] = -f[0]; m[6] = -f[1]; m[10] = -f[2];
+	m[12] = -dot(s, eye);
+	m[13] = -dot(u, eye);
+	m[14] = dot(f, eye);
+	return m;
+}
+
+template <typename Exception = std::exception>
+bool Throws(const std::function<void()>& function)
+{
+	try {
+		function();
+		return false;
+	}
+	catch (Exception&) {
+		return true;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+// Fixed set of worker threads running submitted tasks in FIFO order. The destructor runs
+// whatever is still queued before joining.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+	{
+		threads = std::max<size_t>(threads, 1);
+		for (size_t i = 0; i < threads; i++) {
+			this->workers.emplace_back([this] { this->work(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+		this->wakeup.notify_all();
+		for (auto& worker : this->workers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template <typename Function>
+	std::future<std::invoke_result_t<Function>> submit(Function function)
+	{
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+		auto future = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->tasks.emplace_back([task] { (*task)(); });
+		}
+		this->wakeup.notify_one();
+		return future;
+	}
+
+	size_t size() const
+	{
+		return this->workers.size();
+	}
+
+private:
+	void work()
+	{
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->wakeup.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+				if (this->tasks.empty()) {
+					return;
+				}
+				task = std::move(this->tasks.front());
+				this->tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::deque<std::function<void()>> tasks;
+	bool stopping{ false };
+	std::vector<std::thread> workers;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <Innovator/Simd.h>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+// a transform in a TransformHierarchy, the generation of its slot above the slot index
+typedef uint64_t TransformHandle;
+
+// World transforms of the transform nodes of a scene, computed once and cached. Each transform
+// has a float local matrix and the world matrix of its parent times that. Setting a local marks
+// it dirty, and the next update recomputes the worlds of what is dirty and everything below it,
+// parents before children, four at a time. Matrices are column major, stored in blocks of four
+// slots with each element of the four next to each other.
+class TransformHierarchy {
+public:
+	// the parent of top level transforms, its world is the identity
+	static constexpr TransformHandle ROOT = 0;
+
+	TransformHandle allocate(TransformHandle parent, const float* local)
+	{
+		if (parent != ROOT && !this->valid(parent)) {
+			throw std::invalid_argument("TransformHierarchy: parent is not a transform");
+		}
+		uint32_t slot;
+		if (!this->free_slots.empty()) {
+			slot = this->free_slots.back();
+			this->free_slots.pop_back();
+		}
+		else {
+			slot = static_cast<uint32_t>(this->parents.size());
+			if (slot % 4 == 0) {
+				this->locals.emplace_back();
+				this->worlds.emplace_back();
+			}
+			this->parents.push_back(ROOT);
+			this->generations.push_back(0);
+			this->alive.push_back(0);
+			this->dirty.push_back(0);
+			this->depths.push_back(0);
+		}
+		this->parents[slot] = parent;
+		this->generations[slot]++;
+		this->alive[slot] = 1;
+		this->dirty[slot] = 0;
+		this->relevel = true;
+		this->count++;
+		for (int e = 0; e < 16; e++) {
+			this->locals[slot / 4].m[e][slot % 4] = local[e];
+		}
+		// traversals allocate transforms as they reach them, below parents that are up to date
+		this->multiply(slot / 4);
+		return Handle(slot, this->generations[slot]);
+	}
+
+	// frees the transform and all transforms below it
+	void free(TransformHandle handle)
+	{
+		if (!this->valid(handle)) {
+			return;
+		}
+		// whether each slot is below the freed one, found once per chain of ancestors
+		enum : uint8_t { UNKNOWN, BELOW, ELSEWHERE };
+		std::vector<uint8_t> below(this->parents.size(), UNKNOWN);
+		std::vector<uint32_t> chain;
+		below[Slot(handle)] = BELOW;
+		for (uint32_t slot = 0; slot < this->parents.size(); slot++) {
+			chain.clear();
+			uint32_t s = slot;
+			while (below[s] == UNKNOWN && this->alive[s] && this->parents[s] != ROOT) {
+				chain.push_back(s);
+				s = Slot(this->parents[s]);
+			}
+			uint8_t found = below[s] == BELOW ? BELOW : ELSEWHERE;
+			for (uint32_t c : chain) {
+				below[c] = found;
+			}
+			if (below[s] == UNKNOWN) {
+				below[s] = ELSEWHERE;
+			}
+		}
+		for (uint32_t slot = 0; slot < this->parents.size(); slot++) {
+			if (below[slot] == BELOW && this->alive[slot]) {
+				this->alive[slot] = 0;
+				this->dirty[slot] = 0;
+				this->free_slots.push_back(slot);
+				this->count--;
+			}
+		}
+		this->relevel = true;
+	}
+
+	bool valid(TransformHandle handle) const
+	{
+		uint32_t slot = Slot(handle);
+		return slot < this->parents.size() && this->alive[slot] && this->generations[slot] == Generation(handle);
+	}
+
+	// the world of the transform and those below it is recomputed in the next update
+	void set(TransformHandle handle, const float* local)
+	{
+		if (!this->valid(handle)) {
+			throw std::invalid_argument("TransformHierarchy: not a transform");
+		}
+		uint32_t slot = Slot(handle);
+		for (int e = 0; e < 16; e++) {
+			this->locals[slot / 4].m[e][slot % 4] = local[e];
+		}
+		this->dirty[slot] = 1;
+		this->pending = true;
+	}
+
+	// recomputes the worlds of dirty transforms and those below them, returns how many
+	size_t update()
+	{
+		if (!this->pending) {
+			return 0;
+		}
+		if (this->relevel) {
+			this->sortByDepth();
+		}
+		size_t updated = 0;
+		for (size_t level = 0; level + 1 < this->level_starts.size(); level++) {
+			// slots of a level are in order, dirty slots of the same block are next to each other
+			uint32_t block = UINT32_MAX;
+			for (uint32_t i = this->level_starts[level]; i < this->level_starts[level + 1]; i++) {
+				uint32_t slot = this->order[i];
+				TransformHandle parent = this->parents[slot];
+				if (this->dirty[slot] || (parent != ROOT && this->dirty[Slot(parent)])) {
+					this->dirty[slot] = 1;
+					if (slot / 4 != block) {
+						block = slot / 4;
+						this->multiply(block);
+					}
+					updated++;
+				}
+			}
+		}
+		for (uint32_t slot : this->order) {
+			this->dirty[slot] = 0;
+		}
+		this->pending = false;
+		this->updated += updated;
+		return updated;
+	}
+
+	std::array<float, 16> world(TransformHandle handle) const
+	{
+		std::array<float, 16> m;
+		uint32_t slot = Slot(handle);
+		for (int e = 0; e < 16; e++) {
+			m[e] = this->worlds[slot / 4].m[e][slot % 4];
+		}
+		return m;
+	}
+
+	// out = m * world, the world of the root is the identity
+	void multiply(const float* m, TransformHandle handle, float* out) const
+	{
+		if (handle == ROOT) {
+			std::copy(m, m + 16, out);
+			return;
+		}
+		uint32_t slot = Slot(handle);
+		const Block& world = this->worlds[slot / 4];
+		Float4 columns[4]{ Float4::Load(m), Float4::Load(m + 4), Float4::Load(m + 8), Float4::Load(m + 12) };
+		for (int c = 0; c < 4; c++) {
+			Float4 column =
+				columns[0] * Float4::Set(world.m[c * 4 + 0][slot % 4]) +
+				columns[1] * Float4::Set(world.m[c * 4 + 1][slot % 4]) +
+				columns[2] * Float4::Set(world.m[c * 4 + 2][slot % 4]) +
+				columns[3] * Float4::Set(world.m[c * 4 + 3][slot % 4]);
+			column.store(out + c * 4);
+		}
+	}
+
+	size_t size() const
+	{
+		return this->count;
+	}
+
+	// worlds recomputed by update, in total
+	uint64_t updated{ 0 };
+
+private:
+	struct Block {
+		alignas(16) float m[16][4];
+	};
+
+	static TransformHandle Handle(uint32_t slot, uint32_t generation)
+	{
+		return (TransformHandle(generation) << 32) | slot;
+	}
+
+	static uint32_t Slot(TransformHandle handle)
+	{
+		return static_cast<uint32_t>(handle);
+	}
+
+	static uint32_t Generation(TransformHandle handle)
+	{
+		return static_cast<uint32_t>(handle >> 32);
+	}
+
+	// world = parent world * local for the four slots of a block. Lanes that are not dirty get
+	// the world they have, or one that is recomputed when their level is updated
+	void multiply(uint32_t block)
+	{
+		static const Block identity{ {
+			{ 1, 1, 1, 1 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 },
+			{ 0, 0, 0, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 },
+			{ 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0, 0 },
+			{ 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 1, 1, 1 } } };
+
+		const Block& locals = this->locals[block];
+		Float4 local[16];
+		for (int e = 0; e < 16; e++) {
+			local[e] = Float4::Load(locals.m[e]);
+		}
+
+		// the world of the parent of each lane, element e at [e * 4]
+		const float* parents[4];
+		for (uint32_t i = 0; i < 4; i++) {
+			uint32_t slot = block * 4 + i;
+			TransformHandle parent = slot < this->parents.size() ? this->parents[slot] : ROOT;
+			parents[i] = parent == ROOT ? identity.m[0] : &this->worlds[Slot(parent) / 4].m[0][Slot(parent) % 4];
+		}
+		// siblings share a parent, its elements are broadcast
+		bool shared = parents[1] == parents[0] && parents[2] == parents[0] && parents[3] == parents[0];
+		Float4 parent[16];
+		for (int e = 0; e < 16; e++) {
+			if (shared) {
+				parent[e] = Float4::Set(parents[0][e * 4]);
+			}
+			else {
+				const float lanes[4]{ parents[0][e * 4], parents[1][e * 4], parents[2][e * 4], parents[3][e * 4] };
+				parent[e] = Float4::Load(lanes);
+			}
+		}
+
+		Block& worlds = this->worlds[block];
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				Float4 element =
+					parent[r] * local[c * 4] +
+					parent[4 + r] * local[c * 4 + 1] +
+					parent[8 + r] * local[c * 4 + 2] +
+					parent[12 + r] * local[c * 4 + 3];
+				element.store(worlds.m[c * 4 + r]);
+			}
+		}
+	}
+
+	// live slots in order of depth, and where each depth starts
+	void sortByDepth()
+	{
+		const uint32_t unknown = UINT32_MAX;
+		std::vector<uint32_t> chain;
+		std::fill(this->depths.begin(), this->depths.end(), unknown);
+		uint32_t deepest = 0;
+		for (uint32_t slot = 0; slot < this->parents.size(); slot++) {
+			if (!this->alive[slot]) {
+				continue;
+			}
+			// up to the first ancestor of known depth
+			chain.clear();
+			uint32_t s = slot;
+			while (this->depths[s] == unknown) {
+				chain.push_back(s);
+				if (this->parents[s] == ROOT) {
+					break;
+				}
+				s = Slot(this->parents[s]);
+			}
+			uint32_t depth = this->depths[s] == unknown ? 0 : this->depths[s] + 1;
+			for (auto i = chain.rbegin(); i != chain.rend(); i++, depth++) {
+				this->depths[*i] = depth;
+			}
+			deepest = std::max(deepest, this->depths[slot]);
+		}
+
+		this->level_starts.assign(deepest + 2, 0);
+		for (uint32_t slot = 0; slot < this->parents.size(); slot++) {
+			if (this->alive[slot]) {
+				this->level_starts[this->depths[slot] + 1]++;
+			}
+		}
+		for (size_t level = 1; level < this->level_starts.size(); level++) {
+			this->level_starts[level] += this->level_starts[level - 1];
+		}
+		this->order.resize(this->count);
+		std::vector<uint32_t> next(this->level_starts.begin(), this->level_starts.end() - 1);
+		for (uint32_t slot = 0; slot < this->parents.size(); slot++) {
+			if (this->alive[slot]) {
+				this->order[next[this->depths[slot]]++] = slot;
+			}
+		}
+		this->relevel = false;
+	}
+
+	std::vector<Block> locals;
+	std::vector<Block> worlds;
+	std::vector<TransformHandle> parents;
+	std::vector<uint32_t> generations;
+	std::vector<uint8_t> alive;
+	std::vector<uint8_t> dirty;
+	std::vector<uint32_t> depths;
+	std::vector<uint32_t> free_slots;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> level_starts;
+	size_t count{ 0 };
+	bool relevel{ false };
+	bool pending{ false };
+};
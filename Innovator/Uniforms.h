@@ -0,0 +1,125 @@
+#pragma once
+
+#include <Innovator/State.h>
+#include <Innovator/Frames.h>
+#include <Innovator/VulkanAPI.h>
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+// Per draw uniform data of every frame in flight, packed into one persistently mapped buffer.
+// Each user owns a slot, the data of a slot for frame f lives at offset(f, slot) and is bound as
+// a dynamic uniform buffer, so descriptor sets don't change from frame to frame.
+class UniformRing {
+public:
+	UniformRing() = delete;
+
+	UniformRing(
+		std::shared_ptr<VulkanDevice> device,
+		std::shared_ptr<FrameRing> frames,
+		VkDeviceSize slot_size,
+		uint32_t capacity = 256) :
+		device(std::move(device)),
+		frames(std::move(frames)),
+		capacity(capacity)
+	{
+		VkDeviceSize alignment = this->device->physical_device.properties.limits.minUniformBufferOffsetAlignment;
+		alignment = std::max<VkDeviceSize>(alignment, 1);
+		this->stride = (slot_size + alignment - 1) / alignment * alignment;
+		this->createBuffer();
+	}
+
+	~UniformRing() = default;
+
+	// Grows the buffer when all slots are taken. The old buffer is retired to the frame ring,
+	// descriptor sets that refer to it must be rebuilt by the pipeline pass.
+	uint32_t allocate()
+	{
+		if (!this->unused.empty()) {
+			uint32_t slot = this->unused.back();
+			this->unused.pop_back();
+			return slot;
+		}
+		if (this->count == this->capacity) {
+			this->frames->retire(std::move(this->buffer));
+			this->capacity *= 2;
+			this->createBuffer();
+		}
+		return this->count++;
+	}
+
+	void free(uint32_t slot)
+	{
+		this->unused.push_back(slot);
+	}
+
+	VkDeviceSize offset(uint32_t frame, uint32_t slot) const
+	{
+		return (static_cast<VkDeviceSize>(frame) * this->capacity + slot) * this->stride;
+	}
+
+	char* data(uint32_t frame, uint32_t slot) const
+	{
+		return this->mapped + this->offset(frame, slot);
+	}
+
+	// dynamic offsets for the given slots, in the order they are bound
+	std::vector<uint32_t> offsets(uint32_t frame, const std::vector<uint32_t>& slots) const
+	{
+		std::vector<uint32_t> offsets;
+		for (uint32_t slot : slots) {
+			offsets.push_back(static_cast<uint32_t>(this->offset(frame, slot)));
+		}
+		return offsets;
+	}
+
+	VkBuffer getBuffer() const
+	{
+		return this->buffer->buffer->buffer;
+	}
+
+	VkDeviceSize getStride() const
+	{
+		return this->stride;
+	}
+
+	// ring slots of the dynamic uniform buffer bindings, in binding order as vkCmdBindDescriptorSets expects
+	static std::vector<uint32_t> DynamicSlots(std::vector<DescriptorSetInfo> infos)
+	{
+		std::sort(infos.begin(), infos.end(), [](const DescriptorSetInfo& a, const DescriptorSetInfo& b) {
+			return a.binding < b.binding;
+			});
+
+		std::vector<uint32_t> slots;
+		for (auto& info : infos) {
+			if (info.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) {
+				slots.push_back(info.uniform_slot);
+			}
+		}
+		return slots;
+	}
+
+private:
+	void createBuffer()
+	{
+		this->buffer = std::make_shared<VulkanBufferObject>(
+			this->device,
+			0,
+			this->stride * this->capacity * this->frames->depth(),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		this->mapped = this->buffer->memory->map(VK_WHOLE_SIZE, 0);
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	std::shared_ptr<FrameRing> frames;
+	std::shared_ptr<VulkanBufferObject> buffer;
+	char* mapped{ nullptr };
+	VkDeviceSize stride{ 0 };
+	uint32_t capacity;
+	uint32_t count{ 0 };
+	std::vector<uint32_t> unused;
+};
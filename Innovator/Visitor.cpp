@@ -22,6 +22,11 @@ CommandVisitor::visit(Node* node)
 
 	node->visit(this);
 
+	// uploads recorded in this pass are submitted ahead of the pass' commands
+	if (this->state->staging) {
+		this->state->staging->flush();
+	}
+
 	this->state->fence->reset();
 	this->state->default_command->end();
 	this->state->default_command->submit(
@@ -34,25 +39,212 @@ CommandVisitor::visit(Node* node)
 }
 
 
-EventVisitor::EventVisitor(std::shared_ptr<State> state) :
-	Visitor(state)
+void
+GraphVisitor::visit(Node* node)
+{
+	if (!this->state->graph) {
+		return;
+	}
+	this->state->graph->clear();
+	Visitor::visit(node);
+	this->state->graph->compile();
+}
+
+
+void
+RenderVisitor::visit(Node* node)
+{
+	// no per frame fence wait here, frames in flight are throttled by the frame ring
+	if (this->state->staging) {
+		this->state->staging->flush();
+	}
+	if (this->state->transforms) {
+		this->state->transforms->update();
+	}
+	StateScope scope(this->state.get());
+	this->state->cull = true;
+	node->visit(this);
+}
+
+
+RenderContext::~RenderContext()
+{
+	this->wait();
+	if (this->state->pipelinecache) {
+		try {
+			this->state->pipelinecache->save();
+		}
+		catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+}
+
+
+void
+RenderContext::wait()
+{
+	if (this->state->staging) {
+		this->state->staging->wait();
+	}
+	if (this->state->frames) {
+		this->state->frames->wait();
+		this->state->frames->retired.clear();
+	}
+}
+
+
+void
+RenderContext::create(
+	Node* scene,
+	std::vector<const char*> instance_extensions,
+	std::vector<const char*> device_extensions,
+	uint32_t frames_in_flight,
+	std::filesystem::path pipelinecache)
+{
+	// files are read on the loader's threads while the instance and device are created
+	this->state->assets = std::make_shared<AssetLoader>();
+	this->loadvisitor.visit(scene);
+
+	for (auto extension : instance_extensions) {
+		this->devicevisitor.instance_extensions.push_back(extension);
+	}
+	this->devicevisitor.instance_extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+#ifdef DEBUG
+	this->devicevisitor.instance_layers.push_back("VK_LAYER_KHRONOS_validation");
+	this->devicevisitor.instance_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	this->devicevisitor.instance_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#endif
+	this->devicevisitor.visit(scene);
+
+	this->state->vulkan = std::make_shared<VulkanInstance>(
+		"Innovator",
+		this->devicevisitor.instance_layers,
+		this->devicevisitor.instance_extensions);
+
+#ifdef DEBUG
+	auto debugcb = std::make_unique<VulkanDebugCallback>(
+		this->state->vulkan,
+		VK_DEBUG_REPORT_WARNING_BIT_EXT |
+		VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
+		VK_DEBUG_REPORT_ERROR_BIT_EXT |
+		VK_DEBUG_REPORT_DEBUG_BIT_EXT);
+#endif
+
+#ifdef DEBUG
+	this->devicevisitor.device_layers.push_back("VK_LAYER_KHRONOS_validation");
+#endif
+	for (auto extension : device_extensions) {
+		this->devicevisitor.device_extensions.push_back(extension);
+	}
+
+	this->state->device = std::make_shared<VulkanDevice>(
+		this->state->vulkan,
+		this->devicevisitor.getDeviceFeatures(),
+		this->devicevisitor.device_layers,
+		this->devicevisitor.device_extensions);
+
+	this->state->pipelinecache = std::make_shared<VulkanPipelineCache>(this->state->device, pipelinecache);
+	this->state->descriptors = std::make_shared<VulkanDescriptorCache>(this->state->device);
+	this->state->fence = std::make_shared<VulkanFence>(this->state->device);
+	this->state->default_command = std::make_shared<VulkanCommandBuffers>(this->state->device);
+	this->state->queue = this->state->device->getQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+	this->state->frames = std::make_shared<FrameRing>(this->state->device, frames_in_flight);
+	// uploads go out on the copy engines when the device has a transfer only queue family
+	this->state->staging = std::make_shared<StagingBuffer>(this->state->device, this->state->queue, 32 * 1024 * 1024, true);
+	this->state->uniforms = std::make_shared<UniformRing>(this->state->device, this->state->frames, sizeof(glm::mat4) * 3);
+	this->state->transforms = std::make_shared<TransformHierarchy>();
+	this->state->graph = std::make_shared<FrameGraph>(this->state->device, this->state->frames);
+	this->state->geometry = std::make_shared<GeometryBuffers>(this->state->device, this->state->frames, this->state->staging, this->state->queue);
+}
+
+
+void
+RenderContext::alloc(Node* scene)
+{
+	this->state->assets->wait([](const AssetProgress& progress) { progress.print(std::cout); });
+	this->graphvisitor.visit(scene);
+	this->allocvisitor.visit(scene);
+	this->pipelinevisitor.visit(scene);
+	this->eventvisitor.index(scene);
+}
+
+
+void
+RenderContext::resize(Node* scene, VkExtent3D extent)
+{
+	this->state->extent = extent;
+
+	// replaced resources are retired to the frame ring, no need to drain frames in flight
+	this->graphvisitor.visit(scene);
+	this->resizevisitor.visit(scene);
+	// meshes freed since the last record leave holes in the geometry pool, the record
+	// pass below picks up the ranges of meshes that moved
+	this->state->geometry->compact();
+	this->recordvisitor.visit(scene);
+}
+
+
+void
+RenderContext::redraw(Node* scene)
+{
+	FrameRing::Scope frame(this->state->frames.get(), this->state.get(), this->state->queue);
+	this->eventvisitor.flush();
+	this->rendervisitor.visit(scene);
+	this->presentvisitor.visit(scene);
+}
+
+
+void
+RenderContext::print(std::ostream& out)
+{
+	this->state->frames->stats.print(out);
+	this->state->staging->stats.print(out);
+	this->state->descriptors->stats().print(out);
+	this->state->pipelinecache->stats.print(out);
+	this->state->device->allocator->stats().print(out);
+	this->eventvisitor.events.stats.print(out);
+	this->state->graph->print(out);
+}
+
+
+EventVisitor::EventVisitor(std::shared_ptr<State> state, const Table* table) :
+	Visitor(state, table)
 {
 	this->register_callback<SparseTextureImage>([this](SparseTextureImage* node) {
 		this->visit(node);
+		this->events.subscribe(KEY_PRESS, [this, node] { this->visit(node); });
 		});
 
 	this->register_callback<ViewMatrix>([this](ViewMatrix* node) {
-		this->visit(node);
+		this->events.subscribe(MOUSE_DRAG, [this, node] { this->visit(node); });
 		});
 	this->register_callback<ModelMatrix>([this](ModelMatrix* node) {
-		this->visit(node);
+		this->events.subscribe(MOUSE_DRAG, [this, node] { this->visit(node); });
 		});
 	this->register_callback<TextureMatrix>([this](TextureMatrix* node) {
-		this->visit(node);
+		this->events.subscribe(MOUSE_DRAG, [this, node] { this->visit(node); });
 		});
 }
 
 
+std::optional<PickResult>
+EventVisitor::pick(Node* root, int x, int y)
+{
+	if (!this->picking) {
+		this->picking = std::make_shared<Picking>();
+	}
+	if (this->state->transforms) {
+		this->state->transforms->update();
+	}
+	this->picking->begin();
+	this->state->picking = this->picking.get();
+	this->state->context->pickvisitor.visit(root);
+	this->state->picking = nullptr;
+	return this->picking->end(x, y, this->state->extent);
+}
+
+
 void 
 EventVisitor::visit(SparseTextureImage* node)
 {
@@ -63,12 +255,12 @@ EventVisitor::visit(SparseTextureImage* node)
 void
 EventVisitor::visit(ViewMatrix* node)
 {
-	if (this->move && this->press && !this->interact) {
-		glm::dvec2 dx = this->prevpos - this->currpos;
+	if (!this->interact) {
+		glm::dvec2 dx = this->drag();
 		dx[0] /= this->state->extent.width;
 		dx[1] /= this->state->extent.height;
 		dx *= 20.0;
-		switch (this->button) {
+		switch (this->events.button) {
 		case 0: node->orbit(dx); break;
 		case 1: node->pan(dx); break;
 		case 2: node->zoom(dx[1]); break;
@@ -81,11 +273,11 @@ EventVisitor::visit(ViewMatrix* node)
 void
 EventVisitor::visit(class TextureMatrix* node)
 {
-	if (this->move && this->press && this->interact) {
-		glm::dvec2 dx = this->prevpos - this->currpos;
+	if (this->interact) {
+		glm::dvec2 dx = this->drag();
 		double d = dx[1] * 0.25;
 		glm::dvec3 t(0, d, 0);
-		switch (this->button) {
+		switch (this->events.button) {
 		case 0: {
 			node->mat = glm::translate(node->mat, t);
 			break;
@@ -103,17 +295,17 @@ EventVisitor::visit(class TextureMatrix* node)
 void
 EventVisitor::visit(class ModelMatrix* node)
 {
-	if (this->move && this->press && this->interact) {
-		glm::dvec2 dx = this->prevpos - this->currpos;
+	if (this->interact) {
+		glm::dvec2 dx = this->drag();
 		double d = dx[1] * 0.25;
 		glm::dvec3 t(0, d, 0);
-		switch (this->button) {
+		switch (this->events.button) {
 		case 0: {
-			node->mat = glm::translate(node->mat, t);
+			node->set(glm::translate(node->matrix(), t));
 			break;
 		}
 		case 2: {
-			node->mat = glm::rotate(node->mat, d * 0.1, glm::dvec3(0, 0, 1));
+			node->set(glm::rotate(node->matrix(), d * 0.1, glm::dvec3(0, 0, 1)));
 			break;
 		}
 		default: break;
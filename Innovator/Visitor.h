@@ -1,52 +1,92 @@
 #pragma once
 
 #include <Innovator/State.h>
+#include <Innovator/Events.h>
+#include <Innovator/VisitorTable.h>
 
 #include <glm/glm.hpp>
 
 #include <any>
 #include <map>
+#include <optional>
 #include <variant>
 #include <unordered_map>
 #include <typeindex>
 #include <functional>
+#include <filesystem>
 
 class Visitor {
 public:
-	Visitor(std::shared_ptr<State> state)
-		: state(std::move(state)) {}
+	typedef VisitorTable<class Node, Visitor> Table;
 
+	Visitor(std::shared_ptr<State> state, const Table* table = nullptr)
+		: callbacks(table), state(std::move(state)) {}
+
+	// called instead of what the traversal's table has for the type
 	template <typename NodeType>
 	void register_callback(std::function<void(NodeType*)> callback)
 	{
-		this->callbacks[typeid(NodeType)] = callback;
-	}
-
-	void register_callback(std::type_index type, std::function<void(class Node*)> callback)
-	{
-		this->callbacks[type] = callback;
+		this->callbacks.add<NodeType, Visitor>([callback](NodeType* node, Visitor*) { callback(node); });
 	}
 
 	template <typename NodeType>
 	void apply(NodeType* node)
 	{
-		auto it = this->callbacks.find(typeid(NodeType));
-		if (it != this->callbacks.end()) {
-			auto callback = std::any_cast<std::function<void(NodeType*)>>(it->second);
-			callback(node);
+		auto& callback = this->callbacks.find(typeid(NodeType));
+		if (callback) {
+			callback(node, this);
 		}
 	}
 
+	// whether this is the traversal of the table, in any rendering context
+	bool is(const Table& table) const
+	{
+		return this->callbacks.table == &table;
+	}
+
 	void visit(class Node* node);
 
-	std::unordered_map<std::type_index, std::any> callbacks;
+	VisitorCallbacks<class Node, Visitor> callbacks;
 	std::shared_ptr<State> state{ nullptr };
 };
 
 
+// The table of a traversal, REGISTER_VISITOR adds the method of the node type to it. The
+// method is called with the type of visitor the traversal has.
+template <typename VisitorType>
+class Traversal : public Visitor::Table {
+public:
+	template <typename NodeType, typename Function>
+	void register_callback(Function function)
+	{
+		this->template add<NodeType, VisitorType>(std::move(function));
+	}
+};
+
+
+// what is under a pixel: the draw, its triangle, and the world space point on it
+struct PickResult {
+	class Node* node;
+	uint32_t triangle;
+	glm::dvec3 point;
+};
+
+
+// Traverses the scene once to index the nodes that take events, and routes events to them
+// from then on. Drags are applied once per frame, in flush().
 class EventVisitor : public Visitor {
 public:
-	EventVisitor(std::shared_ptr<State> state);
+	EventVisitor(std::shared_ptr<State> state, const Table* table);
+
+	// the nearest triangle under pixel x, y, of the levels of detail rendered last
+	std::optional<PickResult> pick(Node* root, int x, int y);
+
+	// again when nodes that take events are added to or removed from the scene
+	void index(Node* root)
+	{
+		this->events.clear();
+		Visitor::visit(root);
+	}
 
 private:
 	void visit(class ViewMatrix* node);
@@ -54,30 +94,36 @@ private:
 	void visit(class TextureMatrix* node);
 	void visit(class SparseTextureImage* node);
 
+	glm::dvec2 drag() const
+	{
+		return glm::dvec2(
+			this->events.previous[0] - this->events.position[0],
+			this->events.previous[1] - this->events.position[1]);
+	}
+
 public:
 	void mousePressed(Node* root, int x, int y, int button)
 	{
-		this->press = true;
-		this->button = button;
-		this->currpos = glm::dvec2(x, y);
-		Visitor::visit(root);
-		this->prevpos = this->currpos;
+		this->events.mousePressed(x, y, button);
+		if (this->interact && button == 0) {
+			this->picked = this->pick(root, x, y);
+		}
 	}
 
-	void mouseReleased(Node* root)
+	void mouseReleased()
 	{
-		this->press = false;
-		Visitor::visit(root);
-		this->prevpos = this->currpos;
+		this->events.mouseReleased();
 	}
 
-	void mouseMoved(Node* root, int x, int y)
+	void mouseMoved(int x, int y)
 	{
-		this->move = true;
-		this->currpos = glm::dvec2(x, y);
-		Visitor::visit(root);
-		this->prevpos = this->currpos;
-		this->move = false;
+		this->events.mouseMoved(x, y);
+	}
+
+	// applies the drag since the last frame, returns whether there was one
+	bool flush()
+	{
+		return this->events.flush();
 	}
 
 	void keyPressed(int key)
@@ -92,16 +138,16 @@ public:
 		default:
 			break;
 		}
-
+		this->events.keyPressed(key);
 	}
 
 	bool interact{ false };
 	bool updatelod{ true };
-	bool press{ false };
-	bool move{ false };
-	int button{ 0 };
-	glm::dvec2 currpos = glm::dvec2(0);
-	glm::dvec2 prevpos = glm::dvec2(0);
+	std::optional<PickResult> picked;
+	EventRouter events;
+
+private:
+	std::shared_ptr<class Picking> picking;
 };
 
 
@@ -114,7 +160,7 @@ const VkStructureType VkStructureTypeMap<VkPhysicalDeviceBufferDeviceAddressFeat
 
 class DeviceVisitor : public Visitor {
 public:
-	DeviceVisitor(std::shared_ptr<State> state) : Visitor(state) {}
+	DeviceVisitor(std::shared_ptr<State> state, const Table* table) : Visitor(state, table) {}
 
 	template<typename T>
 	T& getFeatures(VkStructureType type = VkStructureTypeMap<T>::type)
@@ -151,24 +197,98 @@ private:
 
 class CommandVisitor : public Visitor {
 public:
-	CommandVisitor(std::shared_ptr<State> state) : Visitor(state) {}
+	CommandVisitor(std::shared_ptr<State> state, const Table* table) : Visitor(state, table) {}
 	void visit(class Node* node);
 };
 
 
 class RenderVisitor : public CommandVisitor {
 public:
-	RenderVisitor(std::shared_ptr<State> state) : CommandVisitor(state) {}
+	RenderVisitor(std::shared_ptr<State> state, const Table* table) : CommandVisitor(state, table) {}
+	void visit(class Node* node);
 	class OffscreenImage* image{ nullptr };
 };
 
-inline std::shared_ptr<State> state = std::make_shared<State>();
+// Declares the passes of the frame and the images they use to the render graph, and compiles it.
+// Runs ahead of the traversals that allocate the images.
+class GraphVisitor : public Visitor {
+public:
+	GraphVisitor(std::shared_ptr<State> state, const Table* table) : Visitor(state, table) {}
+	void visit(class Node* node);
+};
+
+// What each traversal does with each type of node, the same for every rendering context
+namespace visitors {
+	inline Traversal<EventVisitor> eventvisitor;
+	inline Traversal<DeviceVisitor> devicevisitor;
+	inline Traversal<Visitor> loadvisitor;
+	inline Traversal<GraphVisitor> graphvisitor;
+	inline Traversal<CommandVisitor> allocvisitor;
+	inline Traversal<CommandVisitor> resizevisitor;
+	inline Traversal<Visitor> pipelinevisitor;
+	inline Traversal<Visitor> recordvisitor;
+	inline Traversal<RenderVisitor> rendervisitor;
+	inline Traversal<Visitor> presentvisitor;
+	inline Traversal<Visitor> pickvisitor;
+	inline Traversal<Visitor> occludervisitor;
+}
+
+
+// Renders one scene on its own instance and device: the state its traversals share, and the
+// traversals. Contexts share nothing but the node types, so several can be driven at once,
+// each from its own thread. A scene is allocated on the device of one context only.
+class RenderContext : public NonCopyable {
+public:
+	RenderContext() :
+		state(std::make_shared<State>()),
+		eventvisitor(state, &visitors::eventvisitor),
+		devicevisitor(state, &visitors::devicevisitor),
+		loadvisitor(state, &visitors::loadvisitor),
+		graphvisitor(state, &visitors::graphvisitor),
+		allocvisitor(state, &visitors::allocvisitor),
+		resizevisitor(state, &visitors::resizevisitor),
+		pipelinevisitor(state, &visitors::pipelinevisitor),
+		recordvisitor(state, &visitors::recordvisitor),
+		rendervisitor(state, &visitors::rendervisitor),
+		presentvisitor(state, &visitors::presentvisitor),
+		pickvisitor(state, &visitors::pickvisitor),
+		occludervisitor(state, &visitors::occludervisitor)
+	{
+		this->state->context = this;
+	}
 
-inline EventVisitor eventvisitor(state);
-inline DeviceVisitor devicevisitor(state);
-inline CommandVisitor allocvisitor(state);
-inline CommandVisitor resizevisitor(state);
-inline Visitor pipelinevisitor(state);
-inline Visitor recordvisitor(state);
-inline RenderVisitor rendervisitor(state);
-inline Visitor presentvisitor(state);
+	~RenderContext();
+
+	// loads the files of the scene while the instance and device are made, with the extensions
+	// the scene needs and those given. Without a path, the pipeline cache is not stored.
+	void create(
+		class Node* scene,
+		std::vector<const char*> instance_extensions,
+		std::vector<const char*> device_extensions,
+		uint32_t frames_in_flight = 2,
+		std::filesystem::path pipelinecache = std::filesystem::path());
+
+	// once the extent is set
+	void alloc(class Node* scene);
+	void resize(class Node* scene, VkExtent3D extent);
+	void redraw(class Node* scene);
+	// for the frames in flight, before the scene they render is destroyed
+	void wait();
+
+	void print(std::ostream& out);
+
+	std::shared_ptr<State> state;
+
+	EventVisitor eventvisitor;
+	DeviceVisitor devicevisitor;
+	Visitor loadvisitor;
+	GraphVisitor graphvisitor;
+	CommandVisitor allocvisitor;
+	CommandVisitor resizevisitor;
+	Visitor pipelinevisitor;
+	Visitor recordvisitor;
+	RenderVisitor rendervisitor;
+	Visitor presentvisitor;
+	Visitor pickvisitor;
+	Visitor occludervisitor;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <typeindex>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+// What a traversal calls for each type of node. There is one table for each traversal, shared
+// by the visitors of every rendering context, filled in as node types are first constructed,
+// possibly on several threads at once.
+template <typename NodeBase, typename VisitorBase>
+class VisitorTable {
+public:
+	typedef std::function<void(NodeBase*, VisitorBase*)> Callback;
+
+	VisitorTable() = default;
+	VisitorTable(const VisitorTable&) = delete;
+	VisitorTable& operator=(const VisitorTable&) = delete;
+
+	template <typename NodeType, typename VisitorType, typename Function>
+	void add(Function function)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->callbacks[typeid(NodeType)] = [function](NodeBase* node, VisitorBase* visitor) {
+			function(static_cast<NodeType*>(node), static_cast<VisitorType*>(visitor));
+		};
+		this->additions++;
+	}
+
+	// changes whenever a callback is added, without locking
+	uint64_t revision() const
+	{
+		return this->additions.load();
+	}
+
+	// empty if the traversal does nothing with the type
+	Callback find(std::type_index type) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->callbacks.find(type);
+		return (it != this->callbacks.end()) ? it->second : Callback();
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->callbacks.size();
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<std::type_index, Callback> callbacks;
+	std::atomic<uint64_t> additions{ 0 };
+};
+
+
+// The callbacks of one visitor: its own, and those it has looked up in the table of its
+// traversal. A type is looked up once, the visitor calls it without locking from then on.
+// A type the table did not have is looked up again once the table has changed, a node type
+// may register in some of its constructors only, after an instance of it was visited.
+template <typename NodeBase, typename VisitorBase>
+class VisitorCallbacks {
+public:
+	typedef VisitorTable<NodeBase, VisitorBase> Table;
+	typedef typename Table::Callback Callback;
+
+	explicit VisitorCallbacks(const Table* table = nullptr) :
+		table(table)
+	{}
+
+	// called instead of what the table has for the type
+	template <typename NodeType, typename VisitorType, typename Function>
+	void add(Function function)
+	{
+		this->callbacks[typeid(NodeType)] = {
+			[function](NodeBase* node, VisitorBase* visitor) {
+				function(static_cast<NodeType*>(node), static_cast<VisitorType*>(visitor));
+			},
+			0
+		};
+	}
+
+	const Callback& find(std::type_index type)
+	{
+		auto it = this->callbacks.find(type);
+		if (it != this->callbacks.end() && (it->second.first || !this->table ||
+			it->second.second == this->table->revision())) {
+			return it->second.first;
+		}
+		this->lookups++;
+		// read first, a callback added during the lookup is found by the next one
+		uint64_t revision = this->table ? this->table->revision() : 0;
+		Entry entry{ this->table ? this->table->find(type) : Callback(), revision };
+		return this->callbacks.insert_or_assign(type, std::move(entry)).first->second.first;
+	}
+
+	const Table* table;
+	// times the table was locked
+	size_t lookups{ 0 };
+
+private:
+	// with the revision of the table it was looked up in
+	typedef std::pair<Callback, uint64_t> Entry;
+	std::unordered_map<std::type_index, Entry> callbacks;
+};
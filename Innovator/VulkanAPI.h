@@ -1,8 +1,13 @@
 #pragma once
 
 #include <Innovator/Defines.h>
+#include <Innovator/Allocator.h>
+#include <Innovator/Descriptors.h>
+#include <Innovator/Pipelines.h>
 
 #include <array>
+#include <mutex>
+#include <chrono>
 #include <utility>
 #include <vector>
 #include <memory>
@@ -233,6 +238,10 @@ public:
 	PFN_vkGetPhysicalDeviceWin32PresentationSupportKHR GetPhysicalDeviceWin32PresentationSupportKHR = reinterpret_cast<PFN_vkGetPhysicalDeviceWin32PresentationSupportKHR>(dlsym(libvulkan, "vkGetPhysicalDeviceWin32PresentationSupportKHR"));
 #endif
 
+#ifdef VK_EXT_headless_surface
+	PFN_vkCreateHeadlessSurfaceEXT CreateHeadlessSurfaceEXT = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(dlsym(libvulkan, "vkCreateHeadlessSurfaceEXT"));
+#endif
+
 #ifdef VK_KHR_get_physical_device_properties2
 	PFN_vkGetPhysicalDeviceFeatures2KHR GetPhysicalDeviceFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(dlsym(libvulkan, "vkGetPhysicalDeviceFeatures2"));
 	PFN_vkGetPhysicalDeviceProperties2 GetPhysicalDeviceProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2>(dlsym(libvulkan, "vkGetPhysicalDeviceProperties2"));
@@ -603,6 +612,13 @@ public:
 	std::vector<VulkanPhysicalDevice> physical_devices;
 };
 
+// Vulkan handles as cache key words, they are pointers or 64 bit integers depending on the platform
+template <typename Handle>
+uint64_t HandleKey(Handle handle)
+{
+	return (uint64_t)(handle);
+}
+
 class VulkanDevice {
 public:
 	VulkanDevice() = delete;
@@ -675,10 +691,14 @@ public:
 		};
 
 		THROW_ON_ERROR(vk.CreateCommandPool(this->device, &create_info, nullptr, &this->default_pool));
+
+		this->createAllocator();
 	}
 
 	~VulkanDevice()
 	{
+		// all allocations hold a reference to the device, only the memory blocks are left
+		this->allocator.reset();
 		vk.DestroyCommandPool(this->device, this->default_pool, nullptr);
 		vk.DestroyDevice(this->device, nullptr);
 	}
@@ -705,6 +725,16 @@ public:
 		return this->queues[queue_index];
 	}
 
+	// one queue is created per family, so the family is the queue's index
+	uint32_t getQueueFamily(VkQueue queue) const
+	{
+		auto it = std::find(this->queues.begin(), this->queues.end(), queue);
+		if (it == this->queues.end()) {
+			throw std::runtime_error("VulkanDevice::getQueueFamily: unknown queue");
+		}
+		return static_cast<uint32_t>(std::distance(this->queues.begin(), it));
+	}
+
 #ifdef VK_KHR_ray_tracing
 	VkDeviceAddress getDeviceAddress(VkAccelerationStructureKHR as)
 	{
@@ -732,6 +762,12 @@ public:
 	VulkanPhysicalDevice physical_device;
 	std::vector<VkQueue> queues;
 	VkCommandPool default_pool{ 0 };
+	std::shared_ptr<class VulkanMemoryAllocator> allocator;
+	// buffers, views, samplers and acceleration structures, for the descriptor cache
+	DestroyedHandles destroyed;
+
+private:
+	void createAllocator();
 };
 
 class VulkanMemory {
@@ -754,6 +790,210 @@ public:
 	VkDeviceMemory memory{ 0 };
 };
 
+
+// Owns the VkDeviceMemory blocks that buffers and images are sub-allocated from. Blocks of
+// host visible memory types are mapped once when created and stay mapped.
+class VulkanMemoryAllocator {
+public:
+	struct Range {
+		MemoryAllocator::Allocation allocation;
+		VkDeviceMemory memory{ 0 };
+		char* mapped{ nullptr };
+	};
+
+	VulkanMemoryAllocator() = delete;
+
+	VulkanMemoryAllocator(
+		VkDevice device,
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		VkDeviceSize buffer_image_granularity) :
+		device(device),
+		memory_properties(memory_properties),
+		allocator(
+			[this](uint32_t memory_type, uint32_t flags, uint64_t size) {
+				return this->createBlock(memory_type, flags, size);
+			},
+			[this](uint64_t handle) {
+				this->destroyBlock(handle);
+			},
+			64 * 1024 * 1024,
+			buffer_image_granularity)
+	{}
+
+	~VulkanMemoryAllocator() = default;
+
+	Range allocate(
+		const VkMemoryRequirements& requirements,
+		uint32_t memory_type_index,
+		MemoryAllocator::ResourceKind kind,
+		VkMemoryAllocateFlags flags = 0,
+		bool dedicated = false)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto allocation = this->allocator.allocate({
+			.size = requirements.size,
+			.alignment = requirements.alignment,
+			.memory_type = memory_type_index,
+			.kind = kind,
+			.flags = flags,
+			.dedicated = dedicated,
+			});
+
+		const Block& block = this->blocks.at(allocation.block);
+		return {
+			.allocation = allocation,
+			.memory = block.memory,
+			.mapped = block.mapped ? block.mapped + allocation.offset : nullptr,
+		};
+	}
+
+	void free(const MemoryAllocator::Allocation& allocation)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->allocator.free(allocation);
+	}
+
+	// Plans moves that would release a block. The caller copies the data into a resource
+	// bound to the destination range and frees the source, see MemoryAllocator::defragment.
+	std::vector<MemoryAllocator::Move> defragment()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->allocator.defragment();
+	}
+
+	VkDeviceMemory deviceMemory(uint64_t block)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->blocks.at(block).memory;
+	}
+
+	AllocatorStats stats()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->allocator.stats();
+	}
+
+private:
+	struct Block {
+		VkDeviceMemory memory{ 0 };
+		char* mapped{ nullptr };
+	};
+
+	uint64_t createBlock(uint32_t memory_type, uint32_t flags, uint64_t size)
+	{
+		VkMemoryAllocateFlagsInfo allocate_flags_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR,
+			.pNext = nullptr,
+			.flags = flags,
+			.deviceMask = 0,
+		};
+
+		VkMemoryAllocateInfo allocate_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = flags ? &allocate_flags_info : nullptr,
+			.allocationSize = size,
+			.memoryTypeIndex = memory_type,
+		};
+
+		Block block;
+		THROW_ON_ERROR(vk.AllocateMemory(this->device, &allocate_info, nullptr, &block.memory));
+
+		VkMemoryPropertyFlags properties = this->memory_properties.memoryTypes[memory_type].propertyFlags;
+		if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			void* data;
+			VkResult result = vk.MapMemory(this->device, block.memory, 0, VK_WHOLE_SIZE, 0, &data);
+			if (result != VK_SUCCESS) {
+				vk.FreeMemory(this->device, block.memory, nullptr);
+				THROW_ON_ERROR(result);
+			}
+			block.mapped = reinterpret_cast<char*>(data);
+		}
+
+		uint64_t handle = ++this->next_handle;
+		this->blocks[handle] = block;
+		return handle;
+	}
+
+	void destroyBlock(uint64_t handle)
+	{
+		auto it = this->blocks.find(handle);
+		if (it->second.mapped) {
+			vk.UnmapMemory(this->device, it->second.memory);
+		}
+		vk.FreeMemory(this->device, it->second.memory, nullptr);
+		this->blocks.erase(it);
+	}
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	std::mutex mutex;
+	uint64_t next_handle{ 0 };
+	std::unordered_map<uint64_t, Block> blocks;
+	// destroyed first, it releases the remaining blocks
+	MemoryAllocator allocator;
+};
+
+
+inline void
+VulkanDevice::createAllocator()
+{
+	this->allocator = std::make_shared<VulkanMemoryAllocator>(
+		this->device,
+		this->physical_device.memory_properties,
+		this->physical_device.properties.limits.bufferImageGranularity);
+}
+
+
+// A range of a device memory block, freed back to the device allocator on destruction
+class VulkanMemoryAllocation {
+public:
+	VulkanMemoryAllocation() = delete;
+
+	VulkanMemoryAllocation(
+		std::shared_ptr<VulkanDevice> device,
+		const VkMemoryRequirements& requirements,
+		uint32_t memory_type_index,
+		MemoryAllocator::ResourceKind kind,
+		VkMemoryAllocateFlags flags = 0) :
+		device(std::move(device))
+	{
+		auto range = this->device->allocator->allocate(requirements, memory_type_index, kind, flags);
+		this->allocation = range.allocation;
+		this->memory = range.memory;
+		this->offset = range.allocation.offset;
+		this->size = range.allocation.size;
+		this->mapped = range.mapped;
+	}
+
+	~VulkanMemoryAllocation()
+	{
+		this->device->allocator->free(this->allocation);
+	}
+
+	// the block is persistently mapped, map only offsets into it
+	char* map(VkDeviceSize, VkDeviceSize offset = 0, VkMemoryMapFlags = 0) const
+	{
+		if (!this->mapped) {
+			throw std::runtime_error("VulkanMemoryAllocation: memory is not host visible");
+		}
+		return this->mapped + offset;
+	}
+
+	void unmap() const {}
+
+	void memcpy(const void* src, VkDeviceSize size, VkDeviceSize offset = 0)
+	{
+		::memcpy(this->map(size, offset), src, size);
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	MemoryAllocator::Allocation allocation;
+	VkDeviceMemory memory{ 0 };
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	char* mapped{ nullptr };
+};
+
 static VkBool32 DebugCallback(
 	VkFlags flags,
 	VkDebugReportObjectTypeEXT,
@@ -955,6 +1195,21 @@ public:
 	}
 #endif
 
+#if defined(VK_EXT_headless_surface)
+	// presents nowhere, for rendering the swapchain path without a window
+	explicit VulkanSurface(std::shared_ptr<VulkanInstance> vulkan) :
+		vulkan(std::move(vulkan))
+	{
+		VkHeadlessSurfaceCreateInfoEXT create_info{
+			.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+			.pNext = nullptr,
+			.flags = 0,
+		};
+
+		THROW_ON_ERROR(vk.CreateHeadlessSurfaceEXT(this->vulkan->instance, &create_info, nullptr, &this->surface));
+	}
+#endif
+
 	~VulkanSurface()
 	{
 		vk.DestroySurfaceKHR(this->vulkan->instance, this->surface, nullptr);
@@ -987,6 +1242,16 @@ public:
 		}
 	}
 
+	void checkQueueSupport(std::shared_ptr<VulkanDevice> device, VkQueue queue)
+	{
+		VkBool32 supported = VK_FALSE;
+		THROW_ON_ERROR(vk.GetPhysicalDeviceSurfaceSupportKHR(device->physical_device.device, device->getQueueFamily(queue), surface, &supported));
+
+		if (!supported) {
+			throw std::runtime_error("surface does not support presenting from queue");
+		}
+	}
+
 	VkSurfaceCapabilitiesKHR getSurfaceCapabilities(std::shared_ptr<VulkanDevice> device)
 	{
 		VkSurfaceCapabilitiesKHR surface_capabilities;
@@ -1006,14 +1271,15 @@ public:
 
 	explicit VulkanDescriptorPool(
 		std::shared_ptr<VulkanDevice> device,
-		std::vector<VkDescriptorPoolSize> descriptor_pool_sizes) :
+		std::vector<VkDescriptorPoolSize> descriptor_pool_sizes,
+		uint32_t max_sets) :
 		device(std::move(device))
 	{
 		VkDescriptorPoolCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-			.maxSets = static_cast<uint32_t>(descriptor_pool_sizes.size()),
+			.maxSets = max_sets,
 			.poolSizeCount = static_cast<uint32_t>(descriptor_pool_sizes.size()),
 			.pPoolSizes = descriptor_pool_sizes.data()
 		};
@@ -1101,17 +1367,21 @@ public:
 			static_cast<uint32_t>(descriptor_copies.size()), descriptor_copies.data());
 	}
 
-	void bind(VkCommandBuffer command, VkPipelineLayout layout)
+	void bind(
+		VkCommandBuffer command,
+		VkPipelineLayout layout,
+		const std::vector<uint32_t>& dynamic_offsets = std::vector<uint32_t>(),
+		VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS)
 	{
 		vk.CmdBindDescriptorSets(
 			command,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			bind_point,
 			layout,
 			0,
 			static_cast<uint32_t>(this->descriptor_sets.size()),
 			this->descriptor_sets.data(),
-			0,
-			nullptr);
+			static_cast<uint32_t>(dynamic_offsets.size()),
+			dynamic_offsets.data());
 	}
 
 	std::shared_ptr<VulkanDevice> device;
@@ -1325,6 +1595,7 @@ public:
 	~VulkanBuffer()
 	{
 		vk.DestroyBuffer(this->device->device, this->buffer, nullptr);
+		this->device->destroyed.add(HandleKey(this->buffer));
 	}
 
 	VkMemoryRequirements getMemoryRequirements()
@@ -1371,29 +1642,24 @@ public:
 		allocate_flags = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ?
 			VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR : 0;
 #endif
-		VkMemoryAllocateFlagsInfo allocate_info{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR,
-			.pNext = nullptr,
-			.flags = allocate_flags,
-			.deviceMask = 0,
-		};
 
-		this->memory = std::make_shared<VulkanMemory>(
+		this->memory = std::make_shared<VulkanMemoryAllocation>(
 			device,
-			memory_requirements.size,
+			memory_requirements,
 			memory_type_index,
-			&allocate_info);
+			MemoryAllocator::ResourceKind::LINEAR,
+			allocate_flags);
 
 		device->bindBufferMemory(
 			this->buffer->buffer,
 			this->memory->memory,
-			0);
+			this->memory->offset);
 	}
 
 	~VulkanBufferObject() = default;
 
 	std::shared_ptr<VulkanBuffer> buffer;
-	std::shared_ptr<VulkanMemory> memory;
+	std::shared_ptr<VulkanMemoryAllocation> memory;
 };
 
 
@@ -1433,24 +1699,74 @@ public:
 			this->memory_requirements.memoryTypeBits,
 			memoryFlags);
 
-		this->memory = std::make_shared<VulkanMemory>(
+		this->memory = std::make_shared<VulkanMemoryAllocation>(
 			device,
-			this->memory_requirements.size,
-			memory_type_index);
+			this->memory_requirements,
+			memory_type_index,
+			(tiling == VK_IMAGE_TILING_OPTIMAL) ?
+				MemoryAllocator::ResourceKind::OPTIMAL :
+				MemoryAllocator::ResourceKind::LINEAR);
+
+		device->bindImageMemory(
+			this->image->image,
+			this->memory->memory,
+			this->memory->offset);
+	}
+
+	// an image placed in memory shared with other images, at offset into it
+	VulkanImageObject(
+		std::shared_ptr<VulkanDevice> device,
+		std::shared_ptr<VulkanImage> image,
+		std::shared_ptr<VulkanMemoryAllocation> memory,
+		VkDeviceSize offset) :
+		image(std::move(image)),
+		memory(std::move(memory))
+	{
+		this->memory_requirements = this->image->getMemoryRequirements();
 
 		device->bindImageMemory(
 			this->image->image,
 			this->memory->memory,
-			0);
+			this->memory->offset + offset);
 	}
 
 
 	std::shared_ptr<VulkanImage> image;
-	std::shared_ptr<VulkanMemory> memory;
+	std::shared_ptr<VulkanMemoryAllocation> memory;
 	VkMemoryRequirements memory_requirements;
 };
 
 
+class VulkanCommandPool {
+public:
+	VulkanCommandPool() = delete;
+
+	VulkanCommandPool(
+		std::shared_ptr<VulkanDevice> device,
+		uint32_t queue_family_index,
+		VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT) :
+		device(std::move(device))
+	{
+		VkCommandPoolCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = flags,
+			.queueFamilyIndex = queue_family_index,
+		};
+
+		THROW_ON_ERROR(vk.CreateCommandPool(this->device->device, &create_info, nullptr, &this->pool));
+	}
+
+	~VulkanCommandPool()
+	{
+		vk.DestroyCommandPool(this->device->device, this->pool, nullptr);
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	VkCommandPool pool{ 0 };
+};
+
+
 class VulkanCommandBuffers {
 public:
 	class Scope {
@@ -1476,13 +1792,15 @@ public:
 	VulkanCommandBuffers(
 		std::shared_ptr<VulkanDevice> device,
 		size_t count = 1,
-		VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) :
-		device(std::move(device))
+		VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		VkCommandPool pool = VK_NULL_HANDLE) :
+		device(std::move(device)),
+		pool(pool ? pool : this->device->default_pool)
 	{
 		VkCommandBufferAllocateInfo allocate_info{
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 			.pNext = nullptr,
-			.commandPool = this->device->default_pool,
+			.commandPool = this->pool,
 			.level = level,
 			.commandBufferCount = static_cast<uint32_t>(count),
 		};
@@ -1495,7 +1813,7 @@ public:
 	{
 		vk.FreeCommandBuffers(
 			this->device->device,
-			this->device->default_pool,
+			this->pool,
 			static_cast<uint32_t>(this->buffers.size()),
 			this->buffers.data());
 	}
@@ -1612,6 +1930,7 @@ public:
 	}
 
 	std::shared_ptr<VulkanDevice> device;
+	VkCommandPool pool{ 0 };
 	std::vector<VkCommandBuffer> buffers;
 };
 
@@ -1661,8 +1980,16 @@ public:
 		this->mem = this->memory->map(size, offset);
 	}
 
+	// sub-allocations are persistently mapped, nothing to unmap
+	MemoryMap(VulkanMemoryAllocation* allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
+	{
+		this->mem = allocation->map(size, offset);
+	}
+
 	~MemoryMap() {
-		this->memory->unmap();
+		if (this->memory) {
+			this->memory->unmap();
+		}
 	}
 
 	VulkanMemory* memory{ nullptr };
@@ -1706,6 +2033,7 @@ public:
 	~VulkanImageView()
 	{
 		vk.DestroyImageView(this->device->device, this->view, nullptr);
+		this->device->destroyed.add(HandleKey(this->view));
 	}
 
 	std::shared_ptr<VulkanDevice> device;
@@ -1761,6 +2089,7 @@ public:
 	~VulkanSampler()
 	{
 		vk.DestroySampler(this->device->device, this->sampler, nullptr);
+		this->device->destroyed.add(HandleKey(this->sampler));
 	}
 
 	std::shared_ptr<VulkanDevice> device;
@@ -1797,19 +2126,37 @@ public:
 };
 
 
+// Wraps the VkPipelineCache and is the registry of shader modules and graphics pipelines,
+// shared by everything that asks for identical state. With a path, the driver's cache blob
+// is loaded at startup and written back by save().
 class VulkanPipelineCache {
 public:
 	VulkanPipelineCache() = delete;
 
-	explicit VulkanPipelineCache(std::shared_ptr<VulkanDevice> device) :
-		device(std::move(device))
+	explicit VulkanPipelineCache(
+		std::shared_ptr<VulkanDevice> device,
+		std::filesystem::path path = std::filesystem::path()) :
+		device(std::move(device)),
+		path(std::move(path))
 	{
+		const VkPhysicalDeviceProperties& properties = this->device->physical_device.properties;
+		this->header.vendor_id = properties.vendorID;
+		this->header.device_id = properties.deviceID;
+		this->header.driver_version = properties.driverVersion;
+		std::copy(std::begin(properties.pipelineCacheUUID), std::end(properties.pipelineCacheUUID), this->header.uuid.begin());
+
+		std::vector<char> data;
+		if (!this->path.empty()) {
+			data = PipelineCacheFile::Read(this->path, this->header).value_or(std::vector<char>());
+		}
+		this->stats.loaded_bytes = data.size();
+
 		VkPipelineCacheCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.initialDataSize = 0,
-			.pInitialData = nullptr,
+			.initialDataSize = data.size(),
+			.pInitialData = data.empty() ? nullptr : data.data(),
 		};
 
 		THROW_ON_ERROR(vk.CreatePipelineCache(this->device->device, &create_info, nullptr, &this->cache));
@@ -1817,11 +2164,47 @@ public:
 
 	~VulkanPipelineCache()
 	{
+		this->pipelines.clear();
+		this->modules.clear();
 		vk.DestroyPipelineCache(this->device->device, this->cache, nullptr);
 	}
 
+	void save()
+	{
+		if (this->path.empty()) {
+			return;
+		}
+		size_t size = 0;
+		THROW_ON_ERROR(vk.GetPipelineCacheData(this->device->device, this->cache, &size, nullptr));
+		std::vector<char> data(size);
+		THROW_ON_ERROR(vk.GetPipelineCacheData(this->device->device, this->cache, &size, data.data()));
+		data.resize(size);
+
+		PipelineCacheFile::Write(this->path, this->header, data);
+	}
+
+	std::shared_ptr<VulkanShaderModule> getShaderModule(const std::vector<uint32_t>& code);
+
+	std::shared_ptr<class VulkanGraphicsPipeline> getGraphicsPipeline(
+		VkRenderPass render_pass,
+		VkPipelineLayout pipeline_layout,
+		VkPrimitiveTopology primitive_topology,
+		const VkPipelineRasterizationStateCreateInfo& rasterization_state,
+		VkSampleCountFlagBits samples,
+		const std::vector<VkDynamicState>& dynamic_states,
+		const std::vector<VkPipelineShaderStageCreateInfo>& shaderstages,
+		const std::vector<VkVertexInputBindingDescription>& binding_descriptions,
+		const std::vector<VkVertexInputAttributeDescription>& attribute_descriptions);
+
 	std::shared_ptr<VulkanDevice> device;
 	VkPipelineCache cache{ 0 };
+	PipelineStats stats;
+
+private:
+	std::filesystem::path path;
+	PipelineCacheHeader header;
+	ObjectCache<PipelineKey, VulkanShaderModule> modules;
+	ObjectCache<PipelineKey, class VulkanGraphicsPipeline> pipelines;
 };
 
 class VulkanRenderpass {
@@ -1966,6 +2349,200 @@ public:
 	VkPipelineLayout layout{ 0 };
 };
 
+// Set layouts and pipeline layouts deduplicated by their bindings, descriptor sets by their
+// layout and bound resources. Sets are allocated from a chain of shared pools that grows on
+// demand, and go back to their pool once the last user (or the frame ring) lets go of them.
+class VulkanDescriptorCache {
+public:
+	VulkanDescriptorCache() = delete;
+
+	explicit VulkanDescriptorCache(std::shared_ptr<VulkanDevice> device) :
+		device(device),
+		pools(std::make_shared<Pools>(std::move(device)))
+	{}
+
+	~VulkanDescriptorCache() = default;
+
+	std::shared_ptr<VulkanDescriptorSetLayout> getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		std::vector<DescriptorBindingKey> keys;
+		for (auto& binding : bindings) {
+			keys.push_back({
+				.binding = binding.binding,
+				.type = static_cast<uint32_t>(binding.descriptorType),
+				.count = binding.descriptorCount,
+				.stages = binding.stageFlags,
+				});
+		}
+		DescriptorLayoutKey key(keys);
+
+		return this->layouts.get(key, [&]() {
+			auto layout = std::make_shared<VulkanDescriptorSetLayout>(this->device, bindings);
+			this->counts[HandleKey(layout->layout)] = key.descriptorCounts();
+			return layout;
+			});
+	}
+
+	std::shared_ptr<VulkanPipelineLayout> getPipelineLayout(
+		const std::vector<VkDescriptorSetLayout>& set_layouts,
+		const std::vector<VkPushConstantRange>& push_constant_ranges)
+	{
+		std::vector<uint64_t> layouts;
+		for (auto layout : set_layouts) {
+			layouts.push_back(HandleKey(layout));
+		}
+		std::vector<PushConstantKey> ranges;
+		for (auto& range : push_constant_ranges) {
+			ranges.push_back({ range.stageFlags, range.offset, range.size });
+		}
+
+		return this->pipeline_layouts.get(PipelineLayoutKey(layouts, ranges), [&]() {
+			return std::make_shared<VulkanPipelineLayout>(this->device, set_layouts, push_constant_ranges);
+			});
+	}
+
+	// a set with the given layout and writes, dstSet of the writes is filled in when a new set is made
+	std::shared_ptr<VulkanDescriptorSets> getDescriptorSet(
+		const VulkanDescriptorSetLayout* layout,
+		std::vector<VkWriteDescriptorSet> writes)
+	{
+		std::vector<DescriptorResourceKey> resources;
+		for (auto& write : writes) {
+			resources.push_back(ResourceKey(write));
+		}
+		DescriptorSetKey key(HandleKey(layout->layout), resources);
+
+		auto destroyed = this->device->destroyed.take();
+		if (!destroyed.empty()) {
+			// the resources of these sets are gone, their handles may be bound again
+			this->sets.evict([&](const DescriptorSetKey& key) { return key.refers(destroyed); });
+		}
+
+		if (this->sets.size() >= this->pools->chain.capacity()) {
+			// sets only the cache holds on to are unused, free them before the pools grow
+			this->sets.prune();
+		}
+
+		return this->sets.get(key, [&]() {
+			auto sets = this->allocate(layout);
+			for (auto& write : writes) {
+				write.dstSet = sets->descriptor_sets[0];
+			}
+			sets->update(writes);
+			return sets;
+			});
+	}
+
+	DescriptorCacheStats stats() const
+	{
+		return {
+			.layouts = this->layouts.size(),
+			.pipeline_layouts = this->pipeline_layouts.size(),
+			.sets = this->sets.size(),
+			.pools = this->pools->chain.poolCount(),
+			.hits = this->layouts.hits + this->pipeline_layouts.hits + this->sets.hits,
+			.misses = this->layouts.misses + this->pipeline_layouts.misses + this->sets.misses,
+		};
+	}
+
+private:
+	// outlives the cache while sets allocated from the pools are alive
+	struct Pools {
+		explicit Pools(std::shared_ptr<VulkanDevice> device) :
+			device(std::move(device)),
+			chain(
+				[this](uint32_t max_sets, const DescriptorPoolChain::Counts& counts) {
+					std::vector<VkDescriptorPoolSize> sizes;
+					for (auto& [type, count] : counts) {
+						sizes.push_back({ static_cast<VkDescriptorType>(type), count });
+					}
+					this->pools[++this->created] = std::make_shared<VulkanDescriptorPool>(this->device, sizes, max_sets);
+					return this->created;
+				},
+				[this](uint64_t handle) {
+					this->pools.erase(handle);
+				})
+		{}
+
+		std::shared_ptr<VulkanDevice> device;
+		std::unordered_map<uint64_t, std::shared_ptr<VulkanDescriptorPool>> pools;
+		uint64_t created{ 0 };
+		std::mutex mutex;
+		DescriptorPoolChain chain;
+	};
+
+	std::shared_ptr<VulkanDescriptorSets> allocate(const VulkanDescriptorSetLayout* layout)
+	{
+		const auto& counts = this->counts.at(HandleKey(layout->layout));
+		std::shared_ptr<Pools> pools = this->pools;
+
+		while (true) {
+			uint64_t handle;
+			std::shared_ptr<VulkanDescriptorPool> pool;
+			{
+				std::lock_guard<std::mutex> lock(pools->mutex);
+				handle = pools->chain.acquire(counts);
+				pool = pools->pools.at(handle);
+			}
+			try {
+				auto sets = new VulkanDescriptorSets(this->device, pool, { layout->layout });
+				return std::shared_ptr<VulkanDescriptorSets>(sets, [pools, handle, counts](VulkanDescriptorSets* sets) {
+					delete sets;
+					std::lock_guard<std::mutex> lock(pools->mutex);
+					pools->chain.release(handle, counts);
+					});
+			}
+			catch (VkErrorOutOfPoolMemoryException&) {
+				std::lock_guard<std::mutex> lock(pools->mutex);
+				pools->chain.failed(handle, counts);
+			}
+			catch (VkErrorFragmentedPoolException&) {
+				std::lock_guard<std::mutex> lock(pools->mutex);
+				pools->chain.failed(handle, counts);
+			}
+		}
+	}
+
+	static DescriptorResourceKey ResourceKey(const VkWriteDescriptorSet& write)
+	{
+		DescriptorResourceKey key{
+			.binding = write.dstBinding,
+			.type = static_cast<uint32_t>(write.descriptorType),
+		};
+
+		switch (write.descriptorType) {
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			key.buffer = HandleKey(write.pBufferInfo->buffer);
+			key.offset = write.pBufferInfo->offset;
+			key.range = write.pBufferInfo->range;
+			break;
+		case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR: {
+			auto info = static_cast<const VkWriteDescriptorSetAccelerationStructureKHR*>(write.pNext);
+			for (uint32_t i = 0; i < info->accelerationStructureCount; i++) {
+				key.acceleration_structures.push_back(HandleKey(info->pAccelerationStructures[i]));
+			}
+			break;
+		}
+		default:
+			key.sampler = HandleKey(write.pImageInfo->sampler);
+			key.view = HandleKey(write.pImageInfo->imageView);
+			key.image_layout = static_cast<uint32_t>(write.pImageInfo->imageLayout);
+			break;
+		}
+		return key;
+	}
+
+	std::shared_ptr<VulkanDevice> device;
+	std::shared_ptr<Pools> pools;
+	std::unordered_map<uint64_t, DescriptorPoolChain::Counts> counts;
+	ObjectCache<DescriptorLayoutKey, VulkanDescriptorSetLayout> layouts;
+	ObjectCache<PipelineLayoutKey, VulkanPipelineLayout> pipeline_layouts;
+	ObjectCache<DescriptorSetKey, VulkanDescriptorSets> sets;
+};
+
 class VulkanComputePipeline {
 public:
 	VulkanComputePipeline() = delete;
@@ -2026,6 +2603,7 @@ public:
 		VkPipelineLayout pipeline_layout,
 		VkPrimitiveTopology primitive_topology,
 		VkPipelineRasterizationStateCreateInfo rasterization_state,
+		VkSampleCountFlagBits samples,
 		const std::vector<VkDynamicState>& dynamic_states,
 		const std::vector<VkPipelineShaderStageCreateInfo>& shaderstages,
 		const std::vector<VkVertexInputBindingDescription>& binding_descriptions,
@@ -2119,7 +2697,7 @@ public:
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+			.rasterizationSamples = samples,
 			.sampleShadingEnable = VK_FALSE,
 			.minSampleShading = 0,
 			.pSampleMask = nullptr,
@@ -2166,6 +2744,115 @@ public:
 	VkPipeline pipeline{ 0 };
 };
 
+// shader modules with identical code are shared, so stages compare equal by module handle
+inline std::shared_ptr<VulkanShaderModule>
+VulkanPipelineCache::getShaderModule(const std::vector<uint32_t>& code)
+{
+	PipelineKey key;
+	key.addList(code);
+	return this->modules.get(key, [&]() {
+		return std::make_shared<VulkanShaderModule>(this->device, code);
+		});
+}
+
+inline std::shared_ptr<VulkanGraphicsPipeline>
+VulkanPipelineCache::getGraphicsPipeline(
+	VkRenderPass render_pass,
+	VkPipelineLayout pipeline_layout,
+	VkPrimitiveTopology primitive_topology,
+	const VkPipelineRasterizationStateCreateInfo& rasterization_state,
+	VkSampleCountFlagBits samples,
+	const std::vector<VkDynamicState>& dynamic_states,
+	const std::vector<VkPipelineShaderStageCreateInfo>& shaderstages,
+	const std::vector<VkVertexInputBindingDescription>& binding_descriptions,
+	const std::vector<VkVertexInputAttributeDescription>& attribute_descriptions)
+{
+	PipelineKey key;
+	key.add(HandleKey(render_pass));
+	key.add(HandleKey(pipeline_layout));
+	key.add(primitive_topology);
+
+	key.add(rasterization_state.depthClampEnable);
+	key.add(rasterization_state.rasterizerDiscardEnable);
+	key.add(rasterization_state.polygonMode);
+	key.add(rasterization_state.cullMode);
+	key.add(rasterization_state.frontFace);
+	key.add(rasterization_state.depthBiasEnable);
+	key.addFloat(rasterization_state.depthBiasConstantFactor);
+	key.addFloat(rasterization_state.depthBiasClamp);
+	key.addFloat(rasterization_state.depthBiasSlopeFactor);
+	key.addFloat(rasterization_state.lineWidth);
+	key.add(samples);
+
+	std::vector<PipelineKey::Item> states;
+	for (auto state : dynamic_states) {
+		states.push_back({ static_cast<uint64_t>(state) });
+	}
+	key.addUnordered(states);
+
+	std::vector<PipelineKey::Item> stages;
+	for (auto& stage : shaderstages) {
+		PipelineKey::Item item{ stage.stage, HandleKey(stage.module) };
+		for (const char* c = stage.pName; *c; c++) {
+			item.push_back(static_cast<uint8_t>(*c));
+		}
+		if (auto info = stage.pSpecializationInfo) {
+			for (uint32_t i = 0; i < info->mapEntryCount; i++) {
+				item.push_back(info->pMapEntries[i].constantID);
+				item.push_back(info->pMapEntries[i].offset);
+				item.push_back(info->pMapEntries[i].size);
+			}
+			auto data = static_cast<const uint8_t*>(info->pData);
+			item.insert(item.end(), data, data + info->dataSize);
+		}
+		stages.push_back(item);
+	}
+	key.addUnordered(stages);
+
+	std::vector<PipelineKey::Item> bindings;
+	for (auto& binding : binding_descriptions) {
+		bindings.push_back({ binding.binding, binding.stride, static_cast<uint64_t>(binding.inputRate) });
+	}
+	key.addUnordered(bindings);
+
+	std::vector<PipelineKey::Item> attributes;
+	for (auto& attribute : attribute_descriptions) {
+		attributes.push_back({ attribute.location, attribute.binding, static_cast<uint64_t>(attribute.format), attribute.offset });
+	}
+	key.addUnordered(attributes);
+
+	uint64_t misses = this->pipelines.misses;
+	auto pipeline = this->pipelines.get(key, [&]() {
+		// render passes and layouts are recreated on resize, drop pipelines nobody uses anymore
+		this->pipelines.prune();
+
+		auto t0 = std::chrono::steady_clock::now();
+		auto pipeline = std::make_shared<VulkanGraphicsPipeline>(
+			this->device,
+			render_pass,
+			this->cache,
+			pipeline_layout,
+			primitive_topology,
+			rasterization_state,
+			samples,
+			dynamic_states,
+			shaderstages,
+			binding_descriptions,
+			attribute_descriptions);
+		auto t1 = std::chrono::steady_clock::now();
+		this->stats.create_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		return pipeline;
+		});
+
+	if (this->pipelines.misses > misses) {
+		this->stats.created++;
+	}
+	else {
+		this->stats.reused++;
+	}
+	return pipeline;
+}
+
 #ifdef VK_KHR_ray_tracing
 
 class VulkanRayTracingPipeline {
@@ -2264,6 +2951,7 @@ public:
 	~VulkanAccelerationStructure()
 	{
 		this->vulkan->vkDestroyAccelerationStructureKHR(this->device->device, this->as, nullptr);
+		this->device->destroyed.add(HandleKey(this->as));
 	}
 
 
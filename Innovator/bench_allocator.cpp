@@ -0,0 +1,102 @@
+#include <Innovator/Allocator.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+
+// Churns a scene-like mix of buffers and images through the allocator and compares the
+// number of device allocations against one vkAllocateMemory per resource.
+int main(int, char* [])
+{
+	uint64_t blocks_created = 0;
+	uint64_t blocks_live = 0;
+
+	MemoryAllocator allocator(
+		[&](uint32_t, uint32_t, uint64_t) {
+			blocks_live++;
+			return ++blocks_created;
+		},
+		[&](uint64_t) {
+			blocks_live--;
+		},
+		64 * 1024 * 1024, 1024);
+
+	std::mt19937 rng(42);
+	std::vector<MemoryAllocator::Allocation> live;
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+
+	auto request = [&]() {
+		MemoryAllocator::Request request;
+		switch (rng() % 4) {
+		case 0: // small uniform and vertex buffers
+			request.size = 256 + rng() % (64 * 1024);
+			request.alignment = 256;
+			break;
+		case 1: // meshes
+			request.size = 64 * 1024 + rng() % (4 * 1024 * 1024);
+			request.alignment = 16;
+			break;
+		case 2: // textures
+			request.size = uint64_t(4) << (10 + rng() % 13);
+			request.alignment = 65536;
+			request.kind = MemoryAllocator::ResourceKind::OPTIMAL;
+			break;
+		default: // render targets, some of them dedicated
+			request.size = (1 + rng() % 32) * 1024 * 1024;
+			request.alignment = 65536;
+			request.kind = MemoryAllocator::ResourceKind::OPTIMAL;
+			break;
+		}
+		return request;
+	};
+
+	const int operations = 1000000;
+	auto t0 = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < operations; i++) {
+		// grow towards a working set of a few thousand resources, then churn
+		bool allocate = live.size() < 500 || (live.size() < 4000 && rng() % 2);
+		if (allocate) {
+			live.push_back(allocator.allocate(request()));
+			allocations++;
+		}
+		else {
+			size_t index = rng() % live.size();
+			allocator.free(live[index]);
+			live[index] = live.back();
+			live.pop_back();
+			frees++;
+		}
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / operations;
+
+	auto stats = allocator.stats();
+	std::cout << allocations << " allocations, " << frees << " frees, " << ns << " ns/op" << std::endl;
+	stats.print(std::cout);
+	std::cout << "device allocations: " << blocks_created << " created, "
+		<< stats.blocks + stats.dedicated << " live, vs " << live.size() << " live without sub-allocation" << std::endl;
+
+	auto t2 = std::chrono::steady_clock::now();
+	auto moves = allocator.defragment();
+	for (auto& move : moves) {
+		auto it = std::find_if(live.begin(), live.end(), [&](const auto& allocation) {
+			return allocation.block == move.src.block && allocation.offset == move.src.offset;
+			});
+		*it = move.dst;
+		allocator.free(move.src);
+	}
+	auto t3 = std::chrono::steady_clock::now();
+
+	std::cout << "defragment: " << moves.size() << " moves in "
+		<< std::chrono::duration<double, std::milli>(t3 - t2).count() << " ms" << std::endl;
+	allocator.stats().print(std::cout);
+
+	for (auto& allocation : live) {
+		allocator.free(allocation);
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include <Innovator/Bvh.h>
+#include <Innovator/Testing.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+struct Mesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const
+	{
+		return this->vertices.size() / 3;
+	}
+};
+
+// a bumpy unit sphere of rings by segments quads, triangles in random order
+static Mesh Sphere(uint32_t rings, uint32_t segments)
+{
+	Mesh mesh;
+	for (uint32_t i = 0; i <= rings; i++) {
+		double theta = 3.14159265358979 * i / rings;
+		for (uint32_t j = 0; j < segments; j++) {
+			double phi = 2.0 * 3.14159265358979 * j / segments;
+			double r = 1.0 + 0.05 * std::sin(theta * 9.0) * std::cos(phi * 7.0);
+			mesh.vertices.insert(mesh.vertices.end(), {
+				float(r * std::sin(theta) * std::cos(phi)), float(r * std::cos(theta)), float(r * std::sin(theta) * std::sin(phi)) });
+		}
+	}
+	std::vector<std::array<uint32_t, 3>> triangles;
+	auto vertex = [segments](uint32_t i, uint32_t j) { return i * segments + j % segments; };
+	for (uint32_t i = 0; i < rings; i++) {
+		for (uint32_t j = 0; j < segments; j++) {
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+		}
+	}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(3));
+	for (auto& triangle : triangles) {
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	return mesh;
+}
+
+// Times building a triangle BVH of a multi-million triangle mesh, serially and over the pool,
+// picking it with rays from the view of a mouse, from outside and mostly at the mesh, and
+// culling it to a frustum that sees part of it. Picks should take well under a millisecond.
+int main(int, char* [])
+{
+	Mesh mesh = Sphere(1000, 1000);
+	auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+	auto t0 = std::chrono::steady_clock::now();
+	TriangleBvh serial(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices);
+	auto t1 = std::chrono::steady_clock::now();
+	TriangleBvh bvh(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, &Bvh::Threads());
+	auto t2 = std::chrono::steady_clock::now();
+
+	std::cout << bvh.triangleCount() << " triangles, build milliseconds:" << std::endl;
+	std::cout << "  serial: " << ms(t1 - t0) << std::endl;
+	std::cout << "  " << Bvh::Threads().size() << " threads: " << ms(t2 - t1) << std::endl;
+
+	std::mt19937 random(6);
+	std::uniform_real_distribution<float> position(-3.0f, 3.0f);
+	std::normal_distribution<float> gaussian;
+	std::vector<BvhRay> rays(10000);
+	for (auto& ray : rays) {
+		ray.origin = { position(random), position(random), 3.0f };
+		ray.direction = { -ray.origin[0] * 0.3f + gaussian(random) * 0.1f, -ray.origin[1] * 0.3f + gaussian(random) * 0.1f, -1.0f };
+	}
+
+	size_t hits = 0;
+	double worst = 0.0;
+	auto t3 = std::chrono::steady_clock::now();
+	for (auto& ray : rays) {
+		auto t = std::chrono::steady_clock::now();
+		hits += bvh.intersect(ray).has_value();
+		worst = std::max(worst, ms(std::chrono::steady_clock::now() - t));
+	}
+	auto t4 = std::chrono::steady_clock::now();
+
+	std::cout << rays.size() << " picks, " << hits << " hits, milliseconds per pick:" << std::endl;
+	std::cout << "  mean: " << ms(t4 - t3) / rays.size() << std::endl;
+	std::cout << "  worst: " << worst << std::endl;
+
+	const int culls = 20;
+	Frustum frustum(Multiply(Perspective(0.4, 1.5, 0.1, 10.0), LookAt({ 0.5, 0.3, 3.0 }, { 0, 0, 0 }, { 0, 1, 0 })));
+	size_t visible = 0;
+	auto t5 = std::chrono::steady_clock::now();
+	for (int i = 0; i < culls; i++) {
+		bvh.cull(frustum, [&](uint32_t) { visible++; });
+	}
+	auto t6 = std::chrono::steady_clock::now();
+
+	std::cout << visible / culls << " triangles visible, milliseconds per cull: " << ms(t6 - t5) / culls << std::endl;
+	return 0;
+}
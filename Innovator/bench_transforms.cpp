@@ -0,0 +1,109 @@
+#include <Innovator/Transforms.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <iostream>
+
+typedef std::array<double, 16> Matrix;
+
+static Matrix Multiply(const Matrix& a, const Matrix& b)
+{
+	Matrix m{};
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			for (int k = 0; k < 4; k++) {
+				m[c * 4 + r] += a[k * 4 + r] * b[c * 4 + k];
+			}
+		}
+	}
+	return m;
+}
+
+static Matrix Local(std::mt19937& rng)
+{
+	std::uniform_real_distribution<double> unit(-1.0, 1.0);
+	double angle = unit(rng) * 3.14159265358979;
+	double c = std::cos(angle), s = std::sin(angle);
+	return { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, unit(rng), unit(rng), unit(rng), 1 };
+}
+
+static std::array<float, 16> Floats(const Matrix& m)
+{
+	std::array<float, 16> f;
+	for (int e = 0; e < 16; e++) {
+		f[e] = float(m[e]);
+	}
+	return f;
+}
+
+// Compares computing the world matrix of every transform node each frame, the way the render
+// traversal multiplies double matrices down the scene and converts them to floats for the
+// uniform buffer, against worlds cached in a TransformHierarchy that only recomputes what moved.
+int main(int, char* [])
+{
+	const size_t count = 100000;
+	const int frames = 100;
+	std::mt19937 rng(42);
+
+	// a scene of groups of ten siblings, four levels deep
+	std::vector<int> parents(count);
+	std::vector<Matrix> locals(count);
+	for (size_t i = 0; i < count; i++) {
+		parents[i] = i < 10 ? -1 : int(i / 10 - 1);
+		locals[i] = Local(rng);
+	}
+
+	std::vector<Matrix> worlds(count);
+	std::vector<std::array<float, 16>> uniforms(count);
+	auto t0 = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < count; i++) {
+			worlds[i] = parents[i] < 0 ? locals[i] : Multiply(worlds[parents[i]], locals[i]);
+			uniforms[i] = Floats(worlds[i]);
+		}
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	double traversal = std::chrono::duration<double, std::micro>(t1 - t0).count() / frames;
+
+	TransformHierarchy hierarchy;
+	std::vector<TransformHandle> handles(count);
+	for (size_t i = 0; i < count; i++) {
+		auto f = Floats(locals[i]);
+		handles[i] = hierarchy.allocate(parents[i] < 0 ? TransformHierarchy::ROOT : handles[parents[i]], f.data());
+	}
+	hierarchy.set(handles[0], Floats(locals[0]).data());
+	hierarchy.update();
+
+	std::cout << count << " transforms, microseconds per frame:" << std::endl;
+	std::cout << "  traversal, all worlds recomputed: " << traversal << std::endl;
+
+	for (double moving : { 0.0, 0.01, 0.1, 1.0 }) {
+		std::vector<std::array<float, 16>> sets(frames * size_t(count * moving));
+		std::vector<size_t> moved(sets.size());
+		for (size_t i = 0; i < sets.size(); i++) {
+			moved[i] = rng() % count;
+			sets[i] = Floats(Local(rng));
+		}
+		uint64_t updated = hierarchy.updated;
+		size_t next = 0;
+		double set = 0.0, update = 0.0;
+		for (int frame = 0; frame < frames; frame++) {
+			t0 = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < size_t(count * moving); i++, next++) {
+				hierarchy.set(handles[moved[next]], sets[next].data());
+			}
+			t1 = std::chrono::steady_clock::now();
+			hierarchy.update();
+			auto t2 = std::chrono::steady_clock::now();
+			set += std::chrono::duration<double, std::micro>(t1 - t0).count();
+			update += std::chrono::duration<double, std::micro>(t2 - t1).count();
+		}
+		std::cout << "  cached, " << moving * 100.0 << "% set at random: set " << set / frames
+			<< ", update " << update / frames << ", " << (hierarchy.updated - updated) / frames
+			<< " worlds recomputed" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <Innovator/MeshCache.h>
+
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <exception>
+#include <filesystem>
+
+// Converts STL files to mesh caches ahead of time, the viewer builds the same files on first load.
+//   meshcache [--normals] [--levels n] input.stl [output]
+int main(int argc, char* argv[])
+{
+	bool normals = false;
+	size_t levels = 1;
+	std::filesystem::path input, output;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--normals") {
+			normals = true;
+		}
+		else if (arg == "--levels" && i + 1 < argc) {
+			levels = std::max(std::stoul(argv[++i]), 1ul);
+		}
+		else if (input.empty()) {
+			input = arg;
+		}
+		else if (output.empty()) {
+			output = arg;
+		}
+		else {
+			input.clear();
+			break;
+		}
+	}
+	if (input.empty()) {
+		std::cerr << "usage: meshcache [--normals] [--levels n] input.stl [output]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (output.empty()) {
+		output = MeshCache::PathFor(input, normals);
+	}
+
+	try {
+		auto t0 = std::chrono::steady_clock::now();
+		StlMesh mesh = StlLoader::Load(input, normals);
+		auto t1 = std::chrono::steady_clock::now();
+		auto contents = MeshCache::Build(mesh, levels, &std::cout);
+		auto t2 = std::chrono::steady_clock::now();
+		MeshCache::Write(*contents, MeshCache::Stamp(input), output);
+		auto t3 = std::chrono::steady_clock::now();
+
+		auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		std::cout << input.string() << ": " << mesh.triangleCount() << " triangles, " << mesh.vertexCount() << " vertices, "
+			<< contents->levelCount() << " levels" << std::endl;
+		std::cout << output.string() << ": " << std::filesystem::file_size(output) << " bytes" << std::endl;
+		std::cout << "parse " << ms(t1 - t0) << " ms, build " << ms(t2 - t1) << " ms, write " << ms(t3 - t2) << " ms" << std::endl;
+	}
+	catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,559 @@
+#include <Innovator/Allocator.h>
+
+#include <map>
+#include <deque>
+#include <set>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// reference model of a range allocator: live allocations by offset
+class Reference {
+public:
+	explicit Reference(uint64_t size) : size(size) {}
+
+	bool overlaps(uint64_t offset, uint64_t length) const
+	{
+		auto next = this->live.lower_bound(offset);
+		if (next != this->live.end() && next->first < offset + length) {
+			return true;
+		}
+		if (next != this->live.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second > offset) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// true if some gap can hold size bytes at the given alignment
+	bool fits(uint64_t length, uint64_t alignment) const
+	{
+		uint64_t begin = 0;
+		auto check = [&](uint64_t end) {
+			uint64_t aligned = (begin + alignment - 1) & ~(alignment - 1);
+			return aligned + length <= end;
+		};
+		for (auto& [offset, bytes] : this->live) {
+			if (check(offset)) {
+				return true;
+			}
+			begin = offset + bytes;
+		}
+		return check(this->size);
+	}
+
+	uint64_t used() const
+	{
+		uint64_t sum = 0;
+		for (auto& [offset, bytes] : this->live) {
+			sum += bytes;
+		}
+		return sum;
+	}
+
+	uint64_t size;
+	std::map<uint64_t, uint64_t> live;
+};
+
+// runs random allocate/free against the reference, checking placement and the fit guarantee
+static bool stress(uint64_t size, uint32_t seed, int operations, uint64_t max_size, uint64_t max_alignment)
+{
+	std::mt19937 rng(seed);
+	TlsfAllocator tlsf(size);
+	Reference reference(size);
+
+	for (int i = 0; i < operations; i++) {
+		bool allocate = reference.live.empty() || (rng() % 100) < 55;
+		if (allocate) {
+			uint64_t length = 1 + rng() % max_size;
+			uint64_t alignment = uint64_t(1) << (rng() % (std::bit_width(max_alignment)));
+			bool fits = reference.fits(length, alignment);
+			auto offset = tlsf.allocate(length, alignment);
+			if (offset.has_value() != fits) {
+				std::cout << "fit mismatch for " << length << " @ " << alignment << std::endl;
+				return false;
+			}
+			if (!offset) {
+				continue;
+			}
+			if (*offset % alignment || *offset + length > size || reference.overlaps(*offset, length)) {
+				std::cout << "bad placement " << *offset << " + " << length << std::endl;
+				return false;
+			}
+			reference.live[*offset] = length;
+		}
+		else {
+			auto it = reference.live.begin();
+			std::advance(it, rng() % reference.live.size());
+			tlsf.free(it->first);
+			reference.live.erase(it);
+		}
+		if (tlsf.used() != reference.used() || tlsf.allocationCount() != reference.live.size()) {
+			std::cout << "accounting mismatch" << std::endl;
+			return false;
+		}
+	}
+
+	for (auto& [offset, length] : reference.live) {
+		tlsf.free(offset);
+	}
+	return tlsf.empty() && tlsf.freeRegionCount() == 1 && tlsf.largestFreeRegion() == size;
+}
+
+// stands in for the device: hands out block handles and records what is live
+class FakeDevice {
+public:
+	MemoryAllocator::CreateBlock create()
+	{
+		return [this](uint32_t type, uint32_t flags, uint64_t size) {
+			if (size > this->limit) {
+				throw std::runtime_error("out of device memory");
+			}
+			uint64_t handle = ++this->next;
+			this->blocks[handle] = { type, flags, size };
+			this->created++;
+			return handle;
+		};
+	}
+
+	MemoryAllocator::DestroyBlock destroy()
+	{
+		return [this](uint64_t handle) {
+			this->blocks.erase(handle);
+		};
+	}
+
+	struct Block {
+		uint32_t type;
+		uint32_t flags;
+		uint64_t size;
+	};
+
+	uint64_t next{ 0 };
+	uint64_t created{ 0 };
+	uint64_t limit{ std::numeric_limits<uint64_t>::max() };
+	std::map<uint64_t, Block> blocks;
+};
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "size classes are monotonic and contiguous" << std::endl;
+		uint32_t prev = 0;
+		for (uint64_t size = 1; size < (1 << 20); size++) {
+			uint32_t fl, sl;
+			TlsfAllocator::mapping(size, fl, sl);
+			uint32_t list = fl * TlsfAllocator::SL_COUNT + sl;
+			if (sl >= TlsfAllocator::SL_COUNT || list < prev || list > prev + 1) {
+				return false;
+			}
+			prev = list;
+		}
+		return true;
+	},
+	[] {
+		std::cout << "one allocation can take the whole range" << std::endl;
+		TlsfAllocator tlsf(1000);
+		auto a = tlsf.allocate(1000);
+		auto b = tlsf.allocate(1);
+		bool full = a && *a == 0 && !b && tlsf.available() == 0 && tlsf.freeRegionCount() == 0;
+		tlsf.free(*a);
+		return full && tlsf.largestFreeRegion() == 1000;
+	},
+	[] {
+		std::cout << "requests larger than the range fail" << std::endl;
+		TlsfAllocator tlsf(256);
+		bool large = !tlsf.allocate(257).has_value();
+		auto aligned = tlsf.allocate(256, 512);
+		return large && aligned && *aligned == 0;
+	},
+	[] {
+		std::cout << "every power of two alignment is honoured" << std::endl;
+		for (uint64_t alignment = 1; alignment <= 65536; alignment *= 2) {
+			TlsfAllocator tlsf(1 << 20);
+			tlsf.allocate(1);
+			for (uint64_t size : { 1, 3, 64, 1000, 4097 }) {
+				auto offset = tlsf.allocate(size, alignment);
+				if (!offset || *offset % alignment) {
+					return false;
+				}
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "non power of two alignment throws" << std::endl;
+		TlsfAllocator tlsf(1024);
+		try {
+			tlsf.allocate(16, 24);
+		}
+		catch (std::invalid_argument&) {
+			return true;
+		}
+		return false;
+	},
+	[] {
+		std::cout << "freeing an unknown offset throws" << std::endl;
+		TlsfAllocator tlsf(1024);
+		tlsf.allocate(16);
+		try {
+			tlsf.free(8);
+		}
+		catch (std::invalid_argument&) {
+			return true;
+		}
+		return false;
+	},
+	[] {
+		std::cout << "neighbours coalesce in any free order" << std::endl;
+		std::vector<int> order{ 0, 1, 2, 3, 4 };
+		do {
+			TlsfAllocator tlsf(500);
+			std::vector<uint64_t> offsets;
+			for (int i = 0; i < 5; i++) {
+				offsets.push_back(*tlsf.allocate(100));
+			}
+			for (int i : order) {
+				tlsf.free(offsets[i]);
+			}
+			if (tlsf.freeRegionCount() != 1 || tlsf.largestFreeRegion() != 500) {
+				return false;
+			}
+		} while (std::next_permutation(order.begin(), order.end()));
+		return true;
+	},
+	[] {
+		std::cout << "exhaustive pairs on a small range: placement and fit guarantee" << std::endl;
+		const uint64_t size = 48;
+		for (uint64_t a = 1; a <= size; a++) {
+			for (uint64_t align_a : { 1, 2, 4, 8, 16 }) {
+				for (uint64_t b = 1; b <= size; b++) {
+					for (uint64_t align_b : { 1, 2, 4, 8, 16, 32 }) {
+						TlsfAllocator tlsf(size);
+						Reference reference(size);
+						for (auto [length, alignment] : { std::pair{ a, align_a }, std::pair{ b, align_b } }) {
+							bool fits = reference.fits(length, alignment);
+							auto offset = tlsf.allocate(length, alignment);
+							if (offset.has_value() != fits) {
+								return false;
+							}
+							if (offset) {
+								if (*offset % alignment || reference.overlaps(*offset, length)) {
+									return false;
+								}
+								reference.live[*offset] = length;
+							}
+						}
+					}
+				}
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "random stress against the reference, small sizes" << std::endl;
+		for (uint32_t seed = 0; seed < 8; seed++) {
+			if (!stress(4096, seed, 20000, 64, 64)) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "random stress against the reference, mixed sizes" << std::endl;
+		for (uint32_t seed = 100; seed < 104; seed++) {
+			if (!stress(uint64_t(1) << 24, seed, 20000, 1 << 18, 1 << 16)) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "allocations are visited in address order" << std::endl;
+		TlsfAllocator tlsf(1 << 16);
+		std::vector<uint64_t> offsets;
+		for (int i = 0; i < 32; i++) {
+			offsets.push_back(*tlsf.allocate(100 + i, 16));
+		}
+		for (int i = 0; i < 32; i += 3) {
+			tlsf.free(offsets[i]);
+		}
+		std::vector<uint64_t> visited;
+		tlsf.forEachAllocation([&](uint64_t offset, uint64_t, uint64_t) {
+			visited.push_back(offset);
+			});
+		return visited.size() == tlsf.allocationCount() && std::is_sorted(visited.begin(), visited.end());
+	},
+	[] {
+		std::cout << "small requests share a block, blocks grow on demand" << std::endl;
+		FakeDevice device;
+		{
+			MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+			std::vector<MemoryAllocator::Allocation> allocations;
+			for (int i = 0; i < 8; i++) {
+				allocations.push_back(allocator.allocate({ .size = 128, .alignment = 64, .memory_type = 2 }));
+			}
+			bool one = device.blocks.size() == 1;
+			allocations.push_back(allocator.allocate({ .size = 128, .alignment = 64, .memory_type = 2 }));
+			bool two = device.blocks.size() == 2;
+			auto stats = allocator.stats();
+			if (!one || !two || stats.allocations != 9 || stats.blocks != 2 || stats.used != 9 * 128) {
+				return false;
+			}
+		}
+		return device.blocks.empty();
+	},
+	[] {
+		std::cout << "empty blocks are released, the last one is kept" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		auto a = allocator.allocate({ .size = 512 });
+		auto b = allocator.allocate({ .size = 512 });
+		auto c = allocator.allocate({ .size = 512 });
+		bool two = device.blocks.size() == 2;
+		allocator.free(c);
+		bool one = device.blocks.size() == 1;
+		allocator.free(a);
+		allocator.free(b);
+		return two && one && device.blocks.size() == 1 && allocator.stats().allocations == 0;
+	},
+	[] {
+		std::cout << "large requests get a dedicated allocation" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		auto large = allocator.allocate({ .size = 4000 });
+		auto forced = allocator.allocate({ .size = 16, .dedicated = true });
+		bool dedicated = large.dedicated && forced.dedicated && large.offset == 0 &&
+			device.blocks.at(large.block).size == 4000 && allocator.stats().dedicated == 2;
+		allocator.free(large);
+		allocator.free(forced);
+		return dedicated && device.blocks.empty();
+	},
+	[] {
+		std::cout << "linear and optimal resources are kept apart when granularity > 1" << std::endl;
+		FakeDevice shared;
+		MemoryAllocator a(shared.create(), shared.destroy(), 1024, 1);
+		a.allocate({ .size = 64, .kind = MemoryAllocator::ResourceKind::LINEAR });
+		a.allocate({ .size = 64, .kind = MemoryAllocator::ResourceKind::OPTIMAL });
+
+		FakeDevice separate;
+		MemoryAllocator b(separate.create(), separate.destroy(), 1024, 1024);
+		auto buffer = b.allocate({ .size = 64, .kind = MemoryAllocator::ResourceKind::LINEAR });
+		auto image = b.allocate({ .size = 64, .kind = MemoryAllocator::ResourceKind::OPTIMAL });
+
+		return shared.blocks.size() == 1 && separate.blocks.size() == 2 && buffer.block != image.block;
+	},
+	[] {
+		std::cout << "memory types and allocate flags get their own blocks" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		auto a = allocator.allocate({ .size = 64, .memory_type = 0 });
+		auto b = allocator.allocate({ .size = 64, .memory_type = 1 });
+		auto c = allocator.allocate({ .size = 64, .memory_type = 1, .flags = 2 });
+		return device.blocks.size() == 3 &&
+			device.blocks.at(a.block).type == 0 &&
+			device.blocks.at(b.block).type == 1 &&
+			device.blocks.at(c.block).flags == 2;
+	},
+	[] {
+		std::cout << "block creation retries with smaller blocks" << std::endl;
+		FakeDevice device;
+		device.limit = 300;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		auto a = allocator.allocate({ .size = 100 });
+		bool smaller = device.blocks.at(a.block).size == 256;
+		try {
+			allocator.allocate({ .size = 400 });
+		}
+		catch (std::runtime_error&) {
+			return smaller;
+		}
+		return false;
+	},
+	[] {
+		std::cout << "defragmentation empties the least used block" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		std::vector<MemoryAllocator::Allocation> allocations;
+		for (int i = 0; i < 24; i++) {
+			allocations.push_back(allocator.allocate({ .size = 128, .alignment = 128 }));
+		}
+		// leave a few allocations scattered across three blocks
+		std::vector<MemoryAllocator::Allocation> live;
+		for (size_t i = 0; i < allocations.size(); i++) {
+			if (i % 4 == 0 || i == 23) {
+				live.push_back(allocations[i]);
+			}
+			else {
+				allocator.free(allocations[i]);
+			}
+		}
+		size_t blocks = device.blocks.size();
+		auto moves = allocator.defragment();
+		for (auto& move : moves) {
+			if (move.src.block == move.dst.block || move.dst.size != move.src.size) {
+				return false;
+			}
+			allocator.free(move.src);
+		}
+		auto stats = allocator.stats();
+		return blocks == 3 && !moves.empty() && device.blocks.size() < blocks && stats.allocations == live.size();
+	},
+	[] {
+		std::cout << "defragmentation plans nothing if the block can't be emptied" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		allocator.allocate({ .size = 512 });
+		allocator.allocate({ .size = 512 });
+		allocator.allocate({ .size = 512 });
+		auto moves = allocator.defragment();
+		auto stats = allocator.stats();
+		return moves.empty() && stats.allocations == 3 && stats.used == 1536;
+	},
+	[] {
+		std::cout << "fragmentation is zero for one free region" << std::endl;
+		FakeDevice device;
+		MemoryAllocator allocator(device.create(), device.destroy(), 1024);
+		auto a = allocator.allocate({ .size = 256 });
+		auto b = allocator.allocate({ .size = 256 });
+		auto c = allocator.allocate({ .size = 256 });
+		// the one in the middle leaves a hole when freed
+		bool contiguous = allocator.stats().fragmentation() == 0.0 &&
+			a.offset < b.offset && b.offset < c.offset && a.block == c.block;
+		allocator.free(b);
+		return contiguous && allocator.stats().fragmentation() == 0.5;
+	},
+	[] {
+		std::cout << "staging ring refuses when full and reclaims completed batches" << std::endl;
+		StagingRing ring(256);
+		auto a = ring.allocate(128);
+		auto b = ring.allocate(128);
+		auto c = ring.allocate(1);
+		ring.close(1);
+		bool full = a == 0u && b == 128u && !c && ring.used() == 256;
+		bool early = ring.reclaim(0) == 0;
+		bool released = ring.reclaim(1) == 256 && ring.used() == 0 && ring.pending() == 0;
+		return full && early && released && ring.allocate(256).has_value();
+	},
+	[] {
+		std::cout << "staging ring ranges never wrap around the end" << std::endl;
+		StagingRing ring(100);
+		auto a = ring.allocate(60);
+		ring.close(1);
+		auto b = ring.allocate(30);
+		ring.close(2);
+		bool blocked = !ring.allocate(50).has_value();
+		ring.reclaim(1);
+		auto c = ring.allocate(50);
+		// the 10 bytes skipped at the end are in use until the batch completes
+		return a == 0u && b == 60u && blocked && c == 0u && ring.used() == 90;
+	},
+	[] {
+		std::cout << "staging ring honours texel sized alignments" << std::endl;
+		StagingRing ring(1024);
+		ring.allocate(5);
+		auto a = ring.allocate(24, 12);
+		auto b = ring.allocate(16, 16);
+		return a == 12u && b == 48u;
+	},
+	[] {
+		std::cout << "staging ring random batches never overlap in flight ranges" << std::endl;
+		std::mt19937 rng(7);
+		const uint64_t capacity = 4096;
+		StagingRing ring(capacity);
+		// in flight ranges by batch serial, the GPU completes batches in order some time later
+		std::deque<std::pair<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>>> batches;
+		std::vector<std::pair<uint64_t, uint64_t>> current;
+		uint64_t serial = 0;
+		uint64_t completed = 0;
+
+		auto overlaps = [&](uint64_t offset, uint64_t size) {
+			auto test = [&](const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+				for (auto& [o, s] : ranges) {
+					if (offset < o + s && o < offset + size) {
+						return true;
+					}
+				}
+				return false;
+			};
+			for (auto& batch : batches) {
+				if (test(batch.second)) {
+					return true;
+				}
+			}
+			return test(current);
+		};
+
+		for (int i = 0; i < 20000; i++) {
+			switch (rng() % 4) {
+			case 0:
+			case 1: {
+				uint64_t size = 1 + rng() % 700;
+				uint64_t alignment = 1 + rng() % 16;
+				auto offset = ring.allocate(size, alignment);
+				if (offset) {
+					if (*offset % alignment || *offset + size > capacity || overlaps(*offset, size)) {
+						return false;
+					}
+					current.push_back({ *offset, size });
+				}
+				break;
+			}
+			case 2:
+				ring.close(++serial);
+				batches.push_back({ serial, std::move(current) });
+				current.clear();
+				break;
+			default:
+				if (completed < serial) {
+					completed += 1 + rng() % (serial - completed);
+					ring.reclaim(completed);
+					while (!batches.empty() && batches.front().first <= completed) {
+						batches.pop_front();
+					}
+				}
+				break;
+			}
+		}
+		ring.close(++serial);
+		ring.reclaim(serial);
+		return ring.used() == 0 && ring.allocate(capacity).has_value();
+	},
+};
+
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+#include <Innovator/AssetLoader.h>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+using namespace std::chrono_literals;
+
+// stands in for reading and decoding a file, takes a while and fills in its result
+struct FakeAsset {
+	std::chrono::milliseconds duration{ 0 };
+	bool fail{ false };
+	std::atomic<bool> loaded{ false };
+
+	void read()
+	{
+		std::this_thread::sleep_for(this->duration);
+		if (this->fail) {
+			throw std::runtime_error("corrupt file");
+		}
+		this->loaded = true;
+	}
+};
+
+// holds reads until opened, to control what is in flight when
+class Gate {
+public:
+	void pass()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->waiting++;
+		this->changed.notify_all();
+		this->changed.wait(lock, [this] { return this->opened; });
+	}
+
+	void waitFor(size_t count)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->changed.wait(lock, [&] { return this->waiting >= count; });
+	}
+
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->opened = true;
+		this->changed.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	size_t waiting{ 0 };
+	bool opened{ false };
+};
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "every asset is read once" << std::endl;
+		std::vector<FakeAsset> assets(32);
+		AssetLoader loader(4);
+		for (size_t i = 0; i < assets.size(); i++) {
+			loader.load("asset" + std::to_string(i), [&asset = assets[i]] { asset.read(); });
+		}
+		AssetProgress progress = loader.wait();
+		bool all = std::all_of(assets.begin(), assets.end(), [](auto& asset) { return asset.loaded.load(); });
+		return all && progress.total == 32 && progress.loaded == 32 && progress.done();
+	},
+	[] {
+		std::cout << "loading takes about as long as the slowest asset" << std::endl;
+		std::vector<FakeAsset> assets(8);
+		for (size_t i = 0; i < assets.size(); i++) {
+			assets[i].duration = std::chrono::milliseconds(20 + 10 * i);
+		}
+		// 20 + 30 + ... + 90 = 440ms one after the other, the slowest is 90ms
+		AssetLoader loader(assets.size());
+		auto start = std::chrono::steady_clock::now();
+		for (auto& asset : assets) {
+			loader.load("asset", [&asset] { asset.read(); });
+		}
+		loader.wait();
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms" << std::endl;
+		return elapsed >= 90ms && elapsed < 300ms;
+	},
+	[] {
+		std::cout << "failed reads are reported by name after the others finish" << std::endl;
+		std::vector<FakeAsset> assets(6);
+		assets[2].fail = true;
+		assets[4].fail = true;
+		AssetLoader loader(2);
+		for (size_t i = 0; i < assets.size(); i++) {
+			loader.load("mesh" + std::to_string(i) + ".stl", [&asset = assets[i]] { asset.read(); });
+		}
+		std::string message;
+		try {
+			loader.wait();
+		}
+		catch (std::runtime_error& e) {
+			message = e.what();
+		}
+		size_t loaded = std::count_if(assets.begin(), assets.end(), [](auto& asset) { return asset.loaded.load(); });
+		return loaded == 4 &&
+			message.find("2 asset(s)") != std::string::npos &&
+			message.find("mesh2.stl: corrupt file") != std::string::npos &&
+			message.find("mesh4.stl: corrupt file") != std::string::npos;
+	},
+	[] {
+		std::cout << "cancel skips reads that haven't started" << std::endl;
+		Gate gate;
+		std::atomic<size_t> reads{ 0 };
+		AssetLoader loader(2);
+		for (size_t i = 0; i < 10; i++) {
+			loader.load("asset", [&] { reads++; gate.pass(); });
+		}
+		// both workers are inside a read, the other eight are queued
+		gate.waitFor(2);
+		loader.cancel();
+		gate.open();
+		AssetProgress progress = loader.wait();
+		return reads == 2 && progress.loaded == 2 && progress.cancelled == 8 && progress.done();
+	},
+	[] {
+		std::cout << "progress is reported as assets complete, ending with all of them" << std::endl;
+		std::vector<FakeAsset> assets(12);
+		for (size_t i = 0; i < assets.size(); i++) {
+			assets[i].duration = std::chrono::milliseconds(i);
+		}
+		AssetLoader loader(3);
+		for (auto& asset : assets) {
+			loader.load("asset", [&asset] { asset.read(); });
+		}
+		std::vector<AssetProgress> reports;
+		loader.wait([&](const AssetProgress& progress) { reports.push_back(progress); });
+
+		bool increasing = true;
+		for (size_t i = 1; i < reports.size(); i++) {
+			increasing = increasing && reports[i].loaded > reports[i - 1].loaded;
+		}
+		return !reports.empty() && increasing && reports.back().loaded == 12 && reports.back().done();
+	},
+	[] {
+		std::cout << "the loader takes new assets after a wait" << std::endl;
+		AssetLoader loader(2);
+		std::vector<FakeAsset> first(3), second(5);
+		for (auto& asset : first) {
+			loader.load("first", [&asset] { asset.read(); });
+		}
+		AssetProgress a = loader.wait();
+		loader.cancel();
+		loader.wait();
+		for (auto& asset : second) {
+			loader.load("second", [&asset] { asset.read(); });
+		}
+		AssetProgress b = loader.wait();
+		// a wait also clears a cancel
+		return a.loaded == 3 && b.total == 5 && b.loaded == 5 && b.cancelled == 0;
+	},
+	[] {
+		std::cout << "waiting on nothing returns right away" << std::endl;
+		AssetLoader loader(1);
+		size_t reports = 0;
+		AssetProgress progress = loader.wait([&](const AssetProgress&) { reports++; });
+		return progress.total == 0 && progress.done() && reports == 1;
+	},
+	[] {
+		std::cout << "destroying the loader finishes reads in flight and drops the rest" << std::endl;
+		std::vector<FakeAsset> assets(20);
+		for (auto& asset : assets) {
+			asset.duration = 5ms;
+		}
+		{
+			AssetLoader loader(2);
+			for (auto& asset : assets) {
+				loader.load("asset", [&asset] { asset.read(); });
+			}
+			std::this_thread::sleep_for(2ms);
+		}
+		size_t loaded = std::count_if(assets.begin(), assets.end(), [](auto& asset) { return asset.loaded.load(); });
+		return loaded >= 1 && loaded < assets.size();
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
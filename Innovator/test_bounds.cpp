@@ -0,0 +1,296 @@
+#include <Innovator/Bounds.h>
+#include <Innovator/Testing.h>
+
+#include <set>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+static Matrix4 Scale(double x, double y, double z)
+{
+	Matrix4 m = Identity();
+	m[0] = x;
+	m[5] = y;
+	m[10] = z;
+	return m;
+}
+
+static Matrix4 RotateZ(double angle)
+{
+	Matrix4 m = Identity();
+	m[0] = std::cos(angle);
+	m[1] = std::sin(angle);
+	m[4] = -std::sin(angle);
+	m[5] = std::cos(angle);
+	return m;
+}
+
+static Frustum Camera(const Point3& eye, const Point3& center)
+{
+	return Frustum(Multiply(Perspective(0.7, 16.0 / 9.0, 0.1, 100.0), LookAt(eye, center, { 0, 0, 1 })));
+}
+
+static BoundingBox Cube(double x, double y, double z, double size = 1.0)
+{
+	return BoundingBox({ x, y, z }, { x + size, y + size, z + size });
+}
+
+static bool Culled(const Frustum& frustum, const BoundingBox& box)
+{
+	uint32_t mask = Frustum::ALL_PLANES;
+	return frustum.cull(box, mask);
+}
+
+// a synthetic scene graph, traversed the way Separator traverses the render pass
+struct TestNode {
+	int id{ -1 };
+	Matrix4 matrix{ Identity() };
+	std::optional<BoundingBox> leaf;
+	std::vector<std::shared_ptr<TestNode>> children;
+	SubtreeBounds subtree;
+};
+
+struct Traversal {
+	Frustum frustum;
+	uint64_t revision{ 0 };
+	size_t visited{ 0 };
+	std::set<int> drawn{};
+};
+
+static BoundingBox Render(TestNode& node, const Matrix4& parent, uint32_t planes, Traversal& traversal)
+{
+	traversal.visited++;
+	if (node.subtree.cull(traversal.frustum, planes, traversal.revision)) {
+		return node.subtree.bounds;
+	}
+	Matrix4 model = Multiply(parent, node.matrix);
+	BoundingBox bounds;
+	if (node.leaf) {
+		BoundingBox world = node.leaf->transformed(model);
+		bounds.extend(world);
+		uint32_t mask = planes;
+		if (!traversal.frustum.cull(world, mask)) {
+			traversal.drawn.insert(node.id);
+		}
+	}
+	for (auto& child : node.children) {
+		bounds.extend(Render(*child, model, planes, traversal));
+	}
+	node.subtree.update(bounds, traversal.revision);
+	return bounds;
+}
+
+static void BruteForce(const TestNode& node, const Matrix4& parent, const Frustum& frustum, std::set<int>& drawn)
+{
+	Matrix4 model = Multiply(parent, node.matrix);
+	if (node.leaf && !Culled(frustum, node.leaf->transformed(model))) {
+		drawn.insert(node.id);
+	}
+	for (auto& child : node.children) {
+		BruteForce(*child, model, frustum, drawn);
+	}
+}
+
+// 4 x 4 districts of 8 x 8 cells of 4 objects, with rotated and scaled cells
+static std::shared_ptr<TestNode> City(size_t& nodes)
+{
+	auto root = std::make_shared<TestNode>();
+	int id = 0;
+	nodes = 1;
+	for (int di = 0; di < 4; di++) {
+		for (int dj = 0; dj < 4; dj++) {
+			auto district = std::make_shared<TestNode>();
+			district->matrix = Translate(di * 80.0, dj * 80.0, 0);
+			nodes++;
+			for (int i = 0; i < 8; i++) {
+				for (int j = 0; j < 8; j++) {
+					auto cell = std::make_shared<TestNode>();
+					cell->matrix = Multiply(Translate(i * 10.0, j * 10.0, 0), Multiply(RotateZ((i + j) * 0.1), Scale(1, 1, 1 + (i % 3))));
+					for (int k = 0; k < 4; k++) {
+						auto object = std::make_shared<TestNode>();
+						object->id = id++;
+						object->leaf = Cube(k * 2.0, (k % 2) * 3.0, 0);
+						cell->children.push_back(object);
+					}
+					district->children.push_back(cell);
+					nodes += 5;
+				}
+			}
+			root->children.push_back(district);
+		}
+	}
+	return root;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "bounds of interleaved positions" << std::endl;
+		// position at offset 4 in a 20 byte vertex
+		std::vector<float> vertices{
+			9, 1, 2, 3, 9,
+			9, -1, 5, 0, 9,
+			9, 4, -2, 1, 9,
+		};
+		auto box = BoundingBox::FromPositions(reinterpret_cast<const char*>(vertices.data()), 3, 20, 4);
+		return box.min == Point3{ -1, -2, 0 } && box.max == Point3{ 4, 5, 3 } &&
+			BoundingBox::FromPositions(nullptr, 0, 12).empty();
+	},
+	[] {
+		std::cout << "transformed bounds contain the transformed corners, and no more" << std::endl;
+		BoundingBox box({ -1, 2, 0 }, { 3, 4, 1 });
+		Matrix4 m = Multiply(Translate(5, -2, 1), Multiply(RotateZ(0.5), Scale(2, 1, 3)));
+		BoundingBox expected;
+		for (int c = 0; c < 8; c++) {
+			Point3 p{ c & 1 ? box.max[0] : box.min[0], c & 2 ? box.max[1] : box.min[1], c & 4 ? box.max[2] : box.min[2] };
+			expected.extend(Point3{
+				m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+				m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+				m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14] });
+		}
+		auto result = box.transformed(m);
+		for (int i = 0; i < 3; i++) {
+			if (std::abs(result.min[i] - expected.min[i]) > 1e-12 || std::abs(result.max[i] - expected.max[i]) > 1e-12) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "empty and infinite bounds" << std::endl;
+		BoundingBox empty;
+		BoundingBox bounds = Cube(0, 0, 0);
+		bounds.extend(empty);
+		BoundingBox infinite = bounds;
+		infinite.extend(BoundingBox::Infinite());
+		return empty.empty() && empty.transformed(Translate(1, 2, 3)).empty() &&
+			bounds.min == Point3{ 0, 0, 0 } && bounds.max == Point3{ 1, 1, 1 } &&
+			infinite.infinite() && infinite.transformed(Scale(2, 2, 2)).infinite();
+	},
+	[] {
+		std::cout << "boxes are culled against each side of the frustum" << std::endl;
+		Frustum frustum = Camera({ 0, 0, 0 }, { 10, 0, 0 });
+		return !Culled(frustum, Cube(10, -0.5, -0.5)) &&  // ahead
+			Culled(frustum, Cube(-10, -0.5, -0.5)) &&      // behind
+			Culled(frustum, Cube(10, 50, 0)) &&            // left
+			Culled(frustum, Cube(10, -50, 0)) &&           // right
+			Culled(frustum, Cube(10, 0, 30)) &&            // above
+			Culled(frustum, Cube(10, 0, -30)) &&           // below
+			Culled(frustum, Cube(150, 0, 0)) &&            // beyond the far plane
+			!Culled(frustum, Cube(-1, -1, -1, 2)) &&       // around the eye
+			!Culled(frustum, Cube(95, -5, -5, 10)) &&      // across the far plane
+			!Culled(frustum, BoundingBox::Infinite()) &&
+			!Culled(Frustum(), Cube(-1000, 0, 0));
+	},
+	[] {
+		std::cout << "planes a box is inside of are dropped from the mask" << std::endl;
+		Frustum frustum = Camera({ 0, 0, 0 }, { 10, 0, 0 });
+		uint32_t inside = Frustum::ALL_PLANES;
+		uint32_t across = Frustum::ALL_PLANES;
+		// crosses the far plane only
+		bool culled = frustum.cull(Cube(10, -0.5, -0.5), inside) || frustum.cull(Cube(99.5, -0.5, -0.5), across);
+		return !culled && inside == 0 && across == (1u << 5);
+	},
+	[] {
+		std::cout << "hierarchical culling draws what a brute force test draws" << std::endl;
+		size_t nodes;
+		auto scene = City(nodes);
+		std::vector<std::pair<Point3, Point3>> cameras{
+			{ { -5, -5, 3 }, { 10, 10, 0 } },
+			{ { 160, 160, 50 }, { 160, 161, 0 } },
+			{ { 400, 160, 5 }, { 0, 160, 0 } },
+			{ { 100, 100, 2 }, { 100, 200, 2 } },
+		};
+		for (auto& [eye, center] : cameras) {
+			Traversal traversal{ .frustum = Camera(eye, center) };
+			Render(*scene, Identity(), Frustum::ALL_PLANES, traversal);
+			std::set<int> expected;
+			BruteForce(*scene, Identity(), traversal.frustum, expected);
+			if (traversal.drawn != expected || traversal.drawn.empty()) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "close up views skip most of the scene once bounds are cached" << std::endl;
+		size_t nodes;
+		auto scene = City(nodes);
+		Traversal first{ .frustum = Camera({ -5, -5, 3 }, { 10, 10, 0 }) };
+		Render(*scene, Identity(), Frustum::ALL_PLANES, first);
+		Traversal second{ .frustum = first.frustum };
+		Render(*scene, Identity(), Frustum::ALL_PLANES, second);
+		std::cout << "  drew " << second.drawn.size() << " of 4096 objects, visited "
+			<< second.visited << " of " << nodes << " nodes" << std::endl;
+		return first.visited == nodes && second.drawn == first.drawn &&
+			second.drawn.size() < 400 && second.visited < nodes / 4;
+	},
+	[] {
+		std::cout << "moved subtrees are found again when the revision changes" << std::endl;
+		auto root = std::make_shared<TestNode>();
+		auto group = std::make_shared<TestNode>();
+		auto object = std::make_shared<TestNode>();
+		object->id = 0;
+		object->leaf = Cube(0, 0, 0);
+		group->matrix = Translate(10, 50, 0);
+		group->children.push_back(object);
+		root->children.push_back(group);
+
+		Traversal traversal{ .frustum = Camera({ 0, 0, 0 }, { 10, 0, 0 }) };
+		Render(*root, Identity(), Frustum::ALL_PLANES, traversal);
+		bool hidden = traversal.drawn.empty();
+
+		group->matrix = Translate(10, -0.5, -0.5);
+		traversal.drawn.clear();
+		Render(*root, Identity(), Frustum::ALL_PLANES, traversal);
+		bool stale = traversal.drawn.empty();
+
+		traversal.revision++;
+		Render(*root, Identity(), Frustum::ALL_PLANES, traversal);
+		return hidden && stale && traversal.drawn == std::set<int>{ 0 };
+	},
+	[] {
+		std::cout << "subtrees with infinite bounds are always traversed" << std::endl;
+		TestNode node;
+		node.subtree.update(BoundingBox::Infinite(), 0);
+		uint32_t mask = Frustum::ALL_PLANES;
+		return !node.subtree.cull(Camera({ 0, 0, 0 }, { -10, 0, 0 }), mask, 0) && mask == Frustum::ALL_PLANES &&
+			!node.subtree.valid(1);
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
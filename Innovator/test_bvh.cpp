@@ -0,0 +1,345 @@
+#include <Innovator/Bvh.h>
+#include <Innovator/Testing.h>
+
+#include <set>
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+struct Mesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const
+	{
+		return this->vertices.size() / 3;
+	}
+};
+
+// a bumpy unit sphere of rings by segments quads, triangles in random order
+static Mesh Sphere(uint32_t rings, uint32_t segments)
+{
+	Mesh mesh;
+	for (uint32_t i = 0; i <= rings; i++) {
+		double theta = 3.14159265358979 * i / rings;
+		for (uint32_t j = 0; j < segments; j++) {
+			double phi = 2.0 * 3.14159265358979 * j / segments;
+			double r = 1.0 + 0.05 * std::sin(theta * 9.0) * std::cos(phi * 7.0);
+			mesh.vertices.insert(mesh.vertices.end(), {
+				float(r * std::sin(theta) * std::cos(phi)), float(r * std::cos(theta)), float(r * std::sin(theta) * std::sin(phi)) });
+		}
+	}
+	std::vector<std::array<uint32_t, 3>> triangles;
+	auto vertex = [segments](uint32_t i, uint32_t j) { return i * segments + j % segments; };
+	for (uint32_t i = 0; i < rings; i++) {
+		for (uint32_t j = 0; j < segments; j++) {
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+		}
+	}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(3));
+	for (auto& triangle : triangles) {
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	return mesh;
+}
+
+// rays from outside and inside the sphere in random directions, some axis aligned
+static std::vector<BvhRay> Rays(size_t count, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-1.5f, 1.5f);
+	std::normal_distribution<float> gaussian;
+	std::vector<BvhRay> rays;
+	for (size_t i = 0; i < count; i++) {
+		BvhRay ray;
+		ray.origin = { position(random), position(random), position(random) };
+		if (i % 5 == 0) {
+			ray.direction = { 0, 0, 0 };
+			ray.direction[i % 3] = (i % 2) ? 1.0f : -1.0f;
+		}
+		else if (i % 3 == 0) {
+			// at the sphere, most of these hit
+			ray.direction = { -ray.origin[0] + gaussian(random) * 0.2f, -ray.origin[1] + gaussian(random) * 0.2f, -ray.origin[2] + gaussian(random) * 0.2f };
+		}
+		else {
+			ray.direction = { gaussian(random), gaussian(random), gaussian(random) };
+		}
+		rays.push_back(ray);
+	}
+	return rays;
+}
+
+static std::optional<BvhHit> BruteForce(const Mesh& mesh, BvhRay ray)
+{
+	std::optional<BvhHit> hit;
+	for (size_t t = 0; t < mesh.indices.size() / 3; t++) {
+		float p[9];
+		for (size_t k = 0; k < 3; k++) {
+			std::copy(&mesh.vertices[mesh.indices[t * 3 + k] * 3], &mesh.vertices[mesh.indices[t * 3 + k] * 3] + 3, &p[k * 3]);
+		}
+		float d, u, v;
+		if (TriangleBvh::IntersectTriangle(p, ray, d, u, v)) {
+			ray.tmax = d;
+			hit = BvhHit{ static_cast<uint32_t>(t), d, u, v };
+		}
+	}
+	return hit;
+}
+
+// the same nearest distance, triangles may differ where the ray hits an edge two of them share
+static bool SameHit(const std::optional<BvhHit>& a, const std::optional<BvhHit>& b)
+{
+	return a.has_value() == b.has_value() && (!a || a->t == b->t);
+}
+
+static bool Matches(const TriangleBvh& bvh, const Mesh& mesh, const std::vector<BvhRay>& rays, size_t* hits = nullptr)
+{
+	bool same = true;
+	for (auto& ray : rays) {
+		auto hit = bvh.intersect(ray);
+		same = same && SameHit(hit, BruteForce(mesh, ray));
+		if (hits && hit) {
+			(*hits)++;
+		}
+	}
+	return same;
+}
+
+// every primitive in one leaf, children inside their parents
+static bool Valid(const Bvh& bvh)
+{
+	std::vector<uint32_t> seen(bvh.size(), 0);
+	bool valid = true;
+	auto inside = [](const BvhBox& inner, const BvhBox& outer) {
+		for (int k = 0; k < 3; k++) {
+			if (inner.min[k] < outer.min[k] || inner.max[k] > outer.max[k]) {
+				return false;
+			}
+		}
+		return true;
+	};
+	for (size_t i = 0; i < bvh.nodes.size(); i++) {
+		const BvhNode& node = bvh.nodes[i];
+		if (node.count) {
+			for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+				seen[bvh.primitives[slot]]++;
+				valid = valid && inside(bvh.boxes[bvh.primitives[slot]], node.box);
+			}
+		}
+		else {
+			valid = valid && node.first > i &&
+				inside(bvh.nodes[node.first].box, node.box) && inside(bvh.nodes[node.first + 1].box, node.box);
+		}
+	}
+	return valid && std::all_of(seen.begin(), seen.end(), [](uint32_t n) { return n == 1; });
+}
+
+static std::vector<BvhBox> Boxes(const Mesh& mesh)
+{
+	std::vector<BvhBox> boxes(mesh.indices.size() / 3);
+	for (size_t t = 0; t < boxes.size(); t++) {
+		for (size_t k = 0; k < 3; k++) {
+			boxes[t].extend(&mesh.vertices[mesh.indices[t * 3 + k] * 3]);
+		}
+	}
+	return boxes;
+}
+
+static Matrix4 Transform(double angle, double scale, const Point3& translation)
+{
+	double c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+	return {
+		c, 0, -s, 0,
+		0, scale, 0, 0,
+		s, 0, c, 0,
+		translation[0], translation[1], translation[2], 1,
+	};
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "rays hit the same nearest triangle as testing every triangle" << std::endl;
+		Mesh mesh = Sphere(30, 60);
+		TriangleBvh bvh(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices);
+		size_t hits = 0;
+		bool same = Matches(bvh, mesh, Rays(1500, 1), &hits);
+		std::cout << hits << " of 1500 rays hit" << std::endl;
+		return same && hits > 500 && hits < 1500;
+	},
+	[] {
+		std::cout << "a parallel build is a valid tree with the same hits" << std::endl;
+		// large enough for the top of the tree to be binned over the pool
+		Mesh mesh = Sphere(100, 200);
+		ThreadPool pool(4);
+		Bvh parallel(Boxes(mesh), &pool);
+		Bvh serial(Boxes(mesh));
+		TriangleBvh triangles(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, &pool);
+
+		Mesh small = Sphere(60, 120);
+		return Valid(parallel) && Valid(serial) && parallel.nodes.size() == serial.nodes.size() &&
+			Matches(triangles, mesh, Rays(50, 2)) &&
+			Matches(TriangleBvh(small.vertices.data(), small.vertexCount(), 3, small.indices, &pool), small, Rays(500, 3));
+	},
+	[] {
+		std::cout << "frustum culling finds the triangles whose boxes are not outside" << std::endl;
+		Mesh mesh = Sphere(50, 100);
+		std::vector<BvhBox> boxes = Boxes(mesh);
+		Bvh bvh(boxes);
+		bool same = true;
+		std::mt19937 random(5);
+		std::uniform_real_distribution<double> angle(0.0, 6.28);
+		for (int i = 0; i < 20; i++) {
+			// looking at the sphere from outside, with a narrow field of view so parts are culled
+			Matrix4 view = BvhScene::AffineInverse(Multiply(Transform(angle(random), 1.0, { 0, 0, 0 }), Transform(0, 1.0, { 0.3, 0.2, 3.0 }))).value();
+			Frustum frustum(Multiply(Perspective(0.3 + i * 0.02, 1.5, 0.1, 2.5 + i * 0.05), view));
+			std::set<uint32_t> visible;
+			bvh.cull(frustum, [&](uint32_t primitive) { visible.insert(primitive); });
+			std::set<uint32_t> expected;
+			for (uint32_t t = 0; t < boxes.size(); t++) {
+				uint32_t planes = Frustum::ALL_PLANES;
+				if (!frustum.cull(boxes[t].bounds(), planes)) {
+					expected.insert(t);
+				}
+			}
+			same = same && visible == expected && !expected.empty() && expected.size() < boxes.size();
+		}
+		return same;
+	},
+	[] {
+		std::cout << "refitting to moved vertices keeps the hits right" << std::endl;
+		Mesh mesh = Sphere(30, 60);
+		TriangleBvh bvh(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices);
+		for (size_t v = 0; v < mesh.vertexCount(); v++) {
+			float* p = &mesh.vertices[v * 3];
+			p[0] = p[0] * 1.3f + 0.2f * std::sin(p[1] * 4.0f);
+			p[1] *= 0.8f;
+		}
+		bvh.refit(mesh.vertices.data(), 3);
+		return Matches(bvh, mesh, Rays(1000, 4));
+	},
+	[] {
+		std::cout << "picking instances finds the nearest hit of all of them, and moving them refits" << std::endl;
+		Mesh sphere = Sphere(16, 32);
+		Mesh bumpy = Sphere(12, 20);
+		auto meshes = std::vector<std::shared_ptr<const TriangleBvh>>{
+			std::make_shared<TriangleBvh>(sphere.vertices.data(), sphere.vertexCount(), 3, sphere.indices),
+			std::make_shared<TriangleBvh>(bumpy.vertices.data(), bumpy.vertexCount(), 3, bumpy.indices),
+		};
+		const Mesh* sources[2]{ &sphere, &bumpy };
+
+		BvhScene scene;
+		std::mt19937 random(9);
+		std::uniform_real_distribution<double> position(-4.0, 4.0);
+		std::normal_distribution<double> gaussian;
+		bool same = true;
+		size_t hits = 0;
+		for (int frame = 0; frame < 4; frame++) {
+			std::vector<Matrix4> transforms;
+			scene.begin();
+			for (int i = 0; i < 30; i++) {
+				transforms.push_back(Transform(i + frame * 0.3, 0.3 + (i % 4) * 0.2, { (i % 6) * 1.2 - 3.0, (i / 6) * 1.2 - 3.0 + frame * 0.1, (i % 3) * 0.5 }));
+				scene.add(meshes[i % 2], transforms.back());
+			}
+			scene.end();
+
+			for (int r = 0; r < 300; r++) {
+				Point3 origin{ position(random), position(random), 6.0 };
+				Point3 direction{ gaussian(random) * 0.3, gaussian(random) * 0.3, -1.0 };
+				auto hit = scene.intersect(origin, direction);
+
+				// every triangle of every instance, in the instance's object space
+				std::optional<BvhSceneHit> expected;
+				float nearest = std::numeric_limits<float>::infinity();
+				for (size_t i = 0; i < transforms.size(); i++) {
+					const Matrix4 m = BvhScene::AffineInverse(transforms[i]).value();
+					BvhRay local{ .tmax = nearest };
+					for (int k = 0; k < 3; k++) {
+						local.origin[k] = float(m[k] * origin[0] + m[4 + k] * origin[1] + m[8 + k] * origin[2] + m[12 + k]);
+						local.direction[k] = float(m[k] * direction[0] + m[4 + k] * direction[1] + m[8 + k] * direction[2]);
+					}
+					if (auto h = BruteForce(*sources[i % 2], local)) {
+						nearest = h->t;
+						expected = BvhSceneHit{ .instance = i, .triangle = h->triangle, .t = h->t, .point = {} };
+					}
+				}
+				same = same && hit.has_value() == expected.has_value() &&
+					(!hit || (hit->t == expected->t && hit->instance == expected->instance));
+				if (hit) {
+					hits++;
+					double error = 0;
+					for (int k = 0; k < 3; k++) {
+						error = std::max(error, std::abs(hit->point[k] - (origin[k] + direction[k] * hit->t)));
+					}
+					same = same && error < 1e-9;
+				}
+			}
+		}
+		std::cout << hits << " of 1200 rays hit, " << scene.builds << " build, " << scene.refits << " refits" << std::endl;
+		return same && hits > 200 && scene.builds == 1 && scene.refits == 3 && scene.size() == 30;
+	},
+	[] {
+		std::cout << "degenerate meshes build and bad ones are reported" << std::endl;
+		// every triangle in one point, and on one line
+		Mesh point{ .vertices = { 1, 1, 1 }, .indices = std::vector<uint32_t>(300, 0) };
+		Mesh line;
+		for (uint32_t i = 0; i < 100; i++) {
+			line.vertices.insert(line.vertices.end(), { float(i), 0, 0 });
+			line.indices.insert(line.indices.end(), { i, i, i });
+		}
+		Mesh single{ .vertices = { 0, 0, 0, 1, 0, 0, 0, 1, 0 }, .indices = { 0, 1, 2 } };
+		TriangleBvh points(point.vertices.data(), 1, 3, point.indices);
+		TriangleBvh lines(line.vertices.data(), line.vertexCount(), 3, line.indices);
+		TriangleBvh one(single.vertices.data(), 3, 3, single.indices);
+		TriangleBvh none(nullptr, 0, 3, {});
+
+		BvhRay ray{ .origin = { 0.25f, 0.25f, 1.0f }, .direction = { 0, 0, -1 } };
+		auto hit = one.intersect(ray);
+		size_t visible = 0;
+		one.cull(Frustum(), [&](uint32_t) { visible++; });
+		return hit && visible == 1 && hit->t == 1.0f && hit->u == 0.25f && hit->v == 0.25f &&
+			!points.intersect(ray) && !lines.intersect(ray) && !none.intersect(ray) &&
+			none.bounds().empty() && one.bounds().max[1] == 1.0 &&
+			Throws([] { float v[3]{}; TriangleBvh(v, 1, 3, { 0, 0 }); }) &&
+			Throws([] { float v[3]{}; TriangleBvh(v, 1, 3, { 0, 0, 1 }); }) &&
+			Throws([] { Bvh bvh({ BvhBox() }); bvh.refit({}); });
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
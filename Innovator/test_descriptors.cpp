@@ -0,0 +1,398 @@
+#include <Innovator/Descriptors.h>
+
+#include <map>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// descriptor type and stage values as in vulkan_core.h
+constexpr uint32_t SAMPLER = 0;
+constexpr uint32_t COMBINED_IMAGE_SAMPLER = 1;
+constexpr uint32_t UNIFORM_BUFFER = 6;
+constexpr uint32_t UNIFORM_BUFFER_DYNAMIC = 8;
+constexpr uint32_t VERTEX = 0x1;
+constexpr uint32_t FRAGMENT = 0x10;
+
+// stands in for vkCreateDescriptorPool, records what the chain asked for
+class FakeDevice {
+public:
+	DescriptorPoolChain chain(uint32_t initial_sets = 4, uint32_t max_sets = 16)
+	{
+		return DescriptorPoolChain(
+			[this](uint32_t max_sets, const DescriptorPoolChain::Counts& sizes) {
+				this->created.push_back({ max_sets, sizes });
+				this->live++;
+				return static_cast<uint64_t>(this->created.size());
+			},
+			[this](uint64_t) {
+				this->live--;
+			},
+			initial_sets,
+			max_sets);
+	}
+
+	std::vector<std::pair<uint32_t, DescriptorPoolChain::Counts>> created;
+	int live{ 0 };
+};
+
+// the bindings of the shape shaders: transforms in a dynamic uniform buffer, a texture
+static DescriptorLayoutKey ShapeLayout()
+{
+	return DescriptorLayoutKey({
+		{ .binding = 0, .type = UNIFORM_BUFFER_DYNAMIC, .count = 1, .stages = VERTEX },
+		{ .binding = 1, .type = COMBINED_IMAGE_SAMPLER, .count = 1, .stages = FRAGMENT },
+		});
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "layout keys don't depend on binding order" << std::endl;
+		DescriptorLayoutKey a({
+			{ 0, UNIFORM_BUFFER, 1, VERTEX },
+			{ 1, COMBINED_IMAGE_SAMPLER, 1, FRAGMENT },
+			});
+		DescriptorLayoutKey b({
+			{ 1, COMBINED_IMAGE_SAMPLER, 1, FRAGMENT },
+			{ 0, UNIFORM_BUFFER, 1, VERTEX },
+			});
+		return a == b && a.hash() == b.hash();
+	},
+	[] {
+		std::cout << "layout keys differ in type, count, stages and binding" << std::endl;
+		DescriptorLayoutKey base({ { 0, UNIFORM_BUFFER, 1, VERTEX } });
+		std::vector<DescriptorLayoutKey> others{
+			DescriptorLayoutKey({ { 0, UNIFORM_BUFFER_DYNAMIC, 1, VERTEX } }),
+			DescriptorLayoutKey({ { 0, UNIFORM_BUFFER, 2, VERTEX } }),
+			DescriptorLayoutKey({ { 0, UNIFORM_BUFFER, 1, VERTEX | FRAGMENT } }),
+			DescriptorLayoutKey({ { 1, UNIFORM_BUFFER, 1, VERTEX } }),
+			DescriptorLayoutKey({ { 0, UNIFORM_BUFFER, 1, VERTEX }, { 1, SAMPLER, 1, VERTEX } }),
+		};
+		return std::none_of(others.begin(), others.end(), [&](const DescriptorLayoutKey& other) {
+			return other == base || other.hash() == base.hash();
+			});
+	},
+	[] {
+		std::cout << "descriptor counts of a layout are summed per type" << std::endl;
+		DescriptorLayoutKey key({
+			{ 0, UNIFORM_BUFFER, 1, VERTEX },
+			{ 1, UNIFORM_BUFFER, 3, FRAGMENT },
+			{ 2, COMBINED_IMAGE_SAMPLER, 2, FRAGMENT },
+			});
+		auto counts = key.descriptorCounts();
+		return counts.size() == 2 && counts[UNIFORM_BUFFER] == 4 && counts[COMBINED_IMAGE_SAMPLER] == 2;
+	},
+	[] {
+		std::cout << "pipeline layout keys keep set and push constant order" << std::endl;
+		PipelineLayoutKey a({ 1, 2 }, { { VERTEX, 0, 64 }, { FRAGMENT, 64, 16 } });
+		PipelineLayoutKey b({ 1, 2 }, { { VERTEX, 0, 64 }, { FRAGMENT, 64, 16 } });
+		PipelineLayoutKey swapped_sets({ 2, 1 }, { { VERTEX, 0, 64 }, { FRAGMENT, 64, 16 } });
+		PipelineLayoutKey swapped_ranges({ 1, 2 }, { { FRAGMENT, 64, 16 }, { VERTEX, 0, 64 } });
+		PipelineLayoutKey no_ranges({ 1, 2 }, {});
+		return a == b && a.hash() == b.hash() &&
+			!(a == swapped_sets) && !(a == swapped_ranges) && !(a == no_ranges);
+	},
+	[] {
+		std::cout << "set keys are equal for the same resources in any order" << std::endl;
+		DescriptorResourceKey uniforms{ .binding = 0, .type = UNIFORM_BUFFER_DYNAMIC, .buffer = 7, .offset = 0, .range = 256 };
+		DescriptorResourceKey texture{ .binding = 1, .type = COMBINED_IMAGE_SAMPLER, .sampler = 3, .view = 4, .image_layout = 5 };
+		DescriptorSetKey a(100, { uniforms, texture });
+		DescriptorSetKey b(100, { texture, uniforms });
+		return a == b && a.hash() == b.hash();
+	},
+	[] {
+		std::cout << "set keys differ in layout and in every resource field" << std::endl;
+		DescriptorResourceKey resource{ .binding = 0, .type = UNIFORM_BUFFER, .buffer = 7, .offset = 0, .range = 256 };
+		DescriptorSetKey base(100, { resource });
+
+		std::vector<DescriptorSetKey> others{ DescriptorSetKey(101, { resource }) };
+		auto vary = [&](auto field, auto value) {
+			DescriptorResourceKey other = resource;
+			other.*field = value;
+			others.push_back(DescriptorSetKey(100, { other }));
+		};
+		vary(&DescriptorResourceKey::binding, 1u);
+		vary(&DescriptorResourceKey::type, UNIFORM_BUFFER_DYNAMIC);
+		vary(&DescriptorResourceKey::buffer, uint64_t(8));
+		vary(&DescriptorResourceKey::offset, uint64_t(256));
+		vary(&DescriptorResourceKey::range, uint64_t(512));
+		vary(&DescriptorResourceKey::sampler, uint64_t(1));
+		vary(&DescriptorResourceKey::view, uint64_t(1));
+		vary(&DescriptorResourceKey::image_layout, 1u);
+		vary(&DescriptorResourceKey::acceleration_structures, std::vector<uint64_t>{ 1 });
+
+		return std::none_of(others.begin(), others.end(), [&](const DescriptorSetKey& other) {
+			return other == base || other.hash() == base.hash();
+			});
+	},
+	[] {
+		std::cout << "object cache creates each key once" << std::endl;
+		ObjectCache<DescriptorLayoutKey, int> cache;
+		int created = 0;
+		auto create = [&]() { return std::make_shared<int>(++created); };
+
+		auto a = cache.get(ShapeLayout(), create);
+		auto b = cache.get(ShapeLayout(), create);
+		auto c = cache.get(DescriptorLayoutKey({ { 0, UNIFORM_BUFFER, 1, VERTEX } }), create);
+		return a == b && a != c && created == 2 && cache.hits == 1 && cache.misses == 2 && cache.size() == 2;
+	},
+	[] {
+		std::cout << "prune drops only the entries nobody else holds" << std::endl;
+		ObjectCache<DescriptorSetKey, int> cache;
+		auto create = []() { return std::make_shared<int>(0); };
+
+		auto held = cache.get(DescriptorSetKey(1, {}), create);
+		cache.get(DescriptorSetKey(2, {}), create);
+		size_t pruned = cache.prune();
+
+		int created = 0;
+		auto again = cache.get(DescriptorSetKey(1, {}), [&]() { created++; return std::make_shared<int>(0); });
+		return pruned == 1 && cache.size() == 1 && again == held && created == 0;
+	},
+	[] {
+		std::cout << "a scene of identical shapes creates one layout, one pipeline layout and one set per texture" << std::endl;
+		ObjectCache<DescriptorLayoutKey, uint64_t> layouts;
+		ObjectCache<PipelineLayoutKey, uint64_t> pipeline_layouts;
+		ObjectCache<DescriptorSetKey, uint64_t> sets;
+		uint64_t handles = 0;
+		auto create = [&]() { return std::make_shared<uint64_t>(++handles); };
+
+		for (int shape = 0; shape < 10000; shape++) {
+			// every shape binds the same uniform ring with its own dynamic offset, and one of two textures
+			auto layout = layouts.get(ShapeLayout(), create);
+			pipeline_layouts.get(PipelineLayoutKey({ *layout }, {}), create);
+			sets.get(DescriptorSetKey(*layout, {
+				{ .binding = 0, .type = UNIFORM_BUFFER_DYNAMIC, .buffer = 1, .offset = 0, .range = 256 },
+				{ .binding = 1, .type = COMBINED_IMAGE_SAMPLER, .sampler = 1, .view = uint64_t(shape % 2), .image_layout = 5 },
+				}), create);
+		}
+		return layouts.size() == 1 && pipeline_layouts.size() == 1 && sets.size() == 2 && handles == 4;
+	},
+	[] {
+		std::cout << "sets bound to a destroyed resource are not found for a new one with its handle" << std::endl;
+		ObjectCache<DescriptorSetKey, uint64_t> sets;
+		DestroyedHandles destroyed;
+		uint64_t handles = 0;
+		auto create = [&]() { return std::make_shared<uint64_t>(++handles); };
+		auto texture = [](uint64_t view) {
+			return DescriptorSetKey(100, {
+				{ .binding = 0, .type = UNIFORM_BUFFER, .buffer = 1, .offset = 0, .range = 256 },
+				{ .binding = 1, .type = COMBINED_IMAGE_SAMPLER, .sampler = 2, .view = view, .image_layout = 5 },
+				});
+		};
+
+		auto held = sets.get(texture(7), create);
+		sets.get(texture(8), create);
+		destroyed.add(7);
+		size_t evicted = sets.evict([&, gone = destroyed.take()](const DescriptorSetKey& key) { return key.refers(gone); });
+		auto reused = sets.get(texture(7), create);
+		auto kept = sets.get(texture(8), create);
+		return evicted == 1 && *held == 1 && *reused == 3 && *kept == 2 && destroyed.take().empty();
+	},
+	[] {
+		std::cout << "pools grow geometrically up to the maximum" << std::endl;
+		FakeDevice device;
+		{
+			auto chain = device.chain(4, 16);
+			auto counts = ShapeLayout().descriptorCounts();
+			for (int i = 0; i < 4 + 8 + 16 + 16; i++) {
+				chain.acquire(counts);
+			}
+			bool grown = chain.poolCount() == 4 && chain.setCount() == 44 && chain.capacity() == 44;
+			chain.acquire(counts);
+			grown = grown && chain.poolCount() == 5;
+
+			std::vector<uint32_t> sets;
+			for (auto& [max_sets, sizes] : device.created) {
+				sets.push_back(max_sets);
+			}
+			if (!grown || sets != std::vector<uint32_t>{ 4, 8, 16, 16, 16 }) {
+				return false;
+			}
+		}
+		return device.live == 0;
+	},
+	[] {
+		std::cout << "maxSets and pool sizes follow the sets, not the number of pool sizes" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(8, 64);
+		auto counts = ShapeLayout().descriptorCounts();
+		chain.acquire(counts);
+
+		auto& [max_sets, sizes] = device.created[0];
+		return max_sets == 8 && sizes.size() == 2 &&
+			sizes[UNIFORM_BUFFER_DYNAMIC] == 8 && sizes[COMBINED_IMAGE_SAMPLER] == 8;
+	},
+	[] {
+		std::cout << "new pools are sized by the average demand and always fit the request" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(2, 64);
+		DescriptorPoolChain::Counts small{ { UNIFORM_BUFFER, 1 } };
+		DescriptorPoolChain::Counts large{ { UNIFORM_BUFFER, 1 }, { COMBINED_IMAGE_SAMPLER, 6 } };
+
+		chain.acquire(small);
+		chain.acquire(small);
+		// the first pool has no samplers, the second is sized for 3 sets averaging 2 samplers
+		uint64_t pool = chain.acquire(large);
+
+		auto& [max_sets, sizes] = device.created.back();
+		return pool == 2 && max_sets == 4 && sizes[UNIFORM_BUFFER] == 4 && sizes[COMBINED_IMAGE_SAMPLER] == 8;
+	},
+	[] {
+		std::cout << "freed sets are reused before the chain grows" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(4, 16);
+		auto counts = ShapeLayout().descriptorCounts();
+		std::vector<uint64_t> pools;
+		for (int i = 0; i < 4; i++) {
+			pools.push_back(chain.acquire(counts));
+		}
+		chain.release(pools[1], counts);
+		uint64_t pool = chain.acquire(counts);
+		return pool == pools[1] && chain.poolCount() == 1 && device.created.size() == 1;
+	},
+	[] {
+		std::cout << "empty pools are destroyed, except the last one" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(2, 16);
+		auto counts = ShapeLayout().descriptorCounts();
+		std::vector<uint64_t> pools;
+		for (int i = 0; i < 6; i++) {
+			pools.push_back(chain.acquire(counts));
+		}
+		bool two = chain.poolCount() == 2 && device.live == 2;
+		for (size_t i = 0; i < 2; i++) {
+			chain.release(pools[i], counts);
+		}
+		bool released = chain.poolCount() == 1 && device.live == 1;
+		for (size_t i = 2; i < 6; i++) {
+			chain.release(pools[i], counts);
+		}
+		return two && released && chain.poolCount() == 1 && device.live == 1 && chain.setCount() == 0;
+	},
+	[] {
+		std::cout << "a fragmented pool is skipped until it drains" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(4, 16);
+		auto counts = ShapeLayout().descriptorCounts();
+		uint64_t first = chain.acquire(counts);
+		uint64_t second = chain.acquire(counts);
+		// the device refused the second set although the counts had room
+		chain.failed(second, counts);
+		uint64_t retry = chain.acquire(counts);
+		bool skipped = retry != first && chain.poolCount() == 2 && chain.setCount() == 2;
+
+		// once the fragmented pool is empty it's destroyed, it isn't the last one
+		chain.release(first, counts);
+		return skipped && chain.poolCount() == 1 && device.live == 1;
+	},
+	[] {
+		std::cout << "failing to allocate from an empty pool throws" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(4, 16);
+		auto counts = ShapeLayout().descriptorCounts();
+		uint64_t pool = chain.acquire(counts);
+		try {
+			chain.failed(pool, counts);
+		}
+		catch (std::runtime_error&) {
+			return true;
+		}
+		return false;
+	},
+	[] {
+		std::cout << "releasing to an unknown pool throws" << std::endl;
+		FakeDevice device;
+		auto chain = device.chain(4, 16);
+		try {
+			chain.release(42, {});
+		}
+		catch (std::invalid_argument&) {
+			return true;
+		}
+		return false;
+	},
+	[] {
+		std::cout << "random acquire and release never exceeds pool capacity" << std::endl;
+		FakeDevice device;
+		std::mt19937 rng(7);
+		std::vector<DescriptorPoolChain::Counts> layouts{
+			{ { UNIFORM_BUFFER_DYNAMIC, 1 } },
+			{ { UNIFORM_BUFFER_DYNAMIC, 1 }, { COMBINED_IMAGE_SAMPLER, 1 } },
+			{ { UNIFORM_BUFFER, 2 }, { COMBINED_IMAGE_SAMPLER, 4 } },
+		};
+
+		std::map<uint64_t, DescriptorPoolChain::Counts> used;
+		std::map<uint64_t, uint32_t> sets;
+		std::vector<std::pair<uint64_t, size_t>> live;
+		auto chain = device.chain(4, 64);
+
+		for (int i = 0; i < 20000; i++) {
+			if (live.empty() || rng() % 100 < 55) {
+				size_t layout = rng() % layouts.size();
+				uint64_t pool = chain.acquire(layouts[layout]);
+				for (auto& [type, count] : layouts[layout]) {
+					used[pool][type] += count;
+				}
+				sets[pool]++;
+				live.push_back({ pool, layout });
+
+				auto& [max_sets, sizes] = device.created[pool - 1];
+				if (sets[pool] > max_sets) {
+					return false;
+				}
+				for (auto& [type, count] : used[pool]) {
+					if (count > sizes[type]) {
+						return false;
+					}
+				}
+			}
+			else {
+				size_t index = rng() % live.size();
+				auto [pool, layout] = live[index];
+				chain.release(pool, layouts[layout]);
+				for (auto& [type, count] : layouts[layout]) {
+					used[pool][type] -= count;
+				}
+				sets[pool]--;
+				live[index] = live.back();
+				live.pop_back();
+			}
+		}
+		return chain.setCount() == live.size();
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+#include <Innovator/Events.h>
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// what a handler saw each time it was called
+struct Received {
+	EventType type;
+	std::array<double, 2> drag;
+	bool press;
+	int button;
+};
+
+// a camera that orbits by what it is dragged, subscribed to drags only
+struct Camera {
+	Camera(EventRouter& events) :
+		events(events)
+	{
+		events.subscribe(MOUSE_DRAG, [this] {
+			this->received.push_back({ MOUSE_DRAG, this->drag(), this->events.press, this->events.button });
+			this->orbit[0] += this->drag()[0];
+			this->orbit[1] += this->drag()[1];
+		});
+	}
+
+	std::array<double, 2> drag() const
+	{
+		return { this->events.previous[0] - this->events.position[0], this->events.previous[1] - this->events.position[1] };
+	}
+
+	EventRouter& events;
+	std::array<double, 2> orbit{ 0.0, 0.0 };
+	std::vector<Received> received;
+};
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "events go to the handlers of their type only, in the order they subscribed ";
+		EventRouter events;
+		std::vector<std::string> calls;
+		events.subscribe(MOUSE_PRESS | MOUSE_RELEASE, [&] { calls.push_back("a"); });
+		events.subscribe(KEY_PRESS, [&] { calls.push_back("b"); });
+		events.subscribe(MOUSE_PRESS | KEY_PRESS, [&] { calls.push_back("c"); });
+		events.mousePressed(1, 1, 0);
+		events.keyPressed(1);
+		events.mouseReleased();
+		std::vector<std::string> expected{ "a", "c", "b", "c", "a" };
+		return calls == expected &&
+			events.subscriberCount(MOUSE_PRESS) == 2 &&
+			events.subscriberCount(MOUSE_DRAG) == 0 &&
+			events.stats.handlers == 5;
+	},
+	[] {
+		std::cout << "moves between frames are one drag, by all of them ";
+		EventRouter events;
+		Camera camera(events);
+		events.mousePressed(100, 100, 0);
+		// many moves per frame, as a fast mouse delivers them
+		const int frames = 60, moves = 40;
+		int x = 100, y = 100;
+		for (int frame = 0; frame < frames; frame++) {
+			for (int i = 0; i < moves; i++) {
+				x += 1 + i % 3;
+				y -= i % 2;
+				events.mouseMoved(x, y);
+			}
+			events.flush();
+		}
+		bool flushed = !events.flush() && !events.pending();
+		std::cout << events.stats.events << " events, " << camera.received.size() << " drags ";
+		return flushed &&
+			camera.received.size() == frames &&
+			camera.orbit[0] == 100 - x && camera.orbit[1] == 100 - y &&
+			events.stats.merged == uint64_t(frames * (moves - 1));
+	},
+	[] {
+		std::cout << "a release sends the drag before it, moves with no button are not sent ";
+		EventRouter events;
+		Camera camera(events);
+		size_t released_after = 0;
+		events.subscribe(MOUSE_RELEASE, [&] { released_after = camera.received.size(); });
+		events.mousePressed(0, 0, 2);
+		events.mouseMoved(5, 0);
+		events.mouseMoved(10, 20);
+		events.mouseReleased();
+		events.mouseMoved(50, 50);
+		events.mouseMoved(60, 60);
+		bool idle = !events.pending() && !events.flush();
+		return idle && released_after == 1 && camera.received.size() == 1 &&
+			camera.received[0].drag == std::array<double, 2>{ -10, -20 } &&
+			camera.received[0].press && camera.received[0].button == 2;
+	},
+	[] {
+		std::cout << "a press starts the drag where the button went down ";
+		EventRouter events;
+		Camera camera(events);
+		events.mouseMoved(10, 10);
+		events.mousePressed(200, 300, 1);
+		events.mouseMoved(201, 301);
+		events.flush();
+		return camera.received.size() == 1 &&
+			camera.received[0].drag == std::array<double, 2>{ -1, -1 } &&
+			camera.received[0].button == 1;
+	},
+	[] {
+		std::cout << "handlers are dropped when the scene is indexed again ";
+		EventRouter events;
+		int old_scene = 0, new_scene = 0;
+		events.subscribe(KEY_PRESS, [&] { old_scene++; });
+		events.keyPressed(0);
+		events.clear();
+		events.subscribe(KEY_PRESS, [&] { new_scene++; });
+		events.keyPressed(0);
+		return old_scene == 1 && new_scene == 1;
+	},
+	[] {
+		std::cout << "a drag pending when a key is pressed is sent first ";
+		EventRouter events;
+		std::vector<EventType> order;
+		events.subscribe(MOUSE_DRAG, [&] { order.push_back(MOUSE_DRAG); });
+		events.subscribe(KEY_PRESS, [&] { order.push_back(KEY_PRESS); });
+		events.mousePressed(0, 0, 0);
+		events.mouseMoved(1, 1);
+		events.keyPressed(0);
+		events.flush();
+		return order == std::vector<EventType>{ MOUSE_DRAG, KEY_PRESS };
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
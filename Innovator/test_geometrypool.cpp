@@ -0,0 +1,330 @@
+#include <Innovator/GeometryPool.h>
+#include <Innovator/Testing.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// stands in for the device: page buffers as arrays of one word per vertex and per index
+class FakeBuffers {
+public:
+	GeometryPool::CreatePage create()
+	{
+		return [this](const GeometryFormat& format, uint32_t vertices, uint32_t indices) {
+			uint64_t handle = ++this->next;
+			this->pages[handle] = { format, std::vector<uint32_t>(vertices), std::vector<uint32_t>(indices) };
+			this->created++;
+			return handle;
+		};
+	}
+
+	GeometryPool::DestroyPage destroy()
+	{
+		return [this](uint64_t handle) {
+			if (!this->pages.erase(handle)) {
+				throw std::runtime_error("destroyed unknown page");
+			}
+		};
+	}
+
+	// what an upload does: every vertex and index of the mesh holds its handle
+	void write(const GeometryPool::Range& range, GeometryPool::Handle mesh)
+	{
+		auto& page = this->pages.at(range.page);
+		std::fill_n(page.vertices.begin() + range.base_vertex, range.vertex_count, uint32_t(mesh));
+		std::fill_n(page.indices.begin() + range.first_index, range.index_count, uint32_t(mesh));
+	}
+
+	// what the copy commands of a move do
+	void copy(const GeometryPool::Move& move)
+	{
+		auto& src = this->pages.at(move.src.page);
+		auto& dst = this->pages.at(move.dst.page);
+		std::copy_n(src.vertices.begin() + move.src.base_vertex, move.src.vertex_count, dst.vertices.begin() + move.dst.base_vertex);
+		std::copy_n(src.indices.begin() + move.src.first_index, move.src.index_count, dst.indices.begin() + move.dst.first_index);
+	}
+
+	bool holds(const GeometryPool::Range& range, GeometryPool::Handle mesh) const
+	{
+		auto& page = this->pages.at(range.page);
+		auto is_mesh = [mesh](uint32_t value) { return value == uint32_t(mesh); };
+		return std::all_of(page.vertices.begin() + range.base_vertex, page.vertices.begin() + range.base_vertex + range.vertex_count, is_mesh) &&
+			std::all_of(page.indices.begin() + range.first_index, page.indices.begin() + range.first_index + range.index_count, is_mesh);
+	}
+
+	struct Page {
+		GeometryFormat format;
+		std::vector<uint32_t> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	std::map<uint64_t, Page> pages;
+	uint64_t next{ 0 };
+	uint64_t created{ 0 };
+};
+
+static bool Overlap(const GeometryPool::Range& a, const GeometryPool::Range& b)
+{
+	if (a.page != b.page) {
+		return false;
+	}
+	bool vertices = a.base_vertex < b.base_vertex + b.vertex_count && b.base_vertex < a.base_vertex + a.vertex_count;
+	bool indices = a.index_count && b.index_count &&
+		a.first_index < b.first_index + b.index_count && b.first_index < a.first_index + a.index_count;
+	return vertices || indices;
+}
+
+static bool Disjoint(const GeometryPool& pool, const std::vector<GeometryPool::Handle>& meshes)
+{
+	for (size_t i = 0; i < meshes.size(); i++) {
+		for (size_t j = i + 1; j < meshes.size(); j++) {
+			if (Overlap(pool.range(meshes[i]), pool.range(meshes[j]))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+const GeometryFormat POSITIONS{ .vertex_stride = 12, .index_size = 4 };
+const GeometryFormat POSITIONS_NORMALS{ .vertex_stride = 24, .index_size = 4 };
+const GeometryFormat GLYPHS{ .vertex_stride = 16, .index_size = 2 };
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "small meshes of one format share one page" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 4096, 16384);
+		std::vector<GeometryPool::Handle> meshes;
+		for (uint32_t i = 0; i < 100; i++) {
+			meshes.push_back(pool.allocate(POSITIONS, 24 + i % 7, 36 + i % 5));
+		}
+		auto stats = pool.stats();
+		return pool.pageCount(POSITIONS) == 1 && buffers.created == 1 &&
+			stats.meshes == 100 && stats.reserved_vertices == 4096 && stats.reserved_indices == 16384 &&
+			Disjoint(pool, meshes);
+	},
+	[] {
+		std::cout << "each vertex format has pages of its own" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 1024, 1024);
+		auto a = pool.allocate(POSITIONS, 10, 30);
+		auto b = pool.allocate(POSITIONS_NORMALS, 10, 30);
+		auto c = pool.allocate(GLYPHS, 4, 6);
+		auto d = pool.allocate(POSITIONS, 10, 30);
+		return pool.range(a).page == pool.range(d).page &&
+			pool.range(a).page != pool.range(b).page &&
+			pool.range(b).page != pool.range(c).page &&
+			buffers.pages.at(pool.range(b).page).format == POSITIONS_NORMALS &&
+			pool.range(d).base_vertex == 10 && pool.range(d).first_index == 30;
+	},
+	[] {
+		std::cout << "full pages add pages, meshes larger than a page get one of their size" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 100, 300);
+		auto a = pool.allocate(POSITIONS, 60, 90);
+		auto b = pool.allocate(POSITIONS, 60, 90);
+		auto c = pool.allocate(POSITIONS, 500, 30);
+		auto& big = buffers.pages.at(pool.range(c).page);
+		return pool.range(a).page != pool.range(b).page && pool.range(b).page != pool.range(c).page &&
+			big.vertices.size() == 500 && big.indices.size() == 300 &&
+			pool.pageCount(POSITIONS) == 3;
+	},
+	[] {
+		std::cout << "vertices and indices of a mesh come from the same page" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 1000, 100);
+		auto a = pool.allocate(POSITIONS, 10, 90);
+		uint64_t used = pool.stats().used_vertices;
+		// vertices would fit in the first page but indices don't
+		auto b = pool.allocate(POSITIONS, 10, 20);
+		auto stats = pool.stats();
+		return pool.range(a).page != pool.range(b).page &&
+			used == 10 && stats.used_vertices == 20 && stats.used_indices == 110;
+	},
+	[] {
+		std::cout << "meshes without indices take no index space" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 1000, 100);
+		auto a = pool.allocate(POSITIONS, 10, 0);
+		auto b = pool.allocate(GeometryFormat{ .vertex_stride = 12, .index_size = 0 }, 10, 0);
+		return pool.stats().used_indices == 0 && pool.range(a).index_count == 0 &&
+			buffers.pages.at(pool.range(b).page).indices.empty();
+	},
+	[] {
+		std::cout << "freed ranges are reused only once their serial has completed" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 100, 100);
+		auto a = pool.allocate(POSITIONS, 100, 100);
+		pool.free(a, 5);
+		pool.collect(4);
+		auto b = pool.allocate(POSITIONS, 50, 50);
+		bool deferred = pool.range(b).page != buffers.pages.begin()->first;
+		pool.collect(5);
+		auto c = pool.allocate(POSITIONS, 50, 50);
+		return deferred && pool.range(c).page == pool.range(b).page && pool.stats().meshes == 2;
+	},
+	[] {
+		std::cout << "empty pages are destroyed, one is kept per format" << std::endl;
+		FakeBuffers buffers;
+		auto pool = std::make_unique<GeometryPool>(buffers.create(), buffers.destroy(), 100, 100);
+		std::vector<GeometryPool::Handle> meshes;
+		for (int i = 0; i < 4; i++) {
+			meshes.push_back(pool->allocate(POSITIONS, 100, 10));
+		}
+		for (auto mesh : meshes) {
+			pool->free(mesh);
+		}
+		pool->collect(0);
+		bool one_left = buffers.pages.size() == 1 && pool->pageCount(POSITIONS) == 1;
+		pool.reset();
+		return one_left && buffers.pages.empty() && buffers.created == 4;
+	},
+	[] {
+		std::cout << "compaction empties the least used page into the others" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 100, 300);
+		std::vector<GeometryPool::Handle> meshes;
+		for (int i = 0; i < 10; i++) {
+			meshes.push_back(pool.allocate(POSITIONS, 20, 30));
+			buffers.write(pool.range(meshes.back()), meshes.back());
+		}
+		// two pages of five meshes, free three of each
+		std::vector<GeometryPool::Handle> kept;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (i % 5 < 3) {
+				pool.free(meshes[i], 1);
+			}
+			else {
+				kept.push_back(meshes[i]);
+			}
+		}
+		pool.collect(1);
+		size_t pages = pool.pageCount(POSITIONS);
+		auto moves = pool.compact(2);
+		for (auto& move : moves) {
+			buffers.copy(move);
+		}
+		bool sources_kept = pool.pageCount(POSITIONS) == pages;
+		pool.collect(2);
+		bool intact = std::all_of(kept.begin(), kept.end(), [&](auto mesh) { return buffers.holds(pool.range(mesh), mesh); });
+		return pages == 2 && moves.size() == 2 && sources_kept && pool.pageCount(POSITIONS) == 1 &&
+			intact && Disjoint(pool, kept);
+	},
+	[] {
+		std::cout << "pages that can't be emptied are left alone" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 100, 300);
+		std::vector<GeometryPool::Handle> meshes;
+		for (int i = 0; i < 8; i++) {
+			meshes.push_back(pool.allocate(POSITIONS, 25, 10));
+		}
+		pool.free(meshes[0]);
+		pool.collect(0);
+		auto before = pool.stats();
+		auto moves = pool.compact();
+		auto after = pool.stats();
+		return moves.empty() && before.used_vertices == after.used_vertices &&
+			before.used_indices == after.used_indices && before.pages == after.pages;
+	},
+	[] {
+		std::cout << "bad requests are errors" << std::endl;
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 100, 100);
+		auto mesh = pool.allocate(POSITIONS, 1, 1);
+		pool.free(mesh);
+		return Throws<std::invalid_argument>([&] { pool.allocate(POSITIONS, 0, 3); }) &&
+			Throws<std::invalid_argument>([&] { pool.allocate(GeometryFormat{ .vertex_stride = 12, .index_size = 0 }, 3, 3); }) &&
+			Throws<std::invalid_argument>([&] { pool.free(mesh); }) &&
+			Throws<std::out_of_range>([&] { pool.range(mesh); });
+	},
+	[] {
+		std::cout << "random allocate, free, compact and collect keep every mesh's data in place" << std::endl;
+		std::mt19937 rng(7);
+		FakeBuffers buffers;
+		GeometryPool pool(buffers.create(), buffers.destroy(), 512, 1024);
+		std::vector<GeometryPool::Handle> live;
+		std::vector<GeometryPool::Handle> pending;
+		uint64_t serial = 0;
+		for (int i = 0; i < 4000; i++) {
+			uint32_t op = rng() % 100;
+			if (op < 50 || live.empty()) {
+				GeometryFormat format = (rng() % 4) ? POSITIONS : GLYPHS;
+				uint32_t vertices = 1 + rng() % 96;
+				uint32_t indices = (rng() % 5) ? rng() % 200 : 0;
+				auto mesh = pool.allocate(format, vertices, indices);
+				buffers.write(pool.range(mesh), mesh);
+				live.push_back(mesh);
+			}
+			else if (op < 90) {
+				size_t index = rng() % live.size();
+				pool.free(live[index], serial);
+				live.erase(live.begin() + index);
+			}
+			else if (op < 95) {
+				for (auto& move : pool.compact(serial)) {
+					buffers.copy(move);
+				}
+			}
+			else {
+				// frames in flight lag two serials behind
+				serial++;
+				pool.collect(serial >= 2 ? serial - 2 : 0);
+			}
+			if (i % 100 == 0) {
+				for (auto mesh : live) {
+					if (!buffers.holds(pool.range(mesh), mesh)) {
+						std::cout << "mesh " << mesh << " lost its data" << std::endl;
+						return false;
+					}
+				}
+				if (!Disjoint(pool, live) || pool.stats().meshes != live.size()) {
+					return false;
+				}
+			}
+		}
+		for (auto mesh : live) {
+			pool.free(mesh, serial);
+		}
+		pool.collect(serial);
+		auto stats = pool.stats();
+		return stats.meshes == 0 && stats.used_vertices == 0 && stats.used_indices == 0 &&
+			stats.pages == 2 && buffers.pages.size() == 2;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include <Innovator/ImageCompare.h>
+#include <Innovator/Testing.h>
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+Pixels Fill(uint32_t width, uint32_t height, uint8_t value)
+{
+	return { width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4, value) };
+}
+
+// a white disc on black, each pixel covered by samples x samples points, as a multisampled
+// render pass resolves it
+Pixels Disc(uint32_t size, uint32_t samples)
+{
+	Pixels pixels = Fill(size, size, 0);
+	double radius = size / 3.0;
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			uint32_t inside = 0;
+			for (uint32_t j = 0; j < samples; j++) {
+				for (uint32_t i = 0; i < samples; i++) {
+					double dx = x + (i + 0.5) / samples - size / 2.0;
+					double dy = y + (j + 0.5) / samples - size / 2.0;
+					inside += dx * dx + dy * dy < radius * radius;
+				}
+			}
+			uint8_t value = static_cast<uint8_t>(255 * inside / (samples * samples));
+			std::fill_n(pixels.data.begin() + (static_cast<size_t>(y) * size + x) * 4, 4, value);
+		}
+	}
+	return pixels;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "same images do not differ" << std::endl;
+		ImageDifference difference = Compare(Disc(64, 2), Disc(64, 2), 0);
+		return difference.max == 0 && difference.pixels == 0 && difference.count == 64 * 64;
+	},
+	[] {
+		std::cout << "differences within the tolerance are measured but not counted" << std::endl;
+		ImageDifference difference = Compare(Fill(8, 8, 100), Fill(8, 8, 102), 2);
+		return difference.max == 2 && difference.pixels == 0;
+	},
+	[] {
+		std::cout << "a pixel counts once however many channels differ" << std::endl;
+		Pixels a = Fill(8, 8, 0);
+		Pixels b = a;
+		b.data[9 * 4 + 0] = 255;
+		b.data[9 * 4 + 2] = 10;
+		ImageDifference difference = Compare(a, b, 0);
+		return difference.max == 255 && difference.pixels == 1 && difference.fraction() == 1.0 / 64;
+	},
+	[] {
+		std::cout << "differences are the same both ways" << std::endl;
+		ImageDifference ab = Compare(Fill(4, 4, 10), Fill(4, 4, 200), 0);
+		ImageDifference ba = Compare(Fill(4, 4, 200), Fill(4, 4, 10), 0);
+		return ab.max == 190 && ba.max == 190 && ab.pixels == 16 && ba.pixels == 16;
+	},
+	[] {
+		std::cout << "a multisampled edge differs only along the edge" << std::endl;
+		ImageDifference difference = Compare(Disc(256, 1), Disc(256, 2), 1);
+		return difference.pixels > 0 && difference.fraction() < 0.02;
+	},
+	[] {
+		std::cout << "images of different sizes or pixel sizes are not compared" << std::endl;
+		Pixels short_rows = Fill(8, 8, 0);
+		short_rows.data.resize(8 * 8 * 3);
+		return
+			Throws<std::invalid_argument>([] { Compare(Fill(8, 8, 0), Fill(8, 4, 0), 0); }) &&
+			Throws<std::invalid_argument>([&] { Compare(short_rows, Fill(8, 8, 0), 0); });
+	},
+};
+
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,269 @@
+#include <Innovator/Indirect.h>
+#include <Innovator/Testing.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+static Matrix4 ViewProjection(const Point3& eye, const Point3& center)
+{
+	return Multiply(Perspective(0.7, 16.0 / 9.0, 0.1, 100.0), LookAt(eye, center, { 0, 0, 1 }));
+}
+
+// one unit cube of 8 vertices and 36 indices for each cell of an n x n grid, all in one buffer
+struct Grid {
+	explicit Grid(uint32_t n, double spacing)
+	{
+		const uint32_t cube[36] = {
+			0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7, 0, 1, 4, 4, 1, 5,
+			2, 3, 6, 6, 3, 7, 0, 2, 4, 4, 2, 6, 1, 3, 5, 5, 3, 7,
+		};
+		for (uint32_t y = 0; y < n; y++) {
+			for (uint32_t x = 0; x < n; x++) {
+				BoundingBox box({ x * spacing, y * spacing, 0 }, { x * spacing + 1, y * spacing + 1, 1 });
+				int32_t vertex_offset = static_cast<int32_t>(this->positions.size() / 3);
+				for (uint32_t corner = 0; corner < 8; corner++) {
+					this->positions.push_back(static_cast<float>(corner & 1 ? box.max[0] : box.min[0]));
+					this->positions.push_back(static_cast<float>(corner & 2 ? box.max[1] : box.min[1]));
+					this->positions.push_back(static_cast<float>(corner & 4 ? box.max[2] : box.min[2]));
+				}
+				// the cube indices are shared, every draw offsets them to its own vertices
+				this->draws.push_back({ .index_count = 36, .first_index = 0, .vertex_offset = vertex_offset });
+				this->boxes.push_back(box);
+			}
+		}
+		this->indices.assign(cube, cube + 36);
+	}
+
+	std::vector<BoundingBox> bounds() const
+	{
+		std::vector<BoundingBox> bounds;
+		for (auto& draw : this->draws) {
+			bounds.push_back(IndirectBatch::Bounds(
+				draw,
+				reinterpret_cast<const char*>(this->indices.data()),
+				this->indices.size(),
+				sizeof(uint32_t),
+				reinterpret_cast<const char*>(this->positions.data()),
+				this->positions.size() / 3,
+				sizeof(float) * 3,
+				0));
+		}
+		return bounds;
+	}
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	std::vector<IndirectDraw> draws;
+	std::vector<BoundingBox> boxes;
+};
+
+static std::vector<DrawIndexedIndirectCommand> Cull(const Grid& grid, const Matrix4& m, uint32_t frames = 1, uint32_t frame = 0)
+{
+	auto commands = IndirectBatch::Commands(grid.draws);
+	std::vector<DrawIndexedIndirectCommand> visible(commands.size() * frames);
+	auto constants = IndirectBatch::Constants(Frustum(m), static_cast<uint32_t>(commands.size()), frame);
+	IndirectBatch::Cull(commands, IndirectBatch::PackBounds(grid.bounds()), constants, visible.data());
+	return visible;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "draws pack as indirect commands with their index as first instance" << std::endl;
+		auto commands = IndirectBatch::Commands({ { 36, 0, 0 }, { 6, 36, -8 }, { 3, 42, 100 } });
+		bool fields = true;
+		for (uint32_t i = 0; i < commands.size(); i++) {
+			fields = fields && commands[i].instanceCount == 1 && commands[i].firstInstance == i;
+		}
+		return fields && commands.size() == 3 &&
+			commands[1].indexCount == 6 && commands[1].firstIndex == 36 && commands[1].vertexOffset == -8 &&
+			commands[2].indexCount == 3 && commands[2].firstIndex == 42 && commands[2].vertexOffset == 100 &&
+			offsetof(DrawIndexedIndirectCommand, firstInstance) == 16;
+	},
+	[] {
+		std::cout << "draw bounds cover only the vertices the draw indexes" << std::endl;
+		std::vector<float> positions{ 0, 0, 0, 1, 2, 3, -5, 0, 0, 9, 9, 9, 4, -1, 2 };
+		std::vector<uint16_t> indices16{ 0, 1, 3, 0 };
+		std::vector<uint32_t> indices32{ 0, 1, 3, 0 };
+		auto bounds = [&](const IndirectDraw& draw, const char* indices, uint32_t index_size) {
+			return IndirectBatch::Bounds(
+				draw, indices, 4, index_size, reinterpret_cast<const char*>(positions.data()), 5, 12, 0);
+		};
+		auto a = bounds({ 2, 0, 0 }, reinterpret_cast<const char*>(indices16.data()), 2);
+		auto b = bounds({ 2, 1, 1 }, reinterpret_cast<const char*>(indices32.data()), 4);
+		auto c = bounds({ 0, 4, 0 }, reinterpret_cast<const char*>(indices32.data()), 4);
+		return a.min == Point3{ 0, 0, 0 } && a.max == Point3{ 1, 2, 3 } &&
+			b.min == Point3{ -5, -1, 0 } && b.max == Point3{ 4, 0, 2 } &&
+			c.empty();
+	},
+	[] {
+		std::cout << "draws reading past their buffers are errors" << std::endl;
+		std::vector<float> positions{ 0, 0, 0, 1, 1, 1 };
+		std::vector<uint32_t> indices{ 0, 1, 2 };
+		auto bounds = [&](const IndirectDraw& draw) {
+			IndirectBatch::Bounds(
+				draw, reinterpret_cast<const char*>(indices.data()), 3, 4, reinterpret_cast<const char*>(positions.data()), 2, 12, 0);
+		};
+		return Throws<std::out_of_range>([&] { bounds({ 3, 0, 0 }); }) &&
+			Throws<std::out_of_range>([&] { bounds({ 2, 2, 0 }); }) &&
+			Throws<std::out_of_range>([&] { bounds({ 1, 0, -1 }); }) &&
+			!Throws<std::out_of_range>([&] { bounds({ 2, 0, 0 }); });
+	},
+	[] {
+		std::cout << "bounds pack as two vec4 per draw, empty and infinite boxes are not cullable" << std::endl;
+		auto packed = IndirectBatch::PackBounds({
+			BoundingBox({ 1, 2, 3 }, { 4, 5, 6 }),
+			BoundingBox::Infinite(),
+			BoundingBox(),
+			});
+		std::vector<float> expected{
+			1, 2, 3, 1, 4, 5, 6, 0,
+			0, 0, 0, 0, 0, 0, 0, 0,
+			0, 0, 0, 0, 0, 0, 0, 0,
+		};
+		return packed == expected && packed.size() == 3 * IndirectBatch::BOUNDS_FLOATS;
+	},
+	[] {
+		std::cout << "push constants carry the planes, draw count and the region of the frame" << std::endl;
+		Frustum frustum(ViewProjection({ 0, -10, 0 }, { 0, 0, 0 }));
+		auto constants = IndirectBatch::Constants(frustum, 100, 2);
+		bool planes = true;
+		for (size_t i = 0; i < 24; i++) {
+			planes = planes && constants.planes[i] == static_cast<float>(frustum.planes[i / 4][i % 4]);
+		}
+		return planes && constants.draw_count == 100 && constants.output_offset == 200 &&
+			offsetof(IndirectCullConstants, draw_count) == 96 &&
+			IndirectBatch::WorkgroupCount(1) == 1 &&
+			IndirectBatch::WorkgroupCount(64) == 1 &&
+			IndirectBatch::WorkgroupCount(65) == 2;
+	},
+	[] {
+		std::cout << "the culling pass culls the draws the CPU traversal would" << std::endl;
+		Grid grid(32, 3.0);
+		Matrix4 m = ViewProjection({ 10, -5, 4 }, { 40, 40, 0 });
+		auto visible = Cull(grid, m);
+		Frustum frustum(m);
+		size_t culled = 0;
+		for (size_t i = 0; i < grid.boxes.size(); i++) {
+			uint32_t mask = Frustum::ALL_PLANES;
+			bool reference = frustum.cull(grid.boxes[i], mask);
+			if (reference != (visible[i].instanceCount == 0)) {
+				return false;
+			}
+			culled += reference;
+		}
+		return culled > grid.boxes.size() / 4 && culled < grid.boxes.size();
+	},
+	[] {
+		std::cout << "object space planes cull as world space bounds do" << std::endl;
+		Grid grid(16, 2.5);
+		Matrix4 model = Translate(-20, 5, -1);
+		Matrix4 viewprojection = ViewProjection({ 0, -8, 3 }, { 0, 20, 0 });
+		auto visible = Cull(grid, Multiply(viewprojection, model));
+		Frustum frustum(viewprojection);
+		for (size_t i = 0; i < grid.boxes.size(); i++) {
+			uint32_t mask = Frustum::ALL_PLANES;
+			if (frustum.cull(grid.boxes[i].transformed(model), mask) != (visible[i].instanceCount == 0)) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "culled draws keep their parameters, only the instance count is zero" << std::endl;
+		Grid grid(8, 4.0);
+		auto commands = IndirectBatch::Commands(grid.draws);
+		auto visible = Cull(grid, ViewProjection({ -50, -50, 1 }, { -100, -100, 0 }));
+		for (size_t i = 0; i < commands.size(); i++) {
+			if (visible[i].instanceCount != 0 ||
+				visible[i].indexCount != commands[i].indexCount ||
+				visible[i].vertexOffset != commands[i].vertexOffset ||
+				visible[i].firstInstance != commands[i].firstInstance) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "draws without bounds and a default frustum are never culled" << std::endl;
+		Grid grid(4, 2.0);
+		auto commands = IndirectBatch::Commands(grid.draws);
+		std::vector<DrawIndexedIndirectCommand> visible(commands.size());
+		auto bounds = grid.bounds();
+		bounds[3] = BoundingBox::Infinite();
+		Matrix4 away = ViewProjection({ -50, -50, 1 }, { -100, -100, 0 });
+		IndirectBatch::Cull(commands, IndirectBatch::PackBounds(bounds),
+			IndirectBatch::Constants(Frustum(away), static_cast<uint32_t>(commands.size()), 0), visible.data());
+		bool only_unbounded = true;
+		for (size_t i = 0; i < visible.size(); i++) {
+			only_unbounded = only_unbounded && (visible[i].instanceCount == (i == 3 ? 1u : 0u));
+		}
+		IndirectBatch::Cull(commands, IndirectBatch::PackBounds(grid.bounds()),
+			IndirectBatch::Constants(Frustum(), static_cast<uint32_t>(commands.size()), 0), visible.data());
+		bool none = std::all_of(visible.begin(), visible.end(), [](auto& command) { return command.instanceCount == 1; });
+		return only_unbounded && none;
+	},
+	[] {
+		std::cout << "each frame in flight culls into its own region" << std::endl;
+		Grid grid(4, 2.0);
+		size_t n = grid.draws.size();
+		auto visible = Cull(grid, ViewProjection({ 4, -10, 2 }, { 4, 4, 0 }), 3, 1);
+		bool untouched = std::all_of(visible.begin(), visible.begin() + n, [](auto& command) { return command.indexCount == 0; }) &&
+			std::all_of(visible.begin() + 2 * n, visible.end(), [](auto& command) { return command.indexCount == 0; });
+		bool written = std::all_of(visible.begin() + n, visible.begin() + 2 * n, [](auto& command) { return command.indexCount == 36; });
+		return untouched && written;
+	},
+	[] {
+		std::cout << "visible draws are offset to where the mesh is in a pool page" << std::endl;
+		Grid grid(4, 2.0);
+		auto commands = IndirectBatch::Commands(grid.draws);
+		std::vector<DrawIndexedIndirectCommand> visible(commands.size());
+		IndirectBatch::Cull(commands, IndirectBatch::PackBounds(grid.bounds()),
+			IndirectBatch::Constants(Frustum(), static_cast<uint32_t>(commands.size()), 0, 1000, 600), visible.data());
+		for (size_t i = 0; i < visible.size(); i++) {
+			if (visible[i].firstIndex != commands[i].firstIndex + 600 ||
+				visible[i].vertexOffset != commands[i].vertexOffset + 1000 ||
+				visible[i].indexCount != commands[i].indexCount) {
+				return false;
+			}
+		}
+		return true;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#include <Innovator/Instancing.h>
+#include <Innovator/Testing.h>
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+template <typename T>
+static T Read(const std::vector<char>& data, size_t offset)
+{
+	T value;
+	std::memcpy(&value, data.data() + offset, sizeof(T));
+	return value;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "instance attributes take six locations of one interleaved binding" << std::endl;
+		auto attributes = InstanceLayout::Attributes(3);
+		std::vector<uint32_t> locations, offsets;
+		for (auto& attribute : attributes) {
+			locations.push_back(attribute.location);
+			offsets.push_back(attribute.offset);
+		}
+		return attributes.size() == InstanceLayout::LOCATIONS &&
+			locations == std::vector<uint32_t>{ 3, 4, 5, 6, 7, 8 } &&
+			offsets == std::vector<uint32_t>{ 0, 16, 32, 48, 64, 80 } &&
+			attributes[4].format == InstanceAttribute::VEC4 &&
+			attributes[5].format == InstanceAttribute::UINT &&
+			InstanceLayout::STRIDE == 84;
+	},
+	[] {
+		std::cout << "instances pack as matrix columns, color and id" << std::endl;
+		std::vector<Instance> instances{
+			Instance::FromTranslationScale({ 1, 2, 3 }, { 4, 5, 6 }),
+			Instance::FromTranslationScale({ -1, 0, 0 }, { 1, 1, 1 }),
+		};
+		instances[0].color = { 0.25f, 0.5f, 0.75f, 1.0f };
+		instances[0].id = 17;
+		instances[1].id = 42;
+
+		std::vector<char> data(instances.size() * InstanceLayout::STRIDE);
+		InstanceLayout::Pack(instances, data.data());
+
+		const size_t second = InstanceLayout::STRIDE;
+		return Read<float>(data, 0) == 4.0f &&
+			Read<float>(data, 5 * sizeof(float)) == 5.0f &&
+			Read<float>(data, 10 * sizeof(float)) == 6.0f &&
+			Read<float>(data, 12 * sizeof(float)) == 1.0f &&
+			Read<float>(data, 13 * sizeof(float)) == 2.0f &&
+			Read<float>(data, 14 * sizeof(float)) == 3.0f &&
+			Read<float>(data, 15 * sizeof(float)) == 1.0f &&
+			Read<float>(data, 17 * sizeof(float)) == 0.5f &&
+			Read<uint32_t>(data, 80) == 17 &&
+			Read<float>(data, second + 12 * sizeof(float)) == -1.0f &&
+			Read<float>(data, second + 16 * sizeof(float)) == 1.0f &&
+			Read<uint32_t>(data, second + 80) == 42;
+	},
+	[] {
+		std::cout << "thousands of instances pack into one buffer" << std::endl;
+		std::vector<Instance> instances;
+		for (uint32_t i = 0; i < 10000; i++) {
+			auto instance = Instance::FromTranslationScale({ double(i), 0, 0 }, { 1, 1, 1 });
+			instance.id = i;
+			instances.push_back(instance);
+		}
+		std::vector<char> data(instances.size() * InstanceLayout::STRIDE);
+		InstanceLayout::Pack(instances, data.data());
+		for (uint32_t i = 0; i < instances.size(); i++) {
+			size_t offset = i * InstanceLayout::STRIDE;
+			if (Read<uint32_t>(data, offset + 80) != i || Read<float>(data, offset + 48) != float(i)) {
+				return false;
+			}
+		}
+		return true;
+	},
+	[] {
+		std::cout << "instance bounds cover the geometry at every instance" << std::endl;
+		BoundingBox geometry({ -1, -1, 0 }, { 1, 1, 2 });
+		std::vector<Instance> instances{
+			Instance::FromTranslationScale({ 10, 0, 0 }, { 1, 1, 1 }),
+			Instance::FromTranslationScale({ 0, -5, 1 }, { 2, 2, 2 }),
+		};
+		auto bounds = InstanceLayout::Bounds(geometry, instances);
+		return bounds.min == Point3{ -2, -7, 0 } && bounds.max == Point3{ 11, 1, 5 } &&
+			InstanceLayout::Bounds(geometry, {}).empty();
+	},
+	[] {
+		std::cout << "attributes of a binding bind its buffer once" << std::endl;
+		// positions on binding 0, instance attributes on binding 1
+		std::vector<uint32_t> bindings{ 1, 1, 1, 1, 1, 1, 0 };
+		std::vector<uint64_t> buffers{ 7, 7, 7, 7, 7, 7, 3 };
+		std::vector<uint64_t> offsets{ 0, 0, 0, 0, 0, 0, 16 };
+		auto ranges = VertexBindingRanges(bindings, buffers, offsets);
+		return ranges.size() == 1 && ranges[0].first_binding == 0 &&
+			ranges[0].buffers == std::vector<uint64_t>{ 3, 7 } &&
+			ranges[0].offsets == std::vector<uint64_t>{ 16, 0 };
+	},
+	[] {
+		std::cout << "gaps in the bindings start a new range" << std::endl;
+		auto ranges = VertexBindingRanges<uint64_t>({ 0, 2, 3, 5 }, { 1, 2, 3, 4 }, { 0, 0, 0, 0 });
+		return ranges.size() == 3 &&
+			ranges[0].first_binding == 0 && ranges[0].buffers == std::vector<uint64_t>{ 1 } &&
+			ranges[1].first_binding == 2 && ranges[1].buffers == std::vector<uint64_t>{ 2, 3 } &&
+			ranges[2].first_binding == 5 && ranges[2].buffers == std::vector<uint64_t>{ 4 } &&
+			VertexBindingRanges<uint64_t>({}, {}, {}).empty();
+	},
+	[] {
+		std::cout << "attributes of one binding must read the same buffer" << std::endl;
+		return Throws<std::invalid_argument>([] { VertexBindingRanges<uint64_t>({ 1, 1 }, { 7, 8 }, { 0, 0 }); }) &&
+			Throws<std::invalid_argument>([] { VertexBindingRanges<uint64_t>({ 1, 1 }, { 7, 7 }, { 0, 4 }); });
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
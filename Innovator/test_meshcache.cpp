@@ -0,0 +1,265 @@
+#include <Innovator/MeshCache.h>
+#include <Innovator/Testing.h>
+
+#include <cmath>
+#include <array>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// a directory in the temp directory, removed with its contents at the end of the test
+class TemporaryDirectory {
+public:
+	explicit TemporaryDirectory(const std::string& name) :
+		path(std::filesystem::temp_directory_path() / name)
+	{
+		std::filesystem::remove_all(this->path);
+		std::filesystem::create_directories(this->path);
+	}
+
+	~TemporaryDirectory()
+	{
+		std::error_code ignored;
+		std::filesystem::remove_all(this->path, ignored);
+	}
+
+	std::filesystem::path path;
+};
+
+// a binary STL of n by n quads of two triangles each on a bumpy surface
+static void WriteGrid(const std::filesystem::path& path, size_t n)
+{
+	std::ofstream file(path, std::ios::binary);
+	char header[80]{};
+	file.write(header, sizeof(header));
+	uint32_t triangles = static_cast<uint32_t>(n * n * 2);
+	file.write(reinterpret_cast<const char*>(&triangles), sizeof(triangles));
+	auto position = [n](size_t i, size_t j) {
+		float x = float(i) / float(n), y = float(j) / float(n);
+		return std::array<float, 3>{ x, y, 0.1f * std::sin(x * 7.0f) * std::cos(y * 5.0f) };
+	};
+	const float normal[3]{ 0, 0, 1 };
+	const uint16_t attribute = 0;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			std::pair<size_t, size_t> corners[6]{ { i, j }, { i + 1, j }, { i + 1, j + 1 }, { i, j }, { i + 1, j + 1 }, { i, j + 1 } };
+			for (size_t t = 0; t < 2; t++) {
+				file.write(reinterpret_cast<const char*>(normal), sizeof(normal));
+				for (size_t k = 0; k < 3; k++) {
+					auto p = position(corners[t * 3 + k].first, corners[t * 3 + k].second);
+					file.write(reinterpret_cast<const char*>(p.data()), sizeof(p));
+				}
+				file.write(reinterpret_cast<const char*>(&attribute), sizeof(attribute));
+			}
+		}
+	}
+}
+
+static bool SameStreams(const MeshStreams& a, const MeshStreams& b)
+{
+	if (a.levelCount() != b.levelCount() || a.header().vertex_stride != b.header().vertex_stride) {
+		return false;
+	}
+	for (size_t i = 0; i < a.levelCount(); i++) {
+		if (!std::ranges::equal(a.vertices(i), b.vertices(i)) ||
+			!std::ranges::equal(a.indices(i), b.indices(i)) ||
+			a.error(i) != b.error(i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "a written cache maps back to the streams it was built from" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_roundtrip");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 40);
+		auto contents = MeshCache::Build(StlLoader::Load(source, true), 3);
+		auto path = MeshCache::PathFor(source, true);
+		MeshCache::Write(*contents, MeshCache::Stamp(source), path);
+
+		MeshCacheFile file(path);
+		const MeshCacheHeader& header = file.header();
+		BoundingBox bounds = file.bounds();
+		return SameStreams(*contents, file) &&
+			file.levelCount() == 3 &&
+			header.vertex_stride == 24 &&
+			header.attribute_count == 2 &&
+			header.attributes[1].location == 1 && header.attributes[1].offset == 12 &&
+			header.index_type == MeshCache::INDEX_TYPE_UINT32 &&
+			MeshCache::IsCurrent(header, MeshCache::Stamp(source), true, 3) &&
+			bounds.min[0] == 0.0 && bounds.max[0] == 1.0 && bounds.max[1] == 1.0;
+	},
+	[] {
+		std::cout << "streams start on aligned offsets in the mapping" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_alignment");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 33);
+		auto path = MeshCache::PathFor(source, false);
+		MeshCache::Write(*MeshCache::Build(StlLoader::Load(source), 4), MeshCache::Stamp(source), path);
+
+		MeshCacheFile file(path);
+		bool aligned = true;
+		for (size_t i = 0; i < file.levelCount(); i++) {
+			aligned = aligned &&
+				reinterpret_cast<uintptr_t>(file.vertices(i).data()) % MeshCache::STREAM_ALIGNMENT == 0 &&
+				reinterpret_cast<uintptr_t>(file.indices(i).data()) % MeshCache::STREAM_ALIGNMENT == 0;
+		}
+		return aligned && file.levelCount() > 1 && file.header().file_size == std::filesystem::file_size(path);
+	},
+	[] {
+		std::cout << "loading builds the cache next to the source, and maps it the next time" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_load");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 30);
+
+		std::ostringstream first_report, second_report;
+		auto first = MeshCache::Load(source, false, 2, &first_report);
+		bool created = std::filesystem::exists(directory.path / "grid.stl.meshcache");
+		auto second = MeshCache::Load(source, false, 2, &second_report);
+		// fewer levels are in the cache already, more are not
+		std::ostringstream fewer_report, more_report;
+		auto fewer = MeshCache::Load(source, false, 1, &fewer_report);
+		auto more = MeshCache::Load(source, false, 3, &more_report);
+
+		std::cout << first_report.str();
+		return created &&
+			dynamic_cast<MeshCacheFile*>(first.get()) && dynamic_cast<MeshCacheFile*>(second.get()) &&
+			!first_report.str().empty() && second_report.str().empty() && fewer_report.str().empty() &&
+			!more_report.str().empty() && more->levelCount() == 3 &&
+			SameStreams(*first, *second) && first->levelCount() == 2 &&
+			first->indices(0).size() == 30 * 30 * 2 * 3 * sizeof(uint32_t);
+	},
+	[] {
+		std::cout << "a cache is rebuilt when its source changes" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_stale");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 10);
+		auto before = MeshCache::Load(source, false, 1);
+		before.reset();
+		WriteGrid(source, 12);
+		auto after = MeshCache::Load(source, false, 1);
+		return after->indices(0).size() == 12 * 12 * 2 * 3 * sizeof(uint32_t) &&
+			MeshCache::IsCurrent(after->header(), MeshCache::Stamp(source), false, 1) &&
+			!MeshCache::IsCurrent(after->header(), MeshCache::Stamp(source), true, 1);
+	},
+	[] {
+		std::cout << "damaged caches are reported, and rebuilt when loading" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_damaged");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 20);
+		auto path = MeshCache::PathFor(source, false);
+		MeshCache::Write(*MeshCache::Build(StlLoader::Load(source), 2), MeshCache::Stamp(source), path);
+
+		std::vector<char> bytes(std::filesystem::file_size(path));
+		std::ifstream(path, std::ios::binary).read(bytes.data(), bytes.size());
+		auto damaged = [&](std::function<void(std::vector<char>&)> damage) {
+			std::vector<char> copy = bytes;
+			damage(copy);
+			auto broken = directory.path / "broken.meshcache";
+			std::ofstream(broken, std::ios::binary | std::ios::trunc).write(copy.data(), copy.size());
+			return Throws<std::runtime_error>([&] { MeshCacheFile file(broken); });
+		};
+		auto set = [](size_t offset, auto value) {
+			return [=](std::vector<char>& b) { std::memcpy(b.data() + offset, &value, sizeof(value)); };
+		};
+		const size_t level = sizeof(MeshCacheHeader);
+
+		bool reported =
+			damaged([](std::vector<char>& b) { b.resize(b.size() - 1); }) &&
+			damaged([](std::vector<char>& b) { b.resize(100); }) &&
+			damaged([](std::vector<char>& b) { b[0] = 'X'; }) &&
+			damaged(set(offsetof(MeshCacheHeader, version), MeshCache::VERSION + 1)) &&
+			damaged(set(offsetof(MeshCacheHeader, level_count), uint32_t(1000))) &&
+			damaged(set(level + offsetof(MeshCacheLevel, index_count), uint64_t(1) << 62)) &&
+			damaged(set(level + offsetof(MeshCacheLevel, vertex_offset), uint64_t(bytes.size()))) &&
+			!damaged([](std::vector<char>&) {});
+
+		std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), 1000);
+		std::ostringstream report;
+		auto rebuilt = MeshCache::Load(source, false, 2, &report);
+		std::cout << report.str();
+		return reported && report.str().find("truncated") != std::string::npos && rebuilt->levelCount() == 2;
+	},
+	[] {
+		std::cout << "a cache that can not be written leaves the streams in memory" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_unwritable");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 15);
+		// a directory where the cache would go
+		std::filesystem::create_directories(MeshCache::PathFor(source, false) / "occupied");
+		std::ostringstream report;
+		auto streams = MeshCache::Load(source, false, 2, &report);
+		auto expected = MeshCache::Build(StlLoader::Load(source), 2);
+		std::cout << report.str();
+		return dynamic_cast<MeshCacheContents*>(streams.get()) && SameStreams(*streams, *expected) &&
+			report.str().find("in memory") != std::string::npos;
+	},
+	[] {
+		std::cout << "mapping a cache is faster than parsing the source" << std::endl;
+		TemporaryDirectory directory("innovator_meshcache_timing");
+		auto source = directory.path / "grid.stl";
+		WriteGrid(source, 400);
+		MeshCache::Load(source, true, 1);
+
+		auto t0 = std::chrono::steady_clock::now();
+		StlMesh mesh = StlLoader::Load(source, true);
+		auto t1 = std::chrono::steady_clock::now();
+		auto streams = MeshCache::Load(source, true, 1);
+		// touch every page, what the copy into a staging buffer does
+		uint64_t sum = 0;
+		for (size_t i = 0; i < streams->vertices(0).size(); i += 4096) {
+			sum += uint8_t(streams->vertices(0)[i]);
+		}
+		for (size_t i = 0; i < streams->indices(0).size(); i += 4096) {
+			sum += uint8_t(streams->indices(0)[i]);
+		}
+		auto t2 = std::chrono::steady_clock::now();
+
+		auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		std::cout << mesh.triangleCount() << " triangles: parse " << ms(t1 - t0) << " ms, map " << ms(t2 - t1) << " ms (" << sum % 2 << ")" << std::endl;
+		return dynamic_cast<MeshCacheFile*>(streams.get()) && t2 - t1 < t1 - t0;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+#include <Innovator/MeshOptimizer.h>
+#include <Innovator/Testing.h>
+
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+struct Mesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// n by n quads of two triangles each, xyz per vertex, triangles in random order
+static Mesh Grid(uint32_t n, bool shuffle = true)
+{
+	Mesh mesh;
+	for (uint32_t i = 0; i <= n; i++) {
+		for (uint32_t j = 0; j <= n; j++) {
+			float x = float(i) / float(n), y = float(j) / float(n);
+			mesh.vertices.insert(mesh.vertices.end(), { x, y, 0.1f * std::sin(x * 7.0f) * std::cos(y * 5.0f) });
+		}
+	}
+	std::vector<std::array<uint32_t, 3>> triangles;
+	auto vertex = [n](uint32_t i, uint32_t j) { return i * (n + 1) + j; };
+	for (uint32_t i = 0; i < n; i++) {
+		for (uint32_t j = 0; j < n; j++) {
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+			triangles.push_back({ vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+		}
+	}
+	if (shuffle) {
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937(42));
+	}
+	for (auto& triangle : triangles) {
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	return mesh;
+}
+
+// triangles rotated to start at their smallest index and sorted, the same winding compares equal
+static std::vector<std::array<uint32_t, 3>> Triangles(const std::vector<uint32_t>& indices)
+{
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		std::array<uint32_t, 3> triangle{ indices[t], indices[t + 1], indices[t + 2] };
+		std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+		triangles.push_back(triangle);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+static std::vector<float> Expand(const Mesh& mesh)
+{
+	std::vector<float> soup;
+	for (uint32_t index : mesh.indices) {
+		soup.insert(soup.end(), &mesh.vertices[index * 3], &mesh.vertices[index * 3] + 3);
+	}
+	return soup;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "the cache simulation counts misses per triangle and per vertex" << std::endl;
+		VertexCacheStats single = MeshOptimizer::AnalyzeVertexCache({ 0, 1, 2 }, 3);
+		// a quad reuses two vertices
+		VertexCacheStats quad = MeshOptimizer::AnalyzeVertexCache({ 0, 1, 2, 0, 2, 3 }, 4);
+		// a cache of three has evicted the first triangle when it comes around again
+		VertexCacheStats small = MeshOptimizer::AnalyzeVertexCache({ 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 6, 3);
+		// a cache of three still holds all of the first triangle when it is drawn again
+		VertexCacheStats repeated = MeshOptimizer::AnalyzeVertexCache({ 0, 1, 2, 0, 1, 2 }, 3, 3);
+		VertexCacheStats empty = MeshOptimizer::AnalyzeVertexCache({}, 0);
+		return single.acmr == 3.0 && single.atvr == 1.0 &&
+			quad.acmr == 2.0 && quad.atvr == 1.0 &&
+			small.acmr == 3.0 && small.atvr == 1.5 &&
+			repeated.acmr == 1.5 && repeated.atvr == 1.0 &&
+			empty.acmr == 0.0;
+	},
+	[] {
+		std::cout << "reordering for the cache brings ACMR close to its lower bound" << std::endl;
+		Mesh mesh = Grid(100);
+		const size_t vertex_count = mesh.vertices.size() / 3;
+		VertexCacheStats shuffled = MeshOptimizer::AnalyzeVertexCache(mesh.indices, vertex_count);
+		VertexCacheStats rows = MeshOptimizer::AnalyzeVertexCache(Grid(100, false).indices, vertex_count);
+		std::vector<uint32_t> indices = MeshOptimizer::OptimizeVertexCache(mesh.indices, vertex_count);
+		VertexCacheStats optimized = MeshOptimizer::AnalyzeVertexCache(indices, vertex_count);
+
+		std::cout << "shuffled: ";
+		shuffled.print(std::cout);
+		std::cout << ", rows: ";
+		rows.print(std::cout);
+		std::cout << ", optimized: ";
+		optimized.print(std::cout);
+		std::cout << std::endl;
+		return shuffled.acmr > 2.5 && optimized.acmr < 0.8 && optimized.acmr < rows.acmr && optimized.atvr < 1.6;
+	},
+	[] {
+		std::cout << "reordering keeps every triangle and its winding" << std::endl;
+		Mesh mesh = Grid(40);
+		// a degenerate triangle, a duplicate and an unused vertex
+		mesh.indices.insert(mesh.indices.end(), { 5, 5, 6, 0, 1, 42, 0, 1, 42 });
+		mesh.vertices.insert(mesh.vertices.end(), { 9, 9, 9 });
+		const size_t vertex_count = mesh.vertices.size() / 3;
+		std::vector<uint32_t> indices = MeshOptimizer::OptimizeVertexCache(mesh.indices, vertex_count);
+		return indices.size() == mesh.indices.size() && Triangles(indices) == Triangles(mesh.indices);
+	},
+	[] {
+		std::cout << "vertices are stored in the order they are first drawn, unused ones dropped" << std::endl;
+		Mesh mesh = Grid(30);
+		mesh.vertices.insert(mesh.vertices.begin(), { 7, 7, 7 });
+		for (uint32_t& index : mesh.indices) {
+			index++;
+		}
+		mesh.indices = MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.vertices.size() / 3);
+		std::vector<float> soup = Expand(mesh);
+
+		size_t count = MeshOptimizer::OptimizeVertexFetch(mesh.indices, mesh.vertices.data(), mesh.vertices.size() / 3, 3 * sizeof(float));
+		mesh.vertices.resize(count * 3);
+
+		uint32_t next = 0;
+		bool first_use = true;
+		for (uint32_t index : mesh.indices) {
+			first_use = first_use && index <= next;
+			next = std::max(next, index + 1);
+		}
+		return count == 31 * 31 && first_use && next == count && Expand(mesh) == soup;
+	},
+	[] {
+		std::cout << "quantized positions are within half a step of the originals" << std::endl;
+		Mesh mesh = Grid(50);
+		for (size_t i = 0; i < mesh.vertices.size(); i++) {
+			mesh.vertices[i] = mesh.vertices[i] * 40.0f - 13.0f;
+		}
+		const size_t vertex_count = mesh.vertices.size() / 3;
+		QuantizedPositions quantized = MeshOptimizer::QuantizePositions(mesh.vertices.data(), vertex_count, 3);
+		const auto& m = quantized.dequantize;
+		const float step = m[0] / 65535.0f;
+
+		float error = 0.0f;
+		for (size_t v = 0; v < vertex_count; v++) {
+			const uint16_t* q = &quantized.positions[v * 4];
+			float unorm[4]{ q[0] / 65535.0f, q[1] / 65535.0f, q[2] / 65535.0f, 1.0f };
+			float d2 = 0.0f;
+			for (size_t row = 0; row < 3; row++) {
+				// column major, what the vertex shader does with the matrix and the UNORM attribute
+				float x = m[row] * unorm[0] + m[4 + row] * unorm[1] + m[8 + row] * unorm[2] + m[12 + row] * unorm[3];
+				d2 += (x - mesh.vertices[v * 3 + row]) * (x - mesh.vertices[v * 3 + row]);
+			}
+			error = std::max(error, std::sqrt(d2));
+		}
+		std::cout << "max error " << error << " with steps of " << step << std::endl;
+		return quantized.positions.size() == vertex_count * 4 &&
+			error <= std::sqrt(3.0f) * step * 0.5f * 1.01f &&
+			std::abs(error - quantized.max_error) < step * 0.01f &&
+			m[0] == m[5] && m[5] == m[10];
+	},
+	[] {
+		std::cout << "octahedral normals decode to within a hundredth of a degree" << std::endl;
+		std::mt19937 random(7);
+		std::normal_distribution<float> gaussian;
+		std::vector<std::array<float, 3>> normals{
+			{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+		};
+		for (size_t i = 0; i < 10000; i++) {
+			std::array<float, 3> n{ gaussian(random), gaussian(random), gaussian(random) };
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			normals.push_back({ n[0] / length, n[1] / length, n[2] / length });
+		}
+		double worst = 0.0;
+		for (auto& n : normals) {
+			std::array<float, 3> d = MeshOptimizer::DecodeOctahedral(MeshOptimizer::EncodeOctahedral(n.data()));
+			// acos is too coarse for angles this small
+			double dot = double(n[0]) * d[0] + double(n[1]) * d[1] + double(n[2]) * d[2];
+			double cx = double(n[1]) * d[2] - double(n[2]) * d[1];
+			double cy = double(n[2]) * d[0] - double(n[0]) * d[2];
+			double cz = double(n[0]) * d[1] - double(n[1]) * d[0];
+			worst = std::max(worst, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot) * 180.0 / 3.14159265358979);
+		}
+		std::cout << "worst " << worst << " degrees" << std::endl;
+		return worst < 0.01;
+	},
+	[] {
+		std::cout << "bad index buffers are reported" << std::endl;
+		std::vector<uint32_t> indices{ 0, 1, 3 };
+		return Throws([&] { MeshOptimizer::OptimizeVertexCache({ 0, 1 }, 2); }) &&
+			Throws([&] { MeshOptimizer::OptimizeVertexCache(indices, 3); }) &&
+			Throws([&] { MeshOptimizer::AnalyzeVertexCache(indices, 3); }) &&
+			Throws([&] { float v[9]{}; MeshOptimizer::OptimizeVertexFetch(indices, v, 3, 12); }) &&
+			MeshOptimizer::OptimizeVertexCache({}, 0).empty();
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
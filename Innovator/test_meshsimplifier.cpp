@@ -0,0 +1,292 @@
+#include <Innovator/MeshSimplifier.h>
+
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+struct Mesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const
+	{
+		return this->vertices.size() / 3;
+	}
+};
+
+// n by n quads on a height field
+static Mesh Grid(uint32_t n, std::function<float(float, float)> height)
+{
+	Mesh mesh;
+	for (uint32_t i = 0; i <= n; i++) {
+		for (uint32_t j = 0; j <= n; j++) {
+			float x = float(i) / float(n), y = float(j) / float(n);
+			mesh.vertices.insert(mesh.vertices.end(), { x, y, height(x, y) });
+		}
+	}
+	auto vertex = [n](uint32_t i, uint32_t j) { return i * (n + 1) + j; };
+	for (uint32_t i = 0; i < n; i++) {
+		for (uint32_t j = 0; j < n; j++) {
+			mesh.indices.insert(mesh.indices.end(), { vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+			mesh.indices.insert(mesh.indices.end(), { vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+		}
+	}
+	return mesh;
+}
+
+static Mesh Bumps(uint32_t n)
+{
+	return Grid(n, [](float x, float y) { return 0.1f * std::sin(x * 7.0f) * std::cos(y * 5.0f); });
+}
+
+// a closed unit sphere of rings around the z axis
+static Mesh Sphere(uint32_t rings, uint32_t segments)
+{
+	const float pi = 3.14159265f;
+	Mesh mesh;
+	mesh.vertices.insert(mesh.vertices.end(), { 0, 0, 1 });
+	for (uint32_t r = 1; r < rings; r++) {
+		float theta = pi * float(r) / float(rings);
+		for (uint32_t s = 0; s < segments; s++) {
+			float phi = 2.0f * pi * float(s) / float(segments);
+			mesh.vertices.insert(mesh.vertices.end(), { std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta) });
+		}
+	}
+	mesh.vertices.insert(mesh.vertices.end(), { 0, 0, -1 });
+	const uint32_t south = static_cast<uint32_t>(mesh.vertexCount() - 1);
+	auto vertex = [segments](uint32_t r, uint32_t s) { return 1 + (r - 1) * segments + s % segments; };
+	for (uint32_t s = 0; s < segments; s++) {
+		mesh.indices.insert(mesh.indices.end(), { 0, vertex(1, s), vertex(1, s + 1) });
+		mesh.indices.insert(mesh.indices.end(), { south, vertex(rings - 1, s + 1), vertex(rings - 1, s) });
+	}
+	for (uint32_t r = 1; r + 1 < rings; r++) {
+		for (uint32_t s = 0; s < segments; s++) {
+			mesh.indices.insert(mesh.indices.end(), { vertex(r, s), vertex(r + 1, s), vertex(r + 1, s + 1) });
+			mesh.indices.insert(mesh.indices.end(), { vertex(r, s), vertex(r + 1, s + 1), vertex(r, s + 1) });
+		}
+	}
+	return mesh;
+}
+
+typedef std::array<double, 3> Vec;
+
+static Vec Sub(const Vec& a, const Vec& b) { return { a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+static double Dot(const Vec& a, const Vec& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+// closest point on a triangle (Ericson, Real-Time Collision Detection, 5.1.5)
+static double Distance(const Vec& p, const Vec& a, const Vec& b, const Vec& c)
+{
+	auto along = [](const Vec& o, const Vec& d, double t) { return Vec{ o[0] + d[0] * t, o[1] + d[1] * t, o[2] + d[2] * t }; };
+	auto length = [&](const Vec& q) { Vec d = Sub(p, q); return std::sqrt(Dot(d, d)); };
+	Vec ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+	double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+	if (d1 <= 0 && d2 <= 0) return length(a);
+	Vec bp = Sub(p, b);
+	double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+	if (d3 >= 0 && d4 <= d3) return length(b);
+	double vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) return length(along(a, ab, d1 / (d1 - d3)));
+	Vec cp = Sub(p, c);
+	double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+	if (d6 >= 0 && d5 <= d6) return length(c);
+	double vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) return length(along(a, ac, d2 / (d2 - d6)));
+	double va = d3 * d6 - d5 * d4;
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) return length(along(b, Sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+	double denom = 1.0 / (va + vb + vc);
+	Vec q = along(along(a, ab, vb * denom), ac, vc * denom);
+	return length(q);
+}
+
+// the furthest the surface of a gets from the surface of b, sampled at corners, edge midpoints and centers
+static double OneSided(const Mesh& mesh, const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+	auto position = [&mesh](uint32_t v) { return Vec{ mesh.vertices[v * 3], mesh.vertices[v * 3 + 1], mesh.vertices[v * 3 + 2] }; };
+	double worst = 0.0;
+	for (size_t t = 0; t < a.size(); t += 3) {
+		Vec p[3]{ position(a[t]), position(a[t + 1]), position(a[t + 2]) };
+		std::vector<Vec> samples{ p[0], p[1], p[2] };
+		for (size_t k = 0; k < 3; k++) {
+			const Vec& q = p[(k + 1) % 3];
+			samples.push_back({ (p[k][0] + q[0]) * 0.5, (p[k][1] + q[1]) * 0.5, (p[k][2] + q[2]) * 0.5 });
+		}
+		samples.push_back({ (p[0][0] + p[1][0] + p[2][0]) / 3, (p[0][1] + p[1][1] + p[2][1]) / 3, (p[0][2] + p[1][2] + p[2][2]) / 3 });
+		for (const Vec& s : samples) {
+			double nearest = std::numeric_limits<double>::max();
+			for (size_t u = 0; u < b.size() && nearest > worst; u += 3) {
+				nearest = std::min(nearest, Distance(s, position(b[u]), position(b[u + 1]), position(b[u + 2])));
+			}
+			worst = std::max(worst, nearest);
+		}
+	}
+	return worst;
+}
+
+static double Hausdorff(const Mesh& mesh, const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+	return std::max(OneSided(mesh, a, b), OneSided(mesh, b, a));
+}
+
+// every edge is shared by exactly two triangles, in opposite directions
+static bool Closed(const std::vector<uint32_t>& indices)
+{
+	std::map<std::pair<uint32_t, uint32_t>, int> edges;
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		for (size_t k = 0; k < 3; k++) {
+			edges[{ indices[t + k], indices[t + (k + 1) % 3] }]++;
+		}
+	}
+	for (auto& [edge, count] : edges) {
+		auto opposite = edges.find({ edge.second, edge.first });
+		if (count != 1 || opposite == edges.end() || opposite->second != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// a camera at distance on the z axis looking at the origin, 60 degree vertical field of view
+static Matrix4 View(double distance)
+{
+	return { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -distance, 1 };
+}
+
+static Matrix4 Perspective()
+{
+	const double f = 1.0 / std::tan(3.14159265358979 / 6.0), n = 0.1, far = 1000.0;
+	return { f, 0, 0, 0, 0, -f, 0, 0, 0, 0, far / (n - far), -1, 0, 0, n * far / (n - far), 0 };
+}
+
+static std::vector<float> Errors(const std::vector<LodLevel>& chain)
+{
+	std::vector<float> errors;
+	for (auto& level : chain) {
+		errors.push_back(level.error);
+	}
+	return errors;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "levels have about a quarter of the triangles of the one before, with growing errors" << std::endl;
+		Mesh mesh = Bumps(60);
+		auto chain = MeshSimplifier::LodChain(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, 6);
+		bool quarters = chain.size() == 6 && chain[0].indices == mesh.indices && chain[0].error == 0.0f;
+		for (size_t i = 1; i < chain.size(); i++) {
+			std::cout << "level " << i << ": " << chain[i].triangleCount() << " triangles, error " << chain[i].error << std::endl;
+			quarters = quarters &&
+				chain[i].triangleCount() * 100 <= chain[i - 1].triangleCount() * 26 &&
+				chain[i].triangleCount() * 5 >= chain[i - 1].triangleCount() &&
+				chain[i].error >= chain[i - 1].error;
+		}
+		return quarters && chain.back().triangleCount() * 500 < chain[0].triangleCount();
+	},
+	[] {
+		std::cout << "the error of a level bounds its Hausdorff distance to the full mesh" << std::endl;
+		Mesh mesh = Bumps(20);
+		auto chain = MeshSimplifier::LodChain(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, 4);
+		bool within = chain.size() == 4;
+		for (size_t i = 1; i < chain.size(); i++) {
+			double hausdorff = Hausdorff(mesh, mesh.indices, chain[i].indices);
+			std::cout << "level " << i << ": " << chain[i].triangleCount() << " triangles, Hausdorff " << hausdorff << ", error " << chain[i].error << std::endl;
+			within = within && float(hausdorff) <= chain[i].error && hausdorff > 0.0;
+		}
+		return within;
+	},
+	[] {
+		std::cout << "flat surfaces collapse without error" << std::endl;
+		Mesh mesh = Grid(30, [](float, float) { return 0.5f; });
+		MeshSimplifier simplifier(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices);
+		simplifier.simplify(0, 1e-5f);
+		std::cout << simplifier.triangleCount() << " triangles left" << std::endl;
+		return simplifier.triangleCount() <= 4 && simplifier.error() < 1e-5f &&
+			Hausdorff(mesh, mesh.indices, simplifier.indices()) < 1e-5;
+	},
+	[] {
+		std::cout << "closed meshes stay closed and close to the original" << std::endl;
+		Mesh mesh = Sphere(20, 40);
+		auto chain = MeshSimplifier::LodChain(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, 3);
+		bool closed = Closed(mesh.indices) && chain.size() == 3;
+		for (size_t i = 1; i < chain.size(); i++) {
+			double hausdorff = Hausdorff(mesh, mesh.indices, chain[i].indices);
+			std::cout << "level " << i << ": " << chain[i].triangleCount() << " triangles, Hausdorff " << hausdorff << ", error " << chain[i].error << std::endl;
+			closed = closed && Closed(chain[i].indices) && float(hausdorff) <= chain[i].error && hausdorff < 0.2;
+		}
+		return closed;
+	},
+	[] {
+		std::cout << "simplification stops at the maximum error" << std::endl;
+		Mesh mesh = Bumps(24);
+		MeshSimplifier simplifier(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices);
+		bool reached = simplifier.simplify(0, 0.002f);
+		size_t triangles = simplifier.triangleCount();
+		return !reached && triangles > 0 && triangles < mesh.indices.size() / 3 && simplifier.error() <= 0.002f &&
+			Hausdorff(mesh, mesh.indices, simplifier.indices()) <= 0.002;
+	},
+	[] {
+		std::cout << "projected errors shrink with distance and grow with scale" << std::endl;
+		BoundingBox box({ -1, -1, -1 }, { 1, 1, 1 });
+		Matrix4 projection = Perspective();
+		double near = LodSelection::ProjectedError(0.01, box, View(5), projection, 1000);
+		double far = LodSelection::ProjectedError(0.01, box, View(41), projection, 1000);
+		double inside = LodSelection::ProjectedError(0.01, box, View(0.5), projection, 1000);
+		Matrix4 orthographic{ 0.5, 0, 0, 0, 0, 0.5, 0, 0, 0, 0, -0.01, 0, 0, 0, 0, 1 };
+		double flat = LodSelection::ProjectedError(0.01, box, View(100), orthographic, 1000);
+		Matrix4 scale{ 2, 0, 0, 0, 0, 3, 0, 0, 0, 0, 1, 0, 7, 8, 9, 1 };
+		// 0.01 * cot(30 degrees) * 500 pixels at a distance of 4 and 40
+		return std::abs(near - 0.01 * 1.7320508 * 500 / 4) < 1e-6 && std::abs(far * 10 - near) < 1e-6 &&
+			std::isinf(inside) && std::abs(flat - 2.5) < 1e-9 && LodSelection::MaxScale(scale) == 3.0;
+	},
+	[] {
+		std::cout << "zoomed out views draw orders of magnitude fewer triangles" << std::endl;
+		Mesh mesh = Sphere(50, 100);
+		auto chain = MeshSimplifier::LodChain(mesh.vertices.data(), mesh.vertexCount(), 3, mesh.indices, 6);
+		std::vector<float> errors = Errors(chain);
+		BoundingBox box({ -1, -1, -1 }, { 1, 1, 1 });
+		auto level = [&](double distance) {
+			double pixels_per_unit = LodSelection::ProjectedError(1.0, box, View(distance), Perspective(), 1080);
+			return LodSelection::Select(errors, pixels_per_unit, 1.0);
+		};
+		size_t close = level(1.5), middle = level(20), distant = level(400);
+		std::cout << "distance 1.5: level " << close << ", " << chain[close].triangleCount() << " triangles, "
+			<< "distance 20: level " << middle << ", " << chain[middle].triangleCount() << " triangles, "
+			<< "distance 400: level " << distant << ", " << chain[distant].triangleCount() << " triangles" << std::endl;
+		return close <= 1 && middle > close && distant > middle &&
+			chain[distant].triangleCount() * 100 < chain[0].triangleCount();
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
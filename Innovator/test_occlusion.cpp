@@ -0,0 +1,336 @@
+#include <Innovator/Occlusion.h>
+#include <Innovator/Testing.h>
+
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+struct Mesh {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const
+	{
+		return this->vertices.size() / 3;
+	}
+
+	void quad(const std::array<float, 3>& origin, const std::array<float, 3>& u, const std::array<float, 3>& v)
+	{
+		uint32_t first = uint32_t(this->vertexCount());
+		for (int k = 0; k < 4; k++) {
+			float s = (k == 1 || k == 2) ? 1.0f : 0.0f, t = k >= 2 ? 1.0f : 0.0f;
+			for (int i = 0; i < 3; i++) {
+				this->vertices.push_back(origin[i] + u[i] * s + v[i] * t);
+			}
+		}
+		this->indices.insert(this->indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+	}
+};
+
+static std::array<double, 4> Apply(const Matrix4& m, const float* p)
+{
+	std::array<double, 4> c;
+	for (int k = 0; k < 4; k++) {
+		c[k] = m[k] * p[0] + m[4 + k] * p[1] + m[8 + k] * p[2] + m[12 + k];
+	}
+	return c;
+}
+
+// Every triangle tested at every pixel center, in double. Triangles are in front of the near
+// plane, there is no clipping.
+static std::vector<double> Reference(const Mesh& mesh, const Matrix4& m, uint32_t width, uint32_t height, std::vector<double>* edge = nullptr)
+{
+	std::vector<double> depth(size_t(width) * height, 1.0);
+	if (edge) {
+		edge->assign(depth.size(), std::numeric_limits<double>::max());
+	}
+	for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+		double x[3], y[3], z[3];
+		for (int i = 0; i < 3; i++) {
+			auto c = Apply(m, &mesh.vertices[mesh.indices[t + i] * 3]);
+			x[i] = (c[0] / c[3] * 0.5 + 0.5) * width;
+			y[i] = (c[1] / c[3] * 0.5 + 0.5) * height;
+			z[i] = c[2] / c[3];
+		}
+		double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0.0) {
+			continue;
+		}
+		for (uint32_t py = 0; py < height; py++) {
+			for (uint32_t px = 0; px < width; px++) {
+				double cx = px + 0.5, cy = py + 0.5;
+				double w[3], distance = std::numeric_limits<double>::max();
+				for (int i = 0; i < 3; i++) {
+					int j = (i + 1) % 3, k = (i + 2) % 3;
+					w[k] = ((x[j] - x[i]) * (cy - y[i]) - (y[j] - y[i]) * (cx - x[i])) / area;
+					double length = std::hypot(x[j] - x[i], y[j] - y[i]);
+					distance = std::min(distance, std::abs(w[k] * area) / length);
+				}
+				if (w[0] < 0.0 || w[1] < 0.0 || w[2] < 0.0) {
+					continue;
+				}
+				size_t pixel = size_t(py) * width + px;
+				if (edge) {
+					(*edge)[pixel] = std::min((*edge)[pixel], distance);
+				}
+				depth[pixel] = std::min(depth[pixel], w[0] * z[0] + w[1] * z[1] + w[2] * z[2]);
+			}
+		}
+	}
+	return depth;
+}
+
+// triangles of random size and orientation in front of the camera
+static Mesh Triangles(size_t count, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-6.0f, 6.0f), distance(-20.0f, -3.0f), size(-1.5f, 1.5f);
+	Mesh mesh;
+	for (size_t t = 0; t < count; t++) {
+		float cx = position(random), cy = position(random), cz = distance(random);
+		for (int i = 0; i < 3; i++) {
+			mesh.vertices.insert(mesh.vertices.end(), { cx + size(random), cy + size(random), std::min(cz + size(random), -1.0f) });
+			mesh.indices.push_back(uint32_t(mesh.indices.size()));
+		}
+	}
+	return mesh;
+}
+
+// what the hierarchy is an acceleration of: every pixel the box touches tested
+static bool FlatOccluded(const OcclusionBuffer& buffer, const BoundingBox& box, const Matrix4& m)
+{
+	double nearest = 1e30, xmin = 1e30, ymin = 1e30, xmax = -1e30, ymax = -1e30;
+	for (int i = 0; i < 8; i++) {
+		float p[3]{ float((i & 1) ? box.max[0] : box.min[0]), float((i & 2) ? box.max[1] : box.min[1]), float((i & 4) ? box.max[2] : box.min[2]) };
+		auto c = Apply(m, p);
+		if (c[2] < 0.0 || c[3] <= 0.0) {
+			return false;
+		}
+		nearest = std::min(nearest, c[2] / c[3]);
+		xmin = std::min(xmin, (c[0] / c[3] * 0.5 + 0.5) * buffer.width);
+		xmax = std::max(xmax, (c[0] / c[3] * 0.5 + 0.5) * buffer.width);
+		ymin = std::min(ymin, (c[1] / c[3] * 0.5 + 0.5) * buffer.height);
+		ymax = std::max(ymax, (c[1] / c[3] * 0.5 + 0.5) * buffer.height);
+	}
+	if (xmax < 0.0 || ymax < 0.0 || xmin >= buffer.width || ymin >= buffer.height) {
+		return false;
+	}
+	for (uint32_t y = uint32_t(std::max(ymin, 0.0)); y <= uint32_t(std::min(ymax, buffer.height - 1.0)); y++) {
+		for (uint32_t x = uint32_t(std::max(xmin, 0.0)); x <= uint32_t(std::min(xmax, buffer.width - 1.0)); x++) {
+			if (nearest <= buffer.depthAt(x, y) + OcclusionBuffer::DEPTH_BIAS) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static BoundingBox Box(double x, double y, double z, double half)
+{
+	return BoundingBox({ x - half, y - half, z - half }, { x + half, y + half, z + half });
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "the rasterizer matches a reference rasterizer" << std::endl;
+		Mesh mesh = Triangles(300, 1);
+		Matrix4 projection = Perspective(1.0, 2.0, 0.5, 50.0);
+		OcclusionBuffer buffer(256, 128);
+		buffer.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+		buffer.rasterize();
+
+		std::vector<double> edge;
+		auto reference = Reference(mesh, projection, 256, 128, &edge);
+		size_t covered = 0, mismatched = 0;
+		double error = 0.0;
+		for (uint32_t y = 0; y < 128; y++) {
+			for (uint32_t x = 0; x < 256; x++) {
+				size_t pixel = size_t(y) * 256 + x;
+				bool expected = reference[pixel] < 1.0, actual = buffer.depthAt(x, y) < 1.0f;
+				covered += expected;
+				// pixel centers on an edge may go either way
+				if (expected != actual || std::abs(reference[pixel] - buffer.depthAt(x, y)) > 1e-5) {
+					mismatched += edge[pixel] > 1e-3;
+				}
+				else if (expected) {
+					error = std::max(error, std::abs(reference[pixel] - buffer.depthAt(x, y)));
+				}
+			}
+		}
+		std::cout << covered << " pixels covered, " << mismatched << " differ, depth error " << error << std::endl;
+		return covered > 10000 && mismatched == 0;
+	},
+	[] {
+		std::cout << "occluders through the near plane are clipped to it" << std::endl;
+		// a floor from behind the camera to far ahead, below the eye
+		Mesh mesh;
+		mesh.quad({ -50.0f, -1.0f, 10.0f }, { 100.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -100.0f });
+		double near = 0.5, far = 200.0;
+		Matrix4 projection = Perspective(1.2, 1.0, near, far);
+		OcclusionBuffer buffer(64, 64);
+		buffer.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+		buffer.rasterize();
+
+		// the depth of the plane y = -1 along the ray through each pixel center
+		double f = 1.0 / std::tan(0.6), worst = 0.0;
+		size_t floor = 0;
+		for (uint32_t y = 0; y < 64; y++) {
+			for (uint32_t x = 0; x < 64; x++) {
+				double ndc_y = 2.0 * (y + 0.5) / 64 - 1.0;
+				double ndc_x = 2.0 * (x + 0.5) / 64 - 1.0;
+				// view space direction (ndc_x / f, ndc_y / f, -1)
+				if (ndc_y >= 0.0) {
+					continue;
+				}
+				double z = -f / -ndc_y;
+				// away from the far and side edges of the floor
+				if (-z < 85.0 && std::abs(ndc_x / f * z) < 45.0) {
+					double expected = (far / (near - far) * z - far * near / (far - near)) / -z;
+					worst = std::max(worst, std::abs(expected - buffer.depthAt(x, y)));
+					floor++;
+				}
+			}
+		}
+		std::cout << floor << " floor pixels, depth error " << worst << std::endl;
+		return floor > 1000 && worst < 1e-5 && buffer.depthAt(32, 63) == 1.0f;
+	},
+	[] {
+		std::cout << "the hierarchy culls only boxes that every pixel culls" << std::endl;
+		Mesh mesh = Triangles(400, 2);
+		Matrix4 projection = Perspective(1.0, 2.0, 0.5, 50.0);
+		OcclusionBuffer buffer(256, 128);
+		buffer.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+		buffer.rasterize();
+
+		std::mt19937 random(3);
+		std::uniform_real_distribution<double> position(-8.0, 8.0), distance(-30.0, -2.0), size(0.05, 2.0);
+		size_t flat = 0, hierarchical = 0;
+		bool conservative = true;
+		for (int i = 0; i < 20000; i++) {
+			BoundingBox box = Box(position(random), position(random), distance(random), size(random));
+			bool expected = FlatOccluded(buffer, box, projection);
+			bool actual = buffer.occluded(box);
+			conservative = conservative && (!actual || expected);
+			flat += expected;
+			hierarchical += actual;
+		}
+		std::cout << flat << " boxes culled testing every pixel, " << hierarchical << " by the hierarchy" << std::endl;
+		return conservative && hierarchical > flat * 7 / 10 && buffer.tested == 20000 && buffer.culled == hierarchical;
+	},
+	[] {
+		std::cout << "a wall hides most of what is behind it" << std::endl;
+		Mesh wall;
+		wall.quad({ -10.0f, -3.0f, -5.0f }, { 20.0f, 0.0f, 0.0f }, { 0.0f, 4.5f, 0.0f });
+		Matrix4 projection = Perspective(1.0, 1.5, 0.5, 100.0);
+		OcclusionBuffer buffer(192, 128);
+		buffer.add(wall.vertices.data(), wall.vertexCount(), wall.indices.data(), wall.indices.size(), Identity(), projection);
+		buffer.rasterize();
+
+		// boxes behind the wall, a tall one reaching over it, and boxes in front of it
+		size_t drawn = 0, total = 0;
+		for (int x = -10; x < 10; x++) {
+			for (int z = 0; z < 20; z++) {
+				drawn += !buffer.occluded(Box(x * 0.5, 0.0, -8.0 - z, 0.2));
+				total++;
+			}
+		}
+		bool tall = !buffer.occluded(BoundingBox({ -0.5, -1.0, -10.0 }, { 0.5, 20.0, -9.0 }));
+		bool front = !buffer.occluded(Box(0.0, 0.0, -3.0, 0.5));
+		bool wall_itself = !buffer.occluded(BoundingBox({ -10.0, -3.0, -5.0 }, { 10.0, 1.5, -5.0 }));
+		bool touching = !buffer.occluded(BoundingBox({ -1.0, -1.0, -5.5 }, { 1.0, 1.0, -5.0 }));
+		std::cout << drawn << " of " << total << " boxes behind the wall drawn" << std::endl;
+		return drawn == 0 && tall && front && wall_itself && touching;
+	},
+	[] {
+		std::cout << "rasterizing tiles in parallel gives the same depth" << std::endl;
+		Mesh mesh = Triangles(5000, 4);
+		Matrix4 projection = Perspective(1.0, 2.0, 0.5, 50.0);
+		OcclusionBuffer serial(512, 256), parallel(512, 256);
+		ThreadPool pool(4);
+		serial.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+		parallel.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+
+		auto t0 = std::chrono::steady_clock::now();
+		serial.rasterize();
+		auto t1 = std::chrono::steady_clock::now();
+		parallel.rasterize(&pool);
+		auto t2 = std::chrono::steady_clock::now();
+
+		bool same = true;
+		for (size_t level = 0; level < serial.levelCount(); level++) {
+			uint32_t w = std::max(serial.width >> level, 1u), h = std::max(serial.height >> level, 1u);
+			for (uint32_t y = 0; y < h; y++) {
+				for (uint32_t x = 0; x < w; x++) {
+					same = same && serial.farthest(level, x, y) == parallel.farthest(level, x, y);
+				}
+			}
+		}
+		auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		std::cout << "5000 triangles at 512 by 256: serial " << ms(t1 - t0) << " ms, parallel " << ms(t2 - t1) << " ms" << std::endl;
+		return same && serial.levelCount() == 10;
+	},
+	[] {
+		std::cout << "bad sizes and indices are reported, degenerate occluders are skipped" << std::endl;
+		Mesh mesh;
+		mesh.vertices = { 0, 0, -5, 1, 0, -5, 2, 0, -5, 0, 1, -5 };
+		mesh.indices = { 0, 1, 2, 0, 0, 3 };
+		OcclusionBuffer buffer(64, 64);
+		Matrix4 projection = Perspective(1.0, 1.0, 0.5, 50.0);
+		buffer.add(mesh.vertices.data(), mesh.vertexCount(), mesh.indices.data(), mesh.indices.size(), Identity(), projection);
+		std::vector<uint32_t> bad{ 0, 1, 4 };
+
+		// a box reaching through the near plane is never culled
+		OcclusionBuffer full(64, 64);
+		Mesh wall;
+		wall.quad({ -10.0f, -10.0f, -2.0f }, { 20.0f, 0.0f, 0.0f }, { 0.0f, 20.0f, 0.0f });
+		full.add(wall.vertices.data(), wall.vertexCount(), wall.indices.data(), wall.indices.size(), Identity(), projection);
+		full.rasterize();
+
+		return buffer.triangleCount() == 0 &&
+			Throws<std::logic_error>([] { OcclusionBuffer(62, 64); }) &&
+			Throws<std::logic_error>([] { OcclusionBuffer(64, 0); }) &&
+			Throws<std::logic_error>([&] { buffer.add(mesh.vertices.data(), mesh.vertexCount(), bad.data(), bad.size(), Identity(), projection); }) &&
+			full.occluded(Box(0.0, 0.0, -10.0, 1.0)) &&
+			!full.occluded(BoundingBox({ -1.0, -1.0, -10.0 }, { 1.0, 1.0, 1.0 })) &&
+			!full.occluded(BoundingBox::Infinite()) &&
+			!OcclusionBuffer(64, 64).occluded(Box(0.0, 0.0, -10.0, 1.0));
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+#include <Innovator/Pipelines.h>
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// the state a draw command hands to the registry, with handles and enums as plain integers
+struct FakePipelineState {
+	uint64_t renderpass{ 1 };
+	uint64_t layout{ 2 };
+	uint64_t topology{ 3 };
+	uint64_t cull_mode{ 1 };
+	float line_width{ 1.0f };
+	std::vector<PipelineKey::Item> stages{ { 0x1, 10 }, { 0x10, 11 } };
+	std::vector<PipelineKey::Item> bindings{ { 0, 12, 0 }, { 1, 12, 0 } };
+	std::vector<PipelineKey::Item> attributes{ { 0, 0, 106, 0 }, { 1, 1, 106, 0 } };
+
+	PipelineKey key() const
+	{
+		PipelineKey key;
+		key.add(this->renderpass);
+		key.add(this->layout);
+		key.add(this->topology);
+		key.add(this->cull_mode);
+		key.addFloat(this->line_width);
+		key.addUnordered(this->stages);
+		key.addUnordered(this->bindings);
+		key.addUnordered(this->attributes);
+		return key;
+	}
+};
+
+static PipelineCacheHeader DeviceHeader()
+{
+	PipelineCacheHeader header;
+	header.vendor_id = 0x10005;
+	header.device_id = 1;
+	header.driver_version = 42;
+	for (uint8_t i = 0; i < header.uuid.size(); i++) {
+		header.uuid[i] = i;
+	}
+	return header;
+}
+
+static std::vector<char> Blob(size_t size)
+{
+	std::vector<char> data(size);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = static_cast<char>(i * 31 + 7);
+	}
+	return data;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "pipeline keys don't depend on the order of stages, bindings and attributes" << std::endl;
+		FakePipelineState a;
+		FakePipelineState b;
+		std::reverse(b.stages.begin(), b.stages.end());
+		std::reverse(b.bindings.begin(), b.bindings.end());
+		std::reverse(b.attributes.begin(), b.attributes.end());
+		return a.key() == b.key() && a.key().hash() == b.key().hash();
+	},
+	[] {
+		std::cout << "pipeline keys differ in every piece of state" << std::endl;
+		FakePipelineState base;
+		std::vector<FakePipelineState> others(8);
+		others[0].renderpass = 9;
+		others[1].layout = 9;
+		others[2].topology = 9;
+		others[3].cull_mode = 2;
+		others[4].line_width = 2.0f;
+		others[5].stages[1][1] = 12;
+		others[6].bindings[1][1] = 16;
+		others[7].attributes.pop_back();
+		return std::none_of(others.begin(), others.end(), [&](const FakePipelineState& other) {
+			return other.key() == base.key() || other.key().hash() == base.key().hash();
+			});
+	},
+	[] {
+		std::cout << "length prefixes keep sections apart" << std::endl;
+		PipelineKey a;
+		a.addList(std::vector<uint64_t>{ 1, 2 });
+		a.addList(std::vector<uint64_t>{ 3 });
+		PipelineKey b;
+		b.addList(std::vector<uint64_t>{ 1 });
+		b.addList(std::vector<uint64_t>{ 2, 3 });
+		PipelineKey c;
+		c.addString("main");
+		PipelineKey d;
+		d.addString("mai");
+		d.add('n');
+		return !(a == b) && !(c == d);
+	},
+	[] {
+		std::cout << "a scene of many shapes creates only the unique pipelines" << std::endl;
+		ObjectCache<PipelineKey, int> registry;
+		int created = 0;
+		for (int shape = 0; shape < 5000; shape++) {
+			FakePipelineState state;
+			state.cull_mode = shape % 3;
+			if (shape % 2) {
+				std::reverse(state.attributes.begin(), state.attributes.end());
+			}
+			registry.get(state.key(), [&]() { return std::make_shared<int>(++created); });
+		}
+		return created == 3 && registry.size() == 3 && registry.hits == 4997;
+	},
+	[] {
+		std::cout << "cache blob round trips through the file format" << std::endl;
+		auto data = Blob(1000);
+		auto parsed = PipelineCacheFile::Parse(PipelineCacheFile::Serialize(DeviceHeader(), data), DeviceHeader());
+		return parsed && *parsed == data;
+	},
+	[] {
+		std::cout << "empty blob round trips" << std::endl;
+		auto parsed = PipelineCacheFile::Parse(PipelineCacheFile::Serialize(DeviceHeader(), {}), DeviceHeader());
+		return parsed && parsed->empty();
+	},
+	[] {
+		std::cout << "blobs from another device or driver are rejected" << std::endl;
+		auto bytes = PipelineCacheFile::Serialize(DeviceHeader(), Blob(100));
+		std::vector<PipelineCacheHeader> others(4, DeviceHeader());
+		others[0].uuid[15] ^= 1;
+		others[1].vendor_id++;
+		others[2].device_id++;
+		others[3].driver_version++;
+		return std::none_of(others.begin(), others.end(), [&](const PipelineCacheHeader& other) {
+			return PipelineCacheFile::Parse(bytes, other).has_value();
+			});
+	},
+	[] {
+		std::cout << "the header is written without padding, the same bytes every time" << std::endl;
+		auto bytes = PipelineCacheFile::Serialize(DeviceHeader(), Blob(100));
+		PipelineCacheHeader header;
+		header.read(bytes.data());
+		return PipelineCacheHeader::SIZE < sizeof(PipelineCacheHeader) &&
+			bytes.size() == PipelineCacheHeader::SIZE + 100 &&
+			bytes == PipelineCacheFile::Serialize(DeviceHeader(), Blob(100)) &&
+			header.compatible(DeviceHeader()) && header.size == 100;
+	},
+	[] {
+		std::cout << "blobs of another file version are rejected" << std::endl;
+		auto bytes = PipelineCacheFile::Serialize(DeviceHeader(), Blob(100));
+		PipelineCacheHeader header;
+		header.read(bytes.data());
+		header.version++;
+		header.write(bytes.data());
+		return !PipelineCacheFile::Parse(bytes, DeviceHeader()).has_value();
+	},
+	[] {
+		std::cout << "truncated, extended and corrupted files are rejected" << std::endl;
+		auto bytes = PipelineCacheFile::Serialize(DeviceHeader(), Blob(100));
+
+		auto truncated = bytes;
+		truncated.pop_back();
+		auto header_only = std::vector<char>(bytes.begin(), bytes.begin() + PipelineCacheHeader::SIZE - 1);
+		auto extended = bytes;
+		extended.push_back(0);
+		auto corrupted = bytes;
+		corrupted[PipelineCacheHeader::SIZE + 50] ^= 0x40;
+
+		return !PipelineCacheFile::Parse(truncated, DeviceHeader()) &&
+			!PipelineCacheFile::Parse(header_only, DeviceHeader()) &&
+			!PipelineCacheFile::Parse(extended, DeviceHeader()) &&
+			!PipelineCacheFile::Parse(corrupted, DeviceHeader()) &&
+			!PipelineCacheFile::Parse({}, DeviceHeader());
+	},
+	[] {
+		std::cout << "cache file is written, replaced and read back" << std::endl;
+		auto path = std::filesystem::temp_directory_path() / "test_pipelines.pipelinecache";
+		std::filesystem::remove(path);
+
+		bool missing = !PipelineCacheFile::Read(path, DeviceHeader()).has_value();
+		PipelineCacheFile::Write(path, DeviceHeader(), Blob(10));
+		PipelineCacheFile::Write(path, DeviceHeader(), Blob(5000));
+		auto read = PipelineCacheFile::Read(path, DeviceHeader());
+
+		auto temporary = path;
+		temporary += ".tmp";
+		bool clean = !std::filesystem::exists(temporary);
+		std::filesystem::remove(path);
+		return missing && read && *read == Blob(5000) && clean;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
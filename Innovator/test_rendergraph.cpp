@@ -0,0 +1,245 @@
+#include <Innovator/RenderGraph.h>
+#include <Innovator/Testing.h>
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+typedef RenderGraph::Layout Layout;
+
+// compares the plan as text with what it should be, prints both if they differ
+bool golden(const RenderGraph& graph, const std::string& expected)
+{
+	std::stringstream out;
+	graph.compile().print(out);
+	if (out.str() != expected) {
+		std::cout << std::endl << "expected:" << std::endl << expected << "got:" << std::endl << out.str();
+		return false;
+	}
+	return true;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "the frame of the sparse texture viewer ";
+		RenderGraph graph;
+		const RenderGraph::Memory lod_memory{ 240 * 136 * 4, 256, 1 };
+		const RenderGraph::Memory memory{ 1920 * 1080 * 4, 1024, 1 };
+		size_t lod_color = graph.transient("lod color", lod_memory);
+		size_t lod_depth = graph.transient("lod depth", lod_memory);
+		size_t feedback = graph.import("feedback", Layout::GENERAL, Layout::GENERAL);
+		size_t color = graph.transient("color", memory);
+		size_t depth = graph.transient("depth", memory);
+		size_t swapchain = graph.import("swapchain", Layout::UNDEFINED, Layout::PRESENT);
+
+		size_t lod = graph.pass("lod");
+		graph.use(lod, lod_color, RenderGraph::COLOR_ATTACHMENT, Layout::TRANSFER_SRC);
+		graph.use(lod, lod_depth, RenderGraph::DEPTH_ATTACHMENT);
+		size_t readback = graph.pass("readback");
+		graph.use(readback, lod_color, RenderGraph::TRANSFER_SRC);
+		graph.use(readback, feedback, RenderGraph::TRANSFER_DST);
+		size_t main = graph.pass("main");
+		graph.use(main, color, RenderGraph::COLOR_ATTACHMENT);
+		graph.use(main, depth, RenderGraph::DEPTH_ATTACHMENT);
+		size_t present = graph.pass("present");
+		graph.use(present, color, RenderGraph::TRANSFER_SRC);
+		graph.use(present, swapchain, RenderGraph::TRANSFER_DST);
+
+		return golden(graph,
+			"before lod:\n"
+			"  lod color: TRANSFER_SRC -> COLOR_ATTACHMENT, UNDEFINED -> COLOR_ATTACHMENT\n"
+			"  lod depth: DEPTH_ATTACHMENT|TRANSFER_SRC -> DEPTH_ATTACHMENT, UNDEFINED -> DEPTH_ATTACHMENT\n"
+			"before readback:\n"
+			"  lod color: COLOR_ATTACHMENT -> TRANSFER_SRC\n"
+			"  feedback: none -> TRANSFER_DST, GENERAL -> TRANSFER_DST\n"
+			"before main:\n"
+			"  color: DEPTH_ATTACHMENT|TRANSFER_SRC -> COLOR_ATTACHMENT, UNDEFINED -> COLOR_ATTACHMENT\n"
+			"  depth: DEPTH_ATTACHMENT -> DEPTH_ATTACHMENT, UNDEFINED -> DEPTH_ATTACHMENT\n"
+			"before present:\n"
+			"  color: COLOR_ATTACHMENT -> TRANSFER_SRC, COLOR_ATTACHMENT -> TRANSFER_SRC\n"
+			"  swapchain: none -> TRANSFER_DST, UNDEFINED -> TRANSFER_DST\n"
+			"at the end:\n"
+			"  feedback: TRANSFER_DST -> none, TRANSFER_DST -> GENERAL\n"
+			"  swapchain: TRANSFER_DST -> none, TRANSFER_DST -> PRESENT\n"
+			"lod color: heap 0 at 0\n"
+			"lod depth: heap 0 at 130560\n"
+			"color: heap 0 at 0\n"
+			"depth: heap 0 at 8294400\n"
+			"heap of type 1: 16588800 bytes\n");
+	},
+	[] {
+		std::cout << "reads after reads need no barrier, a write after reads waits for all of them ";
+		RenderGraph graph;
+		size_t image = graph.import("image", Layout::SHADER_READ_ONLY, Layout::SHADER_READ_ONLY);
+		size_t a = graph.pass("a");
+		graph.use(a, image, RenderGraph::SAMPLED);
+		size_t b = graph.pass("b");
+		graph.use(b, image, RenderGraph::SAMPLED);
+		size_t c = graph.pass("c");
+		graph.use(c, image, RenderGraph::INPUT_ATTACHMENT);
+		size_t d = graph.pass("d");
+		graph.use(d, image, RenderGraph::STORAGE_WRITE);
+		size_t e = graph.pass("e");
+		graph.use(e, image, RenderGraph::STORAGE_WRITE);
+		size_t f = graph.pass("f");
+		graph.use(f, image, RenderGraph::STORAGE_READ);
+		size_t g = graph.pass("g");
+		graph.use(g, image, RenderGraph::STORAGE_READ);
+
+		return golden(graph,
+			"before d:\n"
+			"  image: INPUT_ATTACHMENT|SAMPLED -> STORAGE_WRITE, SHADER_READ_ONLY -> GENERAL\n"
+			"before e:\n"
+			"  image: STORAGE_WRITE -> STORAGE_WRITE\n"
+			"before f:\n"
+			"  image: STORAGE_WRITE -> STORAGE_READ\n"
+			"at the end:\n"
+			"  image: STORAGE_READ|STORAGE_WRITE -> none, GENERAL -> SHADER_READ_ONLY\n");
+	},
+	[] {
+		std::cout << "a write is made visible to each kind of read once, an image in place needs no barrier ";
+		RenderGraph graph;
+		size_t image = graph.import("image", Layout::GENERAL, Layout::UNDEFINED);
+		size_t a = graph.pass("a");
+		graph.use(a, image, RenderGraph::STORAGE_WRITE);
+		size_t b = graph.pass("b");
+		graph.use(b, image, RenderGraph::STORAGE_READ);
+		size_t c = graph.pass("c");
+		graph.use(c, image, RenderGraph::STORAGE_READ);
+		size_t d = graph.pass("d");
+		graph.use(d, image, RenderGraph::TRANSFER_SRC);
+		size_t e = graph.pass("e");
+		graph.use(e, image, RenderGraph::TRANSFER_SRC);
+
+		return golden(graph,
+			"before b:\n"
+			"  image: STORAGE_WRITE -> STORAGE_READ\n"
+			"before d:\n"
+			"  image: STORAGE_READ|STORAGE_WRITE -> TRANSFER_SRC, GENERAL -> TRANSFER_SRC\n");
+	},
+	[] {
+		std::cout << "transients that live at the same time do not share memory, the others do ";
+		RenderGraph graph;
+		size_t a = graph.transient("a", { 1000, 256, 3 });
+		size_t b = graph.transient("b", { 3000, 256, 3 });
+		size_t c = graph.transient("c", { 2000, 512, 3 });
+		size_t d = graph.transient("d", { 500, 64, 7 });
+		size_t e = graph.transient("e", { 100, 64, 3 });
+
+		// a and b live in passes 0-1, c in 2-3, d in 1-2, e is never used
+		size_t p0 = graph.pass("p0");
+		graph.use(p0, a, RenderGraph::COLOR_ATTACHMENT);
+		graph.use(p0, b, RenderGraph::DEPTH_ATTACHMENT);
+		size_t p1 = graph.pass("p1");
+		graph.use(p1, a, RenderGraph::SAMPLED);
+		graph.use(p1, b, RenderGraph::DEPTH_READ);
+		graph.use(p1, d, RenderGraph::STORAGE_WRITE);
+		size_t p2 = graph.pass("p2");
+		graph.use(p2, c, RenderGraph::COLOR_ATTACHMENT);
+		graph.use(p2, d, RenderGraph::SAMPLED);
+		size_t p3 = graph.pass("p3");
+		graph.use(p3, c, RenderGraph::SAMPLED);
+
+		RenderGraph::Plan plan = graph.compile();
+		std::cout << plan.transient_bytes << " bytes in " << plan.heap_bytes << " ";
+		bool placed =
+			plan.placements[b]->offset == 0 &&
+			plan.placements[c]->offset == 0 &&
+			plan.placements[a]->offset == 3072 &&
+			plan.placements[a]->heap == plan.placements[c]->heap &&
+			plan.placements[d]->heap != plan.placements[c]->heap &&
+			!plan.placements[e] &&
+			plan.heaps.size() == 2 &&
+			plan.heaps[0].size == 4072 && plan.heaps[0].alignment == 512 &&
+			plan.heaps[1].size == 500 &&
+			plan.transient_bytes == 6500 && plan.heap_bytes == 4572;
+
+		// c takes over the memory of b in this frame, b that of c from the frame before
+		auto& first = plan.barriers[p0];
+		auto& third = plan.barriers[p2];
+		const uint32_t shared = RenderGraph::DEPTH_READ | RenderGraph::SAMPLED;
+		bool handed = first[1].resource == b && first[1].src == shared &&
+			third[0].resource == c && third[0].src == shared &&
+			third[0].old_layout == Layout::UNDEFINED &&
+			first[0].resource == a && first[0].src == RenderGraph::SAMPLED;
+		return placed && handed;
+	},
+	[] {
+		std::cout << "the last use may leave an image in another layout ";
+		RenderGraph graph;
+		size_t image = graph.import("image", Layout::UNDEFINED, Layout::SHADER_READ_ONLY);
+		size_t a = graph.pass("a");
+		graph.use(a, image, RenderGraph::COLOR_ATTACHMENT, Layout::SHADER_READ_ONLY);
+		size_t b = graph.pass("b");
+		graph.use(b, image, RenderGraph::SAMPLED);
+
+		return golden(graph,
+			"before a:\n"
+			"  image: none -> COLOR_ATTACHMENT, UNDEFINED -> COLOR_ATTACHMENT\n"
+			"before b:\n"
+			"  image: COLOR_ATTACHMENT -> SAMPLED\n");
+	},
+	[] {
+		std::cout << "uses that make no sense are refused ";
+		RenderGraph graph;
+		size_t image = graph.transient("image", { 64, 64, 1 });
+		size_t pass = graph.pass("pass");
+		bool read_first = Throws<std::invalid_argument>([&] {
+			RenderGraph g = graph;
+			g.use(pass, image, RenderGraph::SAMPLED);
+			g.compile();
+		});
+		bool twice = Throws<std::invalid_argument>([&] {
+			RenderGraph g = graph;
+			g.use(pass, image, RenderGraph::COLOR_ATTACHMENT);
+			g.use(pass, image, RenderGraph::SAMPLED);
+		});
+		bool two_bits = Throws<std::invalid_argument>([&] {
+			RenderGraph g = graph;
+			g.use(pass, image, RenderGraph::Usage(RenderGraph::SAMPLED | RenderGraph::TRANSFER_SRC));
+		});
+		bool no_pass = Throws<std::out_of_range>([&] {
+			RenderGraph g = graph;
+			g.use(pass + 1, image, RenderGraph::COLOR_ATTACHMENT);
+		});
+		bool alignment = Throws<std::invalid_argument>([&] {
+			RenderGraph g = graph;
+			g.transient("bad", { 64, 48, 1 });
+		});
+		return read_first && twice && two_bits && no_pass && alignment;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
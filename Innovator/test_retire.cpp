@@ -0,0 +1,168 @@
+#include <Innovator/Retire.h>
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// stands in for the frame fences: frames are submitted in order and complete in order
+class FakeFenceClock {
+public:
+	uint64_t submit()
+	{
+		return ++this->submitted;
+	}
+
+	void signal(uint64_t serial)
+	{
+		this->completed = std::max(this->completed, std::min(serial, this->submitted));
+	}
+
+	uint64_t submitted{ 0 };
+	uint64_t completed{ 0 };
+};
+
+// counts live instances so the tests can observe when the queue releases them
+class Resource {
+public:
+	Resource() { live++; }
+	~Resource() { live--; }
+	static inline int live{ 0 };
+};
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "object is kept alive until its frame completes" << std::endl;
+		FakeFenceClock clock;
+		RetireQueue queue;
+		uint64_t frame = clock.submit();
+		queue.retire(std::make_shared<Resource>(), frame);
+		queue.collect(clock.completed);
+		bool alive = Resource::live == 1;
+		clock.signal(frame);
+		queue.collect(clock.completed);
+		return alive && Resource::live == 0 && queue.empty();
+	},
+	[] {
+		std::cout << "unique_ptr and shared_ptr are both accepted" << std::endl;
+		RetireQueue queue;
+		queue.retire(std::make_unique<Resource>(), 1);
+		queue.retire(std::make_shared<Resource>(), 1);
+		bool alive = Resource::live == 2;
+		queue.collect(1);
+		return alive && Resource::live == 0;
+	},
+	[] {
+		std::cout << "null objects are ignored" << std::endl;
+		RetireQueue queue;
+		std::shared_ptr<Resource> empty;
+		queue.retire(std::move(empty), 1);
+		queue.retire(std::unique_ptr<Resource>(), 1);
+		return queue.empty();
+	},
+	[] {
+		std::cout << "objects retire in batches at frame boundaries" << std::endl;
+		FakeFenceClock clock;
+		RetireQueue queue;
+		std::vector<uint64_t> frames;
+		for (int i = 0; i < 3; i++) {
+			frames.push_back(clock.submit());
+			for (int j = 0; j < 4; j++) {
+				queue.retire(std::make_shared<Resource>(), frames.back());
+			}
+		}
+		clock.signal(frames[0]);
+		size_t first = queue.collect(clock.completed);
+		clock.signal(frames[2]);
+		size_t rest = queue.collect(clock.completed);
+		return first == 4 && rest == 8 && Resource::live == 0;
+	},
+	[] {
+		std::cout << "an object shared with the scene outlives retirement" << std::endl;
+		RetireQueue queue;
+		auto object = std::make_shared<Resource>();
+		queue.retire(object, 1);
+		queue.collect(1);
+		bool alive = Resource::live == 1;
+		object.reset();
+		return alive && Resource::live == 0;
+	},
+	[] {
+		std::cout << "out of order serials are kept sorted" << std::endl;
+		RetireQueue queue;
+		queue.retire(std::make_shared<Resource>(), 5);
+		queue.retire(std::make_shared<Resource>(), 2);
+		queue.retire(std::make_shared<Resource>(), 7);
+		size_t first = queue.collect(2);
+		size_t second = queue.collect(6);
+		size_t third = queue.collect(7);
+		return first == 1 && second == 1 && third == 1 && Resource::live == 0;
+	},
+	[] {
+		std::cout << "completed serials never run ahead of submission" << std::endl;
+		FakeFenceClock clock;
+		RetireQueue queue;
+		uint64_t frame = clock.submit();
+		queue.retire(std::make_shared<Resource>(), frame + 1);
+		clock.signal(frame + 10);
+		queue.collect(clock.completed);
+		bool alive = Resource::live == 1;
+		queue.clear();
+		return alive && Resource::live == 0;
+	},
+	[] {
+		std::cout << "ring of 3 frames in flight, steady state" << std::endl;
+		const uint64_t depth = 3;
+		FakeFenceClock clock;
+		RetireQueue queue;
+		int max_live = 0;
+		for (int i = 0; i < 100; i++) {
+			// begin frame: wait for the frame that last used this slot
+			if (clock.submitted >= depth) {
+				clock.signal(clock.submitted - depth + 1);
+			}
+			queue.collect(clock.completed);
+			uint64_t frame = clock.submit();
+			queue.retire(std::make_shared<Resource>(), frame);
+			max_live = std::max(max_live, Resource::live);
+		}
+		clock.signal(clock.submitted);
+		queue.collect(clock.completed);
+		return max_live == static_cast<int>(depth) && Resource::live == 0;
+	},
+};
+
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
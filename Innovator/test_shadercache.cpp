@@ -0,0 +1,269 @@
+#include <Innovator/ShaderCache.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// stands in for shaderc: a valid SPIR-V header followed by a digest of the source
+class FakeCompiler {
+public:
+	ShaderCompiler::Spirv operator()(const ShaderSource& source)
+	{
+		int running = ++this->active;
+		int peak = this->max_active.load();
+		while (running > peak && !this->max_active.compare_exchange_weak(peak, running));
+
+		this->invocations++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(this->delay_ms));
+		this->active--;
+
+		if (source.glsl.find("error") != std::string::npos) {
+			throw std::runtime_error("syntax error");
+		}
+		return Expected(source);
+	}
+
+	static ShaderCompiler::Spirv Expected(const ShaderSource& source)
+	{
+		ShaderCompiler::Spirv spv{ SpirvCache::SPIRV_MAGIC, 0x00010500, 0, 16, 0 };
+		spv.push_back(source.kind);
+		for (char c : source.glsl) {
+			spv.push_back(static_cast<uint8_t>(c));
+		}
+		for (auto& [name, value] : source.defines) {
+			spv.push_back(name.size());
+			spv.push_back(value.size());
+		}
+		return spv;
+	}
+
+	std::atomic<int> invocations{ 0 };
+	std::atomic<int> active{ 0 };
+	std::atomic<int> max_active{ 0 };
+	int delay_ms{ 0 };
+};
+
+// a fresh cache directory per test
+class TemporaryDirectory {
+public:
+	explicit TemporaryDirectory(const std::string& name) :
+		path(std::filesystem::temp_directory_path() / name)
+	{
+		std::filesystem::remove_all(this->path);
+	}
+
+	~TemporaryDirectory()
+	{
+		std::filesystem::remove_all(this->path);
+	}
+
+	std::filesystem::path path;
+};
+
+static std::vector<ShaderSource> Scene()
+{
+	std::vector<ShaderSource> sources;
+	for (uint32_t i = 0; i < 8; i++) {
+		sources.push_back({ .glsl = "void main() { /* shader " + std::to_string(i) + " */ }", .kind = i % 2 });
+	}
+	return sources;
+}
+
+static std::unique_ptr<ShaderCompiler> Compiler(FakeCompiler& fake, const std::filesystem::path& directory, size_t threads = 4)
+{
+	return std::make_unique<ShaderCompiler>(
+		[&fake](const ShaderSource& source) { return fake(source); },
+		directory,
+		"fake 1.0",
+		threads);
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "cache keys differ in source, stage, defines and compiler version" << std::endl;
+		SpirvCache cache("unused", "fake 1.0");
+		SpirvCache other_version("unused", "fake 1.1");
+		ShaderSource base{ .glsl = "void main() {}", .kind = 0 };
+
+		std::vector<std::string> keys{
+			cache.key({ .glsl = "void main() { }", .kind = 0 }),
+			cache.key({ .glsl = "void main() {}", .kind = 1 }),
+			cache.key({ .glsl = "void main() {}", .kind = 0, .defines = { { "TILE", "8" } } }),
+			cache.key({ .glsl = "void main() {}", .kind = 0, .defines = { { "TILE", "16" } } }),
+			cache.key({ .glsl = "void main() {}", .kind = 0, .defines = { { "TILE8", "" } } }),
+			other_version.key(base),
+		};
+		std::string key = cache.key(base);
+		return key.size() == 32 && key == cache.key(base) &&
+			std::none_of(keys.begin(), keys.end(), [&](const std::string& other) { return other == key; });
+	},
+	[] {
+		std::cout << "a warm start does no compiles and gets the same SPIR-V" << std::endl;
+		TemporaryDirectory directory("test_shadercache_warm");
+		auto sources = Scene();
+
+		FakeCompiler cold;
+		{
+			auto compiler = Compiler(cold, directory.path);
+			for (auto& source : sources) {
+				if (compiler->compile(source).get() != FakeCompiler::Expected(source)) {
+					return false;
+				}
+			}
+		}
+
+		FakeCompiler warm;
+		auto compiler = Compiler(warm, directory.path);
+		for (auto& source : sources) {
+			if (compiler->compile(source).get() != FakeCompiler::Expected(source)) {
+				return false;
+			}
+		}
+		return cold.invocations == 8 && warm.invocations == 0 && compiler->stats.hits == 8;
+	},
+	[] {
+		std::cout << "identical shaders in a scene compile once" << std::endl;
+		TemporaryDirectory directory("test_shadercache_shared");
+		FakeCompiler fake;
+		fake.delay_ms = 20;
+		auto compiler = Compiler(fake, directory.path);
+		ShaderSource source{ .glsl = "void main() {}", .kind = 4 };
+
+		std::vector<std::shared_future<ShaderCompiler::Spirv>> results;
+		for (int i = 0; i < 16; i++) {
+			results.push_back(compiler->compile(source));
+		}
+		bool same = std::all_of(results.begin(), results.end(), [&](auto& result) {
+			return result.get() == FakeCompiler::Expected(source);
+			});
+		return same && fake.invocations == 1 && compiler->stats.shared == 15;
+	},
+	[] {
+		std::cout << "misses compile concurrently and don't block the caller" << std::endl;
+		TemporaryDirectory directory("test_shadercache_parallel");
+		FakeCompiler fake;
+		fake.delay_ms = 50;
+		auto compiler = Compiler(fake, directory.path, 4);
+
+		auto t0 = std::chrono::steady_clock::now();
+		std::vector<std::shared_future<ShaderCompiler::Spirv>> results;
+		for (auto& source : Scene()) {
+			results.push_back(compiler->compile(source));
+		}
+		auto submitted = std::chrono::steady_clock::now() - t0;
+		for (auto& result : results) {
+			result.wait();
+		}
+		return submitted < std::chrono::milliseconds(50) && fake.max_active > 1 && fake.invocations == 8;
+	},
+	[] {
+		std::cout << "corrupt cache files are recompiled and replaced" << std::endl;
+		TemporaryDirectory directory("test_shadercache_corrupt");
+		ShaderSource source{ .glsl = "void main() {}", .kind = 0 };
+		SpirvCache cache(directory.path, "fake 1.0");
+		std::filesystem::create_directories(directory.path);
+		{
+			std::ofstream file(cache.path(cache.key(source)), std::ios::binary);
+			file << "not spir-v at all";
+		}
+
+		FakeCompiler fake;
+		bool recompiled = Compiler(fake, directory.path)->compile(source).get() == FakeCompiler::Expected(source);
+		auto stored = cache.load(cache.key(source));
+		return recompiled && fake.invocations == 1 && stored && *stored == FakeCompiler::Expected(source);
+	},
+	[] {
+		std::cout << "compile errors reach the caller and are not cached" << std::endl;
+		TemporaryDirectory directory("test_shadercache_error");
+		ShaderSource source{ .glsl = "error", .kind = 0 };
+		FakeCompiler fake;
+		auto result = Compiler(fake, directory.path)->compile(source);
+		try {
+			result.get();
+			return false;
+		}
+		catch (std::runtime_error&) {}
+
+		SpirvCache cache(directory.path, "fake 1.0");
+		return !cache.load(cache.key(source)).has_value();
+	},
+	[] {
+		std::cout << "mapped files see the file contents" << std::endl;
+		TemporaryDirectory directory("test_shadercache_mapped");
+		std::filesystem::create_directories(directory.path);
+		auto path = directory.path / "file";
+		auto empty = directory.path / "empty";
+		{
+			std::ofstream(path, std::ios::binary) << "mapped contents";
+			std::ofstream(empty, std::ios::binary);
+		}
+		MappedFile file(path);
+		MappedFile nothing(empty);
+		bool missing = false;
+		try {
+			MappedFile absent(directory.path / "absent");
+		}
+		catch (std::runtime_error&) {
+			missing = true;
+		}
+		return std::string(file.data(), file.size()) == "mapped contents" && nothing.size() == 0 && missing;
+	},
+	[] {
+		std::cout << "thread pool runs queued tasks before it is destroyed" << std::endl;
+		std::atomic<int> done{ 0 };
+		std::vector<std::future<int>> results;
+		{
+			ThreadPool pool(2);
+			for (int i = 0; i < 100; i++) {
+				results.push_back(pool.submit([i, &done]() {
+					done++;
+					return i * i;
+					}));
+			}
+		}
+		bool values = true;
+		for (int i = 0; i < 100; i++) {
+			values = values && results[i].get() == i * i;
+		}
+		return done == 100 && values;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
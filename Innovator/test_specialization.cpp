@@ -0,0 +1,150 @@
+#include <Innovator/Specialization.h>
+#include <Innovator/Testing.h>
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+static const std::string glsl = R"(
+	#version 450
+	layout(constant_id = 3) const float TILE_WIDTH = 1.0;
+	layout (constant_id=0) const uint TEXTURE_WIDTH = 1;
+	layout(constant_id = 7)
+		const int LOD_BIAS = 0;
+	layout(constant_id = 2) const bool WIREFRAME = false;
+	const float NOT_A_CONSTANT = 2.0;
+	void main() {}
+)";
+
+template <typename T>
+static T Read(const SpecializationData& packed, size_t entry)
+{
+	T value;
+	std::memcpy(&value, packed.data.data() + packed.entries[entry].offset, sizeof(T));
+	return value;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests
+{
+	[] {
+		std::cout << "constant declarations are read from the source" << std::endl;
+		auto declarations = ParseSpecializationConstants(glsl);
+		return declarations.size() == 4 &&
+			declarations[0].name == "TILE_WIDTH" && declarations[0].id == 3 && declarations[0].type == SpecializationDeclaration::FLOAT &&
+			declarations[1].name == "TEXTURE_WIDTH" && declarations[1].id == 0 && declarations[1].type == SpecializationDeclaration::UINT &&
+			declarations[2].name == "LOD_BIAS" && declarations[2].id == 7 && declarations[2].type == SpecializationDeclaration::INT &&
+			declarations[3].name == "WIREFRAME" && declarations[3].id == 2 && declarations[3].type == SpecializationDeclaration::BOOL;
+	},
+	[] {
+		std::cout << "constants in comments are ignored" << std::endl;
+		auto declarations = ParseSpecializationConstants(R"(
+			// layout(constant_id = 1) const int LINE = 1;
+			/* layout(constant_id = 4) const uint BLOCK = 2;
+			   layout(constant_id = 5) const bool LINES = true; */
+			layout(constant_id = 6)/**/const float AFTER = 0.5; // layout(constant_id = 8) const int TRAILING = 0;
+		)");
+		return declarations.size() == 1 &&
+			declarations[0].name == "AFTER" && declarations[0].id == 6;
+	},
+	[] {
+		std::cout << "values are packed in the declared type, in constant id order" << std::endl;
+		SpecializationConstants constants;
+		constants.set("LOD_BIAS", -2);
+		constants.set("TILE_WIDTH", 64.5);
+		constants.set("WIREFRAME", 1);
+		constants.set("TEXTURE_WIDTH", 1024);
+		auto packed = constants.pack(ParseSpecializationConstants(glsl));
+
+		std::vector<uint32_t> ids;
+		for (auto& entry : packed.entries) {
+			ids.push_back(entry.constantID);
+		}
+		return ids == std::vector<uint32_t>{ 0, 2, 3, 7 } && packed.data.size() == 16 &&
+			packed.entries[3].offset == 12 && packed.entries[3].size == 4 &&
+			Read<uint32_t>(packed, 0) == 1024 &&
+			Read<uint32_t>(packed, 1) == 1 &&
+			Read<float>(packed, 2) == 64.5f &&
+			Read<int32_t>(packed, 3) == -2;
+	},
+	[] {
+		std::cout << "constants that aren't set are left out" << std::endl;
+		SpecializationConstants constants;
+		constants.set("TILE_WIDTH", 32);
+		auto packed = constants.pack(ParseSpecializationConstants(glsl));
+		return packed.entries.size() == 1 && packed.entries[0].constantID == 3 && packed.entries[0].offset == 0 &&
+			Read<float>(packed, 0) == 32.0f &&
+			SpecializationConstants().pack(ParseSpecializationConstants(glsl)).entries.empty();
+	},
+	[] {
+		std::cout << "the same values give the same data regardless of the order they are set" << std::endl;
+		SpecializationConstants a, b;
+		a.set("TEXTURE_WIDTH", 2048);
+		a.set("TILE_WIDTH", 16);
+		b.set("TILE_WIDTH", 16);
+		b.set("TEXTURE_WIDTH", 2048);
+		auto declarations = ParseSpecializationConstants(glsl);
+		auto pa = a.pack(declarations);
+		auto pb = b.pack(declarations);
+		return pa.data == pb.data && pa.entries.size() == pb.entries.size() &&
+			std::equal(pa.entries.begin(), pa.entries.end(), pb.entries.begin(), [](auto& x, auto& y) {
+				return x.constantID == y.constantID && x.offset == y.offset && x.size == y.size;
+			});
+	},
+	[] {
+		std::cout << "names the shader doesn't declare are rejected" << std::endl;
+		SpecializationConstants constants;
+		constants.set("NOT_A_CONSTANT", 1);
+		return Throws<std::invalid_argument>([&] { constants.pack(ParseSpecializationConstants(glsl)); });
+	},
+	[] {
+		std::cout << "values that don't fit the declared type are rejected" << std::endl;
+		auto declarations = ParseSpecializationConstants(glsl);
+		auto pack = [&](const std::string& name, double value) {
+			return [&declarations, name, value] {
+				SpecializationConstants constants;
+				constants.set(name, value);
+				constants.pack(declarations);
+			};
+		};
+		return Throws<std::invalid_argument>(pack("TEXTURE_WIDTH", -1)) &&
+			Throws<std::invalid_argument>(pack("TEXTURE_WIDTH", 1.5)) &&
+			Throws<std::invalid_argument>(pack("TEXTURE_WIDTH", 5e9)) &&
+			Throws<std::invalid_argument>(pack("LOD_BIAS", 0.25)) &&
+			Throws<std::invalid_argument>(pack("WIREFRAME", 2)) &&
+			!Throws<std::invalid_argument>(pack("LOD_BIAS", -2147483648.0));
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,264 @@
+#include <Innovator/StlLoader.h>
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+// nine floats per triangle, what the current STLBufferData hands to the GPU
+typedef std::vector<float> Soup;
+
+// a file in the temp directory, removed again at the end of the test
+class TemporaryFile {
+public:
+	explicit TemporaryFile(const std::string& name) :
+		path(std::filesystem::temp_directory_path() / name)
+	{}
+
+	~TemporaryFile()
+	{
+		std::filesystem::remove(this->path);
+	}
+
+	std::filesystem::path path;
+};
+
+// n by n quads of two triangles each on a bumpy surface, vertices shared by up to six triangles
+static Soup Grid(size_t n)
+{
+	auto position = [n](size_t i, size_t j) {
+		float x = float(i) / float(n), y = float(j) / float(n);
+		return std::vector<float>{ x, y, 0.1f * std::sin(x * 7.0f) * std::cos(y * 5.0f) };
+	};
+	Soup soup;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			for (auto [a, b] : { std::pair{ i, j }, { i + 1, j }, { i + 1, j + 1 }, { i, j }, { i + 1, j + 1 }, { i, j + 1 } }) {
+				auto p = position(a, b);
+				soup.insert(soup.end(), p.begin(), p.end());
+			}
+		}
+	}
+	return soup;
+}
+
+static void WriteBinary(const std::filesystem::path& path, const Soup& soup, const char* header = "binary")
+{
+	std::ofstream file(path, std::ios::binary);
+	char text[80]{};
+	std::strncpy(text, header, sizeof(text) - 1);
+	file.write(text, sizeof(text));
+	uint32_t triangles = static_cast<uint32_t>(soup.size() / 9);
+	file.write(reinterpret_cast<const char*>(&triangles), sizeof(triangles));
+	const float normal[3]{ 0, 0, 1 };
+	const uint16_t attribute = 0;
+	for (size_t t = 0; t < triangles; t++) {
+		file.write(reinterpret_cast<const char*>(normal), sizeof(normal));
+		file.write(reinterpret_cast<const char*>(&soup[t * 9]), sizeof(float) * 9);
+		file.write(reinterpret_cast<const char*>(&attribute), sizeof(attribute));
+	}
+}
+
+static void WriteAscii(const std::filesystem::path& path, const Soup& soup)
+{
+	std::ofstream file(path, std::ios::binary);
+	file << "solid vertex facet names are just names\n";
+	char line[128];
+	for (size_t t = 0; t < soup.size() / 9; t++) {
+		file << "  facet normal 0 0 1\n    outer loop\n";
+		for (size_t k = 0; k < 3; k++) {
+			const float* p = &soup[t * 9 + k * 3];
+			// enough digits to read back the same float, exponents and signs as exporters write them
+			std::snprintf(line, sizeof(line), t % 2 ? "      vertex %.9g %.9g %.9g\r\n" : "\tvertex\t%+.8e %+.8e %+.8e\n", p[0], p[1], p[2]);
+			file << line;
+		}
+		file << "    endloop\n  endfacet\n";
+	}
+	file << "endsolid vertex\n";
+}
+
+// STLBufferData::read, the loader being replaced
+static Soup ReadReference(const std::filesystem::path& path)
+{
+	std::ifstream input(path, std::ios::binary);
+	char header[80];
+	input.read(header, 80);
+	uint32_t num_triangles;
+	input.read(reinterpret_cast<char*>(&num_triangles), 4);
+
+	Soup soup(size_t(num_triangles) * 9);
+	char normal[12];
+	char attrib[2];
+	for (size_t i = 0; i < num_triangles; i++) {
+		input.read(normal, 12);
+		input.read(reinterpret_cast<char*>(soup.data() + i * 9), 36);
+		input.read(attrib, 2);
+	}
+	return soup;
+}
+
+static Soup Expand(const StlMesh& mesh)
+{
+	Soup soup;
+	for (uint32_t index : mesh.indices) {
+		const float* p = &mesh.vertices[size_t(index) * mesh.floatsPerVertex()];
+		soup.insert(soup.end(), p, p + 3);
+	}
+	return soup;
+}
+
+static bool Same(const StlMesh& a, const StlMesh& b)
+{
+	return a.vertices == b.vertices && a.indices == b.indices && a.normals == b.normals;
+}
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "binary files load the same triangles as the current loader" << std::endl;
+		TemporaryFile file("test_stlloader_binary.stl");
+		WriteBinary(file.path, Grid(40));
+		StlMesh mesh = StlLoader::Load(file.path);
+		return Expand(mesh) == ReadReference(file.path) &&
+			mesh.triangleCount() == 40 * 40 * 2 &&
+			mesh.vertexCount() == 41 * 41;
+	},
+	[] {
+		std::cout << "ASCII files load the same mesh as binary ones" << std::endl;
+		TemporaryFile binary("test_stlloader_same.stl");
+		TemporaryFile ascii("test_stlloader_same_ascii.stl");
+		Soup soup = Grid(30);
+		WriteBinary(binary.path, soup);
+		WriteAscii(ascii.path, soup);
+		return Same(StlLoader::Load(binary.path), StlLoader::Load(ascii.path));
+	},
+	[] {
+		std::cout << "the mesh doesn't depend on how many threads parse it" << std::endl;
+		TemporaryFile binary("test_stlloader_threads.stl");
+		TemporaryFile ascii("test_stlloader_threads_ascii.stl");
+		// more than one chunk of each kind
+		Soup soup = Grid(150);
+		WriteBinary(binary.path, soup);
+		WriteAscii(ascii.path, soup);
+		MappedFile b(binary.path), a(ascii.path);
+
+		StlMesh reference = StlLoader::Parse(b.data(), b.size());
+		bool same = Same(reference, StlLoader::Parse(a.data(), a.size()));
+		for (size_t threads : { 1, 3, 8 }) {
+			ThreadPool pool(threads);
+			same = same &&
+				Same(reference, StlLoader::Parse(b.data(), b.size(), false, &pool)) &&
+				Same(reference, StlLoader::Parse(a.data(), a.size(), false, &pool));
+		}
+		return same && Expand(reference) == ReadReference(binary.path);
+	},
+	[] {
+		std::cout << "binary files whose header starts with solid are binary" << std::endl;
+		TemporaryFile file("test_stlloader_solid.stl");
+		WriteBinary(file.path, Grid(4), "solid exported as binary");
+		MappedFile mapped(file.path);
+		return StlLoader::IsBinary(mapped.data(), mapped.size()) && Expand(StlLoader::Load(file.path)) == Grid(4);
+	},
+	[] {
+		std::cout << "-0 and 0 weld into one vertex" << std::endl;
+		TemporaryFile file("test_stlloader_zero.stl");
+		WriteBinary(file.path, { 0, 0, 0, 1, 0, 0, 0, 1, 0, -0.0f, -0.0f, 0, 0, 1, 0, 1, 0, 0 });
+		StlMesh mesh = StlLoader::Load(file.path);
+		return mesh.vertexCount() == 3 && mesh.indices == std::vector<uint32_t>{ 0, 1, 2, 0, 2, 1 };
+	},
+	[] {
+		std::cout << "normals are area weighted averages of the triangles around a vertex" << std::endl;
+		TemporaryFile file("test_stlloader_normals.stl");
+		// two quads folded 90 degrees along x = 0, the fold is shared with equal areas on both sides
+		WriteBinary(file.path, {
+			0, 0, 0, 0, 1, 0, -1, 1, 0,
+			0, 0, 0, -1, 1, 0, -1, 0, 0,
+			0, 0, 0, 0, 1, 1, 0, 0, 1,
+			0, 0, 0, 0, 1, 0, 0, 1, 1,
+			});
+		StlMesh mesh = StlLoader::Load(file.path, true);
+		auto normal = [&](size_t v) { return &mesh.vertices[v * 6 + 3]; };
+		auto near = [](const float* n, float x, float y, float z) {
+			return std::abs(n[0] - x) < 1e-6f && std::abs(n[1] - y) < 1e-6f && std::abs(n[2] - z) < 1e-6f;
+		};
+		// the flat quad faces +z, the upright one +x, vertices on the fold get the average
+		float h = 1.0f / std::sqrt(2.0f);
+		return mesh.normals && mesh.vertexStride() == 24 && mesh.vertexCount() == 6 &&
+			near(normal(2), 0, 0, 1) && near(normal(4), 1, 0, 0) && near(normal(1), h, 0, h) &&
+			Expand(mesh) == ReadReference(file.path);
+	},
+	[] {
+		std::cout << "broken files are reported" << std::endl;
+		auto throws = [](const std::string& text) {
+			try {
+				StlLoader::Parse(text.data(), text.size());
+			}
+			catch (std::runtime_error&) {
+				return true;
+			}
+			return false;
+		};
+		return throws("not an stl file") &&
+			throws("solid x\nfacet normal 0 0 1\nouter loop\nvertex 0 0 zero\nvertex 1 0 0\nvertex 0 1 0\n") &&
+			throws("solid x\nfacet normal 0 0 1\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nendloop\nendfacet\n") &&
+			StlLoader::Parse("solid empty\nendsolid empty\n", 28).indices.empty();
+	},
+	[] {
+		std::cout << "welded buffers are much smaller than the triangle soup" << std::endl;
+		TemporaryFile file("test_stlloader_size.stl");
+		WriteBinary(file.path, Grid(300));
+
+		auto start = std::chrono::steady_clock::now();
+		Soup soup = ReadReference(file.path);
+		auto reference = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		StlMesh mesh = StlLoader::Load(file.path);
+		auto loader = std::chrono::steady_clock::now() - start;
+
+		size_t soup_bytes = soup.size() * sizeof(float);
+		size_t mesh_bytes = mesh.vertices.size() * sizeof(float) + mesh.indices.size() * sizeof(uint32_t);
+		std::cout << mesh.triangleCount() << " triangles: "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(reference).count() << "ms ifstream, "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(loader).count() << "ms mapped and welded, "
+			<< soup_bytes / 1024 << "KB soup, " << mesh_bytes / 1024 << "KB indexed" << std::endl;
+		return Expand(mesh) == soup && mesh_bytes * 10 < soup_bytes * 6;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
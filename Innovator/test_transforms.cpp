@@ -0,0 +1,231 @@
+#include <Innovator/Transforms.h>
+#include <Innovator/Testing.h>
+
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+typedef std::array<double, 16> Matrix;
+
+// a rotation about y, a scale and a translation
+static Matrix Local(std::mt19937& rng)
+{
+	std::uniform_real_distribution<double> unit(-1.0, 1.0);
+	double angle = unit(rng) * 3.14159265358979;
+	double scale = 1.0 + 0.1 * unit(rng);
+	double c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+	return { c, 0, -s, 0, 0, scale, 0, 0, s, 0, c, 0, unit(rng), unit(rng), unit(rng), 1 };
+}
+
+static std::array<float, 16> Floats(const Matrix& m)
+{
+	std::array<float, 16> f;
+	std::transform(m.begin(), m.end(), f.begin(), [](double d) { return float(d); });
+	return f;
+}
+
+// a random tree of transforms, with the locals and parents of each to compute worlds from
+struct Scene {
+	TransformHierarchy hierarchy;
+	std::vector<TransformHandle> handles;
+	std::vector<Matrix> locals;
+	std::vector<int> parents;
+
+	Scene(size_t count, uint32_t seed) :
+		rng(seed)
+	{
+		for (size_t i = 0; i < count; i++) {
+			// mostly shallow and wide, with some long chains
+			int parent = i == 0 || this->rng() % 8 == 0 ? -1 : int(this->rng() % i);
+			if (i > 0 && this->rng() % 16 == 0) {
+				parent = int(i - 1);
+			}
+			this->add(parent);
+		}
+	}
+
+	void add(int parent)
+	{
+		Matrix local = Local(this->rng);
+		auto f = Floats(local);
+		this->handles.push_back(this->hierarchy.allocate(parent < 0 ? TransformHierarchy::ROOT : this->handles[parent], f.data()));
+		this->locals.push_back(local);
+		this->parents.push_back(parent);
+	}
+
+	void set(size_t i)
+	{
+		this->locals[i] = Local(this->rng);
+		auto f = Floats(this->locals[i]);
+		this->hierarchy.set(this->handles[i], f.data());
+	}
+
+	Matrix world(size_t i) const
+	{
+		Matrix m = this->locals[i];
+		for (int p = this->parents[i]; p >= 0; p = this->parents[p]) {
+			m = Multiply(this->locals[p], m);
+		}
+		return m;
+	}
+
+	bool matches(double tolerance) const
+	{
+		for (size_t i = 0; i < this->handles.size(); i++) {
+			if (!this->hierarchy.valid(this->handles[i])) {
+				continue;
+			}
+			auto world = this->hierarchy.world(this->handles[i]);
+			Matrix expected = this->world(i);
+			for (int e = 0; e < 16; e++) {
+				if (std::abs(world[e] - expected[e]) > tolerance) {
+					std::cout << "transform " << i << " element " << e << ": " << world[e] << " != " << expected[e] << std::endl;
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	std::mt19937 rng;
+};
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "allocated and updated worlds match a double precision traversal ";
+		Scene scene(2000, 1);
+		bool allocated = scene.matches(1e-4);
+		std::mt19937 rng(2);
+		for (int frame = 0; frame < 10; frame++) {
+			for (int i = 0; i < 100; i++) {
+				scene.set(rng() % scene.handles.size());
+			}
+			scene.hierarchy.update();
+		}
+		return allocated && scene.matches(1e-4) && scene.hierarchy.size() == 2000;
+	},
+	[] {
+		std::cout << "update recomputes dirty transforms and those below them only ";
+		Scene scene(10, 3);
+		// 0 -> 1 -> 2, 0 -> 3, 4 -> 5, the rest at the top
+		scene.parents = { -1, 0, 1, 0, -1, 4, -1, -1, -1, -1 };
+		TransformHierarchy& hierarchy = scene.hierarchy;
+		hierarchy = TransformHierarchy();
+		scene.handles.clear();
+		for (size_t i = 0; i < 10; i++) {
+			auto f = Floats(scene.locals[i]);
+			int parent = scene.parents[i];
+			scene.handles.push_back(hierarchy.allocate(parent < 0 ? TransformHierarchy::ROOT : scene.handles[parent], f.data()));
+		}
+		size_t none = hierarchy.update();
+		scene.set(1);
+		scene.set(5);
+		size_t dirty = hierarchy.update();
+		size_t again = hierarchy.update();
+		scene.set(0);
+		size_t root = hierarchy.update();
+		std::cout << dirty << " and " << root << " recomputed ";
+		return none == 0 && dirty == 3 && again == 0 && root == 4 && scene.matches(1e-5);
+	},
+	[] {
+		std::cout << "freed transforms and those below them are invalid, their slots reused ";
+		Scene scene(100, 4);
+		std::vector<bool> freed(100, false);
+		scene.hierarchy.free(scene.handles[10]);
+		for (size_t i = 0; i < 100; i++) {
+			for (int p = int(i); p >= 0; p = scene.parents[p]) {
+				freed[i] = freed[i] || p == 10;
+			}
+		}
+		size_t count = std::count(freed.begin(), freed.end(), true);
+		bool invalid = true;
+		for (size_t i = 0; i < 100; i++) {
+			invalid = invalid && scene.hierarchy.valid(scene.handles[i]) == !freed[i];
+		}
+		bool sized = scene.hierarchy.size() == 100 - count;
+
+		// new transforms take the freed slots, old handles stay invalid
+		TransformHandle stale = scene.handles[10];
+		for (size_t i = 0; i < count; i++) {
+			scene.add(int(scene.rng() % 10));
+		}
+		for (size_t i = 0; i < 20; i++) {
+			size_t j = scene.rng() % scene.handles.size();
+			if (scene.hierarchy.valid(scene.handles[j])) {
+				scene.set(j);
+			}
+		}
+		scene.hierarchy.update();
+		std::cout << count << " freed ";
+		return invalid && sized && !scene.hierarchy.valid(stale) && scene.hierarchy.size() == 100 &&
+			uint32_t(scene.handles.back()) < 100 && scene.matches(1e-4);
+	},
+	[] {
+		std::cout << "a matrix times a world matches the scalar product ";
+		Scene scene(9, 5);
+		std::mt19937 rng(6);
+		Matrix view = Multiply(Local(rng), Local(rng));
+		auto f = Floats(view);
+		for (size_t i = 0; i < scene.handles.size(); i++) {
+			float out[16];
+			scene.hierarchy.multiply(f.data(), scene.handles[i], out);
+			Matrix expected = Multiply(view, scene.world(i));
+			for (int e = 0; e < 16; e++) {
+				if (std::abs(out[e] - expected[e]) > 1e-4) {
+					return false;
+				}
+			}
+		}
+		float out[16];
+		scene.hierarchy.multiply(f.data(), TransformHierarchy::ROOT, out);
+		return std::equal(out, out + 16, f.begin());
+	},
+	[] {
+		std::cout << "invalid parents and handles throw ";
+		Scene scene(4, 7);
+		TransformHandle handle = scene.handles[3];
+		scene.hierarchy.free(handle);
+		auto f = Floats(Identity());
+		return
+			Throws([&] { scene.hierarchy.allocate(handle, f.data()); }) &&
+			Throws([&] { scene.hierarchy.set(handle, f.data()); }) &&
+			Throws([&] { scene.hierarchy.set(TransformHandle(1) << 32 | 1000, f.data()); });
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
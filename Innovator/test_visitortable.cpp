@@ -0,0 +1,257 @@
+#include <Innovator/VisitorTable.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#define GREEN(__text__) "\033[1;32m" + std::string(__text__) + "\033[0m"
+#define RED(__text__) "\033[1;31m" + std::string(__text__) + "\033[0m"
+
+class Node;
+
+// a traversal as the renderer has them, with what it gathers as the state of its context
+class Visitor {
+public:
+	explicit Visitor(const VisitorTable<Node, Visitor>* table) :
+		callbacks(table)
+	{}
+
+	template <typename NodeType>
+	void apply(NodeType* node)
+	{
+		auto& callback = this->callbacks.find(typeid(NodeType));
+		if (callback) {
+			callback(node, this);
+		}
+	}
+
+	VisitorCallbacks<Node, Visitor> callbacks;
+	std::vector<std::string> visited;
+};
+
+class CountVisitor : public Visitor {
+public:
+	using Visitor::Visitor;
+	uint64_t sum{ 0 };
+};
+
+class Node {
+public:
+	virtual ~Node() = default;
+	virtual void visit(Visitor* visitor) = 0;
+};
+
+VisitorTable<Node, Visitor> drawvisitor;
+VisitorTable<Node, Visitor> countvisitor;
+
+class Group : public Node {
+public:
+	void visit(Visitor* visitor) override
+	{
+		for (auto& child : this->children) {
+			child->visit(visitor);
+		}
+	}
+	std::vector<std::shared_ptr<Node>> children;
+};
+
+class Shape : public Node {
+public:
+	explicit Shape(std::string name) :
+		name(std::move(name))
+	{
+		[[maybe_unused]] static bool once = [] {
+			drawvisitor.add<Shape, Visitor>([](Shape* self, Visitor* visitor) { self->draw(visitor); });
+			return true;
+		}();
+	}
+
+	void visit(Visitor* visitor) override
+	{
+		visitor->apply(this);
+	}
+
+	void draw(Visitor* visitor)
+	{
+		visitor->visited.push_back(this->name);
+	}
+
+	std::string name;
+};
+
+// not drawn, the draw traversal has nothing registered for it
+class Camera : public Node {
+public:
+	void visit(Visitor* visitor) override
+	{
+		visitor->apply(this);
+	}
+};
+
+// registers in one of its constructors only
+class Light : public Node {
+public:
+	Light() = default;
+
+	explicit Light(std::string name) :
+		name(std::move(name))
+	{
+		[[maybe_unused]] static bool once = [] {
+			drawvisitor.add<Light, Visitor>([](Light*, Visitor* visitor) { visitor->visited.push_back("light"); });
+			return true;
+		}();
+	}
+
+	void visit(Visitor* visitor) override
+	{
+		visitor->apply(this);
+	}
+
+	std::string name;
+};
+
+// many types that register from whichever thread constructs them first
+template <int N>
+class Leaf : public Node {
+public:
+	Leaf()
+	{
+		[[maybe_unused]] static bool once = [] {
+			countvisitor.add<Leaf, CountVisitor>([](Leaf* self, CountVisitor* visitor) { self->count(visitor); });
+			return true;
+		}();
+	}
+
+	void visit(Visitor* visitor) override
+	{
+		visitor->apply(this);
+	}
+
+	void count(CountVisitor* visitor)
+	{
+		visitor->sum += N + 1;
+	}
+};
+
+template <int... N>
+std::vector<std::function<std::shared_ptr<Node>()>> LeafMakers(std::integer_sequence<int, N...>)
+{
+	return { [] { return std::make_shared<Leaf<N>>(); }... };
+}
+
+const int leaf_types = 48;
+
+typedef std::function<bool()> test_case;
+
+std::vector<test_case> tests{
+	[] {
+		std::cout << "a traversal calls what is registered for the type of the node only ";
+		Group scene;
+		scene.children = {
+			std::make_shared<Shape>("a"),
+			std::make_shared<Camera>(),
+			std::make_shared<Shape>("b"),
+		};
+		Visitor draw(&drawvisitor);
+		Visitor count(&countvisitor);
+		scene.visit(&draw);
+		scene.visit(&count);
+		return draw.visited == std::vector<std::string>{ "a", "b" } && count.visited.empty();
+	},
+	[] {
+		std::cout << "a type is looked up in the table once, a visitor's own callbacks come first ";
+		Group scene;
+		scene.children = {
+			std::make_shared<Shape>("a"),
+			std::make_shared<Camera>(),
+			std::make_shared<Shape>("b"),
+			std::make_shared<Camera>(),
+		};
+		Visitor draw(&drawvisitor);
+		for (int i = 0; i < 10; i++) {
+			scene.visit(&draw);
+		}
+		Visitor pick(&drawvisitor);
+		pick.callbacks.add<Camera, Visitor>([](Camera*, Visitor* visitor) { visitor->visited.push_back("camera"); });
+		scene.visit(&pick);
+		return draw.visited.size() == 20 && draw.callbacks.lookups == 2 &&
+			pick.visited == std::vector<std::string>{ "a", "camera", "b", "camera" } &&
+			pick.callbacks.lookups == 1;
+	},
+	[] {
+		std::cout << "a type visited before it registers is dispatched to once it has ";
+		Group scene;
+		scene.children = { std::make_shared<Light>() };
+		Visitor draw(&drawvisitor);
+		scene.visit(&draw);
+		bool before = draw.visited.empty();
+		scene.children.push_back(std::make_shared<Light>("sun"));
+		scene.visit(&draw);
+		size_t lookups = draw.callbacks.lookups;
+		scene.visit(&draw);
+		return before && draw.visited == std::vector<std::string>{ "light", "light", "light", "light" } &&
+			lookups == 2 && draw.callbacks.lookups == 2;
+	},
+	[] {
+		std::cout << "contexts on their own threads traverse their own scenes while types register ";
+		auto makers = LeafMakers(std::make_integer_sequence<int, leaf_types>());
+		const int contexts = 4, frames = 200;
+		std::vector<uint64_t> sums(contexts, 0);
+		std::vector<size_t> lookups(contexts, 0);
+		std::vector<std::thread> threads;
+		for (int c = 0; c < contexts; c++) {
+			threads.emplace_back([&, c] {
+				// each context builds its scene in another order, so types register concurrently
+				Group scene;
+				for (int i = 0; i < leaf_types; i++) {
+					int n = (c % 2) ? leaf_types - 1 - i : (i * 7 + c) % leaf_types;
+					scene.children.push_back(makers[n]());
+				}
+				CountVisitor count(&countvisitor);
+				for (int frame = 0; frame < frames; frame++) {
+					scene.visit(&count);
+				}
+				sums[c] = count.sum;
+				lookups[c] = count.callbacks.lookups;
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		const uint64_t expected = uint64_t(frames) * leaf_types * (leaf_types + 1) / 2;
+		bool correct = std::all_of(sums.begin(), sums.end(), [&](uint64_t sum) { return sum == expected; });
+		bool cached = std::all_of(lookups.begin(), lookups.end(), [](size_t n) { return n == leaf_types; });
+		return correct && cached && countvisitor.size() == leaf_types;
+	},
+};
+
+int main(int, char* [])
+{
+	std::vector<bool> results;
+
+	for (auto test : tests) {
+		bool passed = test();
+		std::cout << (passed ? GREEN("(Pass)") : RED("(Fail)")) << std::endl;
+		results.push_back(passed);
+	}
+
+	size_t n_exec = results.size();
+	size_t n_fail = std::count(results.begin(), results.end(), false);
+
+	std::cout << std::endl << GREEN(std::to_string(n_exec) + " tests executed. ");
+
+	if (n_fail > 0) {
+		std::cout << RED(std::to_string(n_fail) + " tests failed. ") << std::endl;
+	}
+	else {
+		std::cout << GREEN("All tests passed.") << std::endl;
+	}
+
+	return n_fail > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -157,50 +157,24 @@ protected:
 
 class VulkanWindow : public Window {
 public:
-	virtual ~VulkanWindow() = default;
+	virtual ~VulkanWindow()
+	{
+		this->context.wait();
+		this->context.print(std::cout);
+		GetShaderCompiler().stats.print(std::cout);
+	}
 
-	VulkanWindow(VkExtent2D extent, std::shared_ptr<Node> scene) :
+	VulkanWindow(VkExtent2D extent, std::shared_ptr<Node> scene, uint32_t frames_in_flight = 2) :
 		Window(extent.width, extent.height)
 	{
-		devicevisitor.instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-		devicevisitor.instance_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-		devicevisitor.instance_extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
-#ifdef DEBUG
-		devicevisitor.instance_layers.push_back("VK_LAYER_KHRONOS_validation");
-		devicevisitor.instance_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-		devicevisitor.instance_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-#endif
-		devicevisitor.visit(scene.get());
-
-		state->vulkan = std::make_shared<VulkanInstance>(
-			"Innovator",
-			devicevisitor.instance_layers,
-			devicevisitor.instance_extensions);
-
-#ifdef DEBUG
-		auto debugcb = std::make_unique<VulkanDebugCallback>(
-			state->vulkan,
-			VK_DEBUG_REPORT_WARNING_BIT_EXT |
-			VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
-			VK_DEBUG_REPORT_ERROR_BIT_EXT |
-			VK_DEBUG_REPORT_DEBUG_BIT_EXT);
-#endif
-
-#ifdef DEBUG
-		devicevisitor.device_layers.push_back("VK_LAYER_KHRONOS_validation");
-#endif
-		devicevisitor.device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-
-		state->device = std::make_shared<VulkanDevice>(
-			state->vulkan,
-			devicevisitor.getDeviceFeatures(),
-			devicevisitor.device_layers,
-			devicevisitor.device_extensions);
+		this->context.create(
+			scene.get(),
+			{ VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME },
+			{ VK_KHR_SWAPCHAIN_EXTENSION_NAME },
+			frames_in_flight,
+			"Innovator.pipelinecache");
 
-		state->pipelinecache = std::make_shared<VulkanPipelineCache>(state->device);
-		state->fence = std::make_shared<VulkanFence>(state->device);
-		state->default_command = std::make_shared<VulkanCommandBuffers>(state->device);
-		state->queue = state->device->getQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+		State* state = this->context.state.get();
 
 		surface = std::make_shared<VulkanSurface>(
 			state->vulkan,
@@ -208,6 +182,8 @@ public:
 			this->hInstance);
 
 		auto swapchain = std::make_shared<Swapchain>(surface, VK_PRESENT_MODE_FIFO_KHR);
+		// a swapchain attachment in the scene makes its images the framebuffers of the last render pass
+		state->swapchain = swapchain.get();
 
 		this->scene = std::make_shared<Group>();
 		this->scene->children = {
@@ -222,15 +198,13 @@ public:
 			1
 		};
 
-		allocvisitor.visit(this->scene.get());
-		pipelinevisitor.visit(this->scene.get());
+		this->context.alloc(this->scene.get());
 	}
 
 	void redraw() override
 	{
 		try {
-			rendervisitor.visit(this->scene.get());
-			presentvisitor.visit(this->scene.get());
+			this->context.redraw(this->scene.get());
 		}
 		catch (VkErrorOutOfDateException& e) {
 			std::cerr << e.what() << std::endl;
@@ -240,40 +214,40 @@ public:
 
 	void resize(int width, int height) override
 	{
-		state->extent = VkExtent3D{
+		this->context.resize(this->scene.get(), VkExtent3D{
 			static_cast<uint32_t>(width),
 			static_cast<uint32_t>(height),
 			1
-		};
-
-		resizevisitor.visit(this->scene.get());
-		recordvisitor.visit(this->scene.get());
+		});
 		this->redraw();
 	}
 
 	void mousePressed(int x, int y, int button) override
 	{
-		eventvisitor.mousePressed(this->scene.get(), x, y, button);
+		this->context.eventvisitor.mousePressed(this->scene.get(), x, y, button);
 	}
 
 	void mouseReleased() override
 	{
-		eventvisitor.mouseReleased(this->scene.get());
+		this->context.eventvisitor.mouseReleased();
 	}
 
 	void mouseMoved(int x, int y) override
 	{
-		eventvisitor.mouseMoved(this->scene.get(), x, y);
-		if (eventvisitor.press) {
-			this->redraw();
+		this->context.eventvisitor.mouseMoved(x, y);
+		// moves until the window is painted are applied as one
+		if (this->context.eventvisitor.events.pending()) {
+			InvalidateRect(this->hWnd, nullptr, FALSE);
 		}
 	}
 
 	void keyPressed(int key) override
 	{
-		eventvisitor.keyPressed(key);
+		this->context.eventvisitor.keyPressed(key);
 	}
 
+	// outlives the scene and surface, which are made on its device
+	RenderContext context;
 	std::shared_ptr<Group> scene;
 	std::shared_ptr<VulkanSurface> surface;
 };
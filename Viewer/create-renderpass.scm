@@ -43,3 +43,106 @@
                 (imageaspectflags VK_IMAGE_ASPECT_DEPTH_BIT)))
 
         scene))
+
+(define create-present-renderpass (format scene)
+    (renderpass
+        (renderpass-description
+            (renderpass-attachment
+                format
+                VK_SAMPLE_COUNT_1_BIT
+                VK_ATTACHMENT_LOAD_OP_CLEAR
+                VK_ATTACHMENT_STORE_OP_STORE
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_IMAGE_LAYOUT_UNDEFINED
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+
+            (renderpass-attachment
+                VK_FORMAT_D32_SFLOAT
+                VK_SAMPLE_COUNT_1_BIT
+                VK_ATTACHMENT_LOAD_OP_CLEAR
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_IMAGE_LAYOUT_UNDEFINED
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+
+            (subpass
+                (pipeline-bindpoint VK_PIPELINE_BIND_POINT_GRAPHICS)
+                (color-attachment (uint32 0) VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+                (depth-attachment (uint32 1) VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)))
+
+        (framebuffer
+            (swapchain-attachment format)
+
+            (framebuffer-attachment
+                VK_FORMAT_D32_SFLOAT
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                (imageusageflags
+                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                    VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+                (imageaspectflags VK_IMAGE_ASPECT_DEPTH_BIT)))
+
+        scene))
+
+(define create-multisample-present-renderpass (format samples scene)
+    (renderpass
+        (renderpass-description
+            (renderpass-attachment
+                format
+                samples
+                VK_ATTACHMENT_LOAD_OP_CLEAR
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_IMAGE_LAYOUT_UNDEFINED
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+
+            (renderpass-attachment
+                VK_FORMAT_D32_SFLOAT
+                samples
+                VK_ATTACHMENT_LOAD_OP_CLEAR
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_IMAGE_LAYOUT_UNDEFINED
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+
+            (renderpass-attachment
+                format
+                VK_SAMPLE_COUNT_1_BIT
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_STORE
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                VK_ATTACHMENT_STORE_OP_DONT_CARE
+                VK_IMAGE_LAYOUT_UNDEFINED
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+
+            (subpass
+                (pipeline-bindpoint VK_PIPELINE_BIND_POINT_GRAPHICS)
+                (color-attachment (uint32 0) VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+                (depth-attachment (uint32 1) VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+                (resolve-attachment (uint32 2) VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)))
+
+        (framebuffer
+            (multisample-attachment
+                format
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                (imageusageflags
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                    VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+                (imageaspectflags VK_IMAGE_ASPECT_COLOR_BIT)
+                samples)
+
+            (multisample-attachment
+                VK_FORMAT_D32_SFLOAT
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                (imageusageflags
+                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                    VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+                (imageaspectflags VK_IMAGE_ASPECT_DEPTH_BIT)
+                samples)
+
+            (swapchain-attachment format))
+
+        scene))
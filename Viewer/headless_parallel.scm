@@ -0,0 +1,14 @@
+(begin
+   (import "create-renderpass.scm")
+   (import "triangle.scm")
+
+   (headless
+      (extent2 640 480)
+      (uint32 100)
+      (create-renderpass 
+         VK_FORMAT_B8G8R8A8_UNORM
+         (create-triangle (red-green-shader)))
+
+      (create-renderpass 
+         VK_FORMAT_B8G8R8A8_UNORM
+         (create-triangle (green-blue-shader)))))
@@ -0,0 +1,19 @@
+(begin
+   (import "create-renderpass.scm")
+   (import "triangle.scm")
+
+   (headless-present
+      (extent2 640 480)
+      (uint32 100)
+      (create-renderpass 
+         VK_FORMAT_B8G8R8A8_UNORM
+         (create-triangle (red-green-shader)))
+
+      (create-present-renderpass 
+         VK_FORMAT_B8G8R8A8_UNORM
+         (create-triangle (red-green-shader)))
+
+      (create-multisample-present-renderpass 
+         VK_FORMAT_B8G8R8A8_UNORM
+         VK_SAMPLE_COUNT_4_BIT
+         (create-triangle (red-green-shader)))))
@@ -3,8 +3,9 @@
 
    (window 
       (extent2 1920 1080)
-      (create-renderpass 
+      (create-multisample-present-renderpass 
          VK_FORMAT_B8G8R8A8_UNORM
+         VK_SAMPLE_COUNT_4_BIT
          (group
             (viewmatrix 
                (dvec3 0 0 3)
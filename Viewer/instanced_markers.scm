@@ -0,0 +1,80 @@
+(begin
+   (import "indexed-shape.scm")
+   (import "create-renderpass.scm")
+
+   (define marker ()
+      (indexed-shape
+         (bufferdata-uint32
+            0 1 2  0 2 3
+            0 4 1  1 4 2  2 4 3  3 4 0)
+         (bufferdata-float
+            -1 -1 0
+             1 -1 0
+             1  1 0
+            -1  1 0
+             0  0 2)
+         VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST))
+
+   (window
+      (extent2 1920 1080)
+      (create-renderpass
+         VK_FORMAT_B8G8R8A8_UNORM
+         (separator
+            (viewmatrix
+               (dvec3 0 -20 12)
+               (dvec3 0 0 0)
+               (dvec3 0 0 1))
+
+            (projmatrix 1000 0.1 1.0 0.7)
+
+            (shader VK_SHADER_STAGE_VERTEX_BIT [[
+               #version 450
+
+               layout(std140, binding = 0) uniform Transform {
+                  mat4 ModelViewMatrix;
+                  mat4 ProjectionMatrix;
+                  mat4 TextureMatrix;
+               };
+
+               layout(location = 0) in vec3 Position;
+               layout(location = 1) in mat4 InstanceMatrix;
+               layout(location = 5) in vec4 InstanceColor;
+               layout(location = 6) in uint InstanceId;
+
+               layout(location = 0) out vec4 color;
+
+               out gl_PerVertex {
+                  vec4 gl_Position;
+               };
+
+               void main()
+               {
+                  color = InstanceColor;
+                  gl_Position = ProjectionMatrix * ModelViewMatrix * InstanceMatrix * vec4(Position, 1.0);
+               }
+            ]])
+
+            (shader VK_SHADER_STAGE_FRAGMENT_BIT [[
+               #version 450
+
+               layout(location = 0) in vec4 color;
+               layout(location = 0) out vec4 FragColor;
+
+               void main() {
+                  FragColor = color;
+               }
+            ]])
+
+            (instances
+               (uint32 1)
+               (uint32 1)
+               (instancedata
+                  (instance (dvec3 -6 0 0) (dvec3 .5 .5 .5) 1 0 0 1 0)
+                  (instance (dvec3 -3 2 0) (dvec3 .5 .5 1) 1 .5 0 1 1)
+                  (instance (dvec3 0 -2 0) (dvec3 .5 .5 .5) 1 1 0 1 2)
+                  (instance (dvec3 3 1 0) (dvec3 .5 .5 1.5) 0 1 0 1 3)
+                  (instance (dvec3 6 -1 0) (dvec3 .5 .5 .5) 0 0 1 1 4)
+                  (instance (dvec3 -4 6 0) (dvec3 .5 .5 2) 0 1 1 1 5)
+                  (instance (dvec3 2 7 0) (dvec3 .5 .5 .5) 1 0 1 1 6)
+                  (instance (dvec3 7 5 0) (dvec3 .5 .5 1) .5 .5 .5 1 7))
+               (marker))))))
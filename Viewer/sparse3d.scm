@@ -99,8 +99,15 @@
                      layout(location = 0) in vec3 texCoord;
                      layout(location = 0) out uvec4 FragColor;
 
-                     const vec3 textureSize = vec3(1024, 4096, 2048);
-                     const vec3 tileSize = vec3(64.0, 32.0, 32.0);
+                     layout(constant_id = 0) const float TEXTURE_WIDTH = 1.0;
+                     layout(constant_id = 1) const float TEXTURE_HEIGHT = 1.0;
+                     layout(constant_id = 2) const float TEXTURE_DEPTH = 1.0;
+                     layout(constant_id = 3) const float TILE_WIDTH = 1.0;
+                     layout(constant_id = 4) const float TILE_HEIGHT = 1.0;
+                     layout(constant_id = 5) const float TILE_DEPTH = 1.0;
+
+                     const vec3 textureSize = vec3(TEXTURE_WIDTH, TEXTURE_HEIGHT, TEXTURE_DEPTH);
+                     const vec3 tileSize = vec3(TILE_WIDTH, TILE_HEIGHT, TILE_DEPTH);
 
                      float mipmapLevel(vec3 uv)
                      {
@@ -120,7 +127,13 @@
 
                         FragColor = uvec4(ijk.x >> mip, ijk.y >> mip, ijk.z >> mip, mip + 1);
                      }
-                  ]])
+                  ]]
+                  (specialization "TEXTURE_WIDTH" 1024)
+                  (specialization "TEXTURE_HEIGHT" 4096)
+                  (specialization "TEXTURE_DEPTH" 2048)
+                  (specialization "TILE_WIDTH" 64)
+                  (specialization "TILE_HEIGHT" 32)
+                  (specialization "TILE_DEPTH" 32))
                   (stl-shape)
                   ))
             (offscreen-image))